@@ -0,0 +1,326 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// to load every asset of a demo from one memory mapped file instead of many loose files:
+// 1. offline, add the loose files and any generated data and write the pack
+//		AssetPackWriter writer;
+//		writer.addFile("exampleShader.vert", ASSET_SHADER);
+//		writer.add("building.vertices", ASSET_MESH, &vertices[0], vertices.size() * sizeof(GLfloat));
+//		writer.write(ASSET_PACK_FILE);
+// 2. at startup map the pack and hand the blobs to GL where they are, nothing is read or copied up front
+//		AssetPack pack;
+//		if (pack.open(ASSET_PACK_FILE)) {
+//			Shader shader(pack, "exampleShader.vert", "exampleShader.frag");
+//			const AssetEntry* mesh = pack.find("building.vertices");
+//			glBufferData(GL_ARRAY_BUFFER, mesh->size, pack.data(mesh), GL_STATIC_DRAW);
+//		}
+// 3. close the pack once everything is uploaded, GL keeps its own copies
+// Shader sources are stored with a terminating 0 that is not counted in their size, so text() is a C string.
+
+// File layout, little endian:
+//   AssetPackHeader
+//   AssetEntry for every asset, sorted by name
+//   the blobs, each starting on an ASSET_PACK_ALIGNMENT byte boundary
+// Pack of a demo, relative to the working directory
+#define ASSET_PACK_FILE "assets.pack"
+
+const char ASSET_PACK_MAGIC[8] = { 'G', 'L', 'P', 'A', 'C', 'K', '0', '1' };
+const size_t ASSET_PACK_ALIGNMENT = 64;
+const size_t ASSET_NAME_LENGTH = 64;
+
+enum AssetType
+{
+	ASSET_SHADER,	// GLSL source
+	ASSET_MESH,		// vertex or index data, laid out as the demo uploads it
+	ASSET_TEXTURE	// a .tex file from TextureFile.h, pixels already decoded and filtered
+};
+
+struct AssetPackHeader
+{
+	char magic[8];
+	uint32_t entryCount;
+	uint32_t reserved;
+};
+
+struct AssetEntry
+{
+	char name[ASSET_NAME_LENGTH];	// 0 terminated
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset;				// from the start of the file
+	uint64_t size;
+};
+
+class AssetPack
+{
+public:
+	AssetPack() : base(nullptr), length(0), entries(nullptr), entryCount(0)
+#ifdef _WIN32
+		, file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+	{}
+	~AssetPack() { this->close(); }
+
+	// Maps the pack, returns false if it does not exist or is not a valid pack
+	bool open(const std::string& path)
+	{
+		this->close();
+		if (!this->map(path))
+			return false;
+		const AssetPackHeader* header = (const AssetPackHeader*)this->base;
+		if (this->length < sizeof(AssetPackHeader) || std::memcmp(header->magic, ASSET_PACK_MAGIC, sizeof(header->magic)) != 0
+			|| header->entryCount > (this->length - sizeof(AssetPackHeader)) / sizeof(AssetEntry)) {
+			std::cout << "ERROR::ASSET_PACK::NOT_AN_ASSET_PACK " << path << std::endl;
+			this->close();
+			return false;
+		}
+		this->entries = (const AssetEntry*)(this->base + sizeof(AssetPackHeader));
+		this->entryCount = header->entryCount;
+		for (uint32_t i = 0; i < this->entryCount; i++) {
+			const AssetEntry& entry = this->entries[i];
+			// text() relies on the byte after every blob being inside the file
+			if (entry.name[ASSET_NAME_LENGTH - 1] != '\0' || entry.offset > this->length || entry.size >= this->length - entry.offset) {
+				std::cout << "ERROR::ASSET_PACK::FILE_TRUNCATED " << path << std::endl;
+				this->close();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (this->base != nullptr)
+			UnmapViewOfFile(this->base);
+		if (this->mapping != NULL)
+			CloseHandle(this->mapping);
+		if (this->file != INVALID_HANDLE_VALUE)
+			CloseHandle(this->file);
+		this->mapping = NULL;
+		this->file = INVALID_HANDLE_VALUE;
+#else
+		if (this->base != nullptr)
+			munmap((void*)this->base, this->length);
+#endif
+		this->base = nullptr;
+		this->length = 0;
+		this->entries = nullptr;
+		this->entryCount = 0;
+	}
+
+	bool isOpen() const { return this->base != nullptr; }
+
+	// Entry with this name, nullptr if the pack has none. Binary search, the writer sorts the table.
+	const AssetEntry* find(const char* name) const
+	{
+		const AssetEntry* end = this->entries + this->entryCount;
+		const AssetEntry* entry = std::lower_bound(this->entries, end, name, [](const AssetEntry& a, const char* b) { return std::strcmp(a.name, b) < 0; });
+		return entry != end && std::strcmp(entry->name, name) == 0 ? entry : nullptr;
+	}
+
+	// Bytes of an entry inside the mapping, valid until close()
+	const unsigned char* data(const AssetEntry* entry) const { return this->base + entry->offset; }
+	const char* text(const AssetEntry* entry) const { return (const char*)this->base + entry->offset; }
+
+	// Reads one byte from every page of an entry, so it is in memory like after the copy GL makes.
+	// Returns their sum so the reads cannot be optimised away.
+	unsigned touch(const AssetEntry* entry) const
+	{
+		unsigned sum = 0;
+		const unsigned char* bytes = this->data(entry);
+		for (uint64_t i = 0; i < entry->size; i += 4096)
+			sum += bytes[i];
+		return sum;
+	}
+
+	uint32_t count() const { return this->entryCount; }
+	const AssetEntry& entry(uint32_t index) const { return this->entries[index]; }
+	size_t size() const { return this->length; }
+
+	// Drops the file from the operating system's page cache so the next read comes from disk, for timing cold starts.
+	// Only supported on Linux, returns false elsewhere.
+	static bool evictFromCache(const std::string& path)
+	{
+#if defined(__linux__)
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		bool evicted = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		::close(fd);
+		return evicted;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+
+private:
+	const unsigned char* base;
+	size_t length;
+	const AssetEntry* entries;
+	uint32_t entryCount;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+
+	bool map(const std::string& path)
+	{
+#ifdef _WIN32
+		this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (this->file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(this->file, &fileSize) || fileSize.QuadPart == 0) {
+			this->close();
+			return false;
+		}
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (this->mapping == NULL) {
+			this->close();
+			return false;
+		}
+		this->base = (const unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+		if (this->base == nullptr) {
+			this->close();
+			return false;
+		}
+		this->length = (size_t)fileSize.QuadPart;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+		void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// the mapping keeps the file alive
+		::close(fd);
+		if (address == MAP_FAILED)
+			return false;
+		// every asset is used during startup, start reading the whole file ahead of the first page fault
+		madvise(address, (size_t)info.st_size, MADV_WILLNEED);
+		this->base = (const unsigned char*)address;
+		this->length = (size_t)info.st_size;
+#endif
+		return true;
+	}
+
+	// not copyable, the mapping belongs to one object
+	AssetPack(const AssetPack&);
+	AssetPack& operator=(const AssetPack&);
+};
+
+// Collects assets in memory and writes them as a pack
+class AssetPackWriter
+{
+public:
+	// Adds a copy of size bytes, returns false if the name does not fit in an entry
+	bool add(const std::string& name, AssetType type, const void* data, size_t size)
+	{
+		if (name.empty() || name.size() >= ASSET_NAME_LENGTH) {
+			std::cout << "ERROR::ASSET_PACK::NAME_TOO_LONG " << name << std::endl;
+			return false;
+		}
+		Asset asset;
+		asset.name = name;
+		asset.type = type;
+		asset.bytes.assign((const unsigned char*)data, (const unsigned char*)data + size);
+		this->assets.push_back(asset);
+		return true;
+	}
+
+	// Adds a whole file under its path, returns false if it cannot be read
+	bool addFile(const std::string& path, AssetType type)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if (!file) {
+			std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+			return false;
+		}
+		if (!this->add(path, type, nullptr, 0))
+			return false;
+		this->assets.back().bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	// Writes the header, the sorted table and the blobs, every blob followed by a 0 and padding.
+	// Returns false if the file cannot be written.
+	bool write(const std::string& path)
+	{
+		std::sort(this->assets.begin(), this->assets.end(), [](const Asset& a, const Asset& b) { return a.name < b.name; });
+		AssetPackHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+		header.entryCount = (uint32_t)this->assets.size();
+		std::vector<AssetEntry> table(this->assets.size());
+		uint64_t offset = alignUp(sizeof(AssetPackHeader) + table.size() * sizeof(AssetEntry));
+		for (size_t i = 0; i < this->assets.size(); i++) {
+			std::memset(&table[i], 0, sizeof(AssetEntry));
+			std::memcpy(table[i].name, this->assets[i].name.c_str(), this->assets[i].name.size());
+			table[i].type = this->assets[i].type;
+			table[i].offset = offset;
+			table[i].size = this->assets[i].bytes.size();
+			offset = alignUp(offset + table[i].size + 1);
+		}
+
+		std::ofstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		const char padding[ASSET_PACK_ALIGNMENT] = {};
+		file.write((const char*)&header, sizeof(header));
+		if (!table.empty())
+			file.write((const char*)&table[0], table.size() * sizeof(AssetEntry));
+		uint64_t position = sizeof(AssetPackHeader) + table.size() * sizeof(AssetEntry);
+		for (size_t i = 0; i < this->assets.size(); i++) {
+			file.write(padding, table[i].offset - position);
+			if (!this->assets[i].bytes.empty())
+				file.write((const char*)&this->assets[i].bytes[0], this->assets[i].bytes.size());
+			file.write(padding, 1);
+			position = table[i].offset + table[i].size + 1;
+		}
+		file.write(padding, offset - position);
+		return (bool)file;
+	}
+
+private:
+	struct Asset
+	{
+		std::string name;
+		AssetType type;
+		std::vector<unsigned char> bytes;
+	};
+	std::vector<Asset> assets;
+
+	static uint64_t alignUp(uint64_t offset)
+	{
+		return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+	}
+};
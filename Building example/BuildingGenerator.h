@@ -0,0 +1,412 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+
+// GL Includes
+#include <GLEW/glew.h>
+
+// to generate a building mesh:
+// 1. set the parameters (the defaults give the original 346 vertex / 206 triangle building)
+//		BuildingGenerator building;
+//		building.floors = 10;
+// 2. allocate the buffers with the exact sizes and generate in one pass
+//		std::vector<GLfloat> vertices(building.vertexCount() * BUILDING_VERTEX_SIZE);
+//		std::vector<GLuint> indices(building.indexCount());
+//		building.generate(&vertices[0], &indices[0]);
+// Vertices are Position(x,y,z), Colour(r,g,b) with colours in 0-255 like the original table.
+// The building is a box from (0,0,0) to (width, height, -width) with the same window layout on all four faces,
+// faces go anticlockwise seen from above: front (z = 0), right (x = width), back (z = -width), left (x = 0).
+
+// Floats per vertex
+const int BUILDING_VERTEX_SIZE = 6;
+
+class BuildingGenerator
+{
+public:
+	// Layout, floors and bays are at least 1, smaller values generate as 1
+	int floors;				// rows of windows
+	int bays;				// windows per floor on each face
+	GLfloat bayWidth;		// horizontal spacing of the windows, each face is bays * bayWidth wide
+	GLfloat floorHeight;	// vertical spacing of the windows, the building is floors * floorHeight tall
+	GLfloat windowWidth;	// windows are centred in their bay and floor
+	GLfloat windowHeight;
+	// Door on the ground floor of the front face, replaces the window of that bay
+	int doorBay;			// -1 for no door
+	GLfloat doorWidth;
+	GLfloat doorHeight;
+	// Colours
+	GLfloat wallColor[3];
+	GLfloat glassColor[3];
+	GLfloat doorColor[3];
+
+	BuildingGenerator() : floors(3), bays(3), bayWidth(1.0f), floorHeight(1.0f), windowWidth(0.5f), windowHeight(0.5f),
+		doorBay(1), doorWidth(0.3f), doorHeight(0.85f)
+	{
+		setColor(this->wallColor, 128, 128, 128);
+		setColor(this->glassColor, 128, 255, 255);
+		setColor(this->doorColor, 128, 64, 0);
+	}
+
+	// Exact number of vertices generate() writes
+	size_t vertexCount() const
+	{
+		if (!this->validLayout())
+			return this->clamped().vertexCount();
+		std::vector<Column> cols;
+		std::vector<Row> rows;
+		size_t count = 0;
+		for (int face = 0; face < 4; face++) {
+			this->buildLayout(face, cols, rows);
+			for (size_t r = 0; r < rows.size(); r++)
+				for (size_t c = 0; c < cols.size(); c++)
+					count += this->gridHasVertex(rows[r], cols[c], face) ? 1 : 0;
+		}
+		// corners are shared between neighbouring faces
+		count -= 4 * 2;
+		// windows, and the door in place of one of them
+		count += 4 * 4 * (size_t)this->bays * this->floors;
+		return count;
+	}
+
+	// Exact number of indices generate() writes
+	size_t indexCount() const
+	{
+		if (!this->validLayout())
+			return this->clamped().indexCount();
+		// per bay: one wall piece under, between and over the windows, plus the strip to the next bay
+		size_t quadsPerFace = 2 + (size_t)this->bays * (this->floors + 1) + (this->bays - 1);
+		size_t quads = 4 * quadsPerFace + 2;	// bottom and top
+		if (this->hasDoor())
+			quads += 1;	// the two ground floor pieces of the door bay become three pieces around the door
+		quads += 4 * (size_t)this->bays * this->floors;	// windows, the door takes the place of one
+		return quads * 6;
+	}
+
+	// Writes vertexCount() vertices and indexCount() indices in a single pass
+	void generate(GLfloat* vertices, GLuint* indices)
+	{
+		// the same clamp as vertexCount() and indexCount(), so the sizes they gave still hold
+		this->floors = std::max(this->floors, 1);
+		this->bays = std::max(this->bays, 1);
+		this->vertexOut = vertices;
+		this->indexOut = indices;
+		this->nextVertex = 0;
+		this->doorTopRow = 0;
+
+		// 1. Wall vertices for every face
+		GLuint bottomCorners[4], topCorners[4];
+		for (int face = 0; face < 4; face++)
+			this->buildFaceGrid(face, bottomCorners, topCorners);
+
+		// 2. Window vertices, rows of bottom then top edges for each floor
+		GLuint windowStart[4];
+		for (int face = 0; face < 4; face++) {
+			windowStart[face] = this->nextVertex;
+			for (int f = 0; f < this->floors; f++) {
+				GLfloat y = this->windowBottom(f);
+				for (int edge = 0; edge < 2; edge++, y = this->windowTop(f)) {
+					for (int b = 0; b < this->bays; b++) {
+						if (!this->hasWindow(face, b, f))
+							continue;
+						this->addVertex(face, this->windowLeft(b), y, this->glassColor);
+						this->addVertex(face, this->windowRight(b), y, this->glassColor);
+					}
+				}
+			}
+		}
+
+		// 3. Door vertices
+		GLuint doorStart = this->nextVertex;
+		if (this->hasDoor()) {
+			this->addVertex(0, this->doorLeft(), 0.0f, this->doorColor);
+			this->addVertex(0, this->doorRight(), 0.0f, this->doorColor);
+			this->addVertex(0, this->doorLeft(), this->doorHeight, this->doorColor);
+			this->addVertex(0, this->doorRight(), this->doorHeight, this->doorColor);
+		}
+
+		// 4. Wall triangles, then bottom and top
+		for (int face = 0; face < 4; face++)
+			this->addWallQuads(face);
+		this->addQuad(bottomCorners[0], bottomCorners[3], bottomCorners[2], bottomCorners[1]);
+		this->addQuad(topCorners[0], topCorners[3], topCorners[2], topCorners[1]);
+
+		// 5. Window triangles, bay by bay
+		for (int face = 0; face < 4; face++) {
+			GLuint rowStart = windowStart[face];
+			std::vector<GLuint> floorStart(this->floors);
+			std::vector<GLuint> floorWidth(this->floors);
+			for (int f = 0; f < this->floors; f++) {
+				GLuint count = 0;
+				for (int b = 0; b < this->bays; b++)
+					count += this->hasWindow(face, b, f) ? 2 : 0;
+				floorStart[f] = rowStart;
+				floorWidth[f] = count;
+				rowStart += 2 * count;
+			}
+			for (int b = 0; b < this->bays; b++) {
+				for (int f = 0; f < this->floors; f++) {
+					if (!this->hasWindow(face, b, f))
+						continue;
+					// position of this window in its row, skipping the door
+					GLuint k = 2 * (b - (f == 0 && face == 0 && this->hasDoor() && b > this->doorBay ? 1 : 0));
+					GLuint bottom = floorStart[f] + k;
+					GLuint top = bottom + floorWidth[f];
+					this->addQuad(bottom, top, top + 1, bottom + 1);
+				}
+			}
+		}
+
+		// 6. Door triangles
+		if (this->hasDoor())
+			this->addQuad(doorStart, doorStart + 2, doorStart + 3, doorStart + 1);
+	}
+
+private:
+	// Kinds of columns and rows in the wall grid of a face
+	enum ColumnKind { FACE_EDGE, WINDOW_EDGE, DOOR_EDGE };
+	enum RowKind { ROW_BOTTOM, ROW_WINDOW_BOTTOM, ROW_WINDOW_TOP, ROW_DOOR_TOP, ROW_TOP };
+
+	struct Column
+	{
+		GLfloat u;
+		ColumnKind kind;
+		int bay;
+	};
+
+	struct Row
+	{
+		GLfloat y;
+		RowKind kind;
+		int floor;
+	};
+
+	GLfloat* vertexOut;
+	GLuint* indexOut;
+	GLuint nextVertex;
+	// wall vertex index of each (row, column) of every face, -1 where there is no vertex
+	std::vector<Column> columns[4];
+	std::vector<Row> rows;
+	std::vector<int> grid[4];
+	// row of each edge in the sorted rows
+	size_t bottomRow, topRow, doorTopRow;
+	std::vector<size_t> windowBottomRows;
+	std::vector<size_t> windowTopRows;
+
+	static void setColor(GLfloat* color, GLfloat r, GLfloat g, GLfloat b)
+	{
+		color[0] = r;
+		color[1] = g;
+		color[2] = b;
+	}
+
+	// The layout code needs a window row and a bay on every face
+	bool validLayout() const { return this->floors >= 1 && this->bays >= 1; }
+	BuildingGenerator clamped() const
+	{
+		BuildingGenerator building(*this);
+		building.floors = std::max(building.floors, 1);
+		building.bays = std::max(building.bays, 1);
+		return building;
+	}
+
+	bool hasDoor() const { return this->doorBay >= 0 && this->doorBay < this->bays; }
+	bool isDoorBay(int face, int bay) const { return face == 0 && this->hasDoor() && bay == this->doorBay; }
+	bool hasWindow(int face, int bay, int floor) const { return !(floor == 0 && this->isDoorBay(face, bay)); }
+
+	GLfloat faceWidth() const { return this->bays * this->bayWidth; }
+	GLfloat faceHeight() const { return this->floors * this->floorHeight; }
+	// positions are worked out in double so they round to the same floats as the literals in the original table
+	GLfloat windowLeft(int bay) const { return (GLfloat)(bay * (double)this->bayWidth + (this->bayWidth - (double)this->windowWidth) / 2); }
+	GLfloat windowRight(int bay) const { return (GLfloat)(bay * (double)this->bayWidth + (this->bayWidth + (double)this->windowWidth) / 2); }
+	GLfloat windowBottom(int floor) const { return (GLfloat)(floor * (double)this->floorHeight + (this->floorHeight - (double)this->windowHeight) / 2); }
+	GLfloat windowTop(int floor) const { return (GLfloat)(floor * (double)this->floorHeight + (this->floorHeight + (double)this->windowHeight) / 2); }
+	GLfloat doorLeft() const { return (GLfloat)(this->doorBay * (double)this->bayWidth + (this->bayWidth - (double)this->doorWidth) / 2); }
+	GLfloat doorRight() const { return (GLfloat)(this->doorBay * (double)this->bayWidth + (this->bayWidth + (double)this->doorWidth) / 2); }
+
+	// Row where the wall pieces beside and above the door end, the first window above the door or the roof
+	RowKind doorPiecesEnd() const { return this->floors > 1 ? ROW_WINDOW_BOTTOM : ROW_TOP; }
+
+	// Whether the wall grid has a vertex at this row and column
+	bool gridHasVertex(const Row& row, const Column& column, int face) const
+	{
+		if (row.kind == ROW_BOTTOM)
+			return true;
+		if (column.kind == FACE_EDGE)
+			return row.kind == ROW_TOP;
+		if (column.kind == DOOR_EDGE) {
+			if (row.kind == ROW_DOOR_TOP)
+				return true;
+			return row.kind == this->doorPiecesEnd() && (row.kind == ROW_TOP || row.floor == 1);
+		}
+		// window edge
+		if (row.kind == ROW_TOP)
+			return true;
+		if (row.kind == ROW_WINDOW_BOTTOM || row.kind == ROW_WINDOW_TOP)
+			return this->hasWindow(face, column.bay, row.floor);
+		return false;
+	}
+
+	// Maps a point on a face to world space and appends it
+	void addVertex(int face, GLfloat u, GLfloat y, const GLfloat* color)
+	{
+		GLfloat w = this->faceWidth();
+		GLfloat position[3];
+		switch (face) {
+		case 0: position[0] = u; position[2] = 0.0f; break;
+		case 1: position[0] = w; position[2] = -u; break;
+		case 2: position[0] = w - u; position[2] = -w; break;
+		default: position[0] = 0.0f; position[2] = u - w; break;
+		}
+		position[1] = y;
+		GLfloat* out = this->vertexOut + (size_t)this->nextVertex * BUILDING_VERTEX_SIZE;
+		out[0] = position[0];
+		out[1] = position[1];
+		out[2] = position[2];
+		out[3] = color[0];
+		out[4] = color[1];
+		out[5] = color[2];
+		this->nextVertex++;
+	}
+
+	// Two triangles sharing the bottom left to top right diagonal, same winding as the original table
+	void addQuad(GLuint bottomLeft, GLuint topLeft, GLuint topRight, GLuint bottomRight)
+	{
+		GLuint* out = this->indexOut;
+		out[0] = bottomLeft;
+		out[1] = topLeft;
+		out[2] = topRight;
+		out[3] = bottomLeft;
+		out[4] = bottomRight;
+		out[5] = topRight;
+		this->indexOut += 6;
+	}
+
+	// Columns along a face and rows up it, sorted by height
+	void buildLayout(int face, std::vector<Column>& cols, std::vector<Row>& rows) const
+	{
+		cols.clear();
+		Column start = { 0.0f, FACE_EDGE, -1 };
+		cols.push_back(start);
+		for (int b = 0; b < this->bays; b++) {
+			Column left = { this->windowLeft(b), WINDOW_EDGE, b };
+			Column right = { this->windowRight(b), WINDOW_EDGE, b };
+			cols.push_back(left);
+			if (this->isDoorBay(face, b)) {
+				Column doorLeft = { this->doorLeft(), DOOR_EDGE, b };
+				Column doorRight = { this->doorRight(), DOOR_EDGE, b };
+				cols.push_back(doorLeft);
+				cols.push_back(doorRight);
+			}
+			cols.push_back(right);
+		}
+		Column end = { this->faceWidth(), FACE_EDGE, -1 };
+		cols.push_back(end);
+
+		rows.clear();
+		Row bottom = { 0.0f, ROW_BOTTOM, -1 };
+		rows.push_back(bottom);
+		for (int f = 0; f < this->floors; f++) {
+			Row windowBottom = { this->windowBottom(f), ROW_WINDOW_BOTTOM, f };
+			Row windowTop = { this->windowTop(f), ROW_WINDOW_TOP, f };
+			rows.push_back(windowBottom);
+			rows.push_back(windowTop);
+		}
+		if (this->hasDoor()) {
+			Row doorTop = { this->doorHeight, ROW_DOOR_TOP, -1 };
+			rows.push_back(doorTop);
+		}
+		Row top = { this->faceHeight(), ROW_TOP, -1 };
+		rows.push_back(top);
+		std::stable_sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.y < b.y; });
+	}
+
+	// Emits the wall vertices of a face row by row and remembers where each one went
+	void buildFaceGrid(int face, GLuint* bottomCorners, GLuint* topCorners)
+	{
+		std::vector<Column>& cols = this->columns[face];
+		this->buildLayout(face, cols, this->rows);
+		this->windowBottomRows.resize(this->floors);
+		this->windowTopRows.resize(this->floors);
+		for (size_t r = 0; r < this->rows.size(); r++) {
+			switch (this->rows[r].kind) {
+			case ROW_BOTTOM: this->bottomRow = r; break;
+			case ROW_WINDOW_BOTTOM: this->windowBottomRows[this->rows[r].floor] = r; break;
+			case ROW_WINDOW_TOP: this->windowTopRows[this->rows[r].floor] = r; break;
+			case ROW_DOOR_TOP: this->doorTopRow = r; break;
+			case ROW_TOP: this->topRow = r; break;
+			}
+		}
+
+		std::vector<int>& cells = this->grid[face];
+		cells.assign(this->rows.size() * cols.size(), -1);
+		for (size_t r = 0; r < this->rows.size(); r++) {
+			for (size_t c = 0; c < cols.size(); c++) {
+				if (!this->gridHasVertex(this->rows[r], cols[c], face))
+					continue;
+				bool isBottom = this->rows[r].kind == ROW_BOTTOM;
+				GLuint* corners = isBottom ? bottomCorners : topCorners;
+				// the first corner of a face is the last corner of the previous one
+				if (c == 0 && face > 0) {
+					cells[r * cols.size() + c] = (int)corners[face];
+					continue;
+				}
+				// the last face ends on the first corner of the front face
+				if (c == cols.size() - 1 && face == 3) {
+					cells[r * cols.size() + c] = (int)corners[0];
+					continue;
+				}
+				cells[r * cols.size() + c] = (int)this->nextVertex;
+				if (c == 0)
+					corners[0] = this->nextVertex;
+				else if (c == cols.size() - 1)
+					corners[face + 1] = this->nextVertex;
+				this->addVertex(face, cols[c].u, this->rows[r].y, this->wallColor);
+			}
+		}
+	}
+
+	void addWallPiece(int face, size_t leftColumn, size_t rightColumn, size_t bottomRow, size_t topRow)
+	{
+		const std::vector<int>& cells = this->grid[face];
+		size_t width = this->columns[face].size();
+		this->addQuad((GLuint)cells[bottomRow * width + leftColumn], (GLuint)cells[topRow * width + leftColumn],
+			(GLuint)cells[topRow * width + rightColumn], (GLuint)cells[bottomRow * width + rightColumn]);
+	}
+
+	void addWallQuads(int face)
+	{
+		const std::vector<Column>& cols = this->columns[face];
+		size_t bottom = this->bottomRow;
+		size_t top = this->topRow;
+		size_t c = 0;
+		for (int b = 0; b < this->bays; b++) {
+			size_t left = c + 1;
+			bool door = this->isDoorBay(face, b);
+			size_t right = left + (door ? 3 : 1);
+			// full height strip up to this bay
+			this->addWallPiece(face, c, left, bottom, top);
+			int firstFloor = 0;
+			if (door) {
+				// beside and above the door, up to the first window above it
+				size_t piecesEnd = this->floors > 1 ? this->windowBottomRows[1] : top;
+				this->addWallPiece(face, left, left + 1, bottom, piecesEnd);
+				this->addWallPiece(face, left + 1, left + 2, this->doorTopRow, piecesEnd);
+				this->addWallPiece(face, left + 2, right, bottom, piecesEnd);
+				firstFloor = 1;
+			}
+			else {
+				this->addWallPiece(face, left, right, bottom, this->windowBottomRows[0]);
+			}
+			// between the windows, then above the last one
+			for (int f = firstFloor; f < this->floors; f++) {
+				size_t pieceTop = f + 1 < this->floors ? this->windowBottomRows[f + 1] : top;
+				this->addWallPiece(face, left, right, this->windowTopRows[f], pieceTop);
+			}
+			c = right;
+		}
+		// strip after the last bay
+		this->addWallPiece(face, c, cols.size() - 1, bottom, top);
+	}
+};
@@ -8,6 +8,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+// View frustum for culling
+#include "Frustum.h"
 
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -24,9 +26,14 @@ const GLfloat PITCH = 0.0f;
 const GLfloat SPEED = 3.0f;
 const GLfloat SENSITIVTY = 0.25f;
 const GLfloat ZOOM = 45.0f;
+const GLfloat ASPECT = 800.0f / 600.0f;
+const GLfloat NEAR_PLANE = 0.1f;
+const GLfloat FAR_PLANE = 100.0f;
 
 
 // An abstract camera class that processes input and calculates the corresponding Eular Angles, Vectors and Matrices for use in OpenGL
+// The matrices are only recalculated after something changed, GetVersion() tells caches built from them when that happened.
+// After writing position, yaw, pitch or zoom directly call MarkDirty() (or use SetPosition) so the matrices follow.
 class Camera
 {
 public:
@@ -45,7 +52,8 @@ public:
 	GLfloat zoom;
 
 	// Constructor with vectors
-	Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), GLfloat yaw = YAW, GLfloat pitch = PITCH) : front(glm::vec3(0.0f, 0.0f, -1.0f)), movementSpeed(SPEED), mouseSensitivity(SENSITIVTY), zoom(ZOOM)
+	Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), GLfloat yaw = YAW, GLfloat pitch = PITCH) : front(glm::vec3(0.0f, 0.0f, -1.0f)), movementSpeed(SPEED), mouseSensitivity(SENSITIVTY), zoom(ZOOM),
+		aspect(ASPECT), nearPlane(NEAR_PLANE), farPlane(FAR_PLANE), viewDirty(true), projectionDirty(true), viewProjectionDirty(true), version(0)
 	{
 		this->position = position;
 		this->worldUp = up;
@@ -54,7 +62,8 @@ public:
 		this->updateCameraVectors();
 	}
 	// Constructor with scalar values
-	Camera(GLfloat posX, GLfloat posY, GLfloat posZ, GLfloat upX, GLfloat upY, GLfloat upZ, GLfloat yaw, GLfloat pitch) : front(glm::vec3(0.0f, 0.0f, -1.0f)), movementSpeed(SPEED), mouseSensitivity(SENSITIVTY), zoom(ZOOM)
+	Camera(GLfloat posX, GLfloat posY, GLfloat posZ, GLfloat upX, GLfloat upY, GLfloat upZ, GLfloat yaw, GLfloat pitch) : front(glm::vec3(0.0f, 0.0f, -1.0f)), movementSpeed(SPEED), mouseSensitivity(SENSITIVTY), zoom(ZOOM),
+		aspect(ASPECT), nearPlane(NEAR_PLANE), farPlane(FAR_PLANE), viewDirty(true), projectionDirty(true), viewProjectionDirty(true), version(0)
 	{
 		this->position = glm::vec3(posX, posY, posZ);
 		this->worldUp = glm::vec3(upX, upY, upZ);
@@ -64,15 +73,77 @@ public:
 	}
 
 	// Returns the view matrix calculated using Eular Angles and the LookAt Matrix
-	glm::mat4 GetViewMatrix()
+	const glm::mat4& GetViewMatrix()
 	{
-		return glm::lookAt(this->position, this->position + this->front, this->up);
+		if (this->viewDirty) {
+			this->view = glm::lookAt(this->position, this->position + this->front, this->up);
+			this->viewDirty = false;
+		}
+		return this->view;
+	}
+
+	// Returns the perspective projection from the zoom, aspect ratio and clip planes
+	const glm::mat4& GetProjectionMatrix()
+	{
+		if (this->projectionDirty) {
+			this->projection = glm::perspective(glm::radians(this->zoom), this->aspect, this->nearPlane, this->farPlane);
+			this->projectionDirty = false;
+		}
+		return this->projection;
+	}
+
+	// Returns projection * view
+	const glm::mat4& GetViewProjectionMatrix()
+	{
+		this->updateViewProjection();
+		return this->viewProjection;
+	}
+
+	// Returns the planes of everything visible through this camera
+	const Frustum& GetFrustum()
+	{
+		this->updateViewProjection();
+		return this->frustum;
+	}
+
+	// Changes whenever any of the matrices change, never the same for two different cameras
+	unsigned GetVersion() const
+	{
+		return this->version;
+	}
+
+	// Aspect ratio of the window and distance of the clip planes used by the projection
+	void SetPerspective(GLfloat aspect, GLfloat nearPlane = NEAR_PLANE, GLfloat farPlane = FAR_PLANE)
+	{
+		if (aspect == this->aspect && nearPlane == this->nearPlane && farPlane == this->farPlane)
+			return;
+		this->aspect = aspect;
+		this->nearPlane = nearPlane;
+		this->farPlane = farPlane;
+		this->projectionChanged();
+	}
+
+	void SetPosition(const glm::vec3& position)
+	{
+		if (position == this->position)
+			return;
+		this->position = position;
+		this->viewChanged();
+	}
+
+	// Recalculates everything on the next Get, for when the public members were written directly
+	void MarkDirty()
+	{
+		this->updateCameraVectors();
+		this->projectionChanged();
 	}
 
 	// Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
 	void ProcessKeyboard(Camera_Movement direction, GLfloat deltaTime)
 	{
 		GLfloat velocity = this->movementSpeed * deltaTime;
+		if (velocity == 0.0f)
+			return;
 		if (direction == FORWARD)
 			this->position += this->front * velocity;
 		if (direction == BACKWARD)
@@ -81,6 +152,7 @@ public:
 			this->position -= this->right * velocity;
 		if (direction == RIGHT)
 			this->position += this->right * velocity;
+		this->viewChanged();
 	}
 
 	// Processes input received from a mouse input system. Expects the offset value in both the x and y direction.
@@ -88,6 +160,7 @@ public:
 	{
 		xoffset *= this->mouseSensitivity;
 		yoffset *= this->mouseSensitivity;
+		GLfloat oldYaw = this->yaw, oldPitch = this->pitch;
 
 		this->yaw += xoffset;
 		this->pitch += yoffset;
@@ -101,6 +174,10 @@ public:
 				this->pitch = -89.0f;
 		}
 
+		// Nothing to do if the mouse did not move or the pitch is already at the limit
+		if (this->yaw == oldYaw && this->pitch == oldPitch)
+			return;
+
 		// Update Front, Right and Up Vectors using the updated Eular angles
 		this->updateCameraVectors();
 	}
@@ -108,15 +185,62 @@ public:
 	// Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
 	void ProcessMouseScroll(GLfloat yoffset)
 	{
+		GLfloat oldZoom = this->zoom;
 		if (this->zoom >= 1.0f && this->zoom <= 45.0f)
 			this->zoom -= yoffset;
 		if (this->zoom <= 1.0f)
 			this->zoom = 1.0f;
 		if (this->zoom >= 45.0f)
 			this->zoom = 45.0f;
+		if (this->zoom != oldZoom)
+			this->projectionChanged();
 	}
 
 private:
+	// Projection settings
+	GLfloat aspect;
+	GLfloat nearPlane;
+	GLfloat farPlane;
+	// Cached matrices and what needs recalculating
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+	Frustum frustum;
+	bool viewDirty;
+	bool projectionDirty;
+	bool viewProjectionDirty;
+	unsigned version;
+
+	// Versions are shared by every camera so a new camera never reuses the version of an old one
+	static unsigned nextVersion()
+	{
+		static unsigned counter = 0;
+		return ++counter;
+	}
+
+	void viewChanged()
+	{
+		this->viewDirty = true;
+		this->viewProjectionDirty = true;
+		this->version = nextVersion();
+	}
+
+	void projectionChanged()
+	{
+		this->projectionDirty = true;
+		this->viewProjectionDirty = true;
+		this->version = nextVersion();
+	}
+
+	void updateViewProjection()
+	{
+		if (!this->viewProjectionDirty)
+			return;
+		this->viewProjection = this->GetProjectionMatrix() * this->GetViewMatrix();
+		this->frustum.extract(this->viewProjection);
+		this->viewProjectionDirty = false;
+	}
+
 	// Calculates the front vector from the Camera's (updated) Eular Angles
 	void updateCameraVectors()
 	{
@@ -129,5 +253,6 @@ private:
 		// Also re-calculate the Right and Up vector
 		this->right = glm::normalize(glm::cross(this->front, this->worldUp));  // Normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
 		this->up = glm::normalize(glm::cross(this->right, this->front));
+		this->viewChanged();
 	}
 };
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+// to allocate data that only lives for a few frames without touching the heap:
+// 1. create the arena once with a guess of the bytes one frame needs
+//		FrameArena arena(64 * 1024);
+// 2. start every frame with beginFrame(), then allocate as much as the frame needs, there is no free
+//		arena.beginFrame();
+//		glm::mat4* models = arena.allocate<glm::mat4>(count);
+// 3. read the data until FRAME_ARENA_FRAMES - 1 more frames have begun, then its memory is reused
+// Allocating is a pointer bump inside the region of the current frame. The regions take turns, so data written in
+// one frame is still intact while the next frames are recorded, for a replay or an upload running behind the recording.
+// A frame that needs more than its region gets separate blocks and the region grows to fit the next time it comes
+// round, so after the first frames of a new peak nothing is allocated.
+// One arena per thread, allocate() takes no lock.
+
+// Regions the frames take turns with, the number of frames the data of one frame survives
+const int FRAME_ARENA_FRAMES = 3;
+
+class FrameArena
+{
+public:
+	// Allocations that did not fit their region, each one went to the heap
+	unsigned overflowBlocks;
+
+	explicit FrameArena(size_t bytesPerFrame = 64 * 1024) : overflowBlocks(0), current(0), frames(0)
+	{
+		for (int i = 0; i < FRAME_ARENA_FRAMES; i++) {
+			this->regions[i].memory.resize(bytesPerFrame);
+			this->regions[i].used = 0;
+			this->regions[i].needed = 0;
+		}
+	}
+
+	~FrameArena()
+	{
+		for (int i = 0; i < FRAME_ARENA_FRAMES; i++)
+			this->releaseOverflow(this->regions[i]);
+	}
+
+	// Moves to the next region, the data of the frame that used it FRAME_ARENA_FRAMES frames ago is gone
+	void beginFrame()
+	{
+		this->current = (this->current + 1) % FRAME_ARENA_FRAMES;
+		this->frames++;
+		Region& region = this->regions[this->current];
+		this->releaseOverflow(region);
+		if (region.needed > region.memory.size())
+			region.memory.resize(region.needed + region.needed / 2);
+		region.used = 0;
+		region.needed = 0;
+	}
+
+	// size bytes aligned to alignment, a power of two up to 64
+	void* allocate(size_t size, size_t alignment = 16)
+	{
+		Region& region = this->regions[this->current];
+		uintptr_t base = (uintptr_t)region.memory.data();
+		size_t start = (size_t)(((base + region.used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+		// what the frame would need if everything had fit, with room for the alignment
+		region.needed += size + alignment - 1;
+		if (start + size <= region.memory.size()) {
+			region.used = start + size;
+			return (void*)(base + start);
+		}
+		// the region is full, this frame gets a block of its own and the region grows on its next turn
+		unsigned char* block = new unsigned char[size + alignment];
+		region.overflow.push_back(block);
+		this->overflowBlocks++;
+		return (void*)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	}
+
+	// count uninitialised objects, for types that need no constructor or destructor
+	template <typename T>
+	T* allocate(size_t count)
+	{
+		return (T*)this->allocate(count * sizeof(T), alignof(T) < 16 ? 16 : alignof(T));
+	}
+
+	// Bytes used by the current frame and the size of its region
+	size_t used() const { return this->regions[this->current].used; }
+	size_t capacity() const { return this->regions[this->current].memory.size(); }
+	// Frames begun so far
+	unsigned frameCount() const { return this->frames; }
+
+private:
+	struct Region
+	{
+		std::vector<unsigned char> memory;
+		size_t used;
+		// bytes the frame would have needed, overflow included
+		size_t needed;
+		std::vector<unsigned char*> overflow;
+	};
+
+	Region regions[FRAME_ARENA_FRAMES];
+	int current;
+	unsigned frames;
+
+	static void releaseOverflow(Region& region)
+	{
+		for (size_t i = 0; i < region.overflow.size(); i++)
+			delete[] region.overflow[i];
+		region.overflow.clear();
+	}
+
+	// not copyable, pointers handed out point into the regions
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+};
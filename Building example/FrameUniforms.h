@@ -0,0 +1,88 @@
+#pragma once
+
+// Std. Includes
+#include <cstddef>
+
+// GL Includes
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Camera.h"
+#include "Shader.h"
+#include "GLState.h"
+
+// to share the per-frame camera data between every shader:
+// 1. declare the block in the shader (must match FrameData below), frame.glsl has it for #include
+//		layout (std140) uniform FrameData {
+//			mat4 view;
+//			mat4 projection;
+//			vec3 viewPos;
+//			float time;
+//		};
+// 2. create one FrameUniforms after the GL context exists
+// 3. update it once per frame before drawing, Shader binds the block to FRAME_UNIFORM_BINDING automatically
+//    the camera part is only sent when the camera changed
+// while (...) {
+//     frameUniforms.update(camera, time);
+//     DrawStuff();
+// }
+
+// std140 layout of the FrameData block, viewPos and time share one 16 byte slot
+struct FrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 viewPos;
+	GLfloat time;
+};
+
+class FrameUniforms
+{
+public:
+	// The uniform buffer ID
+	GLuint buffer;
+	// Last values written to the buffer
+	FrameData data;
+
+	FrameUniforms() : cameraVersion(0)
+	{
+		GLState& state = GLState::current();
+		glGenBuffers(1, &this->buffer);
+		state.bindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+		// the binding point stays attached to this buffer for the lifetime of the program
+		state.bindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, this->buffer);
+	}
+
+	~FrameUniforms()
+	{
+		GLState::current().deleteBuffers(1, &this->buffer);
+	}
+
+	// Writes the time, and the camera matrices with the same upload if the camera changed since the last update
+	void update(Camera& camera, GLfloat time)
+	{
+		this->data.time = time;
+		// stays bound between frames, nothing else uses GL_UNIFORM_BUFFER so the bind is filtered after the first frame
+		GLState::current().bindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+		if (camera.GetVersion() != this->cameraVersion) {
+			this->data.view = camera.GetViewMatrix();
+			this->data.projection = camera.GetProjectionMatrix();
+			this->data.viewPos = camera.position;
+			this->cameraVersion = camera.GetVersion();
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &this->data);
+		}
+		else {
+			glBufferSubData(GL_UNIFORM_BUFFER, offsetof(FrameData, time), sizeof(GLfloat), &this->data.time);
+		}
+	}
+
+private:
+	// Version of the camera the matrices in the buffer came from
+	unsigned cameraVersion;
+
+	// only one buffer per binding point
+	FrameUniforms(const FrameUniforms&);
+	FrameUniforms& operator=(const FrameUniforms&);
+};
@@ -0,0 +1,269 @@
+#pragma once
+
+// GL Includes
+#include <GLEW/glew.h>
+
+// to skip GL calls that would not change anything:
+// 1. make the state calls through the tracker of the thread instead of calling GL directly
+//		GLState& state = GLState::current();
+//		state.bindVertexArray(VAO);
+//		state.clearColor(0.2f, 0.3f, 0.3f, 1.0f);
+//    Shader::use() already goes through it
+// 2. read stats for profiling, resetFrameStats() once at the start of each frame
+// Every binding a tracker shadows has to be changed through it, or it would skip a call that was needed.
+// Code that changes state behind its back (a library, glDelete* called directly) must call invalidate() afterwards.
+// Values start unknown, so the first call of each kind always reaches GL. One tracker per thread, as a GL context is
+// current on one thread at a time.
+
+// Texture units shadowed, binds on higher units are always issued
+const int GL_STATE_TEXTURE_UNITS = 16;
+
+// State calls passed to GL and filtered out by GLState, for profiling
+struct GLStateStats
+{
+	unsigned callsIssued;	// calls made
+	unsigned callsFiltered;	// calls skipped because they would have set the value already there
+};
+
+class GLState
+{
+public:
+	GLStateStats stats;
+
+	GLState()
+	{
+		this->resetFrameStats();
+		this->invalidate();
+	}
+
+	// The tracker for the context current on this thread
+	static GLState& current()
+	{
+		static thread_local GLState state;
+		return state;
+	}
+
+	void resetFrameStats()
+	{
+		this->stats.callsIssued = 0;
+		this->stats.callsFiltered = 0;
+	}
+
+	// Forgets every value, the next call of each kind reaches GL
+	void invalidate()
+	{
+		this->program = UNKNOWN;
+		this->vertexArray = UNKNOWN;
+		for (int i = 0; i < BUFFER_TARGETS; i++)
+			this->buffers[i] = UNKNOWN;
+		this->activeUnit = UNKNOWN;
+		for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+			this->textures[i] = UNKNOWN;
+		for (int i = 0; i < CAPABILITIES; i++)
+			this->enabled[i] = -1;
+		this->blendSource = UNKNOWN;
+		this->blendDestination = UNKNOWN;
+		this->fillMode = UNKNOWN;
+		this->clearKnown = false;
+	}
+
+	void useProgram(GLuint program)
+	{
+		if (this->filter(this->program, program))
+			glUseProgram(program);
+	}
+
+	// The element array buffer belongs to the vertex array, it becomes unknown when another one is bound
+	void bindVertexArray(GLuint vertexArray)
+	{
+		if (!this->filter(this->vertexArray, vertexArray))
+			return;
+		glBindVertexArray(vertexArray);
+		this->buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+	}
+
+	void bindBuffer(GLenum target, GLuint buffer)
+	{
+		int slot = bufferSlot(target);
+		if (slot >= 0 && !this->filter(this->buffers[slot], buffer))
+			return;
+		if (slot < 0)
+			this->stats.callsIssued++;
+		glBindBuffer(target, buffer);
+	}
+
+	// Also binds buffer to the generic target, as GL does
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		glBindBufferBase(target, index, buffer);
+		this->stats.callsIssued++;
+		int slot = bufferSlot(target);
+		if (slot >= 0)
+			this->buffers[slot] = buffer;
+	}
+
+	void activeTexture(GLenum unit)
+	{
+		if (this->filter(this->activeUnit, unit))
+			glActiveTexture(unit);
+	}
+
+	// Only GL_TEXTURE_2D bindings are shadowed
+	void bindTexture(GLenum target, GLuint texture)
+	{
+		int unit = this->activeUnit == UNKNOWN ? -1 : (int)(this->activeUnit - GL_TEXTURE0);
+		if (target != GL_TEXTURE_2D || unit < 0 || unit >= GL_STATE_TEXTURE_UNITS) {
+			this->stats.callsIssued++;
+			glBindTexture(target, texture);
+		}
+		else if (this->filter(this->textures[unit], texture)) {
+			glBindTexture(target, texture);
+		}
+	}
+
+	void enable(GLenum capability) { this->setCapability(capability, true); }
+	void disable(GLenum capability) { this->setCapability(capability, false); }
+
+	void blendFunc(GLenum source, GLenum destination)
+	{
+		if (this->blendSource == source && this->blendDestination == destination) {
+			this->stats.callsFiltered++;
+			return;
+		}
+		this->blendSource = source;
+		this->blendDestination = destination;
+		this->stats.callsIssued++;
+		glBlendFunc(source, destination);
+	}
+
+	// The core profile only has GL_FRONT_AND_BACK, so one mode is shadowed for both faces
+	void polygonMode(GLenum mode)
+	{
+		if (this->filter(this->fillMode, mode))
+			glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+
+	void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+	{
+		if (this->clearKnown && this->clearValue[0] == red && this->clearValue[1] == green && this->clearValue[2] == blue && this->clearValue[3] == alpha) {
+			this->stats.callsFiltered++;
+			return;
+		}
+		this->clearValue[0] = red;
+		this->clearValue[1] = green;
+		this->clearValue[2] = blue;
+		this->clearValue[3] = alpha;
+		this->clearKnown = true;
+		this->stats.callsIssued++;
+		glClearColor(red, green, blue, alpha);
+	}
+
+	// Deleting a bound object binds 0 in its place, these keep the shadows in step
+	void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+	{
+		glDeleteVertexArrays(count, vertexArrays);
+		for (GLsizei i = 0; i < count; i++) {
+			if (vertexArrays[i] != 0 && this->vertexArray == vertexArrays[i])
+				this->vertexArray = 0;
+		}
+	}
+
+	void deleteBuffers(GLsizei count, const GLuint* buffers)
+	{
+		glDeleteBuffers(count, buffers);
+		for (GLsizei i = 0; i < count; i++) {
+			for (int slot = 0; slot < BUFFER_TARGETS; slot++) {
+				if (buffers[i] != 0 && this->buffers[slot] == buffers[i])
+					this->buffers[slot] = 0;
+			}
+		}
+	}
+
+	void deleteTextures(GLsizei count, const GLuint* textures)
+	{
+		glDeleteTextures(count, textures);
+		for (GLsizei i = 0; i < count; i++) {
+			for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++) {
+				if (textures[i] != 0 && this->textures[unit] == textures[i])
+					this->textures[unit] = 0;
+			}
+		}
+	}
+
+private:
+	// no GL object or enum has this value, it marks a shadow that has to be set before it can filter
+	static const GLuint UNKNOWN = 0xFFFFFFFF;
+	static const int BUFFER_TARGETS = 7;
+	static const int CAPABILITIES = 5;
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint buffers[BUFFER_TARGETS];
+	GLuint activeUnit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS];
+	// 1 enabled, 0 disabled, -1 unknown, in the order of capabilitySlot
+	int enabled[CAPABILITIES];
+	GLenum blendSource;
+	GLenum blendDestination;
+	GLenum fillMode;
+	GLfloat clearValue[4];
+	bool clearKnown;
+
+	// Stores value and returns true if the call has to be made, counts the call either way
+	bool filter(GLuint& shadow, GLuint value)
+	{
+		if (shadow == value) {
+			this->stats.callsFiltered++;
+			return false;
+		}
+		shadow = value;
+		this->stats.callsIssued++;
+		return true;
+	}
+
+	void setCapability(GLenum capability, bool on)
+	{
+		int slot = capabilitySlot(capability);
+		if (slot >= 0 && this->enabled[slot] == (on ? 1 : 0)) {
+			this->stats.callsFiltered++;
+			return;
+		}
+		if (slot >= 0)
+			this->enabled[slot] = on ? 1 : 0;
+		this->stats.callsIssued++;
+		if (on)
+			glEnable(capability);
+		else
+			glDisable(capability);
+	}
+
+	static int bufferSlot(GLenum target)
+	{
+		switch (target) {
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_ELEMENT_ARRAY_BUFFER: return 1;
+		case GL_UNIFORM_BUFFER: return 2;
+		case GL_PIXEL_UNPACK_BUFFER: return 3;
+		case GL_PIXEL_PACK_BUFFER: return 4;
+		case GL_COPY_READ_BUFFER: return 5;
+		case GL_COPY_WRITE_BUFFER: return 6;
+		default: return -1;
+		}
+	}
+
+	static int capabilitySlot(GLenum capability)
+	{
+		switch (capability) {
+		case GL_BLEND: return 0;
+		case GL_DEPTH_TEST: return 1;
+		case GL_CULL_FACE: return 2;
+		case GL_SCISSOR_TEST: return 3;
+		case GL_STENCIL_TEST: return 4;
+		default: return -1;
+		}
+	}
+
+	// not copyable, each thread has one
+	GLState(const GLState&);
+	GLState& operator=(const GLState&);
+};
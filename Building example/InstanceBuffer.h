@@ -0,0 +1,183 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+
+// GL Includes
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+
+// to draw many copies of one mesh with a single draw call:
+// 1. create the buffer and fill in every instance
+//		InstanceBuffer instances;
+//		instances.resize(count);
+//		instances.set(i, model, tint);
+// 2. attach it to the mesh VAO, the shader reads the instance from INSTANCE_MODEL_LOCATION and INSTANCE_TINT_LOCATION
+//		glBindVertexArray(VAO);
+//		instances.attach();
+// 3. move whatever moved, then upload, only the instances that changed are sent to the GPU
+// while (...) {
+//     instances.set(i, model, tint);
+//     instances.upload();
+//     glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0, instances.count());
+// }
+
+// Attribute locations, a mat4 attribute takes one location per column
+const GLuint INSTANCE_MODEL_LOCATION = 2;	// 2 to 5
+const GLuint INSTANCE_TINT_LOCATION = 6;
+// changed instances closer together than this are sent in one glBufferSubData, fewer calls for a few unchanged bytes
+const size_t INSTANCE_MERGE_GAP = 8;
+
+// One copy of the mesh, matches the attribute pointers set in attach()
+struct Instance
+{
+	glm::mat4 model;
+	glm::vec3 tint;
+};
+
+// What the last upload sent
+struct InstanceUploadStats
+{
+	unsigned calls;
+	unsigned instances;
+};
+
+class InstanceBuffer
+{
+public:
+	// The GL buffer ID, 0 until attach() is called
+	GLuint buffer;
+	// Counters of the last upload
+	InstanceUploadStats lastUpload;
+
+	InstanceBuffer() : buffer(0), allocated(0)
+	{
+		this->lastUpload.calls = 0;
+		this->lastUpload.instances = 0;
+	}
+
+	~InstanceBuffer()
+	{
+		if (this->buffer != 0)
+			GLState::current().deleteBuffers(1, &this->buffer);
+	}
+
+	GLsizei count() const { return (GLsizei)this->instances.size(); }
+	const Instance& get(size_t i) const { return this->instances[i]; }
+
+	// New instances are identity transforms with no tint and are sent on the next upload,
+	// shrinking keeps the GL buffer so a list that changes size every frame does not reallocate
+	void resize(size_t count)
+	{
+		size_t oldCount = this->instances.size();
+		Instance identity;
+		identity.model = glm::mat4();
+		identity.tint = glm::vec3(1.0f, 1.0f, 1.0f);
+		this->instances.resize(count, identity);
+		this->dirty.resize(count, 0);
+		if (count < oldCount)
+			this->dirtyList.erase(std::remove_if(this->dirtyList.begin(), this->dirtyList.end(), [count](uint32_t i) { return i >= count; }), this->dirtyList.end());
+		for (size_t i = oldCount; i < count; i++) {
+			this->dirty[i] = 1;
+			this->dirtyList.push_back((uint32_t)i);
+		}
+	}
+
+	// Marks the instance for upload only if it actually changed
+	void set(size_t i, const glm::mat4& model, const glm::vec3& tint)
+	{
+		Instance& instance = this->instances[i];
+		if (std::memcmp(&instance.model, &model, sizeof(glm::mat4)) == 0 && std::memcmp(&instance.tint, &tint, sizeof(glm::vec3)) == 0)
+			return;
+		instance.model = model;
+		instance.tint = tint;
+		if (!this->dirty[i]) {
+			this->dirty[i] = 1;
+			this->dirtyList.push_back((uint32_t)i);
+		}
+	}
+
+	// Creates the buffer and points the instance attributes of the bound VAO at it
+	void attach()
+	{
+		if (this->buffer == 0)
+			glGenBuffers(1, &this->buffer);
+		GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->buffer);
+		for (GLuint column = 0; column < 4; column++) {
+			glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid*)(offsetof(Instance, model) + column * sizeof(glm::vec4)));
+			glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+			glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1); // advance once per instance instead of once per vertex
+		}
+		glVertexAttribPointer(INSTANCE_TINT_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid*)offsetof(Instance, tint));
+		glEnableVertexAttribArray(INSTANCE_TINT_LOCATION);
+		glVertexAttribDivisor(INSTANCE_TINT_LOCATION, 1);
+	}
+
+	// Sends the changed instances to the GL buffer
+	void upload()
+	{
+		// left bound afterwards, the attributes keep the buffer they were pointed at so this changes no draw
+		GLState::current().bindBuffer(GL_ARRAY_BUFFER, this->buffer);
+		this->flush([](size_t offset, size_t size, const void* data, bool reallocate) {
+			if (reallocate)
+				glBufferData(GL_ARRAY_BUFFER, size, data, GL_DYNAMIC_DRAW);
+			else
+				glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+		});
+	}
+
+	// Calls write(offset, size, data, reallocate) for each run of changed instances,
+	// reallocate is true when the buffer has to grow and everything is sent at once
+	template<typename Write>
+	void flush(Write write)
+	{
+		this->lastUpload.calls = 0;
+		this->lastUpload.instances = 0;
+		if (this->instances.empty())
+			return;
+		if (this->instances.size() > this->allocated) {
+			write(0, this->instances.size() * sizeof(Instance), &this->instances[0], true);
+			this->allocated = this->instances.size();
+			this->lastUpload.calls = 1;
+			this->lastUpload.instances = (unsigned)this->instances.size();
+		}
+		else if (!this->dirtyList.empty()) {
+			std::sort(this->dirtyList.begin(), this->dirtyList.end());
+			size_t runStart = this->dirtyList[0], runEnd = runStart + 1;
+			for (size_t i = 1; i <= this->dirtyList.size(); i++) {
+				if (i < this->dirtyList.size() && this->dirtyList[i] <= runEnd + INSTANCE_MERGE_GAP) {
+					runEnd = this->dirtyList[i] + 1;
+					continue;
+				}
+				write(runStart * sizeof(Instance), (runEnd - runStart) * sizeof(Instance), &this->instances[runStart], false);
+				this->lastUpload.calls++;
+				this->lastUpload.instances += (unsigned)(runEnd - runStart);
+				if (i < this->dirtyList.size()) {
+					runStart = this->dirtyList[i];
+					runEnd = runStart + 1;
+				}
+			}
+		}
+		for (size_t i = 0; i < this->dirtyList.size(); i++)
+			this->dirty[this->dirtyList[i]] = 0;
+		this->dirtyList.clear();
+	}
+
+private:
+	std::vector<Instance> instances;
+	// one flag per instance so each changed instance is listed once
+	std::vector<unsigned char> dirty;
+	std::vector<uint32_t> dirtyList;
+	// instances the GL buffer has room for
+	size_t allocated;
+
+	// owns a GL buffer
+	InstanceBuffer(const InstanceBuffer&);
+	InstanceBuffer& operator=(const InstanceBuffer&);
+};
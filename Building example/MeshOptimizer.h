@@ -0,0 +1,337 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+
+// GL Includes
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+
+// to make an indexed triangle mesh cheaper to draw, without changing what it looks like:
+// 1. optimize the vertex and index lists in place, vertexSize is the floats per vertex with the position first
+//		MeshOptimizer optimizer;
+//		optimizer.optimize(vertices, indices, BUILDING_VERTEX_SIZE);
+// 2. print what it did, vertices welded and the vertex cache numbers before and after
+//		optimizer.report("building");
+// The passes can also be run one at a time, in this order:
+//   weld()             merges vertices whose attributes are bit for bit equal
+//   reorderForCache()  Tipsify (Sander, Nehab, Barczak 2007), orders triangles so vertices are reused while still in the post-transform cache
+//   reorderForOverdraw() sorts the clusters Tipsify found so the ones facing out of the mesh come first and hide the rest early
+//   reorderForFetch()  renumbers vertices in the order the triangles first use them, so fetches walk the buffer forwards
+// ACMR is vertices transformed per triangle (0.5 is the best a regular grid gets, 3 is no reuse at all),
+// ATVR is vertices transformed per vertex in the mesh (1 is every vertex once). Both simulate a FIFO cache of cacheSize.
+// The optimizer keeps its scratch buffers, optimizing many meshes with one optimizer only allocates for the largest.
+
+// Entries of the simulated post-transform cache, and the cache Tipsify optimizes for
+const int MESH_CACHE_SIZE = 16;
+
+// Cost of an index list in the simulated cache
+struct MeshCacheStats
+{
+	double acmr;
+	double atvr;
+};
+
+// What the last optimize() did
+struct MeshOptimizeReport
+{
+	size_t verticesBefore;
+	size_t verticesAfter;
+	size_t triangles;
+	size_t clusters;
+	MeshCacheStats before;
+	MeshCacheStats after;
+	double time;	// milliseconds
+};
+
+class MeshOptimizer
+{
+public:
+	int cacheSize;
+	MeshOptimizeReport lastReport;
+
+	MeshOptimizer() : cacheSize(MESH_CACHE_SIZE)
+	{
+		std::memset(&this->lastReport, 0, sizeof(this->lastReport));
+	}
+
+	// Runs every pass, vertices and indices are replaced by the optimized mesh
+	void optimize(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices, int vertexSize)
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		MeshOptimizeReport report;
+		report.verticesBefore = vertices.size() / vertexSize;
+		report.triangles = indices.size() / 3;
+		report.before = cacheStats(indices, report.verticesBefore, this->cacheSize);
+		this->weld(vertices, indices, vertexSize);
+		this->original = indices;
+		this->reorderForCache(indices, vertices.size() / vertexSize);
+		this->reorderForOverdraw(vertices, indices, vertexSize);
+		// a mesh that was already well ordered, such as one of separate quads, keeps its own order
+		if (cacheStats(indices, report.verticesBefore, this->cacheSize).acmr > report.before.acmr) {
+			indices.swap(this->original);
+			this->clusters.clear();
+		}
+		this->reorderForFetch(vertices, indices, vertexSize);
+		report.verticesAfter = vertices.size() / vertexSize;
+		report.clusters = this->clusters.size();
+		report.after = cacheStats(indices, report.verticesAfter, this->cacheSize);
+		report.time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		this->lastReport = report;
+	}
+
+	void report(const char* name) const
+	{
+		const MeshOptimizeReport& r = this->lastReport;
+		std::cout << name << ": " << r.verticesBefore << " -> " << r.verticesAfter << " vertices, " << r.triangles << " triangles, "
+			<< r.clusters << " clusters, ACMR " << r.before.acmr << " -> " << r.after.acmr << ", ATVR " << r.before.atvr << " -> " << r.after.atvr
+			<< " (FIFO " << this->cacheSize << "), " << r.time << " ms" << std::endl;
+	}
+
+	// Simulates a FIFO post-transform cache over the index list
+	static MeshCacheStats cacheStats(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize)
+	{
+		MeshCacheStats stats = { 0.0, 0.0 };
+		if (indices.empty() || vertexCount == 0)
+			return stats;
+		// a vertex is in the cache if it was pushed less than cacheSize misses ago
+		std::vector<size_t> pushedAt(vertexCount, 0);
+		size_t misses = 0;
+		for (size_t i = 0; i < indices.size(); i++) {
+			GLuint v = indices[i];
+			if (pushedAt[v] != 0 && misses - pushedAt[v] < (size_t)cacheSize)
+				continue;
+			misses++;
+			pushedAt[v] = misses;
+		}
+		stats.acmr = (double)misses / (double)(indices.size() / 3);
+		stats.atvr = (double)misses / (double)vertexCount;
+		return stats;
+	}
+
+	// Merges vertices with identical attributes, the first copy is kept. Vertices no triangle uses are kept until reorderForFetch().
+	void weld(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices, int vertexSize)
+	{
+		size_t vertexCount = vertices.size() / vertexSize;
+		const GLfloat* data = vertices.data();
+		size_t bytes = vertexSize * sizeof(GLfloat);
+		// equal vertices end up next to each other, the bytes are compared so -0 and 0 or two NaNs are never merged by value
+		this->order.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			this->order[i] = (GLuint)i;
+		std::sort(this->order.begin(), this->order.end(), [data, vertexSize, bytes](GLuint a, GLuint b) {
+			int compare = std::memcmp(data + (size_t)a * vertexSize, data + (size_t)b * vertexSize, bytes);
+			return compare < 0 || (compare == 0 && a < b);
+		});
+		this->remap.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; ) {
+			size_t run = i + 1;
+			while (run < vertexCount && std::memcmp(data + (size_t)this->order[i] * vertexSize, data + (size_t)this->order[run] * vertexSize, bytes) == 0)
+				run++;
+			for (size_t j = i; j < run; j++)
+				this->remap[this->order[j]] = this->order[i];
+			i = run;
+		}
+		for (size_t i = 0; i < indices.size(); i++)
+			indices[i] = this->remap[indices[i]];
+	}
+
+	// Tipsify: emits the triangles around one vertex at a time and picks the next vertex among the ones just emitted that will
+	// still be in the cache, so each fan mostly hits. Cluster starts, where it had to jump to a vertex out of the cache, are kept
+	// for reorderForOverdraw().
+	void reorderForCache(std::vector<GLuint>& indices, size_t vertexCount)
+	{
+		size_t triangleCount = indices.size() / 3;
+		this->clusters.clear();
+		if (triangleCount == 0)
+			return;
+		// triangles of each vertex, in compressed rows
+		this->adjacencyStart.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+			this->adjacencyStart[indices[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			this->adjacencyStart[v + 1] += this->adjacencyStart[v];
+		this->adjacency.resize(indices.size());
+		this->live.assign(vertexCount, 0);
+		for (size_t i = 0; i < indices.size(); i++) {
+			GLuint v = indices[i];
+			this->adjacency[this->adjacencyStart[v] + this->live[v]++] = (uint32_t)(i / 3);
+		}
+		// time each vertex last entered the cache, time starts past the cache so no vertex counts as cached at first
+		this->cacheTime.assign(vertexCount, 0);
+		this->emitted.assign(triangleCount, 0);
+		this->deadEnds.clear();
+		this->output.clear();
+		this->output.reserve(indices.size());
+		int time = this->cacheSize + 1;
+		size_t cursor = 0;
+		int fan = this->skipDeadEnd(vertexCount, cursor);
+		this->clusters.push_back(0);
+		while (fan >= 0) {
+			this->candidates.clear();
+			for (uint32_t a = this->adjacencyStart[fan]; a < this->adjacencyStart[fan + 1]; a++) {
+				uint32_t triangle = this->adjacency[a];
+				if (this->emitted[triangle])
+					continue;
+				this->emitted[triangle] = 1;
+				for (int corner = 0; corner < 3; corner++) {
+					GLuint v = indices[triangle * 3 + corner];
+					this->output.push_back(v);
+					this->deadEnds.push_back(v);
+					this->candidates.push_back(v);
+					this->live[v]--;
+					if (time - this->cacheTime[v] > this->cacheSize)
+						this->cacheTime[v] = time++;
+				}
+			}
+			// the candidate that is still cached and has been in the cache longest, so its fan uses it before it is pushed out
+			int next = -1, best = -1;
+			for (size_t c = 0; c < this->candidates.size(); c++) {
+				GLuint v = this->candidates[c];
+				if (this->live[v] == 0)
+					continue;
+				int priority = 0;
+				if (time - this->cacheTime[v] + 2 * (int)this->live[v] <= this->cacheSize)
+					priority = time - this->cacheTime[v];
+				if (priority > best) {
+					best = priority;
+					next = (int)v;
+				}
+			}
+			if (next < 0) {
+				next = this->skipDeadEnd(vertexCount, cursor);
+				// a new cluster only where the next fan starts with nothing it uses in the cache, moving it then costs no hits
+				if (next >= 0 && time - this->cacheTime[next] > this->cacheSize && this->clusters.back() != this->output.size() / 3)
+					this->clusters.push_back((uint32_t)(this->output.size() / 3));
+			}
+			fan = next;
+		}
+		indices.swap(this->output);
+	}
+
+	// Orders the clusters found by reorderForCache() so the ones whose faces point away from the centre of the mesh are drawn first,
+	// on a convex part they are in front and the depth test rejects what is behind them. Each cluster keeps its triangle order.
+	void reorderForOverdraw(const std::vector<GLfloat>& vertices, std::vector<GLuint>& indices, int vertexSize)
+	{
+		size_t clusterCount = this->clusters.size();
+		if (clusterCount < 2)
+			return;
+		size_t triangleCount = indices.size() / 3;
+		glm::vec3 meshCentre(0.0f, 0.0f, 0.0f);
+		GLfloat meshArea = 0.0f;
+		this->clusterCentres.assign(clusterCount, glm::vec3(0.0f, 0.0f, 0.0f));
+		this->clusterNormals.assign(clusterCount, glm::vec3(0.0f, 0.0f, 0.0f));
+		this->clusterAreas.assign(clusterCount, 0.0f);
+		for (size_t c = 0; c < clusterCount; c++) {
+			size_t end = c + 1 < clusterCount ? this->clusters[c + 1] : triangleCount;
+			for (size_t t = this->clusters[c]; t < end; t++) {
+				glm::vec3 p0 = position(vertices, indices[t * 3], vertexSize);
+				glm::vec3 p1 = position(vertices, indices[t * 3 + 1], vertexSize);
+				glm::vec3 p2 = position(vertices, indices[t * 3 + 2], vertexSize);
+				// twice the area, pointing out of the front face
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				GLfloat area = glm::length(normal);
+				glm::vec3 centre = (p0 + p1 + p2) * (area / 3.0f);
+				this->clusterNormals[c] += normal;
+				this->clusterCentres[c] += centre;
+				this->clusterAreas[c] += area;
+				meshCentre += centre;
+				meshArea += area;
+			}
+		}
+		if (meshArea > 0.0f)
+			meshCentre = meshCentre * (1.0f / meshArea);
+		this->clusterOrder.resize(clusterCount);
+		this->clusterKeys.resize(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++) {
+			this->clusterOrder[c] = (uint32_t)c;
+			glm::vec3 centre = this->clusterAreas[c] > 0.0f ? this->clusterCentres[c] * (1.0f / this->clusterAreas[c]) : meshCentre;
+			GLfloat length = glm::length(this->clusterNormals[c]);
+			this->clusterKeys[c] = length > 0.0f ? glm::dot(centre - meshCentre, this->clusterNormals[c] * (1.0f / length)) : 0.0f;
+		}
+		std::stable_sort(this->clusterOrder.begin(), this->clusterOrder.end(), [this](uint32_t a, uint32_t b) {
+			return this->clusterKeys[a] > this->clusterKeys[b];
+		});
+		this->output.clear();
+		this->output.reserve(indices.size());
+		this->sortedClusters.clear();
+		for (size_t i = 0; i < clusterCount; i++) {
+			uint32_t c = this->clusterOrder[i];
+			size_t end = c + 1 < clusterCount ? this->clusters[c + 1] : triangleCount;
+			this->sortedClusters.push_back((uint32_t)(this->output.size() / 3));
+			this->output.insert(this->output.end(), indices.begin() + this->clusters[c] * 3, indices.begin() + end * 3);
+		}
+		indices.swap(this->output);
+		this->clusters.swap(this->sortedClusters);
+	}
+
+	// Renumbers vertices in the order of first use and drops the ones no triangle uses
+	void reorderForFetch(std::vector<GLfloat>& vertices, std::vector<GLuint>& indices, int vertexSize)
+	{
+		size_t vertexCount = vertices.size() / vertexSize;
+		const GLuint UNUSED = 0xFFFFFFFF;
+		this->remap.assign(vertexCount, UNUSED);
+		this->fetched.clear();
+		this->fetched.reserve(vertices.size());
+		GLuint next = 0;
+		for (size_t i = 0; i < indices.size(); i++) {
+			GLuint& v = indices[i];
+			if (this->remap[v] == UNUSED) {
+				this->remap[v] = next++;
+				this->fetched.insert(this->fetched.end(), vertices.begin() + (size_t)v * vertexSize, vertices.begin() + ((size_t)v + 1) * vertexSize);
+			}
+			v = this->remap[v];
+		}
+		vertices.swap(this->fetched);
+	}
+
+private:
+	// scratch, kept between calls
+	std::vector<GLuint> order;
+	std::vector<GLuint> remap;
+	std::vector<uint32_t> adjacencyStart;
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> live;
+	std::vector<int> cacheTime;
+	std::vector<unsigned char> emitted;
+	std::vector<GLuint> deadEnds;
+	std::vector<GLuint> candidates;
+	std::vector<GLuint> output;
+	std::vector<GLuint> original;
+	std::vector<GLfloat> fetched;
+	// first triangle of each cluster
+	std::vector<uint32_t> clusters;
+	std::vector<uint32_t> sortedClusters;
+	std::vector<uint32_t> clusterOrder;
+	std::vector<GLfloat> clusterKeys;
+	std::vector<GLfloat> clusterAreas;
+	std::vector<glm::vec3> clusterCentres;
+	std::vector<glm::vec3> clusterNormals;
+
+	static glm::vec3 position(const std::vector<GLfloat>& vertices, GLuint v, int vertexSize)
+	{
+		const GLfloat* p = &vertices[(size_t)v * vertexSize];
+		return glm::vec3(p[0], p[1], p[2]);
+	}
+
+	// The last emitted vertex with triangles left, or else the next one in index order, -1 when every triangle is out
+	int skipDeadEnd(size_t vertexCount, size_t& cursor)
+	{
+		while (!this->deadEnds.empty()) {
+			GLuint v = this->deadEnds.back();
+			this->deadEnds.pop_back();
+			if (this->live[v] > 0)
+				return (int)v;
+		}
+		for (; cursor < vertexCount; cursor++) {
+			if (this->live[cursor] > 0)
+				return (int)cursor;
+		}
+		return -1;
+	}
+};
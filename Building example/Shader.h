@@ -2,91 +2,346 @@
 
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <direct.h> // _mkdir
+#else
+#include <sys/stat.h> // mkdir
+#endif
 
 #include <GLEW/glew.h> // Include glew to get all the required OpenGL headers
+#include "AssetPack.h"
+#include "ShaderIncludes.h"
+#include "GLState.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 // to use the shader class to load external shaders:
 // 1. call constructor
 //		Shader shaderName("path/to/shader.vert", "path/to/shader.frag");
+//    or build from sources already in memory, such as an AssetPack mapping, which are handed to GL without a copy
+//		Shader shaderName(vertexSource, vertexLength, fragmentSource, fragmentLength);
+//    or take both sources from an open AssetPack, falling back to the files if the pack does not have them
+//		Shader shaderName(pack, "path/to/shader.vert", "path/to/shader.frag");
+//    pass deferred = true to only submit the compile and link, so many programs compile at once on the driver's threads
+//		Shader shaderName("path/to/shader.vert", "path/to/shader.frag", true);
+//    and draw something else until shaderName.isReady(), or let use() wait for it
+//    or build a variant with compile time constants, written as #define lines after #version in both stages
+//		Shader shaderName("path/to/shader.vert", "path/to/shader.frag", ShaderDefines().set("SHININESS", 32.0));
 // 2. use shader program by calling the .use() function
 // while (...) {
 //     ourShader.use();
-//     glUniform1f(glGetUniformLocation(ourShader.program, "someUniform"), 1.0f);
+//     ourShader.setFloat("someUniform", 1.0f);
 //     DrawStuff();
 // }
+// The setters look up the location in a table built once after linking and skip the upload if the value has not changed.
+// The path constructor reads each file with a single read into a buffer kept between shaders and hands the bytes to GL
+// with their length. readSources can also read the two stages at once, see --bench-shader-read in "Lighting cube 1".
+// Constructors that take paths resolve #include "file" lines through ShaderIncludes.h.
+// Call Shader::enableParallelCompile() once after creating the context to let the driver compile on all its threads.
+// Linked programs are saved in SHADER_CACHE_DIR and reused on the next launch if the sources and driver are unchanged.
+
+// Folder for cached program binaries, relative to the working directory
+#define SHADER_CACHE_DIR "shadercache"
+
+// Uniform block shared by every shader that declares it, see FrameUniforms.h
+#define FRAME_UNIFORM_BLOCK "FrameData"
+const GLuint FRAME_UNIFORM_BINDING = 0;
+
+// GL calls issued and avoided by the uniform setters, for profiling
+struct UniformStats
+{
+	unsigned callsIssued;	// glUniform* calls made
+	unsigned callsSaved;	// glGetUniformLocation calls replaced by the table, plus glUniform* calls skipped because the value was unchanged
+};
+
+// Compile time constants of one shader variant, kept sorted by name so a set gives the same source,
+// and so the same binary cache entry, whatever order it was filled in
+class ShaderDefines
+{
+public:
+	// Adds or replaces a define, a value of "" defines the name only
+	ShaderDefines& set(const std::string& name, const std::string& value = "1")
+	{
+		std::vector<std::pair<std::string, std::string> >::iterator it = this->values.begin();
+		while (it != this->values.end() && it->first < name)
+			++it;
+		if (it != this->values.end() && it->first == name)
+			it->second = value;
+		else
+			this->values.insert(it, std::make_pair(name, value));
+		return *this;
+	}
+
+	ShaderDefines& set(const std::string& name, const char* value) { return this->set(name, std::string(value)); }
+	ShaderDefines& set(const std::string& name, int value) { return this->set(name, std::to_string(value)); }
+
+	// Written so GLSL reads it as a float, 32.0 gives "32.0" rather than "32"
+	ShaderDefines& set(const std::string& name, double value)
+	{
+		char text[32];
+		snprintf(text, sizeof(text), "%.9g", value);
+		std::string literal = text;
+		if (literal.find_first_of(".e") == std::string::npos)
+			literal += ".0";
+		return this->set(name, literal);
+	}
+
+	bool empty() const { return this->values.empty(); }
+
+	// "NAME=VALUE;..." in name order, equal for equal sets
+	std::string key() const
+	{
+		std::string key;
+		for (size_t i = 0; i < this->values.size(); i++)
+			key += this->values[i].first + "=" + this->values[i].second + ";";
+		return key;
+	}
+
+	// Appends a #define line for every value
+	void write(std::string& source) const
+	{
+		for (size_t i = 0; i < this->values.size(); i++)
+			source += "#define " + this->values[i].first + (this->values[i].second.empty() ? "" : " " + this->values[i].second) + "\n";
+	}
 
+private:
+	std::vector<std::pair<std::string, std::string> > values;
+};
 
 class Shader
 {
 public:
 	// The program ID
 	GLuint program;
+	// Startup statistics, time taken by the constructor (plus finish() for deferred shaders), the part of it spent
+	// reading source files and whether the program came from the binary cache
+	double buildTime;
+	double readTime;
+	bool fromCache;
+	// False after a compile or link error, the program then draws nothing
+	bool linked;
 	// Constructor reads and builds the shader
-	Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
-
-		// 1. Retrieve vertex/fragment source code from filepath
-		std::string vertexCode;
-		std::string fragmentCode;
-		std::ifstream vShaderFile;
-		std::ifstream fShaderFile;
-		// ensures ifstream objects can throw exceptions
-		vShaderFile.exceptions(std::ifstream::badbit);
-		fShaderFile.exceptions(std::ifstream::badbit);
-		try {
-			// open files
-			vShaderFile.open(vertexPath);
-			fShaderFile.open(fragmentPath);
-			std::stringstream vShaderStream, fShaderStream;
-			// Read file's buffer contents into streams
-			vShaderStream << vShaderFile.rdbuf();
-			fShaderStream << fShaderFile.rdbuf();
-			// close file handlers
-			vShaderFile.close();
-			fShaderFile.close();
-			// Convert stream into GLchar array
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, bool deferred = false) : buildTime(0.0), readTime(0.0), fromCache(false), linked(false), pending(false), vertexShader(0), fragmentShader(0) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		// 1. Retrieve vertex/fragment source code from filepath, with the includes resolved
+		const GLchar* vShaderCode;
+		const GLchar* fShaderCode;
+		GLint vertexLength, fragmentLength;
+		loadSources(nullptr, vertexPath, fragmentPath, vShaderCode, vertexLength, fShaderCode, fragmentLength);
+		this->readTime = elapsedMs(start);
+		this->build(vShaderCode, vertexLength, fShaderCode, fragmentLength, start, deferred);
+	}
+
+	// Constructor reads the files and builds the variant given by defines
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const ShaderDefines& defines, bool deferred = false) : buildTime(0.0), readTime(0.0), fromCache(false), linked(false), pending(false), vertexShader(0), fragmentShader(0) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		const GLchar* vShaderCode;
+		const GLchar* fShaderCode;
+		GLint vertexLength, fragmentLength;
+		loadSources(nullptr, vertexPath, fragmentPath, vShaderCode, vertexLength, fShaderCode, fragmentLength);
+		this->readTime = elapsedMs(start);
+		static thread_local std::string vertexVariant;
+		static thread_local std::string fragmentVariant;
+		injectDefines(vShaderCode, vertexLength, defines, vertexVariant);
+		injectDefines(fShaderCode, fragmentLength, defines, fragmentVariant);
+		this->build(vertexVariant.c_str(), (GLint)vertexVariant.size(), fragmentVariant.c_str(), (GLint)fragmentVariant.size(), start, deferred);
+	}
+
+	// Constructor builds the shader from sources in memory, the lengths exclude any terminating 0
+	Shader(const GLchar* vertexSource, GLint vertexLength, const GLchar* fragmentSource, GLint fragmentLength, bool deferred = false) : buildTime(0.0), readTime(0.0), fromCache(false), linked(false), pending(false), vertexShader(0), fragmentShader(0) {
+		this->build(vertexSource, vertexLength, fragmentSource, fragmentLength, std::chrono::high_resolution_clock::now(), deferred);
+	}
+
+	// Constructor builds the shader from the sources in pack, stored under their paths, without copying them unless they
+	// have includes. Reads the files instead when the pack is closed or misses either source.
+	Shader(const AssetPack& pack, const GLchar* vertexPath, const GLchar* fragmentPath, bool deferred = false) : buildTime(0.0), readTime(0.0), fromCache(false), linked(false), pending(false), vertexShader(0), fragmentShader(0) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		const GLchar* vShaderCode;
+		const GLchar* fShaderCode;
+		GLint vertexLength, fragmentLength;
+		loadSources(&pack, vertexPath, fragmentPath, vShaderCode, vertexLength, fShaderCode, fragmentLength);
+		this->readTime = elapsedMs(start);
+		this->build(vShaderCode, vertexLength, fShaderCode, fragmentLength, start, deferred);
+	}
+
+	// Sources of both stages with their #include lines resolved, from pack if it is open and has both, else from the files.
+	// The pointers are into pack or into buffers that keep their capacity, valid until the next call on this thread.
+	static void loadSources(const AssetPack* pack, const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar*& vertexSource, GLint& vertexLength, const GLchar*& fragmentSource, GLint& fragmentLength)
+	{
+		static thread_local std::string vertexCode;
+		static thread_local std::string fragmentCode;
+		const AssetEntry* vertex = pack != nullptr && pack->isOpen() ? pack->find(vertexPath) : nullptr;
+		const AssetEntry* fragment = pack != nullptr && pack->isOpen() ? pack->find(fragmentPath) : nullptr;
+		if (vertex != nullptr && fragment != nullptr) {
+			vertexSource = pack->text(vertex);
+			vertexLength = (GLint)vertex->size;
+			fragmentSource = pack->text(fragment);
+			fragmentLength = (GLint)fragment->size;
+		}
+		else {
+			readSources(vertexPath, fragmentPath, vertexCode, fragmentCode);
+			vertexSource = vertexCode.c_str();
+			vertexLength = (GLint)vertexCode.size();
+			fragmentSource = fragmentCode.c_str();
+			fragmentLength = (GLint)fragmentCode.size();
+		}
+		static thread_local std::string vertexExpanded;
+		static thread_local std::string fragmentExpanded;
+		ShaderIncludes& includes = ShaderIncludes::shared();
+		if (ShaderIncludes::hasIncludes(vertexSource, vertexLength)) {
+			includes.expand(vertexPath, vertexSource, vertexLength, vertexExpanded, pack);
+			vertexSource = vertexExpanded.c_str();
+			vertexLength = (GLint)vertexExpanded.size();
 		}
-		catch (std::ifstream::failure e){
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+		if (ShaderIncludes::hasIncludes(fragmentSource, fragmentLength)) {
+			includes.expand(fragmentPath, fragmentSource, fragmentLength, fragmentExpanded, pack);
+			fragmentSource = fragmentExpanded.c_str();
+			fragmentLength = (GLint)fragmentExpanded.size();
 		}
-		const GLchar* vShaderCode = vertexCode.c_str();
-		const GLchar* fShaderCode = fragmentCode.c_str();
+	}
+
+	// Reads both files whole into vertexCode and fragmentCode, reusing their capacity. With parallel the fragment file is
+	// read on a second thread while this one reads the vertex file, so files not in the page cache wait for the disk once
+	// instead of twice. Starting the thread costs more than reading two cached files, so it is off by default.
+	// Returns false, with the sources empty, if either file cannot be read.
+	static bool readSources(const GLchar* vertexPath, const GLchar* fragmentPath, std::string& vertexCode, std::string& fragmentCode, bool parallel = false)
+	{
+		bool fragmentRead = false;
+		std::thread fragmentReader;
+		if (parallel)
+			fragmentReader = std::thread([&]() { fragmentRead = readFile(fragmentPath, fragmentCode); });
+		bool vertexRead = readFile(vertexPath, vertexCode);
+		if (parallel)
+			fragmentReader.join();
+		else
+			fragmentRead = readFile(fragmentPath, fragmentCode);
+		if (!vertexRead || !fragmentRead) {
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ " << (vertexRead ? fragmentPath : vertexPath) << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Copies source into variant with the defines after its #version line, or in front if it has none.
+	// A #line directive after them keeps the line numbers in compile errors those of the file.
+	static void injectDefines(const GLchar* source, size_t length, const ShaderDefines& defines, std::string& variant)
+	{
+		variant.clear();
+		size_t body = 0;
+		int bodyLine = 1;
+		// only whitespace can come before #version here, GLSL also allows comments but none of the shaders start with one
+		size_t start = 0;
+		while (start < length && (source[start] == ' ' || source[start] == '\t' || source[start] == '\r' || source[start] == '\n'))
+			start++;
+		if (length - start >= 8 && std::memcmp(source + start, "#version", 8) == 0) {
+			const GLchar* end = (const GLchar*)std::memchr(source + start, '\n', length - start);
+			body = end != nullptr ? (size_t)(end - source) + 1 : length;
+			for (size_t i = 0; i < body; i++)
+				bodyLine += source[i] == '\n';
+			variant.append(source, body);
+			if (end == nullptr)
+				variant += '\n';
+		}
+		defines.write(variant);
+		variant += "#line " + std::to_string(bodyLine) + "\n";
+		variant.append(source + body, length - body);
+	}
 
-		// 2: Compile shaders
-		GLuint vertex, fragment;
+	// Reads a whole file with one read call into code, which keeps its capacity, see readShaderFile in ShaderIncludes.h
+	static bool readFile(const GLchar* path, std::string& code) { return readShaderFile(path, code); }
+
+private:
+	// Compile and link still running on the driver when the constructor was deferred
+	bool pending;
+	GLuint vertexShader;
+	GLuint fragmentShader;
+	std::string cachePath;
+
+	// Compiles and links the sources, or loads the program from the binary cache.
+	// Deferred, it returns once the link is submitted and finish() does the rest.
+	void build(const GLchar* vShaderCode, GLint vertexLength, const GLchar* fShaderCode, GLint fragmentLength, std::chrono::high_resolution_clock::time_point start, bool deferred)
+	{
+		// 2. Try the binary cache, the key covers both sources and the driver so a driver update invalidates it
+		this->program = glCreateProgram();
+		bool useCache = binaryCacheEnabled() && binaryCacheSupported();
+		if (useCache) {
+			this->cachePath = cacheFilePath(vShaderCode, vertexLength, fShaderCode, fragmentLength);
+			if (loadBinary(this->program, this->cachePath)) {
+				this->fromCache = true;
+				this->linked = true;
+				this->loadUniforms();
+				this->buildTime = elapsedMs(start);
+				return;
+			}
+			// the cached binary was missing or rejected, start again with a clean program
+			glDeleteProgram(this->program);
+			this->program = glCreateProgram();
+		}
+
+		// 3: Compile shaders, the status is only asked for in finish() so the driver can compile in the background
+		this->vertexShader = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(this->vertexShader, 1, &vShaderCode, &vertexLength);
+		glCompileShader(this->vertexShader);
+		this->fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(this->fragmentShader, 1, &fShaderCode, &fragmentLength);
+		glCompileShader(this->fragmentShader);
+
+		// Shader program
+		glAttachShader(this->program, this->vertexShader);
+		glAttachShader(this->program, this->fragmentShader);
+		if (useCache)
+			glProgramParameteri(this->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(this->program);
+		this->pending = true;
+		this->buildTime = elapsedMs(start);
+		if (!deferred)
+			this->finish();
+	}
+
+public:
+	// True once a deferred shader can be used without waiting. Without KHR_parallel_shader_compile there is no way to
+	// ask, so it is always true and finish() waits for the driver.
+	bool isReady() const
+	{
+		if (!this->pending || !parallelCompileSupported())
+			return true;
+		GLint done = GL_FALSE;
+		glGetProgramiv(this->program, GL_COMPLETION_STATUS_KHR, &done);
+		return done == GL_TRUE;
+	}
+
+	// Waits for a deferred compile and link, prints their errors and reads the uniforms. use() calls it on first use.
+	void finish()
+	{
+		if (!this->pending)
+			return;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		this->pending = false;
 		GLint success;
 		GLchar infoLog[512];
 
-		// Vertex shader
-		vertex = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex, 1, &vShaderCode, NULL);
-		glCompileShader(vertex);
-
-		glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+		glGetShaderiv(this->vertexShader, GL_COMPILE_STATUS, &success);
 		if (!success) {
-			glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+			glGetShaderInfoLog(this->vertexShader, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
 		};
-		
-		// Fragment shader
-		fragment = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragment, 1, &fShaderCode, NULL);
-		glCompileShader(fragment);
 
-		glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+		glGetShaderiv(this->fragmentShader, GL_COMPILE_STATUS, &success);
 		if (!success) {
-			glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+			glGetShaderInfoLog(this->fragmentShader, 512, NULL, infoLog);
 			std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
 		};
 
-		// Shader program
-		this->program = glCreateProgram();
-		glAttachShader(this->program, vertex);
-		glAttachShader(this->program, fragment);
-		glLinkProgram(this->program);
 		// Print linking errors if any
 		glGetProgramiv(this->program, GL_LINK_STATUS, &success);
 		if (!success) {
@@ -95,12 +350,292 @@ public:
 		};
 
 		// Delete shaders as they have been linked now and no longer necesary
-		glDeleteShader(vertex);
-		glDeleteShader(fragment);
-	}
-		
-		
-		;
-	// Use the program
-	void use() { glUseProgram(this->program); }
-};
\ No newline at end of file
+		glDetachShader(this->program, this->vertexShader);
+		glDetachShader(this->program, this->fragmentShader);
+		glDeleteShader(this->vertexShader);
+		glDeleteShader(this->fragmentShader);
+		this->vertexShader = 0;
+		this->fragmentShader = 0;
+
+		this->linked = success == GL_TRUE;
+
+		// 4. Store the linked program for next time
+		if (!this->cachePath.empty() && success)
+			saveBinary(this->program, this->cachePath);
+		this->loadUniforms();
+		this->buildTime += elapsedMs(start);
+	}
+
+	// Lets the driver compile on as many threads as it likes, returns false if it does not support compiling in parallel
+	static bool enableParallelCompile()
+	{
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		else if (GLEW_ARB_parallel_shader_compile)
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		return parallelCompileSupported();
+	}
+
+	// Set to false to compile every program, for timing the compiler
+	static bool& binaryCacheEnabled()
+	{
+		static bool enabled = true;
+		return enabled;
+	}
+
+	// Use the program, skipped by GLState if it is in use already
+	void use()
+	{
+		if (this->pending)
+			this->finish();
+		GLState::current().useProgram(this->program);
+	}
+
+	// Uniform setters, the program must be in use like with glUniform*
+	void setFloat(const char* name, GLfloat value)
+	{
+		UniformSlot* slot = this->findUniform(name);
+		if (slot != nullptr && slot->update(&value, 1))
+			glUniform1f(slot->location, value);
+	}
+
+	void setVec3(const char* name, GLfloat x, GLfloat y, GLfloat z)
+	{
+		GLfloat value[3] = { x, y, z };
+		UniformSlot* slot = this->findUniform(name);
+		if (slot != nullptr && slot->update(value, 3))
+			glUniform3fv(slot->location, 1, value);
+	}
+
+	void setVec3(const char* name, const glm::vec3& value) { this->setVec3(name, value.x, value.y, value.z); }
+
+	void setMat4(const char* name, const glm::mat4& value)
+	{
+		UniformSlot* slot = this->findUniform(name);
+		if (slot != nullptr && slot->update(glm::value_ptr(value), 16))
+			glUniformMatrix4fv(slot->location, 1, GL_FALSE, glm::value_ptr(value));
+	}
+
+	// Location of an active uniform from the table, -1 if the program has no such uniform. Waits for a deferred shader like use().
+	GLint uniformLocation(const char* name)
+	{
+		if (this->pending)
+			this->finish();
+		UniformSlot* slot = this->findUniform(name);
+		return slot != nullptr ? slot->location : -1;
+	}
+
+	// Counters shared by all shaders, call resetFrameStats() once at the start of each frame
+	static UniformStats& frameStats()
+	{
+		static UniformStats stats = { 0, 0 };
+		return stats;
+	}
+
+	static void resetFrameStats()
+	{
+		frameStats().callsIssued = 0;
+		frameStats().callsSaved = 0;
+	}
+
+private:
+	// One active uniform, with the last value uploaded so repeated values can be skipped
+	struct UniformSlot
+	{
+		std::string name;
+		uint32_t nameHash;
+		GLint location;
+		bool hasValue;
+		GLfloat value[16];
+
+		UniformSlot() : nameHash(0), location(-1), hasValue(false) {}
+
+		// Stores the new value, returns true if it differs from the last upload and has to be sent to GL
+		bool update(const GLfloat* newValue, int count)
+		{
+			UniformStats& stats = frameStats();
+			stats.callsSaved++; // the glGetUniformLocation call
+			if (this->hasValue && memcmp(this->value, newValue, count * sizeof(GLfloat)) == 0) {
+				stats.callsSaved++;
+				return false;
+			}
+			memcpy(this->value, newValue, count * sizeof(GLfloat));
+			this->hasValue = true;
+			stats.callsIssued++;
+			return true;
+		}
+	};
+
+	// Open addressing hash table of the active uniforms, the size is a power of two
+	std::vector<UniformSlot> uniforms;
+
+	static uint32_t hashName(const char* name)
+	{
+		uint32_t h = 2166136261u;
+		for (; *name; name++) {
+			h ^= (unsigned char)*name;
+			h *= 16777619u;
+		}
+		return h;
+	}
+
+	// Reads every active uniform once after linking
+	void loadUniforms()
+	{
+		// attach the per-frame block to its fixed binding point
+		GLuint frameBlock = glGetUniformBlockIndex(this->program, FRAME_UNIFORM_BLOCK);
+		if (frameBlock != GL_INVALID_INDEX)
+			glUniformBlockBinding(this->program, frameBlock, FRAME_UNIFORM_BINDING);
+
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(this->program, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(this->program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		size_t capacity = 1;
+		while (capacity < (size_t)count * 2)
+			capacity *= 2;
+		this->uniforms.assign(capacity, UniformSlot());
+
+		std::vector<GLchar> nameBuffer(maxLength + 1);
+		for (GLint i = 0; i < count; i++) {
+			GLint size;
+			GLenum type;
+			glGetActiveUniform(this->program, i, (GLsizei)nameBuffer.size(), NULL, &size, &type, &nameBuffer[0]);
+			std::string name(&nameBuffer[0]);
+			GLint location = glGetUniformLocation(this->program, name.c_str());
+			// uniforms inside a uniform block have no location
+			if (location < 0)
+				continue;
+			// arrays are reported as "name[0]", store them under "name"
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+				name.erase(name.size() - 3);
+			uint32_t h = hashName(name.c_str());
+			size_t index = h & (capacity - 1);
+			while (this->uniforms[index].location >= 0)
+				index = (index + 1) & (capacity - 1);
+			UniformSlot& slot = this->uniforms[index];
+			slot.name = name;
+			slot.nameHash = h;
+			slot.location = location;
+			slot.hasValue = false;
+		}
+	}
+
+	UniformSlot* findUniform(const char* name)
+	{
+		if (this->uniforms.empty())
+			return nullptr;
+		uint32_t h = hashName(name);
+		size_t mask = this->uniforms.size() - 1;
+		for (size_t index = h & mask; this->uniforms[index].location >= 0; index = (index + 1) & mask) {
+			UniformSlot& slot = this->uniforms[index];
+			if (slot.nameHash == h && slot.name == name)
+				return &slot;
+		}
+		return nullptr;
+	}
+
+	// Header written in front of the driver's binary blob
+	struct CacheHeader
+	{
+		char magic[4];
+		GLenum format;
+		GLint length;
+	};
+
+	static double elapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Program binaries need GL 4.1 or ARB_get_program_binary, and a driver that exposes at least one format
+	static bool binaryCacheSupported()
+	{
+		if (!GLEW_ARB_get_program_binary)
+			return false;
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	// GL_COMPLETION_STATUS_KHR has the same value in ARB_parallel_shader_compile
+	static bool parallelCompileSupported()
+	{
+		return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+	}
+
+	// 64 bit FNV-1a hash
+	static uint64_t hash(const char* data, size_t length, uint64_t h = 14695981039346656037ULL)
+	{
+		for (size_t i = 0; i < length; i++) {
+			h ^= (unsigned char)data[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	static uint64_t hashString(const GLubyte* text, uint64_t h)
+	{
+		const char* str = text ? reinterpret_cast<const char*>(text) : "";
+		// include the terminator so "ab"+"c" and "a"+"bc" give different keys
+		return hash(str, strlen(str) + 1, h);
+	}
+
+	static std::string cacheFilePath(const GLchar* vertexCode, GLint vertexLength, const GLchar* fragmentCode, GLint fragmentLength)
+	{
+		// each source followed by a 0, so "ab"+"c" and "a"+"bc" give different keys
+		uint64_t h = hash(vertexCode, vertexLength);
+		h = hash("", 1, h);
+		h = hash(fragmentCode, fragmentLength, h);
+		h = hash("", 1, h);
+		h = hashString(glGetString(GL_VENDOR), h);
+		h = hashString(glGetString(GL_RENDERER), h);
+		h = hashString(glGetString(GL_VERSION), h);
+		char name[17];
+		for (int i = 0; i < 16; i++)
+			name[i] = "0123456789abcdef"[(h >> (60 - i * 4)) & 0xF];
+		name[16] = '\0';
+		return std::string(SHADER_CACHE_DIR) + "/" + name + ".bin";
+	}
+
+	static bool loadBinary(GLuint program, const std::string& path)
+	{
+		std::ifstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		CacheHeader header;
+		if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || memcmp(header.magic, "SHBC", 4) != 0 || header.length <= 0)
+			return false;
+		std::vector<char> binary(header.length);
+		if (!file.read(&binary[0], header.length))
+			return false;
+		glProgramBinary(program, header.format, &binary[0], header.length);
+		// the driver can refuse a binary from an older version, that is reported as a link failure
+		GLint success = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		return success == GL_TRUE;
+	}
+
+	static void saveBinary(GLuint program, const std::string& path)
+	{
+		CacheHeader header;
+		memcpy(header.magic, "SHBC", 4);
+		header.length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+		if (header.length <= 0)
+			return;
+		std::vector<char> binary(header.length);
+		glGetProgramBinary(program, header.length, NULL, &header.format, &binary[0]);
+#ifdef _WIN32
+		_mkdir(SHADER_CACHE_DIR);
+#else
+		mkdir(SHADER_CACHE_DIR, 0755);
+#endif
+		std::ofstream file(path.c_str(), std::ios::binary);
+		if (!file) {
+			std::cout << "WARNING::SHADER::CACHE_NOT_WRITABLE " << path << std::endl;
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(&binary[0], header.length);
+	}
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+// GL Includes
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+
+// to describe a vertex format once and point the attributes at it from the description:
+// 1. list the attributes, each starts after the previous one
+//		VertexLayout layout;
+//		layout.add(0, 3, GL_UNSIGNED_SHORT, GL_TRUE).add(1, 3, GL_UNSIGNED_BYTE, GL_TRUE);
+// 2. with the VAO and the vertex buffer bound, set the attribute pointers, apply(renderer) does the same for the SoftwareRenderer
+//		layout.apply();
+// or pack a mesh of Position(x,y,z), Colour(r,g,b) floats, colours 0-255, into a compact format that comes with its layout
+//		CompactVertices compact;
+//		compact.pack(&vertices[0], vertexCount, BUILDING_VERTEX_SIZE, VERTEX_POSITION_UNORM16);
+//		glBufferData(GL_ARRAY_BUFFER, compact.data.size(), &compact.data[0], GL_STATIC_DRAW);
+//		compact.layout.apply();
+//		shader.setVec3("meshScale", compact.scale);
+//		shader.setVec3("meshOffset", compact.offset);
+// The shader gets the model space position back with position * meshScale + meshOffset,
+// and colours arrive normalized to 0-1 so there is nothing to divide by 255.
+
+// How CompactVertices stores positions
+enum VertexPositionFormat
+{
+	VERTEX_POSITION_FLOAT,		// 12 bytes, exact
+	VERTEX_POSITION_UNORM16,	// 6 bytes, 65536 steps across the mesh's bounding box on each axis
+	VERTEX_POSITION_HALF		// 6 bytes, 11 significant bits, the mesh's own coordinates
+};
+
+// One attribute, offset is from the start of the vertex
+struct VertexAttribute
+{
+	GLuint location;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLuint offset;
+};
+
+class VertexLayout
+{
+public:
+	std::vector<VertexAttribute> attributes;
+	// Bytes per vertex
+	GLsizei stride;
+
+	VertexLayout() : stride(0) {}
+
+	// Appends an attribute. Attributes start on 4 bytes and the stride is a multiple of 4, as some GPUs fetch unaligned attributes slowly.
+	VertexLayout& add(GLuint location, GLint size, GLenum type, GLboolean normalized = GL_FALSE)
+	{
+		VertexAttribute attribute;
+		attribute.location = location;
+		attribute.size = size;
+		attribute.type = type;
+		attribute.normalized = normalized;
+		attribute.offset = (GLuint)this->stride;
+		this->attributes.push_back(attribute);
+		this->stride = (this->stride + size * typeSize(type) + 3) & ~3;
+		return *this;
+	}
+
+	// Points the attributes of the bound VAO at the bound GL_ARRAY_BUFFER
+	void apply() const
+	{
+		for (size_t i = 0; i < this->attributes.size(); i++) {
+			const VertexAttribute& attribute = this->attributes[i];
+			glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, this->stride, (GLvoid*)(uintptr_t)attribute.offset);
+			glEnableVertexAttribArray(attribute.location);
+		}
+	}
+
+	// The same for a renderer with GL's calls as methods, such as SoftwareRenderer
+	template <typename Renderer>
+	void apply(Renderer& renderer) const
+	{
+		for (size_t i = 0; i < this->attributes.size(); i++) {
+			const VertexAttribute& attribute = this->attributes[i];
+			renderer.vertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, this->stride, attribute.offset);
+			renderer.enableVertexAttribArray(attribute.location);
+		}
+	}
+
+	static GLsizei typeSize(GLenum type)
+	{
+		switch (type) {
+		case GL_UNSIGNED_BYTE: case GL_BYTE: return 1;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return 2;
+		default: return 4;
+		}
+	}
+};
+
+// IEEE half float with round to nearest even, values too small for a half become 0 and too large become infinity
+inline uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t exponent = (bits >> 23) & 0xFF;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	if (exponent == 0xFF)
+		return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);	// infinity or NaN
+	int halfExponent = (int)exponent - 127 + 15;
+	if (halfExponent >= 0x1F)
+		return sign | 0x7C00;
+	if (halfExponent <= 0)
+		return sign;
+	uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1FFF;
+	// a carry out of the mantissa moves to the next exponent, which is still the right value
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0))
+		half++;
+	return (uint16_t)(sign | std::min(half, (uint32_t)0x7C00));
+}
+
+// The float a half float stands for
+inline GLfloat halfToFloat(uint16_t half)
+{
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1F;
+	uint32_t mantissa = half & 0x3FF;
+	uint32_t bits;
+	if (exponent == 0x1F)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else if (exponent != 0)
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	else {
+		// subnormal, exact in a float
+		GLfloat value = mantissa / 16777216.0f;
+		return sign != 0 ? -value : value;
+	}
+	GLfloat value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// A mesh of position and colour floats packed into a VertexPositionFormat position and 3 normalized bytes of colour
+class CompactVertices
+{
+public:
+	std::vector<unsigned char> data;
+	VertexLayout layout;
+	// model space position = stored position * scale + offset, the stored position being 0-1 for VERTEX_POSITION_UNORM16
+	glm::vec3 scale;
+	glm::vec3 offset;
+	// Largest distance on any axis between a packed position and the float one
+	GLfloat maxError;
+
+	CompactVertices() : scale(1.0f, 1.0f, 1.0f), offset(0.0f, 0.0f, 0.0f), maxError(0.0f) {}
+
+	// vertices are count runs of vertexSize floats starting with Position(x,y,z), Colour(r,g,b) in 0-255
+	void pack(const GLfloat* vertices, size_t count, int vertexSize, VertexPositionFormat format)
+	{
+		this->layout = VertexLayout();
+		GLenum positionType = format == VERTEX_POSITION_UNORM16 ? GL_UNSIGNED_SHORT : format == VERTEX_POSITION_HALF ? GL_HALF_FLOAT : GL_FLOAT;
+		this->layout.add(0, 3, positionType, format == VERTEX_POSITION_UNORM16 ? GL_TRUE : GL_FALSE);
+		this->layout.add(1, 3, GL_UNSIGNED_BYTE, GL_TRUE);
+		this->data.assign(count * this->layout.stride, 0);
+		this->scale = glm::vec3(1.0f, 1.0f, 1.0f);
+		this->offset = glm::vec3(0.0f, 0.0f, 0.0f);
+		this->maxError = 0.0f;
+		if (count == 0)
+			return;
+		if (format == VERTEX_POSITION_UNORM16) {
+			glm::vec3 min(vertices[0], vertices[1], vertices[2]), max = min;
+			for (size_t v = 1; v < count; v++) {
+				const GLfloat* p = vertices + v * vertexSize;
+				min = glm::vec3(std::min(min.x, p[0]), std::min(min.y, p[1]), std::min(min.z, p[2]));
+				max = glm::vec3(std::max(max.x, p[0]), std::max(max.y, p[1]), std::max(max.z, p[2]));
+			}
+			this->offset = min;
+			// a flat axis keeps a scale of 1 so it is not divided by 0
+			glm::vec3 extent = max - min;
+			this->scale = glm::vec3(extent.x > 0.0f ? extent.x : 1.0f, extent.y > 0.0f ? extent.y : 1.0f, extent.z > 0.0f ? extent.z : 1.0f);
+		}
+		GLuint colourOffset = this->layout.attributes[1].offset;
+		for (size_t v = 0; v < count; v++) {
+			const GLfloat* in = vertices + v * vertexSize;
+			unsigned char* out = &this->data[v * this->layout.stride];
+			for (int axis = 0; axis < 3; axis++) {
+				GLfloat unpacked;
+				if (format == VERTEX_POSITION_UNORM16) {
+					GLfloat normalized = (in[axis] - this->offset[axis]) / this->scale[axis];
+					uint16_t value = (uint16_t)(std::min(std::max(normalized, 0.0f), 1.0f) * 65535.0f + 0.5f);
+					std::memcpy(out + axis * 2, &value, 2);
+					unpacked = value / 65535.0f * this->scale[axis] + this->offset[axis];
+				}
+				else if (format == VERTEX_POSITION_HALF) {
+					uint16_t value = floatToHalf(in[axis]);
+					std::memcpy(out + axis * 2, &value, 2);
+					unpacked = halfToFloat(value);
+				}
+				else {
+					std::memcpy(out + axis * 4, &in[axis], 4);
+					unpacked = in[axis];
+				}
+				this->maxError = std::max(this->maxError, std::abs(unpacked - in[axis]));
+			}
+			for (int channel = 0; channel < 3; channel++)
+				out[colourOffset + channel] = (unsigned char)std::min(std::max(in[3 + channel] + 0.5f, 0.0f), 255.0f);
+		}
+	}
+};
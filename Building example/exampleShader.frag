@@ -7,5 +7,5 @@ out vec4 color; // final output
 uniform sampler2D picture;
 
 void main() {
-	color = vec4(outColor/255, 1.0f);
+	color = vec4(outColor, 1.0f);
 }
\ No newline at end of file
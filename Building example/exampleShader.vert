@@ -1,15 +1,18 @@
 #version 330
 
-layout (location = 0) in vec3 position; // corresponds to glVertexAttribPointer(0,...)
-layout (location = 1) in vec3 myColor; // corresponds to glVertexAttribPointer(1,...)
+layout (location = 0) in vec3 position; // quantized, see VertexLayout.h
+layout (location = 1) in vec3 myColor; // normalized bytes, arrives as 0-1
+layout (location = 2) in mat4 instanceModel; // per instance, takes locations 2 to 5, see InstanceBuffer.h
+layout (location = 6) in vec3 instanceTint; // per instance
 
 out vec3 outColor; // transfer color to fragment shader
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform vec3 meshScale; // model space position = position * meshScale + meshOffset
+uniform vec3 meshOffset;
+
+#include "transform.glsl"
 
 void main() {
-	gl_Position = projection * view * model * vec4(position, 1.0f);
-	outColor = myColor;
+	gl_Position = transform(instanceModel, position * meshScale + meshOffset);
+	outColor = myColor * instanceTint;
 }
\ No newline at end of file
@@ -16,13 +16,51 @@
 
 // C++ includes
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <new>
 
 // Shader class
 #include "Shader.h"
 
+// Shadowed GL state, skips binds and switches that change nothing
+#include "GLState.h"
+
 // Camera class
 #include "Camera.h"
 
+// Per-frame uniform buffer
+#include "FrameUniforms.h"
+
+// CPU renderer for machines without a GPU
+#include "SoftwareRenderer.h"
+
+// Procedural building mesh
+#include "BuildingGenerator.h"
+
+// Per-instance transforms for drawing many buildings at once
+#include "InstanceBuffer.h"
+
+// Shaders and mesh mapped from one file
+#include "AssetPack.h"
+
+// Draw packets recorded on any thread and replayed in key order
+#include "RenderQueue.h"
+
+// Vertex welding and cache, overdraw and fetch ordering of meshes
+#include "MeshOptimizer.h"
+
+// Vertex formats described once, quantized positions and byte colours
+#include "VertexLayout.h"
+
 // temporary globals
 bool lockCursor = true; // (un)lock cursor in window by pressing C
 bool wireframeMode = false; // show wireframe in window by pressing F
@@ -33,6 +71,19 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void movement();
+int runHeadless(int frames, bool dumpFrames, int kernel, int cityCount, bool checkAllocs = false);
+void generateBuilding(BuildingGenerator& building, bool optimize = true);
+bool checkBuilding();
+void benchBuilding();
+void buildCity(InstanceBuffer& city, int count);
+void animateCity(InstanceBuffer& instances, GLfloat time);
+void placeCityCamera(int count);
+void cullCity(Camera& camera, const InstanceBuffer& city, InstanceBuffer& drawn);
+void benchCull();
+void benchQueue();
+void benchVertexFormat();
+bool writeAssetPack();
+void benchPack();
 
 // Window dimensions
 const GLuint WIDTH = 800, HEIGHT = 600;
@@ -42,6 +93,79 @@ GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
 GLfloat currentFrame = 0.0f;
 
+// uniform calls, state calls, queued draws and instance uploads of the previous frame, printed by pressing I
+UniformStats lastFrameStats = { 0, 0 };
+GLStateStats lastStateStats = { 0, 0 };
+RenderQueueStats lastQueueStats = { 0, 0, 0, 0 };
+InstanceUploadStats lastInstanceUpload = { 0, 0 };
+// frustum culling of the city, toggled by pressing K
+bool cullingEnabled = true;
+double lastCullTime = 0.0; // microseconds
+
+// --check-allocs, every operator new of the process is counted while countAllocations is set.
+// Frames after the warm up must not allocate, per-frame data goes to reused vectors and FrameArena instead.
+const int ALLOC_CHECK_WARMUP_FRAMES = 10;
+const int ALLOC_CHECK_FRAMES = 100;
+std::atomic<bool> countAllocations(false);
+std::atomic<unsigned> heapAllocations(0);
+
+void* operator new(size_t size)
+{
+	if (countAllocations.load(std::memory_order_relaxed))
+		heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	void* memory = std::malloc(size != 0 ? size : 1);
+	if (memory == nullptr)
+		throw std::bad_alloc();
+	return memory;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+
+// Counts the allocations of the frames after the warm up, beginFrame() at the top of every frame
+class AllocationCheck
+{
+public:
+	AllocationCheck() : frame(0), total(0), worst(0) {}
+
+	// Returns false once every frame has been checked
+	bool beginFrame()
+	{
+		// the previous frame was counted
+		if (this->frame > ALLOC_CHECK_WARMUP_FRAMES) {
+			unsigned count = heapAllocations.exchange(0);
+			this->total += count;
+			this->worst = std::max(this->worst, count);
+		}
+		if (this->frame == ALLOC_CHECK_WARMUP_FRAMES) {
+			heapAllocations = 0;
+			countAllocations = true;
+		}
+		if (this->frame++ < ALLOC_CHECK_WARMUP_FRAMES + ALLOC_CHECK_FRAMES)
+			return true;
+		countAllocations = false;
+		return false;
+	}
+
+	// Prints the result, returns the exit code
+	int report() const
+	{
+		if (this->total == 0) {
+			std::cout << "No heap allocations in " << ALLOC_CHECK_FRAMES << " frames after " << ALLOC_CHECK_WARMUP_FRAMES << " warm up frames" << std::endl;
+			return 0;
+		}
+		std::cout << "ERROR::FRAME::HEAP_ALLOCATIONS " << this->total << " in " << ALLOC_CHECK_FRAMES << " frames, up to " << this->worst << " in one frame" << std::endl;
+		return 1;
+	}
+
+private:
+	int frame;
+	unsigned total;
+	unsigned worst;
+};
+
 //camera 
 Camera camera;
 GLfloat lastX = WIDTH / 2.0;
@@ -53,9 +177,841 @@ bool keys[1024];
 // light
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
+// city mode, copies of the building on a grid drawn with a single instanced draw call
+const GLfloat CITY_SPACING = 5.0f;
+const int CITY_MOVING_STRIDE = 64; // every 64th building spins, the rest never need uploading again
+const int cityBenchCounts[] = { 1, 10, 100, 1000, 10000, 100000 };
+const int CITY_BENCH_FRAMES = 20;
+// bounds of every building for culling, and the buildings that passed last frame
+CullBoxes cityBounds;
+std::vector<uint32_t> visibleBuildings;
+// camera version visibleBuildings was culled with, 0 when the city or culling changed
+unsigned visibleCameraVersion = 0;
+
+// building mesh, filled in by BuildingGenerator at startup and optimized for the vertex cache
+std::vector<GLfloat> vertices;
+std::vector<GLuint> indices;
+MeshOptimizer meshOptimizer;
+// how the building's positions are stored on the GPU, colours are always normalized bytes
+VertexPositionFormat buildingPositionFormat = VERTEX_POSITION_UNORM16;
+const char* positionFormatNames[] = { "float", "unorm16", "half" };
+
+// hand made building mesh, 346 vertices and 206 triangles
+// no longer drawn, kept so --check-building can compare the generator against it
+const GLfloat referenceVertices[] = {
+	// Position(x,y,z),  Colour(r,g,b)
+	// 128,64,0, door
+	// 128,255,255, glass
+	// 128,128,128, wall
+	// shader divides value by 255 to get the correct color required
+
+	// vertices based on picture
+	// walls
+	//   front face
+	0,0,0,				128,128,128,	//0
+	0.25,0,0,			128,128,128,
+	0.75,0,0,			128,128,128,
+	1.25,0,0,			128,128,128,
+	1.35,0,0,			128,128,128,	// bottom left of door
+	1.65,0,0,			128,128,128,	// bottom right of door
+	1.75,0,0,			128,128,128,
+	2.25,0,0,			128,128,128,
+	2.75,0,0,			128,128,128,
+	3,0,0,				128,128,128,	// 9
+
+	0.25,0.25,0,		128,128,128,	// 10
+	0.75,0.25,0,		128,128,128,
+	2.25,0.25,0,		128,128,128,
+	2.75,0.25,0,		128,128,128,
+	
+	0.25,0.75,0,		128,128,128,
+	0.75,0.75,0,		128,128,128,
+	2.25,0.75,0,		128,128,128,
+	2.75,0.75,0,		128,128,128,
+
+	1.35,0.85,0,		128,128,128,	// top left of door
+	1.65,0.85,0,		128,128,128,	// top right of door
+
+	0.25,1.25,0,		128,128,128,	// 20
+	0.75,1.25,0,		128,128,128,
+	1.25,1.25,0,		128,128,128,
+	1.35,1.25,0,		128,128,128,	// above door left
+	1.65,1.25,0,		128,128,128,	// above door right
+	1.75,1.25,0,		128,128,128,
+	2.25,1.25,0,		128,128,128,
+	2.75,1.25,0,		128,128,128,
+
+	0.25,1.75,0,		128,128,128,
+	0.75,1.75,0,		128,128,128,
+	1.25,1.75,0,		128,128,128,	// 30
+	1.75,1.75,0,		128,128,128,
+	2.25,1.75,0,		128,128,128,
+	2.75,1.75,0,		128,128,128,
+
+	0.25,2.25,0,		128,128,128,
+	0.75,2.25,0,		128,128,128,
+	1.25,2.25,0,		128,128,128,
+	1.75,2.25,0,		128,128,128,
+	2.25,2.25,0,		128,128,128,
+	2.75,2.25,0,		128,128,128,
+
+	0.25,2.75,0,		128,128,128,	// 40
+	0.75,2.75,0,		128,128,128,
+	1.25,2.75,0,		128,128,128,
+	1.75,2.75,0,		128,128,128,
+	2.25,2.75,0,		128,128,128,
+	2.75,2.75,0,		128,128,128,
+
+	0,3,0,				128,128,128,	// 46
+	0.25,3,0,			128,128,128,
+	0.75,3,0,			128,128,128,
+	1.25,3,0,			128,128,128,
+	1.75,3,0,			128,128,128,	// 50
+	2.25,3,0,			128,128,128,
+	2.75,3,0,			128,128,128,
+	3,3,0,				128,128,128,	// 53
+
+	//   right face
+
+	//3, 0, 0, already included as vertex 9
+	3, 0, -0.25,		128,128,128,
+	3, 0, -0.75,		128,128,128,
+	3, 0, -1.25,		128,128,128,
+	3, 0, -1.75,		128,128,128,
+	3, 0, -2.25,		128,128,128,
+	3, 0, -2.75,		128,128,128,
+	3, 0, -3,			128,128,128,	// 60
+
+	3, 0.25,-0.25,		128,128,128,
+	3, 0.25,-0.75,		128,128,128,
+	3, 0.25,-1.25,		128,128,128,
+	3, 0.25,-1.75,		128,128,128,
+	3, 0.25,-2.25,		128,128,128,
+	3, 0.25,-2.75,		128,128,128,
+	
+	3, 0.75, -0.25,		128,128,128,
+	3, 0.75, -0.75,		128,128,128,
+	3, 0.75, -1.25,		128,128,128,
+	3, 0.75, -1.75,		128,128,128,	// 70
+	3, 0.75, -2.25,		128,128,128,
+	3, 0.75, -2.75,		128,128,128,
+
+	3, 1.25, -0.25,		128,128,128,
+	3, 1.25, -0.75,		128,128,128,
+	3, 1.25, -1.25,		128,128,128,
+	3, 1.25, -1.75,		128,128,128,
+	3, 1.25, -2.25,		128,128,128,
+	3, 1.25, -2.75,		128,128,128,
+
+	3, 1.75, -0.25,		128,128,128,
+	3, 1.75, -0.75,		128,128,128,	// 80
+	3, 1.75, -1.25,		128,128,128,
+	3, 1.75, -1.75,		128,128,128,
+	3, 1.75, -2.25,		128,128,128,
+	3, 1.75, -2.75,		128,128,128,
+
+	3, 2.25, -0.25,		128,128,128,
+	3, 2.25, -0.75,		128,128,128,
+	3, 2.25, -1.25,		128,128,128,
+	3, 2.25, -1.75,		128,128,128,
+	3, 2.25, -2.25,		128,128,128,
+	3, 2.25, -2.75,		128,128,128,	// 90
+
+	3, 2.75, -0.25,		128,128,128,
+	3, 2.75, -0.75,		128,128,128,
+	3, 2.75, -1.25,		128,128,128,
+	3, 2.75, -1.75,		128,128,128,
+	3, 2.75, -2.25,		128,128,128,
+	3, 2.75, -2.75,		128,128,128,
+
+	// 3, 3, 0, already included as vertex 53
+	3, 3, -0.25,		128,128,128,
+	3, 3, -0.75,		128,128,128,
+	3, 3, -1.25,		128,128,128,
+	3, 3, -1.75,		128,128,128,	// 100
+	3, 3, -2.25,		128,128,128,
+	3, 3, -2.75,		128,128,128,
+	3, 3, -3,			128,128,128,	// 103
+
+	//  back face
+
+	//3   , 0, -3, already included as vertex 60
+	2.75, 0, -3,		128,128,128,
+	2.25, 0, -3,		128,128,128,
+	1.75, 0, -3,		128,128,128,
+	1.25, 0, -3,		128,128,128,
+	0.75, 0, -3,		128,128,128,
+	0.25, 0, -3,		128,128,128,
+	0   , 0, -3,		128,128,128,	// 110
+
+	2.75, 0.25, -3,		128,128,128,
+	2.25, 0.25, -3,		128,128,128,
+	1.75, 0.25, -3,		128,128,128,
+	1.25, 0.25, -3,		128,128,128,
+	0.75, 0.25, -3,		128,128,128,
+	0.25, 0.25, -3,		128,128,128,
+				
+	2.75, 0.75, -3,		128,128,128,
+	2.25, 0.75, -3,		128,128,128,
+	1.75, 0.75, -3,		128,128,128,
+	1.25, 0.75, -3,		128,128,128,	// 120
+	0.75, 0.75, -3,		128,128,128,
+	0.25, 0.75, -3,		128,128,128,
+				
+	2.75, 1.25, -3,		128,128,128,
+	2.25, 1.25, -3,		128,128,128,
+	1.75, 1.25, -3,		128,128,128,
+	1.25, 1.25, -3,		128,128,128,
+	0.75, 1.25, -3,		128,128,128,
+	0.25, 1.25, -3,		128,128,128,
+				
+	2.75, 1.75, -3,		128,128,128,
+	2.25, 1.75, -3,		128,128,128,	// 130
+	1.75, 1.75, -3,		128,128,128,
+	1.25, 1.75, -3,		128,128,128,
+	0.75, 1.75, -3,		128,128,128,
+	0.25, 1.75, -3,		128,128,128,
+
+	2.75, 2.25, -3,		128,128,128,
+	2.25, 2.25, -3,		128,128,128,
+	1.75, 2.25, -3,		128,128,128,
+	1.25, 2.25, -3,		128,128,128,
+	0.75, 2.25, -3,		128,128,128,
+	0.25, 2.25, -3,		128,128,128,	// 140
+				
+	2.75, 2.75, -3,		128,128,128,
+	2.25, 2.75, -3,		128,128,128,
+	1.75, 2.75, -3,		128,128,128,
+	1.25, 2.75, -3,		128,128,128,
+	0.75, 2.75, -3,		128,128,128,
+	0.25, 2.75, -3,		128,128,128,
+
+	// 3,3, -3, already included as vertex 103
+	2.75, 3, -3,		128,128,128,
+	2.25, 3, -3,		128,128,128,
+	1.75, 3, -3,		128,128,128,
+	1.25, 3, -3,		128,128,128,	// 150
+	0.75, 3, -3,		128,128,128,
+	0.25, 3, -3,		128,128,128,
+	0, 3, -3,			128,128,128,	// 153
+
+	//   left face
+
+	// 0, 0, -3, already included as vertex 110
+	0, 0, -2.75,		128,128,128,
+	0, 0, -2.25,		128,128,128,
+	0, 0, -1.75,		128,128,128,
+	0, 0, -1.25,		128,128,128,
+	0, 0, -0.75,		128,128,128,
+	0, 0, -0.25,		128,128,128,
+	// 0, 0, 0, already included as vertex 0
+
+	0, 0.25, -2.75,		128,128,128,	// 160
+	0, 0.25, -2.25,		128,128,128,
+	0, 0.25, -1.75,		128,128,128,
+	0, 0.25, -1.25,		128,128,128,
+	0, 0.25, -0.75,		128,128,128,
+	0, 0.25, -0.25,		128,128,128,
+
+	0, 0.75, -2.75,		128,128,128,
+	0, 0.75, -2.25,		128,128,128,
+	0, 0.75, -1.75,		128,128,128,
+	0, 0.75, -1.25,		128,128,128,
+	0, 0.75, -0.75,		128,128,128,	// 170
+	0, 0.75, -0.25,		128,128,128,
+
+	0, 1.25, -2.75,		128,128,128,
+	0, 1.25, -2.25,		128,128,128,
+	0, 1.25, -1.75,		128,128,128,
+	0, 1.25, -1.25,		128,128,128,
+	0, 1.25, -0.75,		128,128,128,
+	0, 1.25, -0.25,		128,128,128,
+
+	0, 1.75, -2.75,		128,128,128,
+	0, 1.75, -2.25,		128,128,128,
+	0, 1.75, -1.75,		128,128,128,	// 180
+	0, 1.75, -1.25,		128,128,128,
+	0, 1.75, -0.75,		128,128,128,
+	0, 1.75, -0.25,		128,128,128,
+
+	0, 2.25, -2.75,		128,128,128,
+	0, 2.25, -2.25,		128,128,128,
+	0, 2.25, -1.75,		128,128,128,
+	0, 2.25, -1.25,		128,128,128,
+	0, 2.25, -0.75,		128,128,128,
+	0, 2.25, -0.25,		128,128,128,
+
+	0, 2.75, -2.75,		128,128,128,	// 190
+	0, 2.75, -2.25,		128,128,128,
+	0, 2.75, -1.75,		128,128,128,
+	0, 2.75, -1.25,		128,128,128,
+	0, 2.75, -0.75,		128,128,128,
+	0, 2.75, -0.25,		128,128,128,
+
+	// 0, 3, -3, already included as vertex 153
+	0, 3, -2.75,		128,128,128,
+	0, 3, -2.25,		128,128,128,
+	0, 3, -1.75,		128,128,128,
+	0, 3, -1.25,		128,128,128,
+	0, 3, -0.75,		128,128,128,	// 200
+	0, 3, -0.25,		128,128,128,
+	// 0, 3, 0, already included as vertex 46
+
+	// windows
+
+	0.25, 0.25, 0,		128,255,255,	// 202
+	0.75, 0.25, 0,		128,255,255,
+	2.25, 0.25, 0,		128,255,255,
+	2.75, 0.25, 0,		128,255,255,
+
+	0.25, 0.75, 0,		128,255,255,	
+	0.75, 0.75, 0,		128,255,255,
+	2.25, 0.75, 0,		128,255,255,
+	2.75, 0.75, 0,		128,255,255,
+
+	0.25, 1.25, 0,		128,255,255,	// 210
+	0.75, 1.25, 0,		128,255,255,
+	1.25, 1.25, 0,		128,255,255,
+	1.75, 1.25, 0,		128,255,255,
+	2.25, 1.25, 0,		128,255,255,	
+	2.75, 1.25, 0,		128,255,255,
+
+	0.25, 1.75, 0,		128,255,255,	
+	0.75, 1.75, 0,		128,255,255,
+	1.25, 1.75, 0, 		128,255,255,
+	1.75, 1.75, 0,		128,255,255,
+	2.25, 1.75, 0,		128,255,255,	// 220
+	2.75, 1.75, 0,		128,255,255,
+
+	0.25, 2.25, 0,		128,255,255,	
+	0.75, 2.25, 0,		128,255,255,
+	1.25, 2.25, 0,		128,255,255,
+	1.75, 2.25, 0,		128,255,255,
+	2.25, 2.25, 0,		128,255,255,	
+	2.75, 2.25, 0,		128,255,255,
+
+	0.25, 2.75, 0,		128,255,255,	
+	0.75, 2.75, 0,		128,255,255,
+	1.25, 2.75, 0,		128,255,255,	// 230
+	1.75, 2.75, 0,		128,255,255,
+	2.25, 2.75, 0,		128,255,255,	
+	2.75, 2.75, 0,		128,255,255,
+
+			 //   right face
+
+	3, 0.25, -0.25,		128,255,255,	
+	3, 0.25, -0.75,		128,255,255,
+	3, 0.25, -1.25,		128,255,255,
+	3, 0.25, -1.75,		128,255,255,
+	3, 0.25, -2.25,		128,255,255,	
+	3, 0.25, -2.75,		128,255,255,
+
+	3, 0.75, -0.25,		128,255,255,	// 240
+	3, 0.75, -0.75,		128,255,255,
+	3, 0.75, -1.25,		128,255,255,
+	3, 0.75, -1.75,		128,255,255,
+	3, 0.75, -2.25,		128,255,255,	
+	3, 0.75, -2.75,		128,255,255,
+
+	3, 1.25, -0.25,		128,255,255,	
+	3, 1.25, -0.75,		128,255,255,
+	3, 1.25, -1.25,		128,255,255,
+	3, 1.25, -1.75,		128,255,255,
+	3, 1.25, -2.25,		128,255,255,	// 250
+	3, 1.25, -2.75,		128,255,255,
+
+	3, 1.75, -0.25,		128,255,255,	
+	3, 1.75, -0.75,		128,255,255,
+	3, 1.75, -1.25,		128,255,255,
+	3, 1.75, -1.75,		128,255,255,
+	3, 1.75, -2.25,		128,255,255,	
+	3, 1.75, -2.75,		128,255,255,
+
+	3, 2.25, -0.25,		128,255,255,	
+	3, 2.25, -0.75,		128,255,255,
+	3, 2.25, -1.25,		128,255,255,	// 260
+	3, 2.25, -1.75,		128,255,255,
+	3, 2.25, -2.25,		128,255,255,	
+	3, 2.25, -2.75,		128,255,255,
+
+	3, 2.75, -0.25,		128,255,255,	
+	3, 2.75, -0.75,		128,255,255,
+	3, 2.75, -1.25,		128,255,255,
+	3, 2.75, -1.75,		128,255,255,
+	3, 2.75, -2.25,		128,255,255,	
+	3, 2.75, -2.75,		128,255,255,
+
+			  //  back face
+
+	2.75, 0.25, -3,		128,255,255,	// 270
+	2.25, 0.25, -3,		128,255,255,
+	1.75, 0.25, -3,		128,255,255,
+	1.25, 0.25, -3,		128,255,255,
+	0.75, 0.25, -3,		128,255,255,	
+	0.25, 0.25, -3,		128,255,255,
+
+	2.75, 0.75, -3,		128,255,255,	
+	2.25, 0.75, -3,		128,255,255,
+	1.75, 0.75, -3,		128,255,255,
+	1.25, 0.75, -3,		128,255,255,
+	0.75, 0.75, -3,		128,255,255,	// 280
+	0.25, 0.75, -3,		128,255,255,
+
+	2.75, 1.25, -3,		128,255,255,	
+	2.25, 1.25, -3,		128,255,255,
+	1.75, 1.25, -3,		128,255,255,
+	1.25, 1.25, -3,		128,255,255,
+	0.75, 1.25, -3,		128,255,255,	
+	0.25, 1.25, -3,		128,255,255,
+
+	2.75, 1.75, -3,		128,255,255,	
+	2.25, 1.75, -3,		128,255,255,
+	1.75, 1.75, -3,		128,255,255,	// 290
+	1.25, 1.75, -3,		128,255,255,
+	0.75, 1.75, -3,		128,255,255,	
+	0.25, 1.75, -3,		128,255,255,
+
+	2.75, 2.25, -3,		128,255,255,	
+	2.25, 2.25, -3,		128,255,255,
+	1.75, 2.25, -3,		128,255,255,
+	1.25, 2.25, -3,		128,255,255,
+	0.75, 2.25, -3,		128,255,255,	
+	0.25, 2.25, -3,		128,255,255,
+
+	2.75, 2.75, -3,		128,255,255,	// 300
+	2.25, 2.75, -3,		128,255,255,
+	1.75, 2.75, -3,		128,255,255,
+	1.25, 2.75, -3,		128,255,255,
+	0.75, 2.75, -3,		128,255,255,	
+	0.25, 2.75, -3,		128,255,255,
+
+			  // left face
+
+	0, 0.25, -2.75,		128,255,255,	
+	0, 0.25, -2.25,		128,255,255,
+	0, 0.25, -1.75,		128,255,255,
+	0, 0.25, -1.25,		128,255,255,
+	0, 0.25, -0.75,		128,255,255,	// 310
+	0, 0.25, -0.25,		128,255,255,
+
+	0, 0.75, -2.75,		128,255,255,	
+	0, 0.75, -2.25,		128,255,255,
+	0, 0.75, -1.75,		128,255,255,
+	0, 0.75, -1.25,		128,255,255,
+	0, 0.75, -0.75,		128,255,255,	
+	0, 0.75, -0.25,		128,255,255,
+
+	0, 1.25, -2.75,		128,255,255,	
+	0, 1.25, -2.25,		128,255,255,
+	0, 1.25, -1.75,		128,255,255,	// 320
+	0, 1.25, -1.25,		128,255,255,
+	0, 1.25, -0.75,		128,255,255,	
+	0, 1.25, -0.25,		128,255,255,
+
+	0, 1.75, -2.75,		128,255,255,	
+	0, 1.75, -2.25,		128,255,255,
+	0, 1.75, -1.75,		128,255,255,
+	0, 1.75, -1.25,		128,255,255,
+	0, 1.75, -0.75,		128,255,255,	
+	0, 1.75, -0.25,		128,255,255,
+
+	0, 2.25, -2.75,		128,255,255,	// 330
+	0, 2.25, -2.25,		128,255,255,
+	0, 2.25, -1.75,		128,255,255,
+	0, 2.25, -1.25,		128,255,255,
+	0, 2.25, -0.75,		128,255,255,	
+	0, 2.25, -0.25,		128,255,255,
+
+	0, 2.75, -2.75,		128,255,255,	
+	0, 2.75, -2.25,		128,255,255,
+	0, 2.75, -1.75,		128,255,255,
+	0, 2.75, -1.25,		128,255,255,
+	0, 2.75, -0.75,		128,255,255,	// 340
+	0, 2.75, -0.25,		128,255,255,
+
+	// door
+	1.35,0,0,			128,64,0,		// 342
+	1.65,0,0,			128,64,0,
+	1.35,0.85,0,		128,64,0,
+	1.65,0.85,0,		128,64,0,		// 345
+
+}; 
+
+
+// indices useful for EBOs, especially when reusing vertices
+const GLint referenceIndices[] = {
+	// front face walls
+	0,46,47,		//1
+	0,1,47,
+
+	1,10,11,
+	1,2,11,
+	14,20,21,
+	14,15,21,
+	28,34,35,
+	28,29,35,
+	40,47,48,
+	40,41,48,		//10
+
+	2,48,49,
+	2,3,49,
+
+	// around door
+	3,22,23,
+	3,4,23,
+	18,23,24,
+	18,19,24,
+	5,24,25,
+	5,6,25,
+
+	30,36,37,
+	30,31,37,		//20
+	42,49,50,
+	42,43,50,
+
+	6,50,51,
+	6,7,51,
+
+	7,12,13,
+	7,8,13,
+	16,26,27,
+	16,17,27,
+	32,38,39,
+	32,33,39,		//30
+	44,51,52,
+	44,45,52,
+
+	8,52,53,
+	8,9,53,
+
+	// right wall
+
+	9,53,97,
+	9,54,97,
+	
+	54,61,62,
+	54,55,62,
+	67,73,74,
+	67,68,74,
+	79,85,86,
+	79,80,86,
+	91,97,98,
+	91,92,98,
+
+	55,98,99,
+	55,56,99,
+
+	56,63,64,
+	56,57,64,
+	69,75,76,
+	69,70,76,
+	81,87,88,
+	81,82,88,
+	93,99,100,
+	93,94,100,
+
+	57,100,101,
+	57,58,101,
+
+	58,65,66,
+	58,59,66,
+	71,77,78,
+	71,72,78,
+	83,89,90,
+	83,84,90,
+	95,101,102,
+	95,96,102,
+	
+	59,102,103,
+	59,60,103,
+
+	// back wall
+
+	60,103,147,
+	60,104,147,
+
+	104,111,112,
+	104,105,112,
+	117,123,124,
+	117,118,124,
+	129,135,136,
+	129,130,136,
+	141,147,148,
+	141,142,148,
+
+	105,148,149,
+	105,106,149,
+
+	106,113,114,
+	106,107,114,
+	119,125,126,
+	119,120,126,
+	131,137,138,
+	131,132,138,
+	143,149,150,
+	143,144,150,
+
+	107,150,151,
+	107,108,151,
+
+	108,115,116,
+	108,109,116,
+	121,127,128,
+	121,122,128,
+	133,139,140,
+	133,134,140,
+	145,151,152,
+	145,146,152,
+
+	109,152,153,
+	109,110,153,
+
+	// left wall
+
+	110,153,196,
+	110,154,196,
+
+	154,160,161,
+	154,155,161,
+	166,172,173,
+	166,167,173,
+	178,184,185,
+	178,179,185,
+	190,196,197,
+	190,191,197,
+
+	155,197,198,
+	155,156,198,
+
+	156,162,163,
+	156,157,163,
+	168,174,175,
+	168,169,175,
+	180,186,187,
+	180,181,187,
+	192,198,199,
+	192,193,199,
+
+	157,199,200,
+	157,158,200,
+
+	158,164,165,
+	158,159,165,
+	170,176,177,
+	170,171,177,
+	182,188,189,
+	182,183,189,
+	194,200,201,
+	194,195,201,
+
+	159,201,46,
+	159,0,46,
+
+	// bottom
+
+	0,110,60,
+	0,9,60,
+
+	// top
+
+	46,153,103,
+	46,53,103,
+
+	// windows
+	// front wall
+
+	202,206,207,
+	202,203,207,
+	210,216,217,
+	210,211,217,
+	222,228,229,
+	222,223,229,
+
+	212,218,219,
+	212,213,219,
+	224,230,231,
+	224,225,231,
+
+	204,208,209,
+	204,205,209,
+	214,220,221,
+	214,215,221,
+	226,232,233,
+	226,227,233,
+
+	// right wall
+
+	234,240,241,
+	234,235,241,
+	246,252,253,
+	246,247,253,
+	258,264,265,
+	258,259,265,
+
+	236,242,243,
+	236,237,243,
+	248,254,255,
+	248,249,255,
+	260,266,267,
+	260,261,267,
+
+	238,244,245,
+	238,239,245,
+	250,256,257,
+	250,251,257,
+	262,268,269,
+	262,263,269,
+
+	// back wall
+
+	270,276,277,
+	270,271,277,
+	282,288,289,
+	282,283,289,
+	294,300,301,
+	294,295,301,
+
+	272,278,279,
+	272,273,279,
+	284,290,291,
+	284,285,291,
+	296,302,303,
+	296,297,303,
+
+	274,280,281,
+	274,275,281,
+	286,292,293,
+	286,287,293,
+	298,304,305,
+	298,299,305,
+
+	// left wall
+
+	306,312,313,
+	306,307,313,
+	318,324,325,
+	318,319,325,
+	330,336,337,
+	330,331,337,
+
+	308,314,315,
+	308,309,315,
+	320,326,327,
+	320,321,327,
+	332,338,339,
+	332,333,339,
+
+	310,316,317,
+	310,311,317,
+	322,328,329,
+	322,323,329,
+	334,340,341,
+	334,335,341,
+	
+	// door
+
+	342,344,345,
+	342,343,345
+
+
+};
+
 // The MAIN function, from here we start the application and run the game loop
-int main()
+int main(int argc, char* argv[])
 {
+	// command line options for running without a GPU:
+	//   --headless      render on the CPU instead of opening a window
+	//   --frames N      number of frames to render in headless mode
+	//   --dump          write every headless frame to frame_NNNN.ppm
+	//   --kernel K      coverage kernel for headless mode, 0 = scalar, 1 = SSE, 2 = AVX (default is the best the cpu supports)
+	//   --bench-raster  compare the coverage kernels and exit
+	// building generator:
+	//   --check-building  check the generated building matches the hand made one and exit
+	//   --bench-building  time the generator on large buildings and exit
+	// instancing:
+	//   --city N        draw N buildings on a grid with one instanced draw call
+	//   --bench-city    frame time from 1 to 100,000 buildings, then exit
+	//   --bench-cull    frustum culling throughput of each kernel on 100,000 buildings, then exit
+	//   --bench-queue   record a packet per building of 100,000 on 1 to all cores and sort them, packets per millisecond per thread, then exit
+	//   --vertex-format F  store building positions as float, unorm16 (default) or half
+	//   --bench-vertex-format  vertex memory of the building and estimated vertex fetch per frame of each city size in each format, then exit
+	//   --check-allocs  count heap allocations in 100 frames after 10 warm up frames, fails if there are any, works with --headless (not with --dump, writing files allocates)
+	// asset pack:
+	//   --pack          write the shaders and the building mesh to assets.pack, which is used instead of them from then on, and exit
+	//   --loose         read the loose files even if there is an assets.pack
+	//   --bench-pack    cold and warm time to get the assets into memory from the loose files and from assets.pack, then exit
+	bool headless = false, dumpFrames = false, benchCity = false, looseFiles = false, checkAllocs = false;
+	int headlessFrames = 300, kernel = -1, cityCount = 1;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--headless") headless = true;
+		else if (arg == "--dump") dumpFrames = true;
+		else if (arg == "--frames" && i + 1 < argc) headlessFrames = atoi(argv[++i]);
+		else if (arg == "--kernel" && i + 1 < argc) kernel = atoi(argv[++i]);
+		else if (arg == "--city" && i + 1 < argc) cityCount = std::max(1, atoi(argv[++i]));
+		else if (arg == "--bench-city") benchCity = true;
+		else if (arg == "--loose") looseFiles = true;
+		else if (arg == "--check-allocs") checkAllocs = true;
+		else if (arg == "--vertex-format" && i + 1 < argc) {
+			std::string name = argv[++i];
+			for (int format = VERTEX_POSITION_FLOAT; format <= VERTEX_POSITION_HALF; format++) {
+				if (name == positionFormatNames[format])
+					buildingPositionFormat = (VertexPositionFormat)format;
+			}
+		}
+		else if (arg == "--bench-vertex-format") {
+			benchVertexFormat();
+			return 0;
+		}
+		else if (arg == "--pack") return writeAssetPack() ? 0 : 1;
+		else if (arg == "--bench-pack") {
+			benchPack();
+			return 0;
+		}
+		else if (arg == "--bench-cull") {
+			benchCull();
+			return 0;
+		}
+		else if (arg == "--bench-queue") {
+			benchQueue();
+			return 0;
+		}
+		else if (arg == "--bench-raster") {
+			SoftwareRenderer renderer(WIDTH, HEIGHT, 1);
+			renderer.benchmarkCoverage(20000, 16.0f);
+			renderer.benchmarkCoverage(20000, 64.0f);
+			renderer.benchmarkCoverage(2000, 256.0f);
+			return 0;
+		}
+		else if (arg == "--check-building") return checkBuilding() ? 0 : 1;
+		else if (arg == "--bench-building") {
+			benchBuilding();
+			return 0;
+		}
+	}
+
+	// default parameters give the same building as the hand made mesh,
+	// the window only generates it when there is no asset pack
+	BuildingGenerator building;
+	if (headless) {
+		generateBuilding(building);
+		meshOptimizer.report("Building mesh");
+	}
+	if (headless && benchCity) {
+		for (int count : cityBenchCounts) {
+			std::cout << "City of " << count << " buildings" << std::endl;
+			// fewer frames for the big cities, the software renderer takes seconds per frame there
+			runHeadless(std::max(1, std::min(CITY_BENCH_FRAMES, 20000 / count)), false, kernel, count);
+		}
+		return 0;
+	}
+	if (headless)
+		return runHeadless(headlessFrames, dumpFrames, kernel, cityCount, checkAllocs);
+
+	// startup benchmark, time from here until the first frame is on screen
+	std::chrono::high_resolution_clock::time_point startupStart = std::chrono::high_resolution_clock::now();
+	bool firstFrame = true;
+
 	std::cout << "Starting GLFW context, OpenGL 3.3" << std::endl;
 	// Init GLFW
 	glfwInit();
@@ -95,8 +1051,10 @@ int main()
 			if (window == nullptr)
 			{
 				std::cout << "Failed to create GLFW window 2.1" << std::endl;
+				std::cout << "Falling back to the software renderer" << std::endl;
 				glfwTerminate();
-				return -1;
+				generateBuilding(building);
+				return runHeadless(headlessFrames, dumpFrames, kernel, cityCount, checkAllocs);
 			}
 		}
 	}
@@ -122,726 +1080,31 @@ int main()
 	glfwGetFramebufferSize(window, &width, &height); // gets size of screen
 	glViewport(0, 0, width, height); 
 
-	Shader exampleShader("exampleShader.vert", "exampleShader.frag");
-
-	GLfloat vertices[] = {
-		// Position(x,y,z),  Colour(r,g,b)
-		// 128,64,0, door
-		// 128,255,255, glass
-		// 128,128,128, wall
-		// shader divides value by 255 to get the correct color required
-
-		// vertices based on picture
-		// walls
-		//   front face
-		0,0,0,				128,128,128,	//0
-		0.25,0,0,			128,128,128,
-		0.75,0,0,			128,128,128,
-		1.25,0,0,			128,128,128,
-		1.35,0,0,			128,128,128,	// bottom left of door
-		1.65,0,0,			128,128,128,	// bottom right of door
-		1.75,0,0,			128,128,128,
-		2.25,0,0,			128,128,128,
-		2.75,0,0,			128,128,128,
-		3,0,0,				128,128,128,	// 9
-
-		0.25,0.25,0,		128,128,128,	// 10
-		0.75,0.25,0,		128,128,128,
-		2.25,0.25,0,		128,128,128,
-		2.75,0.25,0,		128,128,128,
-		
-		0.25,0.75,0,		128,128,128,
-		0.75,0.75,0,		128,128,128,
-		2.25,0.75,0,		128,128,128,
-		2.75,0.75,0,		128,128,128,
-
-		1.35,0.85,0,		128,128,128,	// top left of door
-		1.65,0.85,0,		128,128,128,	// top right of door
-
-		0.25,1.25,0,		128,128,128,	// 20
-		0.75,1.25,0,		128,128,128,
-		1.25,1.25,0,		128,128,128,
-		1.35,1.25,0,		128,128,128,	// above door left
-		1.65,1.25,0,		128,128,128,	// above door right
-		1.75,1.25,0,		128,128,128,
-		2.25,1.25,0,		128,128,128,
-		2.75,1.25,0,		128,128,128,
-
-		0.25,1.75,0,		128,128,128,
-		0.75,1.75,0,		128,128,128,
-		1.25,1.75,0,		128,128,128,	// 30
-		1.75,1.75,0,		128,128,128,
-		2.25,1.75,0,		128,128,128,
-		2.75,1.75,0,		128,128,128,
-
-		0.25,2.25,0,		128,128,128,
-		0.75,2.25,0,		128,128,128,
-		1.25,2.25,0,		128,128,128,
-		1.75,2.25,0,		128,128,128,
-		2.25,2.25,0,		128,128,128,
-		2.75,2.25,0,		128,128,128,
-
-		0.25,2.75,0,		128,128,128,	// 40
-		0.75,2.75,0,		128,128,128,
-		1.25,2.75,0,		128,128,128,
-		1.75,2.75,0,		128,128,128,
-		2.25,2.75,0,		128,128,128,
-		2.75,2.75,0,		128,128,128,
-
-		0,3,0,				128,128,128,	// 46
-		0.25,3,0,			128,128,128,
-		0.75,3,0,			128,128,128,
-		1.25,3,0,			128,128,128,
-		1.75,3,0,			128,128,128,	// 50
-		2.25,3,0,			128,128,128,
-		2.75,3,0,			128,128,128,
-		3,3,0,				128,128,128,	// 53
-
-		//   right face
-
-		//3, 0, 0, already included as vertex 9
-		3, 0, -0.25,		128,128,128,
-		3, 0, -0.75,		128,128,128,
-		3, 0, -1.25,		128,128,128,
-		3, 0, -1.75,		128,128,128,
-		3, 0, -2.25,		128,128,128,
-		3, 0, -2.75,		128,128,128,
-		3, 0, -3,			128,128,128,	// 60
-
-		3, 0.25,-0.25,		128,128,128,
-		3, 0.25,-0.75,		128,128,128,
-		3, 0.25,-1.25,		128,128,128,
-		3, 0.25,-1.75,		128,128,128,
-		3, 0.25,-2.25,		128,128,128,
-		3, 0.25,-2.75,		128,128,128,
-		
-		3, 0.75, -0.25,		128,128,128,
-		3, 0.75, -0.75,		128,128,128,
-		3, 0.75, -1.25,		128,128,128,
-		3, 0.75, -1.75,		128,128,128,	// 70
-		3, 0.75, -2.25,		128,128,128,
-		3, 0.75, -2.75,		128,128,128,
-
-		3, 1.25, -0.25,		128,128,128,
-		3, 1.25, -0.75,		128,128,128,
-		3, 1.25, -1.25,		128,128,128,
-		3, 1.25, -1.75,		128,128,128,
-		3, 1.25, -2.25,		128,128,128,
-		3, 1.25, -2.75,		128,128,128,
-
-		3, 1.75, -0.25,		128,128,128,
-		3, 1.75, -0.75,		128,128,128,	// 80
-		3, 1.75, -1.25,		128,128,128,
-		3, 1.75, -1.75,		128,128,128,
-		3, 1.75, -2.25,		128,128,128,
-		3, 1.75, -2.75,		128,128,128,
-
-		3, 2.25, -0.25,		128,128,128,
-		3, 2.25, -0.75,		128,128,128,
-		3, 2.25, -1.25,		128,128,128,
-		3, 2.25, -1.75,		128,128,128,
-		3, 2.25, -2.25,		128,128,128,
-		3, 2.25, -2.75,		128,128,128,	// 90
-
-		3, 2.75, -0.25,		128,128,128,
-		3, 2.75, -0.75,		128,128,128,
-		3, 2.75, -1.25,		128,128,128,
-		3, 2.75, -1.75,		128,128,128,
-		3, 2.75, -2.25,		128,128,128,
-		3, 2.75, -2.75,		128,128,128,
-
-		// 3, 3, 0, already included as vertex 53
-		3, 3, -0.25,		128,128,128,
-		3, 3, -0.75,		128,128,128,
-		3, 3, -1.25,		128,128,128,
-		3, 3, -1.75,		128,128,128,	// 100
-		3, 3, -2.25,		128,128,128,
-		3, 3, -2.75,		128,128,128,
-		3, 3, -3,			128,128,128,	// 103
-
-		//  back face
-
-		//3   , 0, -3, already included as vertex 60
-		2.75, 0, -3,		128,128,128,
-		2.25, 0, -3,		128,128,128,
-		1.75, 0, -3,		128,128,128,
-		1.25, 0, -3,		128,128,128,
-		0.75, 0, -3,		128,128,128,
-		0.25, 0, -3,		128,128,128,
-		0   , 0, -3,		128,128,128,	// 110
-
-		2.75, 0.25, -3,		128,128,128,
-		2.25, 0.25, -3,		128,128,128,
-		1.75, 0.25, -3,		128,128,128,
-		1.25, 0.25, -3,		128,128,128,
-		0.75, 0.25, -3,		128,128,128,
-		0.25, 0.25, -3,		128,128,128,
-					
-		2.75, 0.75, -3,		128,128,128,
-		2.25, 0.75, -3,		128,128,128,
-		1.75, 0.75, -3,		128,128,128,
-		1.25, 0.75, -3,		128,128,128,	// 120
-		0.75, 0.75, -3,		128,128,128,
-		0.25, 0.75, -3,		128,128,128,
-					
-		2.75, 1.25, -3,		128,128,128,
-		2.25, 1.25, -3,		128,128,128,
-		1.75, 1.25, -3,		128,128,128,
-		1.25, 1.25, -3,		128,128,128,
-		0.75, 1.25, -3,		128,128,128,
-		0.25, 1.25, -3,		128,128,128,
-					
-		2.75, 1.75, -3,		128,128,128,
-		2.25, 1.75, -3,		128,128,128,	// 130
-		1.75, 1.75, -3,		128,128,128,
-		1.25, 1.75, -3,		128,128,128,
-		0.75, 1.75, -3,		128,128,128,
-		0.25, 1.75, -3,		128,128,128,
-
-		2.75, 2.25, -3,		128,128,128,
-		2.25, 2.25, -3,		128,128,128,
-		1.75, 2.25, -3,		128,128,128,
-		1.25, 2.25, -3,		128,128,128,
-		0.75, 2.25, -3,		128,128,128,
-		0.25, 2.25, -3,		128,128,128,	// 140
-					
-		2.75, 2.75, -3,		128,128,128,
-		2.25, 2.75, -3,		128,128,128,
-		1.75, 2.75, -3,		128,128,128,
-		1.25, 2.75, -3,		128,128,128,
-		0.75, 2.75, -3,		128,128,128,
-		0.25, 2.75, -3,		128,128,128,
-
-		// 3,3, -3, already included as vertex 103
-		2.75, 3, -3,		128,128,128,
-		2.25, 3, -3,		128,128,128,
-		1.75, 3, -3,		128,128,128,
-		1.25, 3, -3,		128,128,128,	// 150
-		0.75, 3, -3,		128,128,128,
-		0.25, 3, -3,		128,128,128,
-		0, 3, -3,			128,128,128,	// 153
-
-		//   left face
-
-		// 0, 0, -3, already included as vertex 110
-		0, 0, -2.75,		128,128,128,
-		0, 0, -2.25,		128,128,128,
-		0, 0, -1.75,		128,128,128,
-		0, 0, -1.25,		128,128,128,
-		0, 0, -0.75,		128,128,128,
-		0, 0, -0.25,		128,128,128,
-		// 0, 0, 0, already included as vertex 0
-
-		0, 0.25, -2.75,		128,128,128,	// 160
-		0, 0.25, -2.25,		128,128,128,
-		0, 0.25, -1.75,		128,128,128,
-		0, 0.25, -1.25,		128,128,128,
-		0, 0.25, -0.75,		128,128,128,
-		0, 0.25, -0.25,		128,128,128,
-
-		0, 0.75, -2.75,		128,128,128,
-		0, 0.75, -2.25,		128,128,128,
-		0, 0.75, -1.75,		128,128,128,
-		0, 0.75, -1.25,		128,128,128,
-		0, 0.75, -0.75,		128,128,128,	// 170
-		0, 0.75, -0.25,		128,128,128,
-
-		0, 1.25, -2.75,		128,128,128,
-		0, 1.25, -2.25,		128,128,128,
-		0, 1.25, -1.75,		128,128,128,
-		0, 1.25, -1.25,		128,128,128,
-		0, 1.25, -0.75,		128,128,128,
-		0, 1.25, -0.25,		128,128,128,
-
-		0, 1.75, -2.75,		128,128,128,
-		0, 1.75, -2.25,		128,128,128,
-		0, 1.75, -1.75,		128,128,128,	// 180
-		0, 1.75, -1.25,		128,128,128,
-		0, 1.75, -0.75,		128,128,128,
-		0, 1.75, -0.25,		128,128,128,
-
-		0, 2.25, -2.75,		128,128,128,
-		0, 2.25, -2.25,		128,128,128,
-		0, 2.25, -1.75,		128,128,128,
-		0, 2.25, -1.25,		128,128,128,
-		0, 2.25, -0.75,		128,128,128,
-		0, 2.25, -0.25,		128,128,128,
-
-		0, 2.75, -2.75,		128,128,128,	// 190
-		0, 2.75, -2.25,		128,128,128,
-		0, 2.75, -1.75,		128,128,128,
-		0, 2.75, -1.25,		128,128,128,
-		0, 2.75, -0.75,		128,128,128,
-		0, 2.75, -0.25,		128,128,128,
-
-		// 0, 3, -3, already included as vertex 153
-		0, 3, -2.75,		128,128,128,
-		0, 3, -2.25,		128,128,128,
-		0, 3, -1.75,		128,128,128,
-		0, 3, -1.25,		128,128,128,
-		0, 3, -0.75,		128,128,128,	// 200
-		0, 3, -0.25,		128,128,128,
-		// 0, 3, 0, already included as vertex 46
-
-		// windows
-
-		0.25, 0.25, 0,		128,255,255,	// 202
-		0.75, 0.25, 0,		128,255,255,
-		2.25, 0.25, 0,		128,255,255,
-		2.75, 0.25, 0,		128,255,255,
-
-		0.25, 0.75, 0,		128,255,255,	
-		0.75, 0.75, 0,		128,255,255,
-		2.25, 0.75, 0,		128,255,255,
-		2.75, 0.75, 0,		128,255,255,
-
-		0.25, 1.25, 0,		128,255,255,	// 210
-		0.75, 1.25, 0,		128,255,255,
-		1.25, 1.25, 0,		128,255,255,
-		1.75, 1.25, 0,		128,255,255,
-		2.25, 1.25, 0,		128,255,255,	
-		2.75, 1.25, 0,		128,255,255,
-
-		0.25, 1.75, 0,		128,255,255,	
-		0.75, 1.75, 0,		128,255,255,
-		1.25, 1.75, 0, 		128,255,255,
-		1.75, 1.75, 0,		128,255,255,
-		2.25, 1.75, 0,		128,255,255,	// 220
-		2.75, 1.75, 0,		128,255,255,
-
-		0.25, 2.25, 0,		128,255,255,	
-		0.75, 2.25, 0,		128,255,255,
-		1.25, 2.25, 0,		128,255,255,
-		1.75, 2.25, 0,		128,255,255,
-		2.25, 2.25, 0,		128,255,255,	
-		2.75, 2.25, 0,		128,255,255,
-
-		0.25, 2.75, 0,		128,255,255,	
-		0.75, 2.75, 0,		128,255,255,
-		1.25, 2.75, 0,		128,255,255,	// 230
-		1.75, 2.75, 0,		128,255,255,
-		2.25, 2.75, 0,		128,255,255,	
-		2.75, 2.75, 0,		128,255,255,
-
-				 //   right face
-
-		3, 0.25, -0.25,		128,255,255,	
-		3, 0.25, -0.75,		128,255,255,
-		3, 0.25, -1.25,		128,255,255,
-		3, 0.25, -1.75,		128,255,255,
-		3, 0.25, -2.25,		128,255,255,	
-		3, 0.25, -2.75,		128,255,255,
-
-		3, 0.75, -0.25,		128,255,255,	// 240
-		3, 0.75, -0.75,		128,255,255,
-		3, 0.75, -1.25,		128,255,255,
-		3, 0.75, -1.75,		128,255,255,
-		3, 0.75, -2.25,		128,255,255,	
-		3, 0.75, -2.75,		128,255,255,
-
-		3, 1.25, -0.25,		128,255,255,	
-		3, 1.25, -0.75,		128,255,255,
-		3, 1.25, -1.25,		128,255,255,
-		3, 1.25, -1.75,		128,255,255,
-		3, 1.25, -2.25,		128,255,255,	// 250
-		3, 1.25, -2.75,		128,255,255,
-
-		3, 1.75, -0.25,		128,255,255,	
-		3, 1.75, -0.75,		128,255,255,
-		3, 1.75, -1.25,		128,255,255,
-		3, 1.75, -1.75,		128,255,255,
-		3, 1.75, -2.25,		128,255,255,	
-		3, 1.75, -2.75,		128,255,255,
-
-		3, 2.25, -0.25,		128,255,255,	
-		3, 2.25, -0.75,		128,255,255,
-		3, 2.25, -1.25,		128,255,255,	// 260
-		3, 2.25, -1.75,		128,255,255,
-		3, 2.25, -2.25,		128,255,255,	
-		3, 2.25, -2.75,		128,255,255,
-
-		3, 2.75, -0.25,		128,255,255,	
-		3, 2.75, -0.75,		128,255,255,
-		3, 2.75, -1.25,		128,255,255,
-		3, 2.75, -1.75,		128,255,255,
-		3, 2.75, -2.25,		128,255,255,	
-		3, 2.75, -2.75,		128,255,255,
-
-				  //  back face
-
-		2.75, 0.25, -3,		128,255,255,	// 270
-		2.25, 0.25, -3,		128,255,255,
-		1.75, 0.25, -3,		128,255,255,
-		1.25, 0.25, -3,		128,255,255,
-		0.75, 0.25, -3,		128,255,255,	
-		0.25, 0.25, -3,		128,255,255,
-
-		2.75, 0.75, -3,		128,255,255,	
-		2.25, 0.75, -3,		128,255,255,
-		1.75, 0.75, -3,		128,255,255,
-		1.25, 0.75, -3,		128,255,255,
-		0.75, 0.75, -3,		128,255,255,	// 280
-		0.25, 0.75, -3,		128,255,255,
-
-		2.75, 1.25, -3,		128,255,255,	
-		2.25, 1.25, -3,		128,255,255,
-		1.75, 1.25, -3,		128,255,255,
-		1.25, 1.25, -3,		128,255,255,
-		0.75, 1.25, -3,		128,255,255,	
-		0.25, 1.25, -3,		128,255,255,
-
-		2.75, 1.75, -3,		128,255,255,	
-		2.25, 1.75, -3,		128,255,255,
-		1.75, 1.75, -3,		128,255,255,	// 290
-		1.25, 1.75, -3,		128,255,255,
-		0.75, 1.75, -3,		128,255,255,	
-		0.25, 1.75, -3,		128,255,255,
-
-		2.75, 2.25, -3,		128,255,255,	
-		2.25, 2.25, -3,		128,255,255,
-		1.75, 2.25, -3,		128,255,255,
-		1.25, 2.25, -3,		128,255,255,
-		0.75, 2.25, -3,		128,255,255,	
-		0.25, 2.25, -3,		128,255,255,
-
-		2.75, 2.75, -3,		128,255,255,	// 300
-		2.25, 2.75, -3,		128,255,255,
-		1.75, 2.75, -3,		128,255,255,
-		1.25, 2.75, -3,		128,255,255,
-		0.75, 2.75, -3,		128,255,255,	
-		0.25, 2.75, -3,		128,255,255,
-
-				  // left face
-
-		0, 0.25, -2.75,		128,255,255,	
-		0, 0.25, -2.25,		128,255,255,
-		0, 0.25, -1.75,		128,255,255,
-		0, 0.25, -1.25,		128,255,255,
-		0, 0.25, -0.75,		128,255,255,	// 310
-		0, 0.25, -0.25,		128,255,255,
-
-		0, 0.75, -2.75,		128,255,255,	
-		0, 0.75, -2.25,		128,255,255,
-		0, 0.75, -1.75,		128,255,255,
-		0, 0.75, -1.25,		128,255,255,
-		0, 0.75, -0.75,		128,255,255,	
-		0, 0.75, -0.25,		128,255,255,
-
-		0, 1.25, -2.75,		128,255,255,	
-		0, 1.25, -2.25,		128,255,255,
-		0, 1.25, -1.75,		128,255,255,	// 320
-		0, 1.25, -1.25,		128,255,255,
-		0, 1.25, -0.75,		128,255,255,	
-		0, 1.25, -0.25,		128,255,255,
-
-		0, 1.75, -2.75,		128,255,255,	
-		0, 1.75, -2.25,		128,255,255,
-		0, 1.75, -1.75,		128,255,255,
-		0, 1.75, -1.25,		128,255,255,
-		0, 1.75, -0.75,		128,255,255,	
-		0, 1.75, -0.25,		128,255,255,
-
-		0, 2.25, -2.75,		128,255,255,	// 330
-		0, 2.25, -2.25,		128,255,255,
-		0, 2.25, -1.75,		128,255,255,
-		0, 2.25, -1.25,		128,255,255,
-		0, 2.25, -0.75,		128,255,255,	
-		0, 2.25, -0.25,		128,255,255,
-
-		0, 2.75, -2.75,		128,255,255,	
-		0, 2.75, -2.25,		128,255,255,
-		0, 2.75, -1.75,		128,255,255,
-		0, 2.75, -1.25,		128,255,255,
-		0, 2.75, -0.75,		128,255,255,	// 340
-		0, 2.75, -0.25,		128,255,255,
-
-		// door
-		1.35,0,0,			128,64,0,		// 342
-		1.65,0,0,			128,64,0,
-		1.35,0.85,0,		128,64,0,
-		1.65,0.85,0,		128,64,0,		// 345
-
-	}; 
-
-
-	// indices useful for EBOs, especially when reusing vertices
-	GLint indices[] = {
-		// front face walls
-		0,46,47,		//1
-		0,1,47,
-
-		1,10,11,
-		1,2,11,
-		14,20,21,
-		14,15,21,
-		28,34,35,
-		28,29,35,
-		40,47,48,
-		40,41,48,		//10
-
-		2,48,49,
-		2,3,49,
-
-		// around door
-		3,22,23,
-		3,4,23,
-		18,23,24,
-		18,19,24,
-		5,24,25,
-		5,6,25,
-
-		30,36,37,
-		30,31,37,		//20
-		42,49,50,
-		42,43,50,
-
-		6,50,51,
-		6,7,51,
-
-		7,12,13,
-		7,8,13,
-		16,26,27,
-		16,17,27,
-		32,38,39,
-		32,33,39,		//30
-		44,51,52,
-		44,45,52,
-
-		8,52,53,
-		8,9,53,
-
-		// right wall
-
-		9,53,97,
-		9,54,97,
-		
-		54,61,62,
-		54,55,62,
-		67,73,74,
-		67,68,74,
-		79,85,86,
-		79,80,86,
-		91,97,98,
-		91,92,98,
-
-		55,98,99,
-		55,56,99,
-
-		56,63,64,
-		56,57,64,
-		69,75,76,
-		69,70,76,
-		81,87,88,
-		81,82,88,
-		93,99,100,
-		93,94,100,
-
-		57,100,101,
-		57,58,101,
-
-		58,65,66,
-		58,59,66,
-		71,77,78,
-		71,72,78,
-		83,89,90,
-		83,84,90,
-		95,101,102,
-		95,96,102,
-		
-		59,102,103,
-		59,60,103,
-
-		// back wall
-
-		60,103,147,
-		60,104,147,
-
-		104,111,112,
-		104,105,112,
-		117,123,124,
-		117,118,124,
-		129,135,136,
-		129,130,136,
-		141,147,148,
-		141,142,148,
-
-		105,148,149,
-		105,106,149,
-
-		106,113,114,
-		106,107,114,
-		119,125,126,
-		119,120,126,
-		131,137,138,
-		131,132,138,
-		143,149,150,
-		143,144,150,
-
-		107,150,151,
-		107,108,151,
-
-		108,115,116,
-		108,109,116,
-		121,127,128,
-		121,122,128,
-		133,139,140,
-		133,134,140,
-		145,151,152,
-		145,146,152,
-
-		109,152,153,
-		109,110,153,
-
-		// left wall
-
-		110,153,196,
-		110,154,196,
-
-		154,160,161,
-		154,155,161,
-		166,172,173,
-		166,167,173,
-		178,184,185,
-		178,179,185,
-		190,196,197,
-		190,191,197,
-
-		155,197,198,
-		155,156,198,
-
-		156,162,163,
-		156,157,163,
-		168,174,175,
-		168,169,175,
-		180,186,187,
-		180,181,187,
-		192,198,199,
-		192,193,199,
-
-		157,199,200,
-		157,158,200,
-
-		158,164,165,
-		158,159,165,
-		170,176,177,
-		170,171,177,
-		182,188,189,
-		182,183,189,
-		194,200,201,
-		194,195,201,
-
-		159,201,46,
-		159,0,46,
-
-		// bottom
-
-		0,110,60,
-		0,9,60,
-
-		// top
-
-		46,153,103,
-		46,53,103,
-
-		// windows
-		// front wall
-
-		202,206,207,
-		202,203,207,
-		210,216,217,
-		210,211,217,
-		222,228,229,
-		222,223,229,
-
-		212,218,219,
-		212,213,219,
-		224,230,231,
-		224,225,231,
-
-		204,208,209,
-		204,205,209,
-		214,220,221,
-		214,215,221,
-		226,232,233,
-		226,227,233,
-
-		// right wall
-
-		234,240,241,
-		234,235,241,
-		246,252,253,
-		246,247,253,
-		258,264,265,
-		258,259,265,
-
-		236,242,243,
-		236,237,243,
-		248,254,255,
-		248,249,255,
-		260,266,267,
-		260,261,267,
-
-		238,244,245,
-		238,239,245,
-		250,256,257,
-		250,251,257,
-		262,268,269,
-		262,263,269,
-
-		// back wall
-
-		270,276,277,
-		270,271,277,
-		282,288,289,
-		282,283,289,
-		294,300,301,
-		294,295,301,
-
-		272,278,279,
-		272,273,279,
-		284,290,291,
-		284,285,291,
-		296,302,303,
-		296,297,303,
-
-		274,280,281,
-		274,275,281,
-		286,292,293,
-		286,287,293,
-		298,304,305,
-		298,299,305,
-
-		// left wall
-
-		306,312,313,
-		306,307,313,
-		318,324,325,
-		318,319,325,
-		330,336,337,
-		330,331,337,
-
-		308,314,315,
-		308,309,315,
-		320,326,327,
-		320,321,327,
-		332,338,339,
-		332,333,339,
-
-		310,316,317,
-		310,311,317,
-		322,328,329,
-		322,323,329,
-		334,340,341,
-		334,335,341,
-		
-		// door
-
-		342,344,345,
-		342,343,345
-
-
-	};
-
+	// shaders and mesh straight from the mapping of assets.pack if it has been written with --pack
+	AssetPack pack;
+	bool packed = !looseFiles && pack.open(ASSET_PACK_FILE);
+	if (packed)
+		std::cout << "Loading from " << ASSET_PACK_FILE << std::endl;
+	Shader exampleShader(pack, "exampleShader.vert", "exampleShader.frag");
+	std::cout << "exampleShader: " << exampleShader.buildTime << " ms, read in " << exampleShader.readTime << " ms" << (exampleShader.fromCache ? " (binary cache)" : "") << std::endl;
+	const AssetEntry* packedVertices = pack.isOpen() ? pack.find("building.vertices") : nullptr;
+	const AssetEntry* packedIndices = pack.isOpen() ? pack.find("building.indices") : nullptr;
+	if (packedVertices == nullptr || packedIndices == nullptr) {
+		generateBuilding(building);
+		meshOptimizer.report("Building mesh");
+	}
+	const GLvoid* vertexData = packedVertices != nullptr ? (const GLvoid*)pack.data(packedVertices) : (const GLvoid*)&vertices[0];
+	const GLvoid* indexData = packedIndices != nullptr ? (const GLvoid*)pack.data(packedIndices) : (const GLvoid*)&indices[0];
+	size_t vertexBytes = packedVertices != nullptr ? (size_t)packedVertices->size : vertices.size() * sizeof(GLfloat);
+	// the generator and the pack have float vertices with 0-255 colours, the GPU gets the compact format
+	CompactVertices compactVertices;
+	compactVertices.pack((const GLfloat*)vertexData, vertexBytes / (BUILDING_VERTEX_SIZE * sizeof(GLfloat)), BUILDING_VERTEX_SIZE, buildingPositionFormat);
+	std::cout << "Building vertices: " << positionFormatNames[buildingPositionFormat] << " positions, " << compactVertices.layout.stride << " bytes per vertex instead of "
+		<< BUILDING_VERTEX_SIZE * sizeof(GLfloat) << ", largest position error " << compactVertices.maxError << std::endl;
+	size_t indexBytes = packedIndices != nullptr ? (size_t)packedIndices->size : indices.size() * sizeof(GLuint);
+	GLsizei indexCount = (GLsizei)(indexBytes / sizeof(GLuint));
+	// view and projection for every shader
+	FrameUniforms frameUniforms;
 
 	GLuint VBO; // vertex buffer object
 	glGenBuffers(1, &VBO); // generate buffer ID
@@ -851,83 +1114,580 @@ int main()
 	glGenBuffers(1, &EBO); 
 
 
-	// initialisation code
+	// initialisation code, binds and switches go through the state tracker so it can skip the ones that change nothing
+	GLState& state = GLState::current();
 	// 1: bind vertex array object
-	glBindVertexArray(VAO);
+	state.bindVertexArray(VAO);
 	// 2: copy vertices array in buffer for opengl
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	state.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, compactVertices.data.size(), &compactVertices.data[0], GL_STATIC_DRAW);
 		// GL_STATIC_DRAW = data that is unlikely to change
 		// GL_DYNAMIC_DRAW = data that is likely to change a lot
 		// GL_STREAM_DRAW = data will change every time it is drawn
 	// 2.5: copy index array in elemennt buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-	// 3: set vertex position attributes pointers
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
-	// 3.5: set vertex color or texture attribute pointers
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
+	state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
+	// 3: set vertex position and colour attribute pointers from the layout of the compact format
+	compactVertices.layout.apply();
+	// 3.5: the shader takes the quantized positions back to model space
+	exampleShader.use();
+	exampleShader.setVec3("meshScale", compactVertices.scale);
+	exampleShader.setVec3("meshOffset", compactVertices.offset);
+	// 3.75: per-instance model matrix and tint from their own buffer, only the buildings that survive culling
+	InstanceBuffer instances;
+	instances.attach();
+	// every building, never uploaded itself
+	InstanceBuffer city;
 	// 4: unbind VAO (NOT the EBO)
-	glBindVertexArray(0);
-
-
+	state.bindVertexArray(0);
+	// GL has its own copies now
+	pack.close();
+
+	// model : position in world coordinates, one per building
+	int benchIndex = 0, benchFrame = 0;
+	double benchTime = 0.0;
+	if (benchCity)
+		cityCount = cityBenchCounts[0];
+	buildCity(city, cityCount);
+	placeCityCamera(cityCount);
+	// draws are recorded as packets and replayed sorted by shader and depth
+	RenderQueue queue;
+	AllocationCheck allocationCheck;
 	
-	glEnable(GL_DEPTH_TEST); // required for z-buffer to work
+	state.enable(GL_DEPTH_TEST); // required for z-buffer to work
 
 	// Game loop
 	while (!glfwWindowShouldClose(window))
 	{
+		if (checkAllocs && !allocationCheck.beginFrame())
+			break;
 		// Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
 		glfwPollEvents();
 		// time update
 		currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		// profiling counters for this frame
+		lastFrameStats = Shader::frameStats();
+		Shader::resetFrameStats();
+		lastStateStats = state.stats;
+		state.resetFrameStats();
 		// movement update
 		movement();
+		std::chrono::high_resolution_clock::time_point frameStart = std::chrono::high_resolution_clock::now();
 
 		// Render
 		// Clear the colorbuffer
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		state.clearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		
-		// Activate shader (cannot send uniform data before using the shader)
-		exampleShader.use();
-
 		// send data to shader
-		// model : position in world coordinates
-		glm::mat4 model;
-		model = glm::mat4();
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, -3.0f));
-		//model = glm::scale(model, glm::vec3(0.2f));
-		glUniformMatrix4fv(glGetUniformLocation(exampleShader.program, "model"), 1, GL_FALSE, glm::value_ptr(model));
-		// view : what the camera sees
-		glm::mat4 view;
-		view = camera.GetViewMatrix();
-		glUniformMatrix4fv(glGetUniformLocation(exampleShader.program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		// projection : projecting into 2d window
-		glm::mat4 projection;
-		projection = glm::perspective(glm::radians(camera.zoom), (GLfloat)WIDTH/(GLfloat)HEIGHT, 0.1f, 100.0f);
-		glUniformMatrix4fv(glGetUniformLocation(exampleShader.program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+		// view : what the camera sees, projection : projecting into 2d window
+		// both are in the FrameData uniform block shared by every shader
+		frameUniforms.update(camera, currentFrame);
+		// model and tint : only the visible buildings, and of those only the ones that moved or changed place in the list are uploaded
+		animateCity(city, currentFrame);
+		cullCity(camera, city, instances);
+		instances.upload();
+		lastInstanceUpload = instances.lastUpload;
 		
-		// draw triangles
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, sizeof(vertices), GL_UNSIGNED_INT, 0);
-
-		// unbind VAO after use
-		glBindVertexArray(0);
+		// draw every building in one call, replay uses the shader and binds the VAO, which stays bound for the next frame
+		queue.recorder(0).drawElements(renderKey(RENDER_PASS_OPAQUE, exampleShader.program, 0, 0.0f), &exampleShader, VAO, GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instances.count());
+		queue.sort();
+		queue.replay();
+		lastQueueStats = queue.lastReplay;
+		queue.clear();
 
 		// Swap the screen buffers
 		glfwSwapBuffers(window);
+		if (firstFrame) {
+			glFinish();
+			std::cout << "Startup time: " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupStart).count() << " ms"
+				<< (packed ? " (" ASSET_PACK_FILE ")" : " (loose files)") << std::endl;
+			firstFrame = false;
+		}
+		if (benchCity) {
+			// wait for the GPU so the time covers the whole frame, the first frame of each size is not counted
+			glFinish();
+			if (benchFrame++ > 0)
+				benchTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+			if (benchFrame > CITY_BENCH_FRAMES) {
+				std::cout << "City of " << cityCount << " buildings: " << benchTime / CITY_BENCH_FRAMES << " ms per frame" << std::endl;
+				if (++benchIndex == sizeof(cityBenchCounts) / sizeof(cityBenchCounts[0])) {
+					glfwSetWindowShouldClose(window, GL_TRUE);
+				}
+				else {
+					cityCount = cityBenchCounts[benchIndex];
+					buildCity(city, cityCount);
+					placeCityCamera(cityCount);
+					benchFrame = 0;
+					benchTime = 0.0;
+				}
+			}
+		}
 	}
 	// Terminate GLFW, clearing any resources allocated by GLFW.
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
+	state.deleteVertexArrays(1, &VAO);
+	state.deleteBuffers(1, &VBO);
 	//glDeleteBuffers(1, &EBO);
 	glfwTerminate();
-	return 0;
+	return checkAllocs ? allocationCheck.report() : 0;
+}
+
+// Renders the building on the CPU, used when there is no GPU or display available
+int runHeadless(int frames, bool dumpFrames, int kernel, int cityCount, bool checkAllocs)
+{
+	SoftwareRenderer renderer(WIDTH, HEIGHT);
+	if (kernel >= 0)
+		renderer.setCoverageKernel((SoftwareCoverageKernel)kernel);
+	std::cout << "Software renderer: " << WIDTH << "x" << HEIGHT << ", " << renderer.threadCount() << " threads, "
+		<< SoftwareRenderer::kernelName(renderer.coverageKernel()) << " coverage" << std::endl;
+
+	// same buffer setup as the GL version
+	GLuint VBO = renderer.genBuffer();
+	GLuint VAO = renderer.genVertexArray();
+	GLuint EBO = renderer.genBuffer();
+	renderer.bindVertexArray(VAO);
+	CompactVertices compactVertices;
+	compactVertices.pack(&vertices[0], vertices.size() / BUILDING_VERTEX_SIZE, BUILDING_VERTEX_SIZE, buildingPositionFormat);
+	renderer.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	renderer.bufferData(GL_ARRAY_BUFFER, compactVertices.data.size(), &compactVertices.data[0]);
+	renderer.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	renderer.bufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0]);
+	compactVertices.layout.apply(renderer);
+	// instance attributes, same layout as InstanceBuffer::attach
+	InstanceBuffer instances, city;
+	GLuint instanceVBO = renderer.genBuffer();
+	renderer.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	for (GLuint column = 0; column < 4; column++) {
+		renderer.vertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), offsetof(Instance, model) + column * sizeof(glm::vec4));
+		renderer.enableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+		renderer.vertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+	}
+	renderer.vertexAttribPointer(INSTANCE_TINT_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), offsetof(Instance, tint));
+	renderer.enableVertexAttribArray(INSTANCE_TINT_LOCATION);
+	renderer.vertexAttribDivisor(INSTANCE_TINT_LOCATION, 1);
+	renderer.bindVertexArray(0);
+	buildCity(city, cityCount);
+	placeCityCamera(cityCount);
+
+	// exampleShader.vert and exampleShader.frag
+	glm::mat4 view, projection;
+	glm::vec3 meshScale = compactVertices.scale, meshOffset = compactVertices.offset;
+	SoftwareProgram exampleProgram;
+	exampleProgram.varyingCount = 3;
+	exampleProgram.vertex = [&](const glm::vec4* in, SoftwareVertex& out) {
+		glm::mat4 instanceModel(in[INSTANCE_MODEL_LOCATION], in[INSTANCE_MODEL_LOCATION + 1], in[INSTANCE_MODEL_LOCATION + 2], in[INSTANCE_MODEL_LOCATION + 3]);
+		const glm::vec4& tint = in[INSTANCE_TINT_LOCATION];
+		glm::vec4 position(in[0].x * meshScale.x + meshOffset.x, in[0].y * meshScale.y + meshOffset.y, in[0].z * meshScale.z + meshOffset.z, 1.0f);
+		out.position = projection * view * instanceModel * position;
+		out.varyings[0] = in[1].x * tint.x;
+		out.varyings[1] = in[1].y * tint.y;
+		out.varyings[2] = in[1].z * tint.z;
+	};
+	exampleProgram.fragment = [](const float* in, glm::vec4& color) {
+		color = glm::vec4(in[0], in[1], in[2], 1.0f);
+		return true;
+	};
+
+	renderer.enable(GL_DEPTH_TEST);
+
+	// fixed time step so every run produces the same frames
+	deltaTime = 1.0f / 60.0f;
+	double renderTime = 0.0;
+	AllocationCheck allocationCheck;
+	if (checkAllocs)
+		frames = ALLOC_CHECK_WARMUP_FRAMES + ALLOC_CHECK_FRAMES;
+	for (int frame = 0; frame < frames; frame++) {
+		if (checkAllocs)
+			allocationCheck.beginFrame();
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		renderer.clearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		renderer.clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		renderer.useProgram(&exampleProgram);
+		view = camera.GetViewMatrix();
+		projection = camera.GetProjectionMatrix();
+		animateCity(city, frame * deltaTime);
+		cullCity(camera, city, instances);
+		renderer.bindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		instances.flush([&renderer](size_t offset, size_t size, const void* data, bool reallocate) {
+			if (reallocate)
+				renderer.bufferData(GL_ARRAY_BUFFER, size, data);
+			else
+				renderer.bufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+		});
+
+		renderer.bindVertexArray(VAO);
+		renderer.drawElementsInstanced(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0, instances.count());
+		renderer.bindVertexArray(0);
+
+		renderTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (dumpFrames) {
+			char path[64];
+			snprintf(path, sizeof(path), "frame_%04d.ppm", frame);
+			renderer.savePPM(path);
+		}
+	}
+	// counts the last frame
+	if (checkAllocs)
+		allocationCheck.beginFrame();
+	if (frames > 0)
+		std::cout << frames << " frames in " << renderTime * 1000.0 << " ms (" << frames / renderTime << " fps, "
+			<< renderTime * 1000.0 / frames << " ms per frame)" << std::endl;
+	return checkAllocs ? allocationCheck.report() : 0;
+}
+
+// One building for a count of 1, in the same place as before instancing,
+// otherwise a square grid going away from the camera with a different shade for each building
+void buildCity(InstanceBuffer& city, int count)
+{
+	city.resize(count);
+	cityBounds.clear();
+	visibleCameraVersion = 0;
+	int side = (int)std::ceil(std::sqrt((double)count));
+	for (int i = 0; i < count; i++) {
+		glm::mat4 model;
+		glm::vec3 tint(1.0f, 1.0f, 1.0f);
+		if (count > 1) {
+			model = glm::translate(model, glm::vec3((i % side - side / 2) * CITY_SPACING, 0.0f, -(i / side) * CITY_SPACING - 3.0f));
+			// cheap hash so the shades look random but every run is the same
+			unsigned hash = (unsigned)i * 2654435761u;
+			tint = glm::vec3(0.6f + 0.4f * ((hash >> 8) & 255) / 255.0f, 0.6f + 0.4f * ((hash >> 16) & 255) / 255.0f, 0.6f + 0.4f * ((hash >> 24) & 255) / 255.0f);
+		}
+		else {
+			model = glm::translate(model, glm::vec3(0.0f, 0.0f, -3.0f));
+		}
+		city.set(i, model, tint);
+		// big enough for the building at any rotation about its centre, so the spinning ones need no updates
+		glm::vec3 centre(model[3].x + 1.5f, 1.5f, model[3].z - 1.5f);
+		GLfloat halfWidth = 1.5f * 1.41421356f;
+		cityBounds.add(centre - glm::vec3(halfWidth, 1.5f, halfWidth), centre + glm::vec3(halfWidth, 1.5f, halfWidth));
+	}
+}
+
+// Spins every CITY_MOVING_STRIDE'th building around its centre, only those are uploaded each frame
+void animateCity(InstanceBuffer& instances, GLfloat time)
+{
+	int count = instances.count();
+	if (count == 1)
+		return;
+	int side = (int)std::ceil(std::sqrt((double)count));
+	for (int i = 0; i < count; i += CITY_MOVING_STRIDE) {
+		glm::mat4 model;
+		model = glm::translate(model, glm::vec3((i % side - side / 2) * CITY_SPACING + 1.5f, 0.0f, -(i / side) * CITY_SPACING - 3.0f - 1.5f));
+		model = glm::rotate(model, time + i, glm::vec3(0.0f, 1.0f, 0.0f));
+		model = glm::translate(model, glm::vec3(-1.5f, 0.0f, 1.5f));
+		instances.set(i, model, instances.get(i).tint);
+	}
+}
+
+// Above and in front of the city looking down on it, the single building keeps the original camera
+void placeCityCamera(int count)
+{
+	if (count == 1) {
+		camera = Camera();
+	}
+	else {
+		GLfloat height = std::min(8.0f + std::sqrt((GLfloat)count) * 0.5f, 40.0f);
+		camera = Camera(glm::vec3(1.5f, height, 8.0f), glm::vec3(0.0f, 1.0f, 0.0f), YAW, -25.0f);
+	}
+	camera.SetPerspective((GLfloat)WIDTH / (GLfloat)HEIGHT);
+}
+
+// Copies the buildings inside the frustum to the drawn list, everything when culling is off.
+// The bounds never change after buildCity, so the list is only culled again when the camera changed.
+void cullCity(Camera& camera, const InstanceBuffer& city, InstanceBuffer& drawn)
+{
+	if (camera.GetVersion() != visibleCameraVersion) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		if (cullingEnabled) {
+			camera.GetFrustum().cullBoxes(cityBounds, visibleBuildings);
+		}
+		else {
+			visibleBuildings.resize(city.count());
+			for (size_t i = 0; i < visibleBuildings.size(); i++)
+				visibleBuildings[i] = (uint32_t)i;
+		}
+		lastCullTime = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+		visibleCameraVersion = camera.GetVersion();
+	}
+	drawn.resize(visibleBuildings.size());
+	for (size_t i = 0; i < visibleBuildings.size(); i++) {
+		const Instance& instance = city.get(visibleBuildings[i]);
+		drawn.set(i, instance.model, instance.tint);
+	}
+}
+
+// Culls a city of 100,000 buildings from a few camera directions with every kernel, reports objects per microsecond
+void benchCull()
+{
+	const int count = 100000, repeats = 50;
+	InstanceBuffer city;
+	buildCity(city, count);
+	CullSpheres spheres;
+	for (size_t i = 0; i < cityBounds.size(); i++) {
+		glm::vec3 min(cityBounds.minX[i], cityBounds.minY[i], cityBounds.minZ[i]);
+		glm::vec3 max(cityBounds.maxX[i], cityBounds.maxY[i], cityBounds.maxZ[i]);
+		spheres.add((min + max) * 0.5f, glm::length(max - min) * 0.5f);
+	}
+	placeCityCamera(count);
+	const GLfloat yaws[] = { -90.0f, -45.0f, 0.0f };
+	std::vector<uint32_t> visible, reference;
+	for (GLfloat yaw : yaws) {
+		Camera view(camera.position, glm::vec3(0.0f, 1.0f, 0.0f), yaw, camera.pitch);
+		view.SetPerspective((GLfloat)WIDTH / (GLfloat)HEIGHT);
+		const Frustum& frustum = view.GetFrustum();
+		for (int shape = 0; shape < 2; shape++) {
+			for (int k = FRUSTUM_KERNEL_SCALAR; k <= Frustum::bestKernel(); k++) {
+				FrustumKernel kernel = (FrustumKernel)k;
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				for (int r = 0; r < repeats; r++) {
+					if (shape == 0)
+						frustum.cullBoxes(cityBounds, visible, kernel);
+					else
+						frustum.cullSpheres(spheres, visible, kernel);
+				}
+				double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+				// every kernel has to agree with the scalar one
+				if (kernel == FRUSTUM_KERNEL_SCALAR)
+					reference = visible;
+				else if (visible != reference)
+					std::cout << "ERROR::FRUSTUM::KERNEL_MISMATCH " << Frustum::kernelName(kernel) << std::endl;
+				std::cout << "yaw " << yaw << ", " << (shape == 0 ? "boxes" : "spheres") << ", " << Frustum::kernelName(kernel) << ": "
+					<< visible.size() << " of " << count << " visible, " << us << " us, " << count / us << " objects/us" << std::endl;
+			}
+		}
+	}
+}
+
+// Records a packet with a model matrix and tint per building of a 100,000 building city on 1, 2, 4... threads up to
+// the number of cores, then sorts them. Nothing is replayed, so the packets need no shader or GL context.
+void benchQueue()
+{
+	const int count = 100000, repeats = 20;
+	InstanceBuffer city;
+	buildCity(city, count);
+	placeCityCamera(count);
+	int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; ; threads = std::min(threads * 2, cores)) {
+		RenderQueue queue(threads);
+		std::vector<double> recordTimes(threads, 0.0);
+		double sortTime = 0.0;
+		for (int r = 0; r < repeats; r++) {
+			queue.clear();
+			std::vector<std::thread> workers;
+			for (int t = 0; t < threads; t++) {
+				workers.push_back(std::thread([&, t]() {
+					std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+					RenderRecorder& recorder = queue.recorder(t);
+					// each thread takes a contiguous slice of the city, as a traversal of one part of the scene would
+					for (int i = count * t / threads; i < count * (t + 1) / threads; i++) {
+						const Instance& building = city.get(i);
+						glm::vec3 position(building.model[3].x, building.model[3].y, building.model[3].z);
+						// a few shaders and materials so the sort has more than depth to order by
+						recorder.drawElements(renderKey(RENDER_PASS_OPAQUE, 1 + i % 3, i % 7, glm::length(position - camera.position)),
+							nullptr, 1, GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+						recorder.setMat4("model", building.model);
+						recorder.setVec3("tint", building.tint);
+					}
+					recordTimes[t] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+				}));
+			}
+			for (size_t t = 0; t < workers.size(); t++)
+				workers[t].join();
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			queue.sort();
+			sortTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		for (size_t i = 1; i < queue.count(); i++) {
+			if (queue.sortedKey(i - 1) > queue.sortedKey(i)) {
+				std::cout << "ERROR::RENDER_QUEUE::NOT_SORTED at packet " << i << std::endl;
+				break;
+			}
+		}
+		// mean of the threads' own rates, the first round also grows the recorders
+		double perThread = 0.0;
+		for (int t = 0; t < threads; t++)
+			perThread += (double)(count * (t + 1) / threads - count * t / threads) / (recordTimes[t] / repeats);
+		perThread /= threads;
+		std::cout << threads << (threads == 1 ? " thread: " : " threads: ") << perThread << " packets/ms per thread, "
+			<< perThread * threads << " packets/ms in total, sorted in " << sortTime / repeats << " ms" << std::endl;
+		if (threads == cores)
+			break;
+	}
+}
+
+// Fills the global building mesh, sized exactly so there is one allocation per buffer.
+// optimize welds and reorders it, meshOptimizer.lastReport has the numbers. The pack stores the optimized mesh.
+void generateBuilding(BuildingGenerator& building, bool optimize)
+{
+	vertices.resize(building.vertexCount() * BUILDING_VERTEX_SIZE);
+	indices.resize(building.indexCount());
+	building.generate(&vertices[0], &indices[0]);
+	if (optimize)
+		meshOptimizer.optimize(vertices, indices, BUILDING_VERTEX_SIZE);
+}
+
+// Compares the default generated building with the hand made mesh, every float has to be bit for bit identical
+bool checkBuilding()
+{
+	BuildingGenerator building;
+	// the generator itself is compared, before any optimization
+	generateBuilding(building, false);
+	const size_t referenceVertexFloats = sizeof(referenceVertices) / sizeof(referenceVertices[0]);
+	const size_t referenceIndexCount = sizeof(referenceIndices) / sizeof(referenceIndices[0]);
+	if (vertices.size() != referenceVertexFloats || indices.size() != referenceIndexCount) {
+		std::cout << "ERROR::BUILDING::SIZE_MISMATCH " << vertices.size() / BUILDING_VERTEX_SIZE << " vertices, " << indices.size()
+			<< " indices, expected " << referenceVertexFloats / BUILDING_VERTEX_SIZE << " and " << referenceIndexCount << std::endl;
+		return false;
+	}
+	if (memcmp(&vertices[0], referenceVertices, sizeof(referenceVertices)) != 0) {
+		for (size_t i = 0; i < referenceVertexFloats; i++) {
+			if (memcmp(&vertices[i], &referenceVertices[i], sizeof(GLfloat)) != 0) {
+				std::cout << "ERROR::BUILDING::VERTEX_MISMATCH vertex " << i / BUILDING_VERTEX_SIZE << " component " << i % BUILDING_VERTEX_SIZE
+					<< ": " << vertices[i] << ", expected " << referenceVertices[i] << std::endl;
+				break;
+			}
+		}
+		return false;
+	}
+	for (size_t i = 0; i < referenceIndexCount; i++) {
+		if (indices[i] != (GLuint)referenceIndices[i]) {
+			std::cout << "ERROR::BUILDING::INDEX_MISMATCH index " << i << ": " << indices[i] << ", expected " << referenceIndices[i] << std::endl;
+			return false;
+		}
+	}
+	std::cout << "Generated building matches the reference mesh (" << vertices.size() / BUILDING_VERTEX_SIZE << " vertices, "
+		<< indices.size() / 3 << " triangles)" << std::endl;
+	return true;
+}
+
+// Generator throughput on increasingly tall buildings, buffers are allocated once outside the timed loop
+void benchBuilding()
+{
+	const int floorCounts[] = { 3, 30, 300, 3000 };
+	for (int floors : floorCounts) {
+		BuildingGenerator building;
+		building.floors = floors;
+		building.bays = 8;
+		std::vector<GLfloat> outVertices(building.vertexCount() * BUILDING_VERTEX_SIZE);
+		std::vector<GLuint> outIndices(building.indexCount());
+		// repeat small buildings so every size generates roughly the same number of vertices
+		int repeats = std::max(1, 2000000 / (int)building.vertexCount());
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < repeats; i++)
+			building.generate(&outVertices[0], &outIndices[0]);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		std::cout << floors << " floors x " << building.bays << " bays: " << building.vertexCount() << " vertices, "
+			<< building.indexCount() / 3 << " triangles, " << ms / repeats << " ms per building, "
+			<< building.vertexCount() * repeats / ms << " vertices/ms" << std::endl;
+		std::vector<GLfloat> optimizedVertices(outVertices);
+		std::vector<GLuint> optimizedIndices(outIndices);
+		meshOptimizer.optimize(optimizedVertices, optimizedIndices, BUILDING_VERTEX_SIZE);
+		meshOptimizer.report("  optimized");
+	}
+}
+
+// Memory of the building in each vertex format, and the vertex and instance bytes a frame of each city size fetches at 60 fps.
+// The fetch is estimated, not measured: every post-transform cache miss reads one vertex, every instance its Instance once.
+void benchVertexFormat()
+{
+	BuildingGenerator building;
+	generateBuilding(building);
+	size_t vertexCount = vertices.size() / BUILDING_VERTEX_SIZE;
+	double misses = meshOptimizer.lastReport.after.acmr * (indices.size() / 3);
+	std::cout << "Building: " << vertexCount << " vertices, " << indices.size() / 3 << " triangles, " << misses
+		<< " vertex fetches per instance, " << sizeof(Instance) << " bytes per instance" << std::endl;
+	std::cout << "Uncompacted: " << BUILDING_VERTEX_SIZE * sizeof(GLfloat) << " bytes per vertex, "
+		<< vertices.size() * sizeof(GLfloat) / 1024.0 << " KB" << std::endl;
+	for (int format = VERTEX_POSITION_FLOAT; format <= VERTEX_POSITION_HALF; format++) {
+		CompactVertices compact;
+		compact.pack(&vertices[0], vertexCount, BUILDING_VERTEX_SIZE, (VertexPositionFormat)format);
+		std::cout << positionFormatNames[format] << ": " << compact.layout.stride << " bytes per vertex, "
+			<< compact.data.size() / 1024.0 << " KB, largest position error " << compact.maxError << std::endl;
+		for (int count : cityBenchCounts) {
+			double vertexBytes = misses * compact.layout.stride * count;
+			double instanceBytes = (double)sizeof(Instance) * count;
+			std::cout << "  " << count << " buildings: " << vertexBytes / 1048576.0 << " MB vertices + " << instanceBytes / 1048576.0
+				<< " MB instances per frame, " << (vertexBytes + instanceBytes) * 60 / 1048576.0 << " MB/s at 60 fps" << std::endl;
+		}
+	}
+}
+
+// Writes the shader sources and the default building mesh to assets.pack
+bool writeAssetPack()
+{
+	BuildingGenerator building;
+	generateBuilding(building);
+	AssetPackWriter writer;
+	bool added = writer.addFile("exampleShader.vert", ASSET_SHADER) && writer.addFile("exampleShader.frag", ASSET_SHADER)
+		&& writer.addFile("transform.glsl", ASSET_SHADER) && writer.addFile("frame.glsl", ASSET_SHADER)
+		&& writer.add("building.vertices", ASSET_MESH, &vertices[0], vertices.size() * sizeof(GLfloat))
+		&& writer.add("building.indices", ASSET_MESH, &indices[0], indices.size() * sizeof(GLuint));
+	if (!added || !writer.write(ASSET_PACK_FILE)) {
+		std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_WRITTEN " << ASSET_PACK_FILE << std::endl;
+		return false;
+	}
+	std::cout << "Wrote " << ASSET_PACK_FILE << std::endl;
+	return true;
+}
+
+// Time until the shaders and the building mesh are in memory: read from the loose files and generated,
+// against mapped from assets.pack. Cold runs drop the files from the page cache first, which needs Linux.
+void benchPack()
+{
+	const char* files[] = { "exampleShader.vert", "exampleShader.frag", "transform.glsl", "frame.glsl", ASSET_PACK_FILE };
+	const char* entries[] = { "exampleShader.vert", "exampleShader.frag", "transform.glsl", "frame.glsl", "building.vertices", "building.indices" };
+	const int warmRuns = 50;
+	AssetPack pack;
+	if (!pack.open(ASSET_PACK_FILE)) {
+		std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_READ " << ASSET_PACK_FILE << ", run --pack first" << std::endl;
+		return;
+	}
+	std::cout << ASSET_PACK_FILE << ": " << pack.count() << " assets, " << pack.size() / 1024.0 << " KB" << std::endl;
+	pack.close();
+	bool canEvict = AssetPack::evictFromCache(ASSET_PACK_FILE);
+	if (!canEvict)
+		std::cout << "  cold: dropping files from the page cache is only supported on Linux" << std::endl;
+	unsigned checksum = 0;
+	for (int cold = canEvict ? 1 : 0; cold >= 0; cold--) {
+		double times[2] = { 0.0, 0.0 };
+		int runs = cold ? 1 : warmRuns;
+		for (int source = 0; source < 2; source++) {
+			for (int run = 0; run < runs; run++) {
+				if (cold) {
+					for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++)
+						AssetPack::evictFromCache(files[f]);
+				}
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				if (source == 0) {
+					std::string vertexCode, fragmentCode, transformCode, frameCode;
+					Shader::readSources("exampleShader.vert", "exampleShader.frag", vertexCode, fragmentCode);
+					Shader::readSources("transform.glsl", "frame.glsl", transformCode, frameCode);
+					BuildingGenerator building;
+					generateBuilding(building);
+					checksum += (unsigned)(vertexCode.size() + fragmentCode.size() + transformCode.size() + frameCode.size() + vertices.size());
+				}
+				else {
+					pack.open(ASSET_PACK_FILE);
+					for (size_t e = 0; e < sizeof(entries) / sizeof(entries[0]); e++) {
+						const AssetEntry* entry = pack.find(entries[e]);
+						if (entry != nullptr)
+							checksum += pack.touch(entry);
+					}
+					pack.close();
+				}
+				times[source] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+		}
+		std::cout << (cold ? "  cold" : "  warm") << "  loose files: " << times[0] / runs << " ms, " << ASSET_PACK_FILE << ": " << times[1] / runs << " ms" << std::endl;
+	}
+	// keeps the reads from being optimised away
+	volatile unsigned sink = checksum;
+	(void)sink;
 }
 
 // Is called whenever a key is pressed/released via GLFW
@@ -951,17 +1711,33 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	if (key == GLFW_KEY_F && action == GLFW_PRESS) {
 		if (wireframeMode == false) {
 			wireframeMode = true;
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); // wireframe mode
+			GLState::current().polygonMode(GL_LINE); // wireframe mode
 		}
 		else {
 			wireframeMode = false;
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // wireframe mode
+			GLState::current().polygonMode(GL_FILL); // wireframe mode
 		}
 	}
 	if (key == GLFW_KEY_P && action == GLFW_PRESS) {
 		if (lockCamera == true) lockCamera = false;
 		else lockCamera = true;
 	}
+	if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+		// print the uniform calls saved by the Shader setters in the last frame
+		std::cout << "Uniform calls issued: " << lastFrameStats.callsIssued << ", saved: " << lastFrameStats.callsSaved << std::endl;
+		std::cout << "State calls issued: " << lastStateStats.callsIssued << ", filtered: " << lastStateStats.callsFiltered << std::endl;
+		std::cout << "Render queue: " << lastQueueStats.packets << " packets, " << lastQueueStats.shaderChanges << " shader changes, " << lastQueueStats.vertexArrayChanges << " VAO changes";
+		if (lastQueueStats.droppedUniforms > 0)
+			std::cout << ", " << lastQueueStats.droppedUniforms << " uniforms dropped, set before a draw";
+		std::cout << std::endl;
+		std::cout << "Instance uploads: " << lastInstanceUpload.calls << " calls, " << lastInstanceUpload.instances << " instances" << std::endl;
+		std::cout << "Visible buildings: " << visibleBuildings.size() << " of " << cityBounds.size() << ", culled in " << lastCullTime << " us" << std::endl;
+	}
+	if (key == GLFW_KEY_K && action == GLFW_PRESS) {
+		cullingEnabled = !cullingEnabled;
+		visibleCameraVersion = 0;
+		std::cout << "Frustum culling " << (cullingEnabled ? "on" : "off") << std::endl;
+	}
 
 	
 
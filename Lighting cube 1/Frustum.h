@@ -0,0 +1,376 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+// SIMD culling kernels are only built for x86, other platforms use the scalar kernel
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FRUSTUM_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FRUSTUM_TARGET_AVX
+#define FRUSTUM_TARGET_SSE
+#else
+// lets gcc/clang build the kernels without -mavx, the kernel is only called after checking the cpu
+#define FRUSTUM_TARGET_AVX __attribute__((target("avx")))
+#define FRUSTUM_TARGET_SSE __attribute__((target("sse2")))
+#endif
+#endif
+
+// GL Includes
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+
+// to skip objects the camera cannot see:
+// 1. store the bounds of every object, one array per component
+//		CullBoxes boxes;
+//		boxes.add(min, max);
+// 2. each frame cull the whole array at once against the frustum of the camera, visible gets the indices of the boxes it sees
+//		std::vector<uint32_t> visible;
+// while (...) {
+//     camera.GetFrustum().cullBoxes(boxes, visible);
+//     for (size_t i = 0; i < visible.size(); i++)
+//         DrawStuff(visible[i]);
+// }
+// The batch functions test 4 (SSE) or 8 (AVX) objects per instruction and write the visible indices packed together.
+
+// Axis aligned boxes in structure of arrays layout
+struct CullBoxes
+{
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+
+	size_t size() const { return this->minX.size(); }
+
+	void clear()
+	{
+		this->minX.clear(); this->minY.clear(); this->minZ.clear();
+		this->maxX.clear(); this->maxY.clear(); this->maxZ.clear();
+	}
+
+	void add(const glm::vec3& min, const glm::vec3& max)
+	{
+		this->minX.push_back(min.x); this->minY.push_back(min.y); this->minZ.push_back(min.z);
+		this->maxX.push_back(max.x); this->maxY.push_back(max.y); this->maxZ.push_back(max.z);
+	}
+};
+
+// Bounding spheres in structure of arrays layout
+struct CullSpheres
+{
+	std::vector<float> x, y, z, radius;
+
+	size_t size() const { return this->x.size(); }
+
+	void clear()
+	{
+		this->x.clear(); this->y.clear(); this->z.clear(); this->radius.clear();
+	}
+
+	void add(const glm::vec3& centre, float r)
+	{
+		this->x.push_back(centre.x); this->y.push_back(centre.y); this->z.push_back(centre.z); this->radius.push_back(r);
+	}
+};
+
+enum FrustumKernel
+{
+	FRUSTUM_KERNEL_SCALAR,
+	FRUSTUM_KERNEL_SSE,	// 4 objects per instruction
+	FRUSTUM_KERNEL_AVX	// 8 objects per instruction
+};
+
+class Frustum
+{
+public:
+	// left, right, bottom, top, near, far as (normal, distance) with the normals pointing inside
+	glm::vec4 planes[6];
+
+	// Everything is inside until planes are extracted
+	Frustum()
+	{
+		for (int i = 0; i < 6; i++)
+			this->planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+	}
+
+	explicit Frustum(const glm::mat4& viewProjection)
+	{
+		this->extract(viewProjection);
+	}
+
+	// Gribb/Hartmann plane extraction, each plane is the last row of the matrix plus or minus one of the others
+	void extract(const glm::mat4& m)
+	{
+		for (int i = 0; i < 3; i++) {
+			glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+			glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+			this->planes[i * 2] = w + row;
+			this->planes[i * 2 + 1] = w - row;
+		}
+		// normalized so sphere radii can be compared with the plane distance
+		for (int i = 0; i < 6; i++) {
+			glm::vec4& p = this->planes[i];
+			float length = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+			if (length > 0.0f)
+				p = p * (1.0f / length);
+		}
+	}
+
+	// Single object tests, conservative: objects near the corners of the frustum may be reported visible
+	bool containsBox(const glm::vec3& min, const glm::vec3& max) const
+	{
+		for (int i = 0; i < 6; i++) {
+			const glm::vec4& p = this->planes[i];
+			// the corner furthest along the plane normal
+			float x = p.x > 0.0f ? max.x : min.x;
+			float y = p.y > 0.0f ? max.y : min.y;
+			float z = p.z > 0.0f ? max.z : min.z;
+			// same order of additions as the SIMD kernels so every kernel gives the same result
+			if ((p.x * x + p.y * y) + (p.z * z + p.w) < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	bool containsSphere(const glm::vec3& centre, float radius) const
+	{
+		for (int i = 0; i < 6; i++) {
+			const glm::vec4& p = this->planes[i];
+			if ((p.x * centre.x + p.y * centre.y) + (p.z * centre.z + p.w) < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	// Batch tests, visible is replaced by the indices of the objects inside in ascending order
+	size_t cullBoxes(const CullBoxes& boxes, std::vector<uint32_t>& visible, FrustumKernel kernel = bestKernel()) const
+	{
+		size_t count = boxes.size();
+		visible.resize(count);
+		if (count == 0)
+			return 0;
+		size_t found;
+		switch (kernel) {
+#ifdef FRUSTUM_X86
+		case FRUSTUM_KERNEL_AVX: found = this->cullBoxesAVX(boxes, &visible[0]); break;
+		case FRUSTUM_KERNEL_SSE: found = this->cullBoxesSSE(boxes, &visible[0]); break;
+#endif
+		default: found = this->cullBoxesScalar(boxes, 0, count, &visible[0], 0); break;
+		}
+		visible.resize(found);
+		return found;
+	}
+
+	size_t cullSpheres(const CullSpheres& spheres, std::vector<uint32_t>& visible, FrustumKernel kernel = bestKernel()) const
+	{
+		size_t count = spheres.size();
+		visible.resize(count);
+		if (count == 0)
+			return 0;
+		size_t found;
+		switch (kernel) {
+#ifdef FRUSTUM_X86
+		case FRUSTUM_KERNEL_AVX: found = this->cullSpheresAVX(spheres, &visible[0]); break;
+		case FRUSTUM_KERNEL_SSE: found = this->cullSpheresSSE(spheres, &visible[0]); break;
+#endif
+		default: found = this->cullSpheresScalar(spheres, 0, count, &visible[0], 0); break;
+		}
+		visible.resize(found);
+		return found;
+	}
+
+	// Fastest kernel supported by this cpu, checked once
+	static FrustumKernel bestKernel()
+	{
+		static const FrustumKernel best = detectKernel();
+		return best;
+	}
+
+	static const char* kernelName(FrustumKernel kernel)
+	{
+		switch (kernel) {
+		case FRUSTUM_KERNEL_AVX: return "AVX";
+		case FRUSTUM_KERNEL_SSE: return "SSE";
+		default: return "scalar";
+		}
+	}
+
+private:
+	static FrustumKernel detectKernel()
+	{
+#ifdef FRUSTUM_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		// AVX also needs the OS to save the ymm registers
+		bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+#else
+		__builtin_cpu_init();
+		bool sse2 = __builtin_cpu_supports("sse2") != 0;
+		bool avx = __builtin_cpu_supports("avx") != 0;
+#endif
+		if (avx)
+			return FRUSTUM_KERNEL_AVX;
+		if (sse2)
+			return FRUSTUM_KERNEL_SSE;
+#endif
+		return FRUSTUM_KERNEL_SCALAR;
+	}
+
+	// Scalar kernels, also finish the objects left over after the last full SIMD group
+	size_t cullBoxesScalar(const CullBoxes& boxes, size_t start, size_t end, uint32_t* out, size_t found) const
+	{
+		for (size_t i = start; i < end; i++) {
+			glm::vec3 min(boxes.minX[i], boxes.minY[i], boxes.minZ[i]);
+			glm::vec3 max(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+			// written every time, only kept by moving on when visible, avoids a branch per object
+			out[found] = (uint32_t)i;
+			found += this->containsBox(min, max) ? 1 : 0;
+		}
+		return found;
+	}
+
+	size_t cullSpheresScalar(const CullSpheres& spheres, size_t start, size_t end, uint32_t* out, size_t found) const
+	{
+		for (size_t i = start; i < end; i++) {
+			out[found] = (uint32_t)i;
+			found += this->containsSphere(glm::vec3(spheres.x[i], spheres.y[i], spheres.z[i]), spheres.radius[i]) ? 1 : 0;
+		}
+		return found;
+	}
+
+#ifdef FRUSTUM_X86
+	// Appends the lanes set in mask, lowest lane first
+	static size_t packVisible(int mask, int lanes, size_t first, uint32_t* out, size_t found)
+	{
+		for (int lane = 0; lane < lanes; lane++) {
+			out[found] = (uint32_t)(first + lane);
+			found += (mask >> lane) & 1;
+		}
+		return found;
+	}
+
+	// For each plane the furthest corner comes from the same min or max array for every box,
+	// so the arrays are picked once per plane outside the loop
+	void selectCorners(const CullBoxes& boxes, const float* cornerX[6], const float* cornerY[6], const float* cornerZ[6]) const
+	{
+		for (int p = 0; p < 6; p++) {
+			const glm::vec4& plane = this->planes[p];
+			cornerX[p] = &(plane.x > 0.0f ? boxes.maxX : boxes.minX)[0];
+			cornerY[p] = &(plane.y > 0.0f ? boxes.maxY : boxes.minY)[0];
+			cornerZ[p] = &(plane.z > 0.0f ? boxes.maxZ : boxes.minZ)[0];
+		}
+	}
+
+	FRUSTUM_TARGET_SSE size_t cullBoxesSSE(const CullBoxes& boxes, uint32_t* out) const
+	{
+		const float* cornerX[6];
+		const float* cornerY[6];
+		const float* cornerZ[6];
+		this->selectCorners(boxes, cornerX, cornerY, cornerZ);
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm_set1_ps(this->planes[p].x);
+			planeY[p] = _mm_set1_ps(this->planes[p].y);
+			planeZ[p] = _mm_set1_ps(this->planes[p].z);
+			planeW[p] = _mm_set1_ps(this->planes[p].w);
+		}
+		size_t count = boxes.size(), found = 0, i = 0;
+		for (; i + 4 <= count; i += 4) {
+			int outside = 0;
+			// most objects of a big scene fail the first plane or two, stop once all four are out
+			for (int p = 0; p < 6 && outside != 0xF; p++) {
+				__m128 x = _mm_loadu_ps(cornerX[p] + i);
+				__m128 y = _mm_loadu_ps(cornerY[p] + i);
+				__m128 z = _mm_loadu_ps(cornerZ[p] + i);
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])), _mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+				outside |= _mm_movemask_ps(_mm_cmplt_ps(distance, _mm_setzero_ps()));
+			}
+			found = packVisible(~outside, 4, i, out, found);
+		}
+		return this->cullBoxesScalar(boxes, i, count, out, found);
+	}
+
+	FRUSTUM_TARGET_AVX size_t cullBoxesAVX(const CullBoxes& boxes, uint32_t* out) const
+	{
+		const float* cornerX[6];
+		const float* cornerY[6];
+		const float* cornerZ[6];
+		this->selectCorners(boxes, cornerX, cornerY, cornerZ);
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm256_set1_ps(this->planes[p].x);
+			planeY[p] = _mm256_set1_ps(this->planes[p].y);
+			planeZ[p] = _mm256_set1_ps(this->planes[p].z);
+			planeW[p] = _mm256_set1_ps(this->planes[p].w);
+		}
+		size_t count = boxes.size(), found = 0, i = 0;
+		for (; i + 8 <= count; i += 8) {
+			int outside = 0;
+			for (int p = 0; p < 6 && outside != 0xFF; p++) {
+				__m256 x = _mm256_loadu_ps(cornerX[p] + i);
+				__m256 y = _mm256_loadu_ps(cornerY[p] + i);
+				__m256 z = _mm256_loadu_ps(cornerZ[p] + i);
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, planeX[p]), _mm256_mul_ps(y, planeY[p])), _mm256_add_ps(_mm256_mul_ps(z, planeZ[p]), planeW[p]));
+				outside |= _mm256_movemask_ps(_mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+			}
+			found = packVisible(~outside, 8, i, out, found);
+		}
+		return this->cullBoxesScalar(boxes, i, count, out, found);
+	}
+
+	FRUSTUM_TARGET_SSE size_t cullSpheresSSE(const CullSpheres& spheres, uint32_t* out) const
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm_set1_ps(this->planes[p].x);
+			planeY[p] = _mm_set1_ps(this->planes[p].y);
+			planeZ[p] = _mm_set1_ps(this->planes[p].z);
+			planeW[p] = _mm_set1_ps(this->planes[p].w);
+		}
+		size_t count = spheres.size(), found = 0, i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128 x = _mm_loadu_ps(&spheres.x[i]);
+			__m128 y = _mm_loadu_ps(&spheres.y[i]);
+			__m128 z = _mm_loadu_ps(&spheres.z[i]);
+			__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+			int outside = 0;
+			for (int p = 0; p < 6 && outside != 0xF; p++) {
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])), _mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+				outside |= _mm_movemask_ps(_mm_cmplt_ps(distance, negativeRadius));
+			}
+			found = packVisible(~outside, 4, i, out, found);
+		}
+		return this->cullSpheresScalar(spheres, i, count, out, found);
+	}
+
+	FRUSTUM_TARGET_AVX size_t cullSpheresAVX(const CullSpheres& spheres, uint32_t* out) const
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (int p = 0; p < 6; p++) {
+			planeX[p] = _mm256_set1_ps(this->planes[p].x);
+			planeY[p] = _mm256_set1_ps(this->planes[p].y);
+			planeZ[p] = _mm256_set1_ps(this->planes[p].z);
+			planeW[p] = _mm256_set1_ps(this->planes[p].w);
+		}
+		size_t count = spheres.size(), found = 0, i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256 x = _mm256_loadu_ps(&spheres.x[i]);
+			__m256 y = _mm256_loadu_ps(&spheres.y[i]);
+			__m256 z = _mm256_loadu_ps(&spheres.z[i]);
+			__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+			int outside = 0;
+			for (int p = 0; p < 6 && outside != 0xFF; p++) {
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, planeX[p]), _mm256_mul_ps(y, planeY[p])), _mm256_add_ps(_mm256_mul_ps(z, planeZ[p]), planeW[p]));
+				outside |= _mm256_movemask_ps(_mm256_cmp_ps(distance, negativeRadius, _CMP_LT_OQ));
+			}
+			found = packVisible(~outside, 8, i, out, found);
+		}
+		return this->cullSpheresScalar(spheres, i, count, out, found);
+	}
+#endif
+};
@@ -0,0 +1,317 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// GL Includes
+#include <GLEW/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Shader.h"
+#include "GLState.h"
+#include "FrameArena.h"
+
+// to record draws on any thread and send them to GL in the order that changes the least state:
+// 1. create the queue with one recorder per thread that records
+//		RenderQueue queue(threads);
+// 2. every thread records packets into its own recorder, then sets the uniforms of each packet after its draw
+//		RenderRecorder& recorder = queue.recorder(thread);
+//		recorder.drawElements(renderKey(RENDER_PASS_OPAQUE, shader.program, material, depth), &shader, VAO, GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+//		recorder.setMat4("model", model);
+//    a uniform set before the recorder's first draw of the frame has no packet to belong to, it is dropped and counted
+//    in lastReplay.droppedUniforms. Names are kept as pointers, not copied, and must stay valid until replay(): pass string literals
+// 3. once every thread is done, sort and replay on the render thread, then clear for the next frame
+//		queue.sort();
+//		queue.replay();
+//		queue.clear();
+// Recorders only append to their own buffers, so recording needs no locks. clear() keeps the capacity and uniform
+// values go to a FrameArena per recorder, so after the first frames recording allocates nothing. Replay changes
+// program and VAO through GLState and uniforms through the Shader setters, so packets that share them cost no extra GL calls.
+
+// Passes are drawn in this order, the top bits of the key
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE = 0,
+	RENDER_PASS_TRANSPARENT = 1,
+	RENDER_PASS_OVERLAY = 2
+};
+
+// 4 bits pass, 12 bits shader, 16 bits material, 32 bits depth. Packets sort by pass, then shader, then material,
+// then front to back. shader is usually the program name, names above 4095 share slots and only sort less well.
+// depth is a distance in front of the camera, the bits of a positive float sort like the float.
+// For back to front drawing, as transparent passes need, pass a large value minus the distance.
+inline uint64_t renderKey(unsigned pass, unsigned shader, unsigned material, GLfloat depth)
+{
+	uint32_t depthBits = 0;
+	if (depth > 0.0f)
+		std::memcpy(&depthBits, &depth, sizeof(depthBits));
+	return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(shader & 0xFFF) << 48) | ((uint64_t)(material & 0xFFFF) << 32) | depthBits;
+}
+
+// One draw call with its state
+struct RenderPacket
+{
+	uint64_t key;
+	Shader* shader;
+	GLuint vertexArray;
+	GLenum mode;
+	GLenum indexType;	// 0 for glDrawArrays
+	GLint first;		// first vertex, or byte offset into the element buffer
+	GLsizei count;
+	GLsizei instances;
+	uint32_t uniformBegin;	// range in the recorder's uniform list
+	uint32_t uniformEnd;
+};
+
+// A uniform value of a packet, the floats are in the recorder's arena
+struct RenderUniform
+{
+	const char* name;
+	const GLfloat* value;
+	uint32_t components;	// 1, 3 or 16
+};
+
+// Packets recorded by one thread
+class RenderRecorder
+{
+public:
+	std::vector<RenderPacket> packets;
+	std::vector<RenderUniform> uniforms;
+	// uniforms set while there was no packet, since the last clear()
+	unsigned droppedUniforms;
+	// uniform values, they stay valid for FRAME_ARENA_FRAMES - 1 clears
+	FrameArena values;
+
+	RenderRecorder() : droppedUniforms(0) {}
+
+	void drawArrays(uint64_t key, Shader* shader, GLuint vertexArray, GLenum mode, GLint first, GLsizei count, GLsizei instances = 1)
+	{
+		this->add(key, shader, vertexArray, mode, 0, first, count, instances);
+	}
+
+	void drawElements(uint64_t key, Shader* shader, GLuint vertexArray, GLenum mode, GLsizei count, GLenum indexType, size_t offset, GLsizei instances = 1)
+	{
+		this->add(key, shader, vertexArray, mode, indexType, (GLint)offset, count, instances);
+	}
+
+	// Uniforms of the last packet
+	void setFloat(const char* name, GLfloat value) { this->setUniform(name, &value, 1); }
+	void setVec3(const char* name, const glm::vec3& value) { this->setUniform(name, glm::value_ptr(value), 3); }
+	void setMat4(const char* name, const glm::mat4& value) { this->setUniform(name, glm::value_ptr(value), 16); }
+
+	void clear()
+	{
+		this->packets.clear();
+		this->uniforms.clear();
+		this->droppedUniforms = 0;
+		this->values.beginFrame();
+	}
+
+private:
+	// keeps the vectors of two recorders off the same cache line, they are written by different threads
+	char padding[64];
+
+	void add(uint64_t key, Shader* shader, GLuint vertexArray, GLenum mode, GLenum indexType, GLint first, GLsizei count, GLsizei instances)
+	{
+		RenderPacket packet;
+		packet.key = key;
+		packet.shader = shader;
+		packet.vertexArray = vertexArray;
+		packet.mode = mode;
+		packet.indexType = indexType;
+		packet.first = first;
+		packet.count = count;
+		packet.instances = instances;
+		packet.uniformBegin = packet.uniformEnd = (uint32_t)this->uniforms.size();
+		this->packets.push_back(packet);
+	}
+
+	void setUniform(const char* name, const GLfloat* value, uint32_t components)
+	{
+		if (this->packets.empty()) {
+			this->droppedUniforms++;
+			return;
+		}
+		GLfloat* copy = this->values.allocate<GLfloat>(components);
+		std::memcpy(copy, value, components * sizeof(GLfloat));
+		RenderUniform uniform;
+		uniform.name = name;
+		uniform.value = copy;
+		uniform.components = components;
+		this->uniforms.push_back(uniform);
+		this->packets.back().uniformEnd = (uint32_t)this->uniforms.size();
+	}
+};
+
+// Program and vertex array changes between consecutive packets of the last replay, for profiling
+struct RenderQueueStats
+{
+	unsigned packets;
+	unsigned shaderChanges;
+	unsigned vertexArrayChanges;
+	unsigned droppedUniforms;	// set before any draw of their recorder, see the usage comment
+};
+
+class RenderQueue
+{
+public:
+	RenderQueueStats lastReplay;
+
+	explicit RenderQueue(int threads = 1)
+	{
+		for (int i = 0; i < std::max(threads, 1); i++)
+			this->recorders.push_back(new RenderRecorder());
+		this->lastReplay.packets = 0;
+		this->lastReplay.shaderChanges = 0;
+		this->lastReplay.vertexArrayChanges = 0;
+		this->lastReplay.droppedUniforms = 0;
+	}
+
+	~RenderQueue()
+	{
+		for (size_t i = 0; i < this->recorders.size(); i++)
+			delete this->recorders[i];
+	}
+
+	int threads() const { return (int)this->recorders.size(); }
+	RenderRecorder& recorder(int thread) { return *this->recorders[thread]; }
+
+	// Packets of every recorder
+	size_t count() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < this->recorders.size(); i++)
+			total += this->recorders[i]->packets.size();
+		return total;
+	}
+
+	// Orders the packets of every recorder by key. Stable, equal keys keep the order of the recorders and of recording.
+	void sort()
+	{
+		this->order.clear();
+		for (uint32_t r = 0; r < (uint32_t)this->recorders.size(); r++) {
+			const std::vector<RenderPacket>& packets = this->recorders[r]->packets;
+			for (uint32_t i = 0; i < (uint32_t)packets.size(); i++) {
+				SortItem item = { packets[i].key, r, i };
+				this->order.push_back(item);
+			}
+		}
+		radixSort(this->order, this->scratch);
+	}
+
+	// Sorted keys, for checking the order
+	uint64_t sortedKey(size_t i) const { return this->order[i].key; }
+
+	// Draws the sorted packets on the render thread
+	void replay()
+	{
+		GLState& state = GLState::current();
+		RenderQueueStats stats = { 0, 0, 0, 0 };
+		for (size_t r = 0; r < this->recorders.size(); r++)
+			stats.droppedUniforms += this->recorders[r]->droppedUniforms;
+		const Shader* lastShader = nullptr;
+		GLuint lastVertexArray = 0;
+		for (size_t i = 0; i < this->order.size(); i++) {
+			const RenderRecorder& recorder = *this->recorders[this->order[i].recorder];
+			const RenderPacket& packet = recorder.packets[this->order[i].packet];
+			if (i == 0 || packet.shader != lastShader)
+				stats.shaderChanges++;
+			if (i == 0 || packet.vertexArray != lastVertexArray)
+				stats.vertexArrayChanges++;
+			lastShader = packet.shader;
+			lastVertexArray = packet.vertexArray;
+			packet.shader->use();
+			state.bindVertexArray(packet.vertexArray);
+			for (uint32_t u = packet.uniformBegin; u < packet.uniformEnd; u++) {
+				const RenderUniform& uniform = recorder.uniforms[u];
+				const GLfloat* value = uniform.value;
+				if (uniform.components == 1)
+					packet.shader->setFloat(uniform.name, value[0]);
+				else if (uniform.components == 3)
+					packet.shader->setVec3(uniform.name, value[0], value[1], value[2]);
+				else
+					packet.shader->setMat4(uniform.name, glm::make_mat4(value));
+			}
+			if (packet.indexType == 0) {
+				if (packet.instances == 1)
+					glDrawArrays(packet.mode, packet.first, packet.count);
+				else
+					glDrawArraysInstanced(packet.mode, packet.first, packet.count, packet.instances);
+			}
+			else {
+				const GLvoid* offset = (const GLvoid*)(uintptr_t)packet.first;
+				if (packet.instances == 1)
+					glDrawElements(packet.mode, packet.count, packet.indexType, offset);
+				else
+					glDrawElementsInstanced(packet.mode, packet.count, packet.indexType, offset, packet.instances);
+			}
+			stats.packets++;
+		}
+		this->lastReplay = stats;
+	}
+
+	// Empties every recorder and the sorted order, keeping their memory
+	void clear()
+	{
+		for (size_t i = 0; i < this->recorders.size(); i++)
+			this->recorders[i]->clear();
+		this->order.clear();
+	}
+
+private:
+	struct SortItem
+	{
+		uint64_t key;
+		uint32_t recorder;
+		uint32_t packet;
+	};
+
+	// separate allocations, each recorder is written by its own thread
+	std::vector<RenderRecorder*> recorders;
+	std::vector<SortItem> order;
+	std::vector<SortItem> scratch;
+
+	// LSD radix sort on the key, one byte per pass. The histograms of all 8 bytes are counted in one read of the keys
+	// and passes where every key has the same byte are skipped, which is most of them when few shaders and materials are used.
+	static void radixSort(std::vector<SortItem>& items, std::vector<SortItem>& scratch)
+	{
+		size_t count = items.size();
+		if (count < 2)
+			return;
+		scratch.resize(count);
+		size_t histograms[8][256];
+		std::memset(histograms, 0, sizeof(histograms));
+		for (size_t i = 0; i < count; i++) {
+			uint64_t key = items[i].key;
+			for (int b = 0; b < 8; b++)
+				histograms[b][(key >> (b * 8)) & 0xFF]++;
+		}
+		SortItem* from = &items[0];
+		SortItem* to = &scratch[0];
+		for (int b = 0; b < 8; b++) {
+			size_t* histogram = histograms[b];
+			int shift = b * 8;
+			if (histogram[(from[0].key >> shift) & 0xFF] == count)
+				continue;
+			size_t offset = 0;
+			for (int digit = 0; digit < 256; digit++) {
+				size_t digitCount = histogram[digit];
+				histogram[digit] = offset;
+				offset += digitCount;
+			}
+			for (size_t i = 0; i < count; i++)
+				to[histogram[(from[i].key >> shift) & 0xFF]++] = from[i];
+			std::swap(from, to);
+		}
+		if (from != &items[0])
+			items.swap(scratch);
+	}
+
+	// not copyable, the recorders belong to one queue
+	RenderQueue(const RenderQueue&);
+	RenderQueue& operator=(const RenderQueue&);
+};
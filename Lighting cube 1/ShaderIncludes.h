@@ -0,0 +1,315 @@
+#pragma once
+
+// Std. Includes
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h> // CreateFileA, ReadFile
+#else
+#include <sys/stat.h> // fstat
+#include <fcntl.h> // open
+#include <unistd.h> // read
+#endif
+
+#include "AssetPack.h"
+
+// to share GLSL between shaders:
+// 1. put the shared code in a file without #version, such as transform.glsl, and include it after #version
+//		#include "transform.glsl"
+//    the name is relative to the folder of the including file, includes can include other files
+// 2. build the shader as usual, every Shader constructor that takes paths resolves the includes
+// 3. when a file changes, drop it from the cache and rebuild the programs that use it
+//		std::vector<std::string> shaders = ShaderIncludes::shared().changed("transform.glsl");
+// Every file is parsed once per process and kept, later programs only copy the parsed text.
+// The shared cache can be used from several threads, such as a thread rebuilding shaders in the background.
+// A file is pasted once per shader however often it is included, as if every file had #pragma once.
+// #line directives keep compile errors pointing at the right line, the second number is the file's id(), 0 for the shader itself.
+
+// Reads a whole file into code with one read call, code is resized to the file and keeps its capacity.
+// The file is read as binary, line endings are passed to GL as they are.
+inline bool readShaderFile(const char* path, std::string& code)
+{
+	bool success = false;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart < MAXDWORD) {
+			code.resize((size_t)size.QuadPart);
+			DWORD read = 0;
+			success = code.empty() || (ReadFile(file, &code[0], (DWORD)code.size(), &read, NULL) && read == code.size());
+		}
+		CloseHandle(file);
+	}
+#else
+	int file = ::open(path, O_RDONLY);
+	if (file >= 0) {
+		struct stat info;
+		if (fstat(file, &info) == 0) {
+			code.resize((size_t)info.st_size);
+			// one call unless the kernel returns less than asked
+			size_t done = 0;
+			while (done < code.size()) {
+				ssize_t count = ::read(file, &code[done], code.size() - done);
+				if (count <= 0)
+					break;
+				done += (size_t)count;
+			}
+			success = done == code.size();
+		}
+		::close(file);
+	}
+#endif
+	if (!success)
+		code.clear();
+	return success;
+}
+
+class ShaderIncludes
+{
+public:
+	// Include files read from disk or the pack, and includes served from the cache instead
+	unsigned filesRead;
+	unsigned filesReused;
+
+	ShaderIncludes() : filesRead(0), filesReused(0) {}
+
+	// The cache shared by every Shader in the process
+	static ShaderIncludes& shared()
+	{
+		static ShaderIncludes includes;
+		return includes;
+	}
+
+	// True if source has an #include line, sources without one are used as they are
+	static bool hasIncludes(const char* source, size_t length)
+	{
+		const char* end = source + length;
+		for (const char* line = source; line < end; ) {
+			while (line < end && (*line == ' ' || *line == '\t'))
+				line++;
+			if (end - line >= 8 && std::memcmp(line, "#include", 8) == 0)
+				return true;
+			line = (const char*)std::memchr(line, '\n', end - line);
+			if (line == nullptr)
+				break;
+			line++;
+		}
+		return false;
+	}
+
+	// Writes source, the shader at path, to expanded with every #include replaced by the file it names.
+	// Included files are taken from pack when it has them, under the same relative path, and otherwise read from disk.
+	// Returns false, after printing the missing file, if an include cannot be found.
+	bool expand(const std::string& path, const char* source, size_t length, std::string& expanded, const AssetPack* pack = nullptr)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		File shader;
+		shader.id = 0;
+		this->parse(path, source, length, shader);
+		this->shaders.insert(path);
+		expanded.clear();
+		expanded.reserve(length * 2);
+		std::set<std::string> included;
+		return this->append(shader, expanded, included, pack);
+	}
+
+	// Drops path from the cache so the next shader reads it again. Returns the shaders to rebuild: path itself if it is one
+	// and every shader that includes it, directly or through other files. Edges are only ever added, so a shader that
+	// stopped including path is still returned until the process restarts.
+	std::vector<std::string> changed(const std::string& path)
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<std::string, File>::iterator cached = this->files.find(path);
+		if (cached != this->files.end())
+			cached->second.loaded = false;
+		std::vector<std::string> affected;
+		std::set<std::string> visited;
+		std::vector<std::string> open(1, path);
+		while (!open.empty()) {
+			std::string file = open.back();
+			open.pop_back();
+			if (!visited.insert(file).second)
+				continue;
+			if (this->shaders.count(file) != 0)
+				affected.push_back(file);
+			std::map<std::string, std::set<std::string> >::const_iterator users = this->includedBy.find(file);
+			if (users != this->includedBy.end())
+				open.insert(open.end(), users->second.begin(), users->second.end());
+		}
+		return affected;
+	}
+
+	// Every file that has been included so far, for watching them
+	std::vector<std::string> includedFiles() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::vector<std::string> paths;
+		for (std::map<std::string, File>::const_iterator it = this->files.begin(); it != this->files.end(); ++it)
+			paths.push_back(it->first);
+		return paths;
+	}
+
+	// Files that include path directly, shaders and other includes
+	std::vector<std::string> includers(const std::string& path) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return this->includersLocked(path);
+	}
+
+	// Number used for path in #line directives, -1 if it has not been included yet
+	int id(const std::string& path) const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<std::string, File>::const_iterator it = this->files.find(path);
+		return it != this->files.end() ? it->second.id : -1;
+	}
+
+	// Prints every included file with its id and the files that include it
+	void report() const
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::cout << this->files.size() << " include files, " << this->filesRead << " read, " << this->filesReused << " reused" << std::endl;
+		for (std::map<std::string, File>::const_iterator it = this->files.begin(); it != this->files.end(); ++it) {
+			std::cout << "  " << it->second.id << " " << it->first << " <-";
+			std::vector<std::string> users = this->includersLocked(it->first);
+			for (size_t i = 0; i < users.size(); i++)
+				std::cout << " " << users[i];
+			std::cout << std::endl;
+		}
+	}
+
+private:
+	// A parsed file: texts[i] is followed by the file includes[i], texts has one entry more than includes.
+	// lines[i] is the line of the file texts[i] starts on.
+	struct File
+	{
+		int id;
+		bool loaded;
+		std::vector<std::string> texts;
+		std::vector<std::string> includes;
+		std::vector<int> lines;
+	};
+
+	std::map<std::string, File> files;
+	// reverse edges of the dependency graph, from a file to the files that include it
+	std::map<std::string, std::set<std::string> > includedBy;
+	// files given to expand(), the roots of the graph
+	std::set<std::string> shaders;
+	mutable std::mutex mutex;
+
+	std::vector<std::string> includersLocked(const std::string& path) const
+	{
+		std::map<std::string, std::set<std::string> >::const_iterator users = this->includedBy.find(path);
+		if (users == this->includedBy.end())
+			return std::vector<std::string>();
+		return std::vector<std::string>(users->second.begin(), users->second.end());
+	}
+
+	// name as written in an #include, relative to the folder of the including file
+	static std::string resolve(const std::string& includer, const std::string& name)
+	{
+		size_t slash = includer.find_last_of("/\\");
+		return slash == std::string::npos ? name : includer.substr(0, slash + 1) + name;
+	}
+
+	void parse(const std::string& path, const char* source, size_t length, File& file)
+	{
+		file.loaded = true;
+		file.texts.assign(1, std::string());
+		file.includes.clear();
+		file.lines.assign(1, 1);
+		const char* end = source + length;
+		int lineNumber = 1;
+		for (const char* line = source; line < end; lineNumber++) {
+			const char* next = (const char*)std::memchr(line, '\n', end - line);
+			next = next != nullptr ? next + 1 : end;
+			const char* directive = line;
+			while (directive < next && (*directive == ' ' || *directive == '\t'))
+				directive++;
+			if (next - directive > 8 && std::memcmp(directive, "#include", 8) == 0) {
+				const char* open = (const char*)std::memchr(directive, '"', next - directive);
+				const char* close = open != nullptr ? (const char*)std::memchr(open + 1, '"', next - open - 1) : nullptr;
+				if (close != nullptr) {
+					std::string included = resolve(path, std::string(open + 1, close));
+					file.includes.push_back(included);
+					this->includedBy[included].insert(path);
+					file.texts.push_back(std::string());
+					file.lines.push_back(lineNumber + 1);
+					line = next;
+					continue;
+				}
+				std::cout << "ERROR::SHADER::INCLUDE::BAD_DIRECTIVE " << path << "(" << lineNumber << ")" << std::endl;
+			}
+			file.texts.back().append(line, next);
+			line = next;
+		}
+	}
+
+	// The parsed file at path, read and parsed the first time or after changed(). nullptr if it cannot be found.
+	const File* load(const std::string& path, const AssetPack* pack)
+	{
+		std::map<std::string, File>::iterator it = this->files.find(path);
+		if (it != this->files.end() && it->second.loaded) {
+			this->filesReused++;
+			return &it->second;
+		}
+		const AssetEntry* entry = pack != nullptr && pack->isOpen() ? pack->find(path.c_str()) : nullptr;
+		std::string code;
+		if (entry == nullptr && !readShaderFile(path.c_str(), code))
+			return nullptr;
+		if (it == this->files.end()) {
+			it = this->files.insert(std::make_pair(path, File())).first;
+			it->second.id = (int)this->files.size();
+		}
+		if (entry != nullptr)
+			this->parse(path, pack->text(entry), (size_t)entry->size, it->second);
+		else
+			this->parse(path, code.c_str(), code.size(), it->second);
+		this->filesRead++;
+		return &it->second;
+	}
+
+	bool append(const File& file, std::string& expanded, std::set<std::string>& included, const AssetPack* pack)
+	{
+		for (size_t i = 0; i < file.texts.size(); i++) {
+			if (i > 0) {
+				// back in this file after an include
+				if (!expanded.empty() && expanded[expanded.size() - 1] != '\n')
+					expanded += '\n';
+				expanded += "#line " + std::to_string(file.lines[i]) + " " + std::to_string(file.id) + "\n";
+			}
+			expanded += file.texts[i];
+			if (i == file.includes.size() || !included.insert(file.includes[i]).second)
+				continue;
+			const File* child = this->load(file.includes[i], pack);
+			if (child == nullptr) {
+				std::cout << "ERROR::SHADER::INCLUDE::FILE_NOT_FOUND " << file.includes[i] << std::endl;
+				return false;
+			}
+			if (!expanded.empty() && expanded[expanded.size() - 1] != '\n')
+				expanded += '\n';
+			expanded += "#line 1 " + std::to_string(child->id) + "\n";
+			// child stays valid, std::map does not move its elements
+			if (!this->append(*child, expanded, included, pack))
+				return false;
+		}
+		return true;
+	}
+
+	// not copyable, there is one shared cache
+	ShaderIncludes(const ShaderIncludes&);
+	ShaderIncludes& operator=(const ShaderIncludes&);
+};
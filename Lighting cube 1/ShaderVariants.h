@@ -0,0 +1,104 @@
+#pragma once
+
+// Std. Includes
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <iostream>
+#include <functional>
+
+#include "Shader.h"
+#include "AssetPack.h"
+
+// to build specialised copies of one shader from sets of #define values instead of uniforms and branches:
+// 1. read the sources once, from the files or from an open AssetPack
+//		ShaderVariants lighting(pack, "lighting.vert", "lighting.frag");
+// 2. ask for a variant, it is compiled the first time and the same program is returned after that
+//		Shader& shader = lighting.get(ShaderDefines().set("SHININESS", 8.0));
+//    get() builds a string key and searches a map, keep the reference rather than calling it every frame
+// 3. lighting.report() prints how many variants were built and the compile time of each
+// Variants are keyed by a hash of both sources and the define set, and each one also goes through the binary cache of Shader.
+
+class ShaderVariants
+{
+public:
+	// Reads both sources with their includes resolved, they are kept in memory to build variants later
+	ShaderVariants(const GLchar* vertexPath, const GLchar* fragmentPath) : hits(0)
+	{
+		this->load(nullptr, vertexPath, fragmentPath);
+	}
+
+	// Copies both sources from pack, reads the files instead if the pack is closed or misses either
+	ShaderVariants(const AssetPack& pack, const GLchar* vertexPath, const GLchar* fragmentPath) : hits(0)
+	{
+		this->load(&pack, vertexPath, fragmentPath);
+	}
+
+	// The variant for defines, built now if it is new. Deferred as in the Shader constructor.
+	// The reference stays valid as long as this object.
+	Shader& get(const ShaderDefines& defines, bool deferred = false)
+	{
+		std::string key = this->sourceKey + defines.key();
+		std::map<std::string, Shader>::iterator it = this->variants.find(key);
+		if (it != this->variants.end()) {
+			this->hits++;
+			return it->second;
+		}
+		std::string vertexVariant, fragmentVariant;
+		Shader::injectDefines(this->vertexCode.c_str(), this->vertexCode.size(), defines, vertexVariant);
+		Shader::injectDefines(this->fragmentCode.c_str(), this->fragmentCode.size(), defines, fragmentVariant);
+		it = this->variants.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+			std::forward_as_tuple(vertexVariant.c_str(), (GLint)vertexVariant.size(), fragmentVariant.c_str(), (GLint)fragmentVariant.size(), deferred)).first;
+		return it->second;
+	}
+
+	// Variants built so far
+	size_t count() const { return this->variants.size(); }
+
+	// Sum of the build times of all variants, in ms
+	double buildTime() const
+	{
+		double total = 0.0;
+		for (std::map<std::string, Shader>::const_iterator it = this->variants.begin(); it != this->variants.end(); ++it)
+			total += it->second.buildTime;
+		return total;
+	}
+
+	// Prints the number of variants, how often get() found an existing one and the build time of each
+	void report() const
+	{
+		std::cout << this->variants.size() << (this->variants.size() == 1 ? " variant" : " variants") << " built in " << this->buildTime() << " ms, "
+			<< this->hits << " reused" << std::endl;
+		for (std::map<std::string, Shader>::const_iterator it = this->variants.begin(); it != this->variants.end(); ++it) {
+			std::string defines = it->first.substr(this->sourceKey.size());
+			std::cout << "  " << (defines.empty() ? "(no defines)" : defines) << ": " << it->second.buildTime << " ms"
+				<< (it->second.fromCache ? " (binary cache)" : "") << std::endl;
+		}
+	}
+
+private:
+	std::string vertexCode;
+	std::string fragmentCode;
+	// hash of both sources, in front of every key so reloaded sources do not find the old programs
+	std::string sourceKey;
+	std::map<std::string, Shader> variants;
+	unsigned hits;
+
+	// Reads both sources with their includes resolved and hashes them
+	void load(const AssetPack* pack, const GLchar* vertexPath, const GLchar* fragmentPath)
+	{
+		const GLchar* vertexSource;
+		const GLchar* fragmentSource;
+		GLint vertexLength, fragmentLength;
+		Shader::loadSources(pack, vertexPath, fragmentPath, vertexSource, vertexLength, fragmentSource, fragmentLength);
+		this->vertexCode.assign(vertexSource, vertexLength);
+		this->fragmentCode.assign(fragmentSource, fragmentLength);
+		std::hash<std::string> hash;
+		this->sourceKey = std::to_string(hash(this->vertexCode)) + ":" + std::to_string(hash(this->fragmentCode)) + ":";
+	}
+
+	// not copyable, callers keep references to the variants
+	ShaderVariants(const ShaderVariants&);
+	ShaderVariants& operator=(const ShaderVariants&);
+};
@@ -0,0 +1,1043 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <string>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <random>
+
+// SIMD coverage kernels are only built for x86, other platforms use the scalar kernel
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SR_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SR_TARGET_AVX
+#define SR_TARGET_SSE
+#else
+// lets gcc/clang build the kernels without -mavx, the kernel is only called after checking the cpu
+#define SR_TARGET_AVX __attribute__((target("avx")))
+#define SR_TARGET_SSE __attribute__((target("sse2")))
+#endif
+#endif
+
+// GL Includes
+#include <GLEW/glew.h> // only used for the GL types and enums, no GL context is required
+#include <glm/glm.hpp>
+
+// to use the software renderer when there is no GPU or window available:
+// 1. create the renderer and set up buffers exactly like the GL version
+//		SoftwareRenderer renderer(WIDTH, HEIGHT);
+//		GLuint VAO = renderer.genVertexArray();
+//		renderer.bindVertexArray(VAO);
+//		...
+// 2. write the GLSL shaders as C++ functions in a SoftwareProgram
+// 3. draw with the same calls as the GL render loop
+// while (...) {
+//     renderer.clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+//     renderer.useProgram(&program);
+//     renderer.drawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, 0);
+//     renderer.savePPM("frame.ppm");
+// }
+// Triangles are binned into screen tiles and the tiles are shaded in parallel on all cores.
+
+// Limits of the software pipeline
+const int SR_MAX_ATTRIBS = 8;
+const int SR_MAX_VARYINGS = 8;
+const int SR_TILE_SIZE = 64;
+const int SR_BLOCK_SIZE = 8; // coverage is tested for 8x8 pixel blocks, one bit per pixel in a 64 bit mask
+const size_t SR_TRIANGLE_BATCH = 65536; // instanced draws are rasterized in batches of this many triangles to bound memory
+
+// Coverage kernels, picked at runtime from what the cpu supports. The kernels only multiply, add, compare and
+// movemask floats, which SSE2 and AVX already have, so they do not require SSE4 or AVX2 and run on more cpus.
+// Edge values are computed in the same order as the scalar kernel, without FMA, so every kernel covers the same pixels.
+enum SoftwareCoverageKernel {
+	SR_KERNEL_SCALAR,
+	SR_KERNEL_SSE,	// 4 pixels per instruction, a row of 8 per step in two registers
+	SR_KERNEL_AVX	// 8 pixels per instruction, two rows of 16 per step in two registers
+};
+
+// Output of a software vertex shader, position is in clip space like gl_Position
+struct SoftwareVertex
+{
+	glm::vec4 position;
+	float varyings[SR_MAX_VARYINGS];
+};
+
+// C++ version of a vertex/fragment shader pair. Uniforms are captured by the functions.
+struct SoftwareProgram
+{
+	int varyingCount;
+	// attribs holds one value per vertex attribute location, missing components default to (0,0,0,1)
+	std::function<void(const glm::vec4* attribs, SoftwareVertex& out)> vertex;
+	// returns false to discard the fragment
+	std::function<bool(const float* varyings, glm::vec4& color)> fragment;
+
+	SoftwareProgram() : varyingCount(0) {}
+};
+
+// RGBA8 image sampled with GL_LINEAR and GL_CLAMP_TO_EDGE, row 0 is the bottom row like OpenGL
+struct SoftwareTexture
+{
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+
+	SoftwareTexture() : width(0), height(0) {}
+
+	// Copies an image with 1-4 channels (as returned by stbi_load) into RGBA8
+	void load(const unsigned char* data, int w, int h, int channels)
+	{
+		this->width = w;
+		this->height = h;
+		this->pixels.resize((size_t)w * h * 4);
+		for (size_t i = 0; i < (size_t)w * h; i++) {
+			const unsigned char* src = data + i * channels;
+			unsigned char* dst = &this->pixels[i * 4];
+			if (channels < 3) {
+				dst[0] = dst[1] = dst[2] = src[0];
+				dst[3] = (channels == 2) ? src[1] : 255;
+			}
+			else {
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+				dst[3] = (channels == 4) ? src[3] : 255;
+			}
+		}
+	}
+
+	// Bilinear sample, equivalent to texture() in GLSL
+	glm::vec4 sample(float u, float v) const
+	{
+		if (this->width == 0 || this->height == 0)
+			return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		float x = u * this->width - 0.5f;
+		float y = v * this->height - 0.5f;
+		int x0 = (int)std::floor(x);
+		int y0 = (int)std::floor(y);
+		float fx = x - x0;
+		float fy = y - y0;
+		int x1 = std::min(std::max(x0 + 1, 0), this->width - 1);
+		int y1 = std::min(std::max(y0 + 1, 0), this->height - 1);
+		x0 = std::min(std::max(x0, 0), this->width - 1);
+		y0 = std::min(std::max(y0, 0), this->height - 1);
+		const unsigned char* p00 = &this->pixels[((size_t)y0 * this->width + x0) * 4];
+		const unsigned char* p10 = &this->pixels[((size_t)y0 * this->width + x1) * 4];
+		const unsigned char* p01 = &this->pixels[((size_t)y1 * this->width + x0) * 4];
+		const unsigned char* p11 = &this->pixels[((size_t)y1 * this->width + x1) * 4];
+		float c[4];
+		for (int i = 0; i < 4; i++) {
+			float top = p00[i] + (p10[i] - p00[i]) * fx;
+			float bottom = p01[i] + (p11[i] - p01[i]) * fx;
+			c[i] = (top + (bottom - top) * fy) / 255.0f;
+		}
+		return glm::vec4(c[0], c[1], c[2], c[3]);
+	}
+};
+
+// A CPU implementation of the subset of OpenGL 3.3 used by the demos
+class SoftwareRenderer
+{
+public:
+	// Frame buffer, RGBA8 stored top row first so it can be written straight to an image file
+	std::vector<unsigned char> colorBuffer;
+	std::vector<float> depthBuffer;
+	int width;
+	int height;
+
+	SoftwareRenderer(int width, int height, int threadCount = 0) : width(width), height(height), currentVAO(0), currentArrayBuffer(0), currentProgram(nullptr), currentInstance(0),
+		depthTest(false), blend(false), stopWorkers(false), jobGeneration(0), jobCount(0), jobsRemaining(0)
+	{
+		this->setCoverageKernel(bestCoverageKernel());
+		this->colorBuffer.resize((size_t)width * height * 4);
+		this->depthBuffer.resize((size_t)width * height);
+		this->clearValue[0] = this->clearValue[1] = this->clearValue[2] = 0.0f;
+		this->clearValue[3] = 1.0f;
+		this->tilesX = (width + SR_TILE_SIZE - 1) / SR_TILE_SIZE;
+		this->tilesY = (height + SR_TILE_SIZE - 1) / SR_TILE_SIZE;
+		this->tiles.resize(this->tilesX * this->tilesY);
+		// object 0 is reserved, same as GL
+		this->buffers.resize(1);
+		this->vertexArrays.resize(1);
+
+		if (threadCount <= 0)
+			threadCount = (int)std::thread::hardware_concurrency();
+		if (threadCount <= 0)
+			threadCount = 1;
+		// the calling thread also works on tiles, so start one less worker
+		for (int i = 1; i < threadCount; i++)
+			this->workers.push_back(std::thread(&SoftwareRenderer::workerLoop, this));
+	}
+
+	~SoftwareRenderer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->jobMutex);
+			this->stopWorkers = true;
+		}
+		this->jobStart.notify_all();
+		for (size_t i = 0; i < this->workers.size(); i++)
+			this->workers[i].join();
+	}
+
+	int threadCount() const { return (int)this->workers.size() + 1; }
+
+	// Fastest kernel supported by this cpu
+	static SoftwareCoverageKernel bestCoverageKernel()
+	{
+#ifdef SR_X86
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		// AVX also needs the OS to save the ymm registers
+		bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+#else
+		__builtin_cpu_init();
+		bool sse2 = __builtin_cpu_supports("sse2") != 0;
+		bool avx = __builtin_cpu_supports("avx") != 0;
+#endif
+		if (avx)
+			return SR_KERNEL_AVX;
+		if (sse2)
+			return SR_KERNEL_SSE;
+#endif
+		return SR_KERNEL_SCALAR;
+	}
+
+	// Overrides the kernel picked at startup, falls back to scalar if the cpu cannot run it
+	void setCoverageKernel(SoftwareCoverageKernel kernel)
+	{
+		if (kernel > bestCoverageKernel())
+			kernel = SR_KERNEL_SCALAR;
+		this->kernel = kernel;
+		switch (kernel) {
+#ifdef SR_X86
+		case SR_KERNEL_AVX: this->coverage = &coverageAVX; break;
+		case SR_KERNEL_SSE: this->coverage = &coverageSSE; break;
+#endif
+		default: this->coverage = &coverageScalar; break;
+		}
+	}
+
+	SoftwareCoverageKernel coverageKernel() const { return this->kernel; }
+
+	static const char* kernelName(SoftwareCoverageKernel kernel)
+	{
+		switch (kernel) {
+		case SR_KERNEL_AVX: return "AVX";
+		case SR_KERNEL_SSE: return "SSE";
+		default: return "scalar";
+		}
+	}
+
+	// Buffer objects
+	GLuint genBuffer()
+	{
+		this->buffers.push_back(std::vector<unsigned char>());
+		return (GLuint)this->buffers.size() - 1;
+	}
+
+	void bindBuffer(GLenum target, GLuint buffer)
+	{
+		if (target == GL_ARRAY_BUFFER)
+			this->currentArrayBuffer = buffer;
+		else if (target == GL_ELEMENT_ARRAY_BUFFER)
+			this->vertexArrays[this->currentVAO].elementBuffer = buffer; // element buffer binding is part of the VAO, same as GL
+	}
+
+	void bufferData(GLenum target, size_t size, const void* data)
+	{
+		GLuint buffer = (target == GL_ARRAY_BUFFER) ? this->currentArrayBuffer : this->vertexArrays[this->currentVAO].elementBuffer;
+		std::vector<unsigned char>& store = this->buffers[buffer];
+		store.resize(size);
+		if (data != nullptr && size > 0)
+			std::memcpy(&store[0], data, size);
+	}
+
+	void bufferSubData(GLenum target, size_t offset, size_t size, const void* data)
+	{
+		GLuint buffer = (target == GL_ARRAY_BUFFER) ? this->currentArrayBuffer : this->vertexArrays[this->currentVAO].elementBuffer;
+		std::vector<unsigned char>& store = this->buffers[buffer];
+		// same as GL, writes past the end of the buffer are an error and do nothing
+		if (offset + size > store.size() || size == 0)
+			return;
+		std::memcpy(&store[offset], data, size);
+	}
+
+	// Vertex array objects
+	GLuint genVertexArray()
+	{
+		this->vertexArrays.push_back(VertexArray());
+		return (GLuint)this->vertexArrays.size() - 1;
+	}
+
+	void bindVertexArray(GLuint vao) { this->currentVAO = vao; }
+
+	// Types are the ones fetchAttrib() converts, others leave the attribute as it was, as GL_INVALID_ENUM would
+	void vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, size_t offset)
+	{
+		switch (type) {
+		case GL_BYTE: case GL_UNSIGNED_BYTE: case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT:
+		case GL_INT: case GL_UNSIGNED_INT: case GL_FLOAT: break;
+		default:
+			std::cout << "ERROR::SOFTWARE_RENDERER::UNSUPPORTED_ATTRIBUTE_TYPE " << type << std::endl;
+			return;
+		}
+		Attrib& attrib = this->vertexArrays[this->currentVAO].attribs[index];
+		attrib.buffer = this->currentArrayBuffer;
+		attrib.size = size;
+		attrib.type = type;
+		attrib.normalized = normalized;
+		attrib.stride = stride != 0 ? stride : size * typeSize(type);
+		attrib.offset = offset;
+	}
+
+	void enableVertexAttribArray(GLuint index) { this->vertexArrays[this->currentVAO].attribs[index].enabled = true; }
+	void disableVertexAttribArray(GLuint index) { this->vertexArrays[this->currentVAO].attribs[index].enabled = false; }
+	// 0 = per vertex, N = advance once every N instances
+	void vertexAttribDivisor(GLuint index, GLuint divisor) { this->vertexArrays[this->currentVAO].attribs[index].divisor = divisor; }
+
+	// State
+	void useProgram(const SoftwareProgram* program) { this->currentProgram = program; }
+
+	void enable(GLenum cap) { this->setCapability(cap, true); }
+	void disable(GLenum cap) { this->setCapability(cap, false); }
+
+	void clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+	{
+		this->clearValue[0] = r;
+		this->clearValue[1] = g;
+		this->clearValue[2] = b;
+		this->clearValue[3] = a;
+	}
+
+	void clear(GLbitfield mask)
+	{
+		if (mask & GL_COLOR_BUFFER_BIT) {
+			unsigned char c[4];
+			for (int i = 0; i < 4; i++)
+				c[i] = toByte(this->clearValue[i]);
+			uint32_t packed;
+			std::memcpy(&packed, c, 4);
+			uint32_t* dst = reinterpret_cast<uint32_t*>(&this->colorBuffer[0]);
+			std::fill(dst, dst + (size_t)this->width * this->height, packed);
+		}
+		if (mask & GL_DEPTH_BUFFER_BIT)
+			std::fill(this->depthBuffer.begin(), this->depthBuffer.end(), 1.0f);
+	}
+
+	// Draw calls, only GL_TRIANGLES is supported
+	void drawArrays(GLenum mode, GLint first, GLsizei count)
+	{
+		if (mode != GL_TRIANGLES || this->currentProgram == nullptr || count < 3)
+			return;
+		this->indexScratch.resize(count);
+		for (GLsizei i = 0; i < count; i++)
+			this->indexScratch[i] = first + i;
+		this->draw(&this->indexScratch[0], count, 1);
+	}
+
+	void drawElements(GLenum mode, GLsizei count, GLenum type, size_t offset)
+	{
+		this->drawElementsInstanced(mode, count, type, offset, 1);
+	}
+
+	void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, size_t offset, GLsizei instanceCount)
+	{
+		if (mode != GL_TRIANGLES || this->currentProgram == nullptr || instanceCount < 1)
+			return;
+		const std::vector<unsigned char>& elements = this->buffers[this->vertexArrays[this->currentVAO].elementBuffer];
+		int indexSize = typeSize(type);
+		// never read past the end of the element buffer
+		if (offset >= elements.size())
+			return;
+		count = (GLsizei)std::min((size_t)count, (elements.size() - offset) / indexSize);
+		if (count < 3)
+			return;
+		this->indexScratch.resize(count);
+		const unsigned char* src = &elements[offset];
+		for (GLsizei i = 0; i < count; i++) {
+			if (type == GL_UNSIGNED_BYTE)
+				this->indexScratch[i] = src[i];
+			else if (type == GL_UNSIGNED_SHORT)
+				this->indexScratch[i] = reinterpret_cast<const uint16_t*>(src)[i];
+			else
+				this->indexScratch[i] = reinterpret_cast<const uint32_t*>(src)[i];
+		}
+		this->draw(&this->indexScratch[0], count, instanceCount);
+	}
+
+	// Micro-benchmark of the coverage kernels on random triangles, reports triangles/second and pixels/second for each kernel
+	void benchmarkCoverage(int triangleCount = 20000, float maxSize = 64.0f)
+	{
+		SoftwareProgram flat;
+		const SoftwareProgram* previousProgram = this->currentProgram;
+		this->currentProgram = &flat;
+		this->triangles.clear();
+		for (size_t i = 0; i < this->tiles.size(); i++)
+			this->tiles[i].clear();
+
+		// random triangles in normalized device coordinates, same seed every run
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+		float sizeX = 2.0f * maxSize / this->width, sizeY = 2.0f * maxSize / this->height;
+		for (int i = 0; i < triangleCount; i++) {
+			SoftwareVertex v[3];
+			float cx = position(random), cy = position(random);
+			for (int j = 0; j < 3; j++)
+				v[j].position = glm::vec4(cx + offset(random) * sizeX, cy + offset(random) * sizeY, 0.0f, 1.0f);
+			this->setupTriangle(v[0], v[1], v[2]);
+		}
+		this->currentProgram = previousProgram;
+
+		std::cout << "Coverage benchmark: " << this->triangles.size() << " triangles up to " << maxSize << " pixels wide" << std::endl;
+		SoftwareCoverageKernel best = bestCoverageKernel();
+		double scalarTime = 0.0;
+		for (int k = SR_KERNEL_SCALAR; k <= best; k++) {
+			uint64_t (*kernel)(const SetupTriangle&, int, int) = &coverageScalar;
+#ifdef SR_X86
+			if (k == SR_KERNEL_SSE) kernel = &coverageSSE;
+			if (k == SR_KERNEL_AVX) kernel = &coverageAVX;
+#endif
+			uint64_t pixels = 0;
+			const int repeats = 10;
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (int r = 0; r < repeats; r++) {
+				for (size_t t = 0; t < this->triangles.size(); t++) {
+					const SetupTriangle& tri = this->triangles[t];
+					for (int blockY = tri.minY & ~(SR_BLOCK_SIZE - 1); blockY <= tri.maxY; blockY += SR_BLOCK_SIZE) {
+						for (int blockX = tri.minX & ~(SR_BLOCK_SIZE - 1); blockX <= tri.maxX; blockX += SR_BLOCK_SIZE) {
+							int result = classifyBlock(tri, blockX, blockY);
+							if (result < 0)
+								continue;
+							uint64_t mask = rectMask(blockX, blockY, tri.minX, tri.minY, tri.maxX, tri.maxY);
+							if (result == 0)
+								mask &= kernel(tri, blockX, blockY);
+							pixels += popCount(mask);
+						}
+					}
+				}
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			if (k == SR_KERNEL_SCALAR)
+				scalarTime = seconds;
+			double triangles = (double)this->triangles.size() * repeats;
+			std::cout << "  " << kernelName((SoftwareCoverageKernel)k) << ": " << triangles / seconds / 1e6 << " Mtriangles/s, "
+				<< pixels / seconds / 1e6 << " Mpixels/s, " << scalarTime / seconds << "x scalar" << std::endl;
+		}
+		this->triangles.clear();
+		for (size_t i = 0; i < this->tiles.size(); i++)
+			this->tiles[i].clear();
+	}
+
+	// Writes the color buffer as a binary PPM image for golden image comparison
+	bool savePPM(const std::string& path) const
+	{
+		std::ofstream file(path.c_str(), std::ios::binary);
+		if (!file)
+			return false;
+		file << "P6\n" << this->width << " " << this->height << "\n255\n";
+		std::vector<unsigned char> row((size_t)this->width * 3);
+		for (int y = 0; y < this->height; y++) {
+			const unsigned char* src = &this->colorBuffer[(size_t)y * this->width * 4];
+			for (int x = 0; x < this->width; x++) {
+				row[x * 3 + 0] = src[x * 4 + 0];
+				row[x * 3 + 1] = src[x * 4 + 1];
+				row[x * 3 + 2] = src[x * 4 + 2];
+			}
+			file.write(reinterpret_cast<const char*>(&row[0]), row.size());
+		}
+		return (bool)file;
+	}
+
+private:
+	struct Attrib
+	{
+		bool enabled;
+		GLuint buffer;
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+		GLsizei stride;
+		size_t offset;
+		GLuint divisor;
+
+		Attrib() : enabled(false), buffer(0), size(4), type(GL_FLOAT), normalized(GL_FALSE), stride(0), offset(0), divisor(0) {}
+	};
+
+	struct VertexArray
+	{
+		Attrib attribs[SR_MAX_ATTRIBS];
+		GLuint elementBuffer;
+
+		VertexArray() : elementBuffer(0) {}
+	};
+
+	// Triangle after clipping, perspective divide and viewport transform
+	struct SetupTriangle
+	{
+		// edge functions E(x,y) = a*x + b*y + c, positive inside
+		float a[3], b[3], c[3];
+		bool topLeft[3];
+		// depth and 1/w are interpolated linearly in screen space, varyings are stored pre-divided by w
+		float z[3];
+		float invW[3];
+		float varyings[3][SR_MAX_VARYINGS];
+		float invArea;
+		int minX, minY, maxX, maxY;
+	};
+
+	std::vector<std::vector<unsigned char> > buffers;
+	std::vector<VertexArray> vertexArrays;
+	GLuint currentVAO;
+	GLuint currentArrayBuffer;
+	const SoftwareProgram* currentProgram;
+	GLsizei currentInstance;
+	bool depthTest;
+	bool blend;
+	float clearValue[4];
+
+	// per draw scratch memory, kept between draws to avoid reallocation
+	std::vector<uint32_t> indexScratch;
+	std::vector<SoftwareVertex> vertexCache;
+	std::vector<unsigned char> vertexDone;
+	std::vector<SetupTriangle> triangles;
+	std::vector<std::vector<uint32_t> > tiles;
+	int tilesX;
+	int tilesY;
+
+	// coverage kernel
+	SoftwareCoverageKernel kernel;
+	uint64_t (*coverage)(const SetupTriangle& tri, int blockX, int blockY);
+
+	// thread pool
+	std::vector<std::thread> workers;
+	std::mutex jobMutex;
+	std::condition_variable jobStart;
+	std::condition_variable jobFinished;
+	bool stopWorkers;
+	unsigned jobGeneration;
+	int jobCount;
+	int jobsRemaining;
+	std::atomic<int> nextJob;
+	std::function<void(int)> job;
+
+	static int typeSize(GLenum type)
+	{
+		switch (type) {
+		case GL_UNSIGNED_BYTE: case GL_BYTE: return 1;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return 2;
+		default: return 4;
+		}
+	}
+
+	static unsigned char toByte(float value)
+	{
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		return (unsigned char)(value * 255.0f + 0.5f);
+	}
+
+	void setCapability(GLenum cap, bool value)
+	{
+		if (cap == GL_DEPTH_TEST)
+			this->depthTest = value;
+		else if (cap == GL_BLEND)
+			this->blend = value; // blend function is always GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+	}
+
+	static float halfToFloat(uint16_t half)
+	{
+		uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1F;
+		uint32_t mantissa = half & 0x3FF;
+		uint32_t bits;
+		if (exponent == 0x1F)
+			bits = sign | 0x7F800000 | (mantissa << 13);
+		else if (exponent != 0)
+			bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		else {
+			// subnormal, exact in a float
+			float value = mantissa / 16777216.0f;
+			return sign != 0 ? -value : value;
+		}
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// Reads one attribute of one vertex, converting to float like the GL vertex fetch does
+	static glm::vec4 fetchAttrib(const Attrib& attrib, const std::vector<unsigned char>& store, uint32_t index)
+	{
+		glm::vec4 value(0.0f, 0.0f, 0.0f, 1.0f);
+		size_t start = attrib.offset + (size_t)index * attrib.stride;
+		if (start + (size_t)attrib.size * typeSize(attrib.type) > store.size())
+			return value;
+		const unsigned char* src = &store[start];
+		// packed layouts need not align their attributes, so wider types are copied out rather than cast
+		for (int i = 0; i < attrib.size; i++) {
+			float v;
+			switch (attrib.type) {
+			case GL_UNSIGNED_BYTE: v = src[i]; if (attrib.normalized) v /= 255.0f; break;
+			case GL_BYTE: v = (int8_t)src[i]; if (attrib.normalized) v = std::max(v / 127.0f, -1.0f); break;
+			case GL_UNSIGNED_SHORT: { uint16_t u; std::memcpy(&u, src + i * 2, 2); v = u; if (attrib.normalized) v /= 65535.0f; break; }
+			case GL_SHORT: { int16_t s; std::memcpy(&s, src + i * 2, 2); v = s; if (attrib.normalized) v = std::max(v / 32767.0f, -1.0f); break; }
+			case GL_HALF_FLOAT: { uint16_t h; std::memcpy(&h, src + i * 2, 2); v = halfToFloat(h); break; }
+			case GL_UNSIGNED_INT: { uint32_t u; std::memcpy(&u, src + i * 4, 4); v = (float)u; break; }
+			case GL_INT: { int32_t s; std::memcpy(&s, src + i * 4, 4); v = (float)s; break; }
+			case GL_FLOAT: std::memcpy(&v, src + i * 4, 4); break;
+			default: v = 0.0f; break;
+			}
+			value[i] = v;
+		}
+		return value;
+	}
+
+	void runVertexShader(uint32_t index)
+	{
+		const VertexArray& vao = this->vertexArrays[this->currentVAO];
+		glm::vec4 attribs[SR_MAX_ATTRIBS];
+		for (int i = 0; i < SR_MAX_ATTRIBS; i++) {
+			const Attrib& attrib = vao.attribs[i];
+			if (attrib.enabled)
+				attribs[i] = fetchAttrib(attrib, this->buffers[attrib.buffer], attrib.divisor != 0 ? this->currentInstance / attrib.divisor : index);
+			else
+				attribs[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+		SoftwareVertex& out = this->vertexCache[index];
+		std::memset(out.varyings, 0, sizeof(out.varyings));
+		this->currentProgram->vertex(attribs, out);
+	}
+
+	void draw(const uint32_t* indices, GLsizei count, GLsizei instanceCount)
+	{
+		uint32_t maxIndex = 0;
+		for (GLsizei i = 0; i < count; i++)
+			maxIndex = std::max(maxIndex, indices[i]);
+		this->vertexCache.resize(maxIndex + 1);
+		this->triangles.clear();
+		for (size_t i = 0; i < this->tiles.size(); i++)
+			this->tiles[i].clear();
+
+		for (this->currentInstance = 0; this->currentInstance < instanceCount; this->currentInstance++) {
+			// 1. Run the vertex shader once per referenced vertex
+			this->vertexDone.assign(maxIndex + 1, 0);
+			for (GLsizei i = 0; i < count; i++) {
+				uint32_t index = indices[i];
+				if (!this->vertexDone[index]) {
+					this->runVertexShader(index);
+					this->vertexDone[index] = 1;
+				}
+			}
+
+			// 2. Clip, set up and bin every triangle into the tiles it touches
+			for (GLsizei i = 0; i + 2 < count; i += 3)
+				this->clipTriangle(this->vertexCache[indices[i]], this->vertexCache[indices[i + 1]], this->vertexCache[indices[i + 2]]);
+			if (this->triangles.size() >= SR_TRIANGLE_BATCH)
+				this->flushTriangles();
+		}
+		this->currentInstance = 0;
+		this->flushTriangles();
+	}
+
+	// 3. Shade the tiles in parallel, instances are drawn in order so batches keep the same result as one big draw
+	void flushTriangles()
+	{
+		if (this->triangles.empty())
+			return;
+		this->runParallel((int)this->tiles.size(), [this](int tile) { this->rasterizeTile(tile); });
+		this->triangles.clear();
+		for (size_t i = 0; i < this->tiles.size(); i++)
+			this->tiles[i].clear();
+	}
+
+	// Clips against the near plane (z > -w), anything else off screen is handled by the bounding box
+	void clipTriangle(const SoftwareVertex& v0, const SoftwareVertex& v1, const SoftwareVertex& v2)
+	{
+		const SoftwareVertex* in[3] = { &v0, &v1, &v2 };
+		// trivially reject triangles completely outside one of the frustum planes
+		for (int axis = 0; axis < 3; axis++) {
+			bool allOutsidePositive = true, allOutsideNegative = true;
+			for (int i = 0; i < 3; i++) {
+				const glm::vec4& p = in[i]->position;
+				if (p[axis] <= p.w) allOutsidePositive = false;
+				if (p[axis] >= -p.w) allOutsideNegative = false;
+			}
+			if (allOutsidePositive || allOutsideNegative)
+				return;
+		}
+
+		int varyingCount = this->currentProgram->varyingCount;
+		SoftwareVertex clipped[4];
+		int clippedCount = 0;
+		for (int i = 0; i < 3; i++) {
+			const SoftwareVertex& a = *in[i];
+			const SoftwareVertex& b = *in[(i + 1) % 3];
+			float da = a.position.z + a.position.w;
+			float db = b.position.z + b.position.w;
+			if (da >= 0.0f)
+				clipped[clippedCount++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				// edge crosses the near plane, add the intersection point
+				float t = da / (da - db);
+				SoftwareVertex& out = clipped[clippedCount++];
+				for (int c = 0; c < 4; c++)
+					out.position[c] = a.position[c] + (b.position[c] - a.position[c]) * t;
+				for (int v = 0; v < varyingCount; v++)
+					out.varyings[v] = a.varyings[v] + (b.varyings[v] - a.varyings[v]) * t;
+			}
+		}
+		for (int i = 1; i + 1 < clippedCount; i++)
+			this->setupTriangle(clipped[0], clipped[i], clipped[i + 1]);
+	}
+
+	void setupTriangle(const SoftwareVertex& v0, const SoftwareVertex& v1, const SoftwareVertex& v2)
+	{
+		const SoftwareVertex* v[3] = { &v0, &v1, &v2 };
+		float x[3], y[3];
+		SetupTriangle tri;
+		for (int i = 0; i < 3; i++) {
+			float invW = 1.0f / v[i]->position.w;
+			// viewport transform, y is flipped because row 0 of the color buffer is the top of the screen
+			x[i] = (v[i]->position.x * invW * 0.5f + 0.5f) * this->width;
+			y[i] = (0.5f - v[i]->position.y * invW * 0.5f) * this->height;
+			tri.z[i] = v[i]->position.z * invW * 0.5f + 0.5f;
+			tri.invW[i] = invW;
+			for (int j = 0; j < this->currentProgram->varyingCount; j++)
+				tri.varyings[i][j] = v[i]->varyings[j] * invW;
+		}
+
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+		if (area == 0.0f || !std::isfinite(area))
+			return;
+		// no face culling, so flip the edge functions of back facing triangles instead
+		float sign = area > 0.0f ? 1.0f : -1.0f;
+		for (int i = 0; i < 3; i++) {
+			int j = (i + 1) % 3;
+			int k = (i + 2) % 3;
+			// edge opposite vertex i, goes from vertex j to vertex k
+			tri.a[i] = sign * (y[j] - y[k]);
+			tri.b[i] = sign * (x[k] - x[j]);
+			tri.c[i] = sign * (x[j] * y[k] - x[k] * y[j]);
+			// shared edges have opposite coefficients, so exactly one of the two triangles owns pixels on the edge
+			tri.topLeft[i] = tri.a[i] > 0.0f || (tri.a[i] == 0.0f && tri.b[i] > 0.0f);
+		}
+		tri.invArea = 1.0f / (area * sign);
+
+		// bounding box clamped to the screen. Only the near plane is clipped, so a vertex close to it can be far outside
+		// the range of an int; the box is clamped while still a float, to one pixel beyond each side so a box that is
+		// entirely off screen still comes out empty, with the limit first so a NaN becomes -1 and the box is empty too
+		float minX = std::min(x[0], std::min(x[1], x[2]));
+		float maxX = std::max(x[0], std::max(x[1], x[2]));
+		float minY = std::min(y[0], std::min(y[1], y[2]));
+		float maxY = std::max(y[0], std::max(y[1], y[2]));
+		float screenX = (float)this->width, screenY = (float)this->height;
+		tri.minX = std::max((int)std::floor(std::min(screenX, std::max(-1.0f, minX))), 0);
+		tri.minY = std::max((int)std::floor(std::min(screenY, std::max(-1.0f, minY))), 0);
+		tri.maxX = std::min((int)std::ceil(std::min(screenX, std::max(-1.0f, maxX))), this->width - 1);
+		tri.maxY = std::min((int)std::ceil(std::min(screenY, std::max(-1.0f, maxY))), this->height - 1);
+		if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+			return;
+
+		uint32_t triIndex = (uint32_t)this->triangles.size();
+		this->triangles.push_back(tri);
+		for (int ty = tri.minY / SR_TILE_SIZE; ty <= tri.maxY / SR_TILE_SIZE; ty++)
+			for (int tx = tri.minX / SR_TILE_SIZE; tx <= tri.maxX / SR_TILE_SIZE; tx++)
+				this->tiles[ty * this->tilesX + tx].push_back(triIndex);
+	}
+
+	// Rasterizes every triangle binned to one tile, in submission order so blending stays correct
+	void rasterizeTile(int tile)
+	{
+		const std::vector<uint32_t>& list = this->tiles[tile];
+		if (list.empty())
+			return;
+		int tileMinX = (tile % this->tilesX) * SR_TILE_SIZE;
+		int tileMinY = (tile / this->tilesX) * SR_TILE_SIZE;
+		int tileMaxX = std::min(tileMinX + SR_TILE_SIZE, this->width) - 1;
+		int tileMaxY = std::min(tileMinY + SR_TILE_SIZE, this->height) - 1;
+
+		for (size_t t = 0; t < list.size(); t++) {
+			const SetupTriangle& tri = this->triangles[list[t]];
+			int minX = std::max(tri.minX, tileMinX);
+			int maxX = std::min(tri.maxX, tileMaxX);
+			int minY = std::max(tri.minY, tileMinY);
+			int maxY = std::min(tri.maxY, tileMaxY);
+			// tiles start on a block boundary so the blocks stay aligned
+			for (int blockY = minY & ~(SR_BLOCK_SIZE - 1); blockY <= maxY; blockY += SR_BLOCK_SIZE) {
+				for (int blockX = minX & ~(SR_BLOCK_SIZE - 1); blockX <= maxX; blockX += SR_BLOCK_SIZE) {
+					int result = classifyBlock(tri, blockX, blockY);
+					if (result < 0)
+						continue;
+					uint64_t mask = rectMask(blockX, blockY, minX, minY, maxX, maxY);
+					if (result == 0)
+						mask &= this->coverage(tri, blockX, blockY);
+					// shade the covered pixels
+					while (mask != 0) {
+						int bit = lowestBit(mask);
+						mask &= mask - 1;
+						int x = blockX + (bit & (SR_BLOCK_SIZE - 1));
+						int y = blockY + bit / SR_BLOCK_SIZE;
+						float px = x + 0.5f;
+						float py = y + 0.5f;
+						float e[3];
+						for (int i = 0; i < 3; i++)
+							e[i] = edgeValue(tri, i, px, py);
+						this->shadePixel(tri, x, y, e);
+					}
+				}
+			}
+		}
+	}
+
+	// All kernels evaluate the edge functions in this order so they produce identical coverage
+	static float edgeValue(const SetupTriangle& tri, int i, float px, float py)
+	{
+		return (tri.a[i] * px + tri.b[i] * py) + tri.c[i];
+	}
+
+	// Returns -1 if the block is completely outside the triangle, 1 if it is completely inside and 0 otherwise
+	static int classifyBlock(const SetupTriangle& tri, int blockX, int blockY)
+	{
+		bool inside = true;
+		float left = blockX + 0.5f, right = blockX + SR_BLOCK_SIZE - 0.5f;
+		float top = blockY + 0.5f, bottom = blockY + SR_BLOCK_SIZE - 0.5f;
+		for (int i = 0; i < 3; i++) {
+			// the edge function is linear, so its extremes are at the corner pixels
+			float maxValue = edgeValue(tri, i, tri.a[i] > 0.0f ? right : left, tri.b[i] > 0.0f ? bottom : top);
+			float minValue = edgeValue(tri, i, tri.a[i] > 0.0f ? left : right, tri.b[i] > 0.0f ? top : bottom);
+			if (maxValue < 0.0f)
+				return -1;
+			if (minValue <= 0.0f)
+				inside = false;
+		}
+		return inside ? 1 : 0;
+	}
+
+	// Bits of the block that are inside the rectangle (minX, minY) - (maxX, maxY)
+	static uint64_t rectMask(int blockX, int blockY, int minX, int minY, int maxX, int maxY)
+	{
+		int x0 = std::max(minX - blockX, 0), x1 = std::min(maxX - blockX, SR_BLOCK_SIZE - 1);
+		int y0 = std::max(minY - blockY, 0), y1 = std::min(maxY - blockY, SR_BLOCK_SIZE - 1);
+		if (x0 > x1 || y0 > y1)
+			return 0;
+		uint64_t row = ((0xFFu >> (SR_BLOCK_SIZE - 1 - x1)) >> x0) << x0;
+		uint64_t mask = 0;
+		for (int y = y0; y <= y1; y++)
+			mask |= row << (y * SR_BLOCK_SIZE);
+		return mask;
+	}
+
+	static int lowestBit(uint64_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+#ifdef _M_X64
+		_BitScanForward64(&index, mask);
+#else
+		if (!_BitScanForward(&index, (unsigned long)mask)) {
+			_BitScanForward(&index, (unsigned long)(mask >> 32));
+			index += 32;
+		}
+#endif
+		return (int)index;
+#else
+		return __builtin_ctzll(mask);
+#endif
+	}
+
+	static int popCount(uint64_t mask)
+	{
+		int count = 0;
+		for (; mask != 0; mask &= mask - 1)
+			count++;
+		return count;
+	}
+
+	static uint64_t coverageScalar(const SetupTriangle& tri, int blockX, int blockY)
+	{
+		uint64_t mask = 0;
+		for (int row = 0; row < SR_BLOCK_SIZE; row++) {
+			float py = blockY + row + 0.5f;
+			for (int col = 0; col < SR_BLOCK_SIZE; col++) {
+				float px = blockX + col + 0.5f;
+				bool inside = true;
+				for (int i = 0; i < 3 && inside; i++) {
+					float e = edgeValue(tri, i, px, py);
+					inside = e > 0.0f || (e == 0.0f && tri.topLeft[i]);
+				}
+				if (inside)
+					mask |= (uint64_t)1 << (row * SR_BLOCK_SIZE + col);
+			}
+		}
+		return mask;
+	}
+
+#ifdef SR_X86
+	SR_TARGET_SSE static uint64_t coverageSSE(const SetupTriangle& tri, int blockX, int blockY)
+	{
+		__m128 zero = _mm_setzero_ps();
+		__m128 pxLeft = _mm_add_ps(_mm_set1_ps(blockX + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+		__m128 pxRight = _mm_add_ps(pxLeft, _mm_set1_ps(4.0f));
+		__m128 axLeft[3], axRight[3], c[3];
+		for (int i = 0; i < 3; i++) {
+			__m128 a = _mm_set1_ps(tri.a[i]);
+			axLeft[i] = _mm_mul_ps(a, pxLeft);
+			axRight[i] = _mm_mul_ps(a, pxRight);
+			c[i] = _mm_set1_ps(tri.c[i]);
+		}
+		uint64_t mask = 0;
+		for (int row = 0; row < SR_BLOCK_SIZE; row++) {
+			float py = blockY + row + 0.5f;
+			__m128 insideLeft = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			__m128 insideRight = insideLeft;
+			for (int i = 0; i < 3; i++) {
+				__m128 by = _mm_set1_ps(tri.b[i] * py);
+				__m128 eLeft = _mm_add_ps(_mm_add_ps(axLeft[i], by), c[i]);
+				__m128 eRight = _mm_add_ps(_mm_add_ps(axRight[i], by), c[i]);
+				if (tri.topLeft[i]) {
+					insideLeft = _mm_and_ps(insideLeft, _mm_cmpge_ps(eLeft, zero));
+					insideRight = _mm_and_ps(insideRight, _mm_cmpge_ps(eRight, zero));
+				}
+				else {
+					insideLeft = _mm_and_ps(insideLeft, _mm_cmpgt_ps(eLeft, zero));
+					insideRight = _mm_and_ps(insideRight, _mm_cmpgt_ps(eRight, zero));
+				}
+			}
+			uint64_t bits = (uint64_t)(_mm_movemask_ps(insideLeft) | (_mm_movemask_ps(insideRight) << 4));
+			mask |= bits << (row * SR_BLOCK_SIZE);
+		}
+		return mask;
+	}
+
+	SR_TARGET_AVX static uint64_t coverageAVX(const SetupTriangle& tri, int blockX, int blockY)
+	{
+		__m256 zero = _mm256_setzero_ps();
+		__m256 px = _mm256_add_ps(_mm256_set1_ps(blockX + 0.5f), _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+		__m256 ax[3], c[3];
+		for (int i = 0; i < 3; i++) {
+			ax[i] = _mm256_mul_ps(_mm256_set1_ps(tri.a[i]), px);
+			c[i] = _mm256_set1_ps(tri.c[i]);
+		}
+		// 16 pixels per step, two rows in two registers so the compares of one row overlap those of the other
+		uint64_t mask = 0;
+		for (int row = 0; row < SR_BLOCK_SIZE; row += 2) {
+			float pyTop = blockY + row + 0.5f;
+			float pyBottom = pyTop + 1.0f;
+			__m256 insideTop = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			__m256 insideBottom = insideTop;
+			for (int i = 0; i < 3; i++) {
+				__m256 eTop = _mm256_add_ps(_mm256_add_ps(ax[i], _mm256_set1_ps(tri.b[i] * pyTop)), c[i]);
+				__m256 eBottom = _mm256_add_ps(_mm256_add_ps(ax[i], _mm256_set1_ps(tri.b[i] * pyBottom)), c[i]);
+				if (tri.topLeft[i]) {
+					insideTop = _mm256_and_ps(insideTop, _mm256_cmp_ps(eTop, zero, _CMP_GE_OQ));
+					insideBottom = _mm256_and_ps(insideBottom, _mm256_cmp_ps(eBottom, zero, _CMP_GE_OQ));
+				}
+				else {
+					insideTop = _mm256_and_ps(insideTop, _mm256_cmp_ps(eTop, zero, _CMP_GT_OQ));
+					insideBottom = _mm256_and_ps(insideBottom, _mm256_cmp_ps(eBottom, zero, _CMP_GT_OQ));
+				}
+			}
+			uint64_t bits = (uint64_t)(_mm256_movemask_ps(insideTop) | (_mm256_movemask_ps(insideBottom) << SR_BLOCK_SIZE));
+			mask |= bits << (row * SR_BLOCK_SIZE);
+		}
+		return mask;
+	}
+#endif
+
+	void shadePixel(const SetupTriangle& tri, int x, int y, const float* e)
+	{
+		float l0 = e[0] * tri.invArea;
+		float l1 = e[1] * tri.invArea;
+		float l2 = e[2] * tri.invArea;
+		size_t pixel = (size_t)y * this->width + x;
+
+		float z = l0 * tri.z[0] + l1 * tri.z[1] + l2 * tri.z[2];
+		if (this->depthTest && !(z < this->depthBuffer[pixel]))
+			return;
+
+		// perspective correct interpolation
+		float w = 1.0f / (l0 * tri.invW[0] + l1 * tri.invW[1] + l2 * tri.invW[2]);
+		float varyings[SR_MAX_VARYINGS];
+		for (int i = 0; i < this->currentProgram->varyingCount; i++)
+			varyings[i] = (l0 * tri.varyings[0][i] + l1 * tri.varyings[1][i] + l2 * tri.varyings[2][i]) * w;
+
+		glm::vec4 color;
+		if (!this->currentProgram->fragment(varyings, color))
+			return;
+		if (this->depthTest)
+			this->depthBuffer[pixel] = z;
+
+		unsigned char* dst = &this->colorBuffer[pixel * 4];
+		if (this->blend) {
+			float alpha = std::min(std::max(color.w, 0.0f), 1.0f);
+			for (int i = 0; i < 4; i++)
+				dst[i] = toByte(color[i] * alpha + (dst[i] / 255.0f) * (1.0f - alpha));
+		}
+		else {
+			for (int i = 0; i < 4; i++)
+				dst[i] = toByte(color[i]);
+		}
+	}
+
+	// Runs job(0) .. job(count - 1) on the worker threads and the calling thread, returns when all are done
+	void runParallel(int count, const std::function<void(int)>& fn)
+	{
+		if (this->workers.empty()) {
+			for (int i = 0; i < count; i++)
+				fn(i);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(this->jobMutex);
+			this->job = fn;
+			this->jobCount = count;
+			this->nextJob = 0;
+			this->jobsRemaining = (int)this->workers.size();
+			this->jobGeneration++;
+		}
+		this->jobStart.notify_all();
+		this->runJobs();
+		std::unique_lock<std::mutex> lock(this->jobMutex);
+		this->jobFinished.wait(lock, [this] { return this->jobsRemaining == 0; });
+	}
+
+	void runJobs()
+	{
+		for (int i = this->nextJob++; i < this->jobCount; i = this->nextJob++)
+			this->job(i);
+	}
+
+	void workerLoop()
+	{
+		unsigned seenGeneration = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(this->jobMutex);
+				this->jobStart.wait(lock, [&] { return this->stopWorkers || this->jobGeneration != seenGeneration; });
+				if (this->stopWorkers)
+					return;
+				seenGeneration = this->jobGeneration;
+			}
+			this->runJobs();
+			{
+				std::lock_guard<std::mutex> lock(this->jobMutex);
+				if (--this->jobsRemaining == 0)
+					this->jobFinished.notify_one();
+			}
+		}
+	}
+};
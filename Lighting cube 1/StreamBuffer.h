@@ -0,0 +1,229 @@
+#pragma once
+
+// Std. Includes
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// GL Includes
+#include <GLEW/glew.h>
+
+#include "GLState.h"
+
+// to send geometry that changes every frame without reallocating a buffer:
+// 1. create the buffer once with the most bytes a frame will write, a multiple of the alignments it is allocated with,
+//    regions start at multiples of that size and padding to an alignment comes out of the frame's room
+//		StreamBuffer stream(GL_ARRAY_BUFFER, 64 * 1024);
+// 2. every frame, begin, write straight into the mapped memory, submit, then draw from the offsets allocate() gave
+//		stream.beginFrame();
+//		GLintptr offset;
+//		glm::vec3* points = (glm::vec3*)stream.allocate(count * sizeof(glm::vec3), sizeof(glm::vec3), offset);
+//		// fill points, it returns nullptr if the frame is out of room
+//		stream.submit();
+//		glDrawArrays(GL_LINE_STRIP, (GLint)(offset / sizeof(glm::vec3)), count);
+// The buffer is a ring of STREAM_BUFFER_FRAMES regions. A frame writes its region while the GPU still reads the ones before,
+// and beginFrame() only waits when the GPU is that many frames behind, so writing never stalls on a draw of the last frame.
+// With GL 4.4 or GL_ARB_buffer_storage the buffer is mapped once, persistent and coherent, and submit() costs nothing.
+// On 3.3 each frame maps its region unsynchronized, the fences make that safe, and submit() unmaps it again.
+// If waiting on a region's fence fails the region is skipped for that frame and allocate() returns nullptr.
+// Without fences the buffer is orphaned every frame, as glBufferData would, which is also the comparison for --bench-stream.
+
+// Regions in the ring, the frames the GPU may lag behind before beginFrame() waits
+const int STREAM_BUFFER_FRAMES = 3;
+// Longest wait for the GPU to give a region back, in nanoseconds
+const GLuint64 STREAM_BUFFER_WAIT_NS = 1000000000;
+
+// How the memory is written
+enum StreamBufferMode
+{
+	STREAM_BUFFER_PERSISTENT,	// mapped once with glBufferStorage, GL 4.4 or GL_ARB_buffer_storage
+	STREAM_BUFFER_UNSYNCHRONIZED,	// glMapBufferRange every frame without syncing, fenced regions, GL 3.2 or GL_ARB_sync
+	STREAM_BUFFER_ORPHAN,	// new storage every frame, any 3.x context
+	STREAM_BUFFER_BEST	// the first of these the context supports
+};
+
+// What the last frame wrote, for profiling
+struct StreamBufferStats
+{
+	unsigned bytes;		// bytes allocated
+	unsigned stalls;	// 1 if beginFrame() had to wait for the GPU
+	unsigned overflows;	// allocations refused because the region was full
+	unsigned fenceFailures;	// 1 if the wait for the region failed, the frame then has no room
+};
+
+class StreamBuffer
+{
+public:
+	// The GL buffer ID
+	GLuint buffer;
+	// The mode in use, never STREAM_BUFFER_BEST
+	StreamBufferMode mode;
+	StreamBufferStats lastFrame;
+
+	StreamBuffer(GLenum target, size_t bytesPerFrame, StreamBufferMode mode = STREAM_BUFFER_BEST)
+		: buffer(0), target(target), regionSize(bytesPerFrame), region(0), used(0), mapped(nullptr), persistentMemory(nullptr), begun(false)
+	{
+		this->mode = mode != STREAM_BUFFER_BEST && supported(mode) ? mode : bestMode();
+		for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+			this->fences[i] = 0;
+		this->frame.bytes = this->frame.stalls = this->frame.overflows = this->frame.fenceFailures = 0;
+		this->lastFrame = this->frame;
+
+		glGenBuffers(1, &this->buffer);
+		GLState::current().bindBuffer(this->target, this->buffer);
+		if (this->mode == STREAM_BUFFER_PERSISTENT) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(this->target, this->regionSize * STREAM_BUFFER_FRAMES, nullptr, flags);
+			this->persistentMemory = (unsigned char*)glMapBufferRange(this->target, 0, this->regionSize * STREAM_BUFFER_FRAMES, flags);
+			if (this->persistentMemory == nullptr) {
+				std::cout << "ERROR::STREAM_BUFFER::PERSISTENT_MAP_FAILED, mapping every frame instead" << std::endl;
+				GLState::current().deleteBuffers(1, &this->buffer);
+				glGenBuffers(1, &this->buffer);
+				GLState::current().bindBuffer(this->target, this->buffer);
+				this->mode = STREAM_BUFFER_UNSYNCHRONIZED;
+			}
+		}
+		if (this->mode == STREAM_BUFFER_UNSYNCHRONIZED)
+			glBufferData(this->target, this->regionSize * STREAM_BUFFER_FRAMES, nullptr, GL_STREAM_DRAW);
+		else if (this->mode == STREAM_BUFFER_ORPHAN)
+			glBufferData(this->target, this->regionSize, nullptr, GL_STREAM_DRAW);
+	}
+
+	~StreamBuffer()
+	{
+		for (int i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+			if (this->fences[i] != 0)
+				glDeleteSync(this->fences[i]);
+		}
+		GLState::current().bindBuffer(this->target, this->buffer);
+		if (this->mapped != nullptr || this->persistentMemory != nullptr)
+			glUnmapBuffer(this->target);
+		GLState::current().deleteBuffers(1, &this->buffer);
+	}
+
+	// Modes the current context can use
+	static bool supported(StreamBufferMode mode)
+	{
+		switch (mode) {
+		case STREAM_BUFFER_PERSISTENT: return (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && supported(STREAM_BUFFER_UNSYNCHRONIZED);
+		case STREAM_BUFFER_UNSYNCHRONIZED: return GLEW_VERSION_3_2 || GLEW_ARB_sync;
+		default: return true;
+		}
+	}
+
+	static StreamBufferMode bestMode()
+	{
+		if (supported(STREAM_BUFFER_PERSISTENT))
+			return STREAM_BUFFER_PERSISTENT;
+		return supported(STREAM_BUFFER_UNSYNCHRONIZED) ? STREAM_BUFFER_UNSYNCHRONIZED : STREAM_BUFFER_ORPHAN;
+	}
+
+	static const char* modeName(StreamBufferMode mode)
+	{
+		switch (mode) {
+		case STREAM_BUFFER_PERSISTENT: return "persistent";
+		case STREAM_BUFFER_UNSYNCHRONIZED: return "unsynchronized";
+		case STREAM_BUFFER_ORPHAN: return "orphan";
+		default: return "best";
+		}
+	}
+
+	size_t bytesPerFrame() const { return this->regionSize; }
+
+	// Fences the region of the last frame behind its draws, moves to the next region and waits until the GPU is done with it
+	void beginFrame()
+	{
+		if (this->begun) {
+			this->submit();
+			if (this->mode != STREAM_BUFFER_ORPHAN)
+				this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			this->lastFrame = this->frame;
+		}
+		this->begun = true;
+		this->frame.bytes = this->frame.stalls = this->frame.overflows = this->frame.fenceFailures = 0;
+		this->used = 0;
+		if (this->mode != STREAM_BUFFER_ORPHAN)
+			this->region = (this->region + 1) % STREAM_BUFFER_FRAMES;
+		GLsync fence = this->fences[this->region];
+		if (fence != 0) {
+			// a zero timeout only asks, the region is usually free already
+			GLenum status = glClientWaitSync(fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				this->frame.stalls = 1;
+				do {
+					status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_BUFFER_WAIT_NS);
+				} while (status == GL_TIMEOUT_EXPIRED);
+			}
+			glDeleteSync(fence);
+			this->fences[this->region] = 0;
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+				// GL_WAIT_FAILED, the GPU may still read the region, so this frame gets no room rather than overwrite it
+				std::cout << "ERROR::STREAM_BUFFER::FENCE_WAIT_FAILED, skipping region " << this->region << std::endl;
+				this->frame.fenceFailures = 1;
+				this->mapped = nullptr;
+				return;
+			}
+		}
+		GLState::current().bindBuffer(this->target, this->buffer);
+		if (this->mode == STREAM_BUFFER_UNSYNCHRONIZED) {
+			this->mapped = (unsigned char*)glMapBufferRange(this->target, this->regionStart(), this->regionSize,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+		}
+		else if (this->mode == STREAM_BUFFER_ORPHAN) {
+			// new storage, the GPU keeps reading the old one
+			glBufferData(this->target, this->regionSize, nullptr, GL_STREAM_DRAW);
+			this->mapped = (unsigned char*)glMapBufferRange(this->target, 0, this->regionSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		}
+		else {
+			this->mapped = this->persistentMemory + this->regionStart();
+		}
+	}
+
+	// size bytes at an offset that is a multiple of alignment, which need not be a power of two so vertices can be
+	// addressed by first = offset / stride. offset is from the start of the buffer, for attribute pointers and draws.
+	// Returns nullptr when this frame has no room left.
+	void* allocate(size_t size, size_t alignment, GLintptr& offset)
+	{
+		size_t start = this->regionStart();
+		size_t aligned = (start + this->used + alignment - 1) / alignment * alignment;
+		if (this->mapped == nullptr || aligned + size > start + this->regionSize) {
+			this->frame.overflows++;
+			return nullptr;
+		}
+		this->used = aligned + size - start;
+		this->frame.bytes += (unsigned)size;
+		offset = (GLintptr)aligned;
+		return this->mapped + (aligned - start);
+	}
+
+	// Makes the writes of this frame visible to GL, after the last allocate() and before the draws that read them
+	void submit()
+	{
+		if (this->mode == STREAM_BUFFER_PERSISTENT || this->mapped == nullptr)
+			return;
+		GLState::current().bindBuffer(this->target, this->buffer);
+		if (this->mode == STREAM_BUFFER_UNSYNCHRONIZED && this->used > 0)
+			glFlushMappedBufferRange(this->target, 0, this->used);
+		glUnmapBuffer(this->target);
+		this->mapped = nullptr;
+	}
+
+private:
+	GLenum target;
+	size_t regionSize;
+	int region;
+	// bytes of the region allocated this frame
+	size_t used;
+	// where this frame writes, nullptr once submitted
+	unsigned char* mapped;
+	unsigned char* persistentMemory;
+	GLsync fences[STREAM_BUFFER_FRAMES];
+	bool begun;
+	StreamBufferStats frame;
+
+	size_t regionStart() const { return this->mode == STREAM_BUFFER_ORPHAN ? 0 : (size_t)this->region * this->regionSize; }
+
+	// owns a GL buffer and its mapping
+	StreamBuffer(const StreamBuffer&);
+	StreamBuffer& operator=(const StreamBuffer&);
+};
@@ -0,0 +1,7 @@
+// Per-frame camera data, filled by FrameUniforms.h and declared once here for every shader
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	vec3 viewPos;
+	float time;
+};
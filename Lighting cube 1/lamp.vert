@@ -3,9 +3,9 @@
 layout(location = 0) in vec3 position;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "transform.glsl"
 
 void main() {
-	gl_Position = projection * view * model * vec4(position, 1.0f);
+	gl_Position = transform(model, position);
 }
\ No newline at end of file
@@ -5,15 +5,29 @@ in vec3 FragPos;
 
 out vec4 color;
 
+// compile time constants, ShaderVariants writes the values of a variant after #version
+#ifndef AMBIENT_STRENGTH
+#define AMBIENT_STRENGTH 0.1
+#endif
+#ifndef SPECULAR_STRENGTH
+#define SPECULAR_STRENGTH 0.5
+#endif
+#ifndef SHININESS
+#define SHININESS 32.0
+#endif
+#ifndef SPECULAR
+#define SPECULAR 1
+#endif
+
 uniform vec3 lightPos;
 uniform vec3 objectColor;
 uniform vec3 lightColor;
-uniform vec3 viewPos;
+
+#include "frame.glsl"
 
 void main() {
 	// ambient light
-	float ambientStrength = 0.1f;
-	vec3 ambient = ambientStrength * lightColor;
+	vec3 ambient = AMBIENT_STRENGTH * lightColor;
 
 	// diffuse light
 	vec3 norm = normalize(Normal);
@@ -22,11 +36,14 @@ void main() {
 	vec3 diffuse = diff*lightColor;
 
 	// specular light
-	float specularStrength = 0.5f;
+#if SPECULAR
 	vec3 viewDir = normalize(viewPos - FragPos);
 	vec3 reflectDir = reflect(-lightDir, norm);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-	vec3 specular = specularStrength * spec * lightColor;
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), SHININESS);
+	vec3 specular = SPECULAR_STRENGTH * spec * lightColor;
+#else
+	vec3 specular = vec3(0.0);
+#endif
 
 
 	vec3 result = (ambient + diffuse + specular) * objectColor;
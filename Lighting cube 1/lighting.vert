@@ -7,11 +7,11 @@ out vec3 Normal;
 out vec3 FragPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "transform.glsl"
 
 void main() {
-	gl_Position = projection * view * model * vec4(position, 1.0f);
+	gl_Position = transform(model, position);
 	FragPos = vec3(model * vec4(position, 1.0f));
 	Normal = normal;
 }
\ No newline at end of file
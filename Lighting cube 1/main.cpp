@@ -1,4 +1,12 @@
 #include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
 // GLEW
 #define GLEW_STATIC
@@ -14,14 +22,33 @@
 
 // Shader class
 #include "Shader.h"
+
+// Shadowed GL state, skips binds and switches that change nothing
+#include "GLState.h"
 #define STB_IMAGE_IMPLEMENTATION
 //#define STBI_ONLY_PNG
 //#define STBI_ONLY_JPEG
 #include "stb_image.h"
 #include "Camera.h"
+// Per-frame uniform buffer
+#include "FrameUniforms.h"
+// CPU renderer for machines without a GPU
+#include "SoftwareRenderer.h"
+// Shaders and mesh mapped from one file
+#include "AssetPack.h"
+// lighting.frag specialised by #define
+#include "ShaderVariants.h"
+
+// Draw packets recorded on any thread and replayed in key order
+#include "RenderQueue.h"
+
+// Ring buffer for vertices written every frame
+#include "StreamBuffer.h"
 
 // temporary globals
 bool lockCursor = false; // lock cursor in window by pressing C
+int lightingVariant = 0; // variant of lighting.frag, the next one by pressing V
+bool lightingVariantChanged = false;
 
 
 // Function prototypes
@@ -29,6 +56,16 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void movement();
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+int runHeadless(int frames, bool dumpFrames);
+bool writeAssetPack();
+void benchPack();
+void benchShaderRead(int variants);
+void benchCompile(int programs);
+void benchStream();
+ShaderDefines lightingDefines(int variant);
+
+// Variants of lighting.frag cycled with V
+const int LIGHTING_VARIANTS = 4;
 
 // Window dimensions
 const GLuint WIDTH = 800, HEIGHT = 600;
@@ -45,6 +82,12 @@ GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
 GLfloat currentFrame = 0.0f;
 
+// uniform calls, state calls, queued draws and streamed bytes of the previous frame, printed by pressing I
+UniformStats lastFrameStats = { 0, 0 };
+GLStateStats lastStateStats = { 0, 0 };
+RenderQueueStats lastQueueStats = { 0, 0, 0, 0 };
+StreamBufferStats lastStreamStats = { 0, 0, 0, 0 };
+
 
 //camera 
 Camera camera;
@@ -54,10 +97,102 @@ bool keys[1024];
 
 // light
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+// the path the lamp took over the last LAMP_TRAIL_POINTS * LAMP_TRAIL_STEP seconds, streamed as a line strip every frame
+const int LAMP_TRAIL_POINTS = 64;
+const GLfloat LAMP_TRAIL_STEP = 0.02f;
+// sizes --bench-stream writes per frame, the last is one RGBA frame at the window size
+const size_t streamBenchSizes[] = { 64 * 1024, 1024 * 1024, 800 * 600 * 4 };
+const int STREAM_BENCH_FRAMES = 300;
+
+// cube with normals, 36 vertices
+GLfloat vertices[] = {
+	-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+	-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
+
+	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+	-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
+
+	-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+	-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
+
+	0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+	0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
+
+	-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+	0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+	0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+	0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+	-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
+	-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
+
+	-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+	0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+	0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+	-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
+	-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
+};
 
 // The MAIN function, from here we start the application and run the game loop
-int main()
+int main(int argc, char* argv[])
 {
+	// command line options for running without a GPU:
+	//   --headless      render on the CPU instead of opening a window
+	//   --frames N      number of frames to render in headless mode
+	//   --dump          write every headless frame to frame_NNNN.ppm
+	// asset pack:
+	//   --pack          write the shaders and the cube mesh to assets.pack, which is used instead of them from then on, and exit
+	//   --loose         read the loose files even if there is an assets.pack
+	//   --bench-pack    cold and warm time to get the assets into memory from the loose files and from assets.pack, then exit
+	// shader loading:
+	//   --bench-shader-read N   time to read the sources of each program N times with stream copies, one read per file and both files at once, then exit
+	//   --bench-compile N       time to compile N programs one after another and as one batch on the driver's threads, then exit
+	// streaming:
+	//   --bench-stream  MB/s written through StreamBuffer in each mode the context supports, drawn from every frame, then exit
+	bool headless = false, dumpFrames = false, looseFiles = false;
+	bool streamBench = false;
+	int headlessFrames = 300, compilePrograms = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--headless") headless = true;
+		else if (arg == "--dump") dumpFrames = true;
+		else if (arg == "--frames" && i + 1 < argc) headlessFrames = atoi(argv[++i]);
+		else if (arg == "--loose") looseFiles = true;
+		else if (arg == "--pack") return writeAssetPack() ? 0 : 1;
+		else if (arg == "--bench-pack") {
+			benchPack();
+			return 0;
+		}
+		else if (arg == "--bench-shader-read" && i + 1 < argc) {
+			benchShaderRead(std::max(1, atoi(argv[++i])));
+			return 0;
+		}
+		else if (arg == "--bench-compile" && i + 1 < argc) compilePrograms = std::max(1, atoi(argv[++i]));
+		else if (arg == "--bench-stream") streamBench = true;
+	}
+	if (headless)
+		return runHeadless(headlessFrames, dumpFrames);
+
+	// startup benchmark, time from here until the first frame is on screen
+	std::chrono::high_resolution_clock::time_point startupStart = std::chrono::high_resolution_clock::now();
+	bool firstFrame = true;
+
 	std::cout << "Starting GLFW context, OpenGL 3.1" << std::endl;
 	// Init GLFW
 	glfwInit();
@@ -97,8 +232,9 @@ int main()
 			if (window == nullptr)
 			{
 				std::cout << "Failed to create GLFW window 2.1" << std::endl;
+				std::cout << "Falling back to the software renderer" << std::endl;
 				glfwTerminate();
-				return -1;
+				return runHeadless(headlessFrames, dumpFrames);
 			}
 		}
 	}
@@ -122,54 +258,39 @@ int main()
 	int width, height;
 	glfwGetFramebufferSize(window, &width, &height); // gets size of screen
 	glViewport(0, 0, width, height); 
+	if (compilePrograms > 0) {
+		benchCompile(compilePrograms);
+		glfwTerminate();
+		return 0;
+	}
+	if (streamBench) {
+		benchStream();
+		glfwTerminate();
+		return 0;
+	}
+	// compile on the driver's threads where supported
+	bool parallelCompile = Shader::enableParallelCompile();
 
 	//Shader testShader("lighting.vert", "lighting.frag");
-	Shader lightingShader("lighting.vert", "lighting.frag");
-	Shader lampShader("lamp.vert", "lamp.frag");
-
-	GLfloat vertices[] = {
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f,  0.0f, 1.0f,
-
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-
-		0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-		0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-		0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
-	};
+	// shaders and mesh straight from the mapping of assets.pack if it has been written with --pack
+	AssetPack pack;
+	bool packed = !looseFiles && pack.open(ASSET_PACK_FILE);
+	if (packed)
+		std::cout << "Loading from " << ASSET_PACK_FILE << std::endl;
+	// the lit shader is only submitted and compiles while the first frames draw the cube flat with the lamp shader
+	// its constants are defines rather than uniforms, every set of them is a variant compiled once
+	ShaderVariants lightingVariants(pack, "lighting.vert", "lighting.frag");
+	Shader* lightingShader = &lightingVariants.get(lightingDefines(lightingVariant), true);
+	Shader lampShader(pack, "lamp.vert", "lamp.frag");
+	// transform.glsl and frame.glsl are read once for all three shaders that include them
+	std::cout << "Shader includes: ";
+	ShaderIncludes::shared().report();
+	bool lightingReported = false;
+	std::cout << "lampShader: " << lampShader.buildTime << " ms, read in " << lampShader.readTime << " ms" << (lampShader.fromCache ? " (binary cache)" : "") << std::endl;
+	// view, projection and viewPos for both shaders
+	FrameUniforms frameUniforms;
+	camera.SetPerspective((GLfloat)WIDTH / (GLfloat)HEIGHT);
+
 
 
 
@@ -194,16 +315,21 @@ int main()
 	//GLuint VAO2;
 	//glGenVertexArrays(1, &VAO2);
 
-	// initialisation code
+	// initialisation code, binds and switches go through the state tracker so it can skip the ones that change nothing
+	GLState& state = GLState::current();
 	// 1: bind vertex array object
 	//glBindVertexArray(VAO);
 	//glBindVertexArray(lightingVAO);
-	glBindVertexArray(VAO);
+	state.bindVertexArray(VAO);
 	// 2: copy vertices array in buffer for opengl
 
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	state.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	const AssetEntry* packedVertices = pack.isOpen() ? pack.find("cube.vertices") : nullptr;
+	if (packedVertices != nullptr)
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)packedVertices->size, pack.data(packedVertices), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 	// 2.5: copy index array in elemennt buffer
 	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	//glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
@@ -219,14 +345,27 @@ int main()
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
 	glEnableVertexAttribArray(1);
 	// 4: unbind VAO (NOT the EBO)
-	glBindVertexArray(0);
+	state.bindVertexArray(0);
 
-	// bind other vao
-	glBindVertexArray(lightingVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	// bind other vao, VBO is still bound so that bind is filtered
+	state.bindVertexArray(lightingVAO);
+	state.bindBuffer(GL_ARRAY_BUFFER, VBO);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)0);
 	glEnableVertexAttribArray(0);
-	glBindVertexArray(0);
+	state.bindVertexArray(0);
+	// GL has its own copies now
+	pack.close();
+
+	// lamp trail, positions only, read from the stream buffer at the offset of each frame through the first vertex of the draw
+	StreamBuffer stream(GL_ARRAY_BUFFER, LAMP_TRAIL_POINTS * sizeof(glm::vec3));
+	std::cout << "Stream buffer: " << StreamBuffer::modeName(stream.mode) << std::endl;
+	GLuint trailVAO;
+	glGenVertexArrays(1, &trailVAO);
+	state.bindVertexArray(trailVAO);
+	state.bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+	state.bindVertexArray(0);
 
 
 
@@ -238,7 +377,9 @@ int main()
 	// matrix goodness!
 
 	
-	glEnable(GL_DEPTH_TEST); // required for z-buffer to work
+	state.enable(GL_DEPTH_TEST); // required for z-buffer to work
+	// draws are recorded as packets and replayed sorted by shader and depth
+	RenderQueue queue;
 
 
 	// Game loop
@@ -250,6 +391,11 @@ int main()
 		currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		// profiling counters for this frame
+		lastFrameStats = Shader::frameStats();
+		Shader::resetFrameStats();
+		lastStateStats = state.stats;
+		state.resetFrameStats();
 
 
 
@@ -260,16 +406,28 @@ int main()
 	
 
 		// Clear the colorbuffer
-		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		state.clearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		
 
-		lightingShader.use();
-		GLuint objectColorLoc = glGetUniformLocation(lightingShader.program, "objectColor");
-		GLuint lightColorLoc = glGetUniformLocation(lightingShader.program, "lightColor");
+		// camera data is uploaded once and shared by both shaders, and only again after the camera moves
+		frameUniforms.update(camera, currentFrame);
 
-		glUniform3f(objectColorLoc, 1.0f, 0.5f, 0.31f);
-		glUniform3f(lightColorLoc, 1.0f, 1.0f, 1.0f);
+		// lamp shader until the lit shader is ready, it has none of the lighting uniforms so their setters do nothing
+		if (lightingVariantChanged) {
+			// a new variant compiles in the background like the first one
+			lightingShader = &lightingVariants.get(lightingDefines(lightingVariant), true);
+			lightingVariantChanged = false;
+		}
+		bool lit = lightingShader->isReady();
+		if (lit && !lightingReported) {
+			lightingShader->finish();
+			std::cout << "lightingShader: " << lightingShader->buildTime << " ms" << (lightingShader->fromCache ? " (binary cache)" : "")
+				<< (parallelCompile ? ", compiled in the background" : "") << ", ready after " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupStart).count() << " ms" << std::endl;
+			lightingReported = true;
+		}
+		Shader& cubeShader = lit ? *lightingShader : lampShader;
+		// both cubes are recorded as packets, replay sorts them by shader and distance and sets the uniforms
+		RenderRecorder& recorder = queue.recorder(0);
 
 
 
@@ -279,43 +437,46 @@ int main()
 		
 		//model = glm::translate(model, lightPos);
 		//model = glm::scale(model, glm::vec3(0.2f));
-		glUniformMatrix4fv(glGetUniformLocation(lightingShader.program, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-		glm::mat4 view;
-		view = camera.GetViewMatrix();
-		glUniformMatrix4fv(glGetUniformLocation(lightingShader.program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-
-		glm::mat4 projection;
-		projection = glm::perspective(glm::radians(camera.zoom), (GLfloat)WIDTH/(GLfloat)HEIGHT, 0.1f, 100.0f);
-		glUniformMatrix4fv(glGetUniformLocation(lightingShader.program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-		
-		glUniform3f(glGetUniformLocation(lightingShader.program, "lightPos"), lightPos.x, lightPos.y, lightPos.z);
-		glUniform3f(glGetUniformLocation(lightingShader.program, "viewPos"), camera.position.x, camera.position.y, camera.position.z);
 
 		// draw triangle
-		glBindVertexArray(VAO);
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		recorder.drawArrays(renderKey(RENDER_PASS_OPAQUE, cubeShader.program, 0, glm::length(camera.position)), &cubeShader, VAO, GL_TRIANGLES, 0, 36);
+		recorder.setVec3("objectColor", glm::vec3(1.0f, 0.5f, 0.31f));
+		recorder.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
+		recorder.setMat4("model", model);
+		recorder.setVec3("lightPos", lightPos);
 
 
 
-		lampShader.use();
 		// change lamp position
-		lightPos = glm::vec3(sin(glfwGetTime()*glm::radians(45.0f)), 1.0f, cos(glfwGetTime()*glm::radians(45.0f)));
+		GLfloat time = (GLfloat)glfwGetTime();
+		lightPos = glm::vec3(sin(time*glm::radians(45.0f)), 1.0f, cos(time*glm::radians(45.0f)));
 		model = glm::mat4();
 		model = glm::translate(model, lightPos);
 		model = glm::scale(model, glm::vec3(0.2f)); // Make it a smaller cube
-		glUniformMatrix4fv(glGetUniformLocation(lampShader.program, "model"), 1, GL_FALSE, glm::value_ptr(model));
-		glUniformMatrix4fv(glGetUniformLocation(lampShader.program, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(glGetUniformLocation(lampShader.program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-		glBindVertexArray(lightingVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-
-
-
+		recorder.drawArrays(renderKey(RENDER_PASS_OPAQUE, lampShader.program, 0, glm::length(camera.position - lightPos)), &lampShader, lightingVAO, GL_TRIANGLES, 0, 36);
+		recorder.setMat4("model", model);
+
+		// lamp trail, written straight into this frame's region of the stream buffer
+		stream.beginFrame();
+		lastStreamStats = stream.lastFrame;
+		GLintptr trailOffset = 0;
+		glm::vec3* trail = (glm::vec3*)stream.allocate(LAMP_TRAIL_POINTS * sizeof(glm::vec3), sizeof(glm::vec3), trailOffset);
+		if (trail != nullptr) {
+			for (int i = 0; i < LAMP_TRAIL_POINTS; i++) {
+				GLfloat angle = (time - i * LAMP_TRAIL_STEP) * glm::radians(45.0f);
+				trail[i] = glm::vec3(sin(angle), 1.0f, cos(angle));
+			}
+			recorder.drawArrays(renderKey(RENDER_PASS_OPAQUE, lampShader.program, 0, glm::length(camera.position - lightPos)), &lampShader, trailVAO,
+				GL_LINE_STRIP, (GLint)(trailOffset / sizeof(glm::vec3)), LAMP_TRAIL_POINTS);
+			recorder.setMat4("model", glm::mat4());
+		}
+		stream.submit();
 
-		glBindVertexArray(0);
+		// the last VAO is left bound, the next frame binds its own before drawing anyway
+		queue.sort();
+		queue.replay();
+		lastQueueStats = queue.lastReplay;
+		queue.clear();
 
 
 
@@ -331,14 +492,381 @@ int main()
 
 		// Swap the screen buffers
 		glfwSwapBuffers(window);
+		if (firstFrame) {
+			glFinish();
+			std::cout << "Startup time: " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupStart).count() << " ms"
+				<< (packed ? " (" ASSET_PACK_FILE ")" : " (loose files)") << std::endl;
+			firstFrame = false;
+		}
 	}
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &EBO);
+	std::cout << "lighting.frag: ";
+	lightingVariants.report();
+	state.deleteVertexArrays(1, &VAO);
+	state.deleteVertexArrays(1, &trailVAO);
+	state.deleteBuffers(1, &VBO);
+	state.deleteBuffers(1, &EBO);
 	// Terminate GLFW, clearing any resources allocated by GLFW.
 	glfwTerminate();
 	return 0;
 }
+// Renders the lit cube and the lamp on the CPU, used when there is no GPU or display available
+int runHeadless(int frames, bool dumpFrames)
+{
+	SoftwareRenderer renderer(WIDTH, HEIGHT);
+	std::cout << "Software renderer: " << WIDTH << "x" << HEIGHT << ", " << renderer.threadCount() << " threads" << std::endl;
+
+	// same buffer setup as the GL version
+	GLuint VBO = renderer.genBuffer();
+	GLuint VAO = renderer.genVertexArray();
+	GLuint lightingVAO = renderer.genVertexArray();
+	renderer.bindVertexArray(VAO);
+	renderer.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	renderer.bufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices);
+	renderer.vertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+	renderer.enableVertexAttribArray(0);
+	renderer.vertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 3 * sizeof(GLfloat));
+	renderer.enableVertexAttribArray(1);
+	renderer.bindVertexArray(lightingVAO);
+	renderer.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	renderer.vertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+	renderer.enableVertexAttribArray(0);
+	renderer.bindVertexArray(0);
+
+	glm::mat4 model, view, projection;
+	glm::vec3 objectColor(1.0f, 0.5f, 0.31f);
+	glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
+
+	// lighting.vert and lighting.frag, varyings are FragPos then Normal
+	SoftwareProgram lightingProgram;
+	lightingProgram.varyingCount = 6;
+	lightingProgram.vertex = [&](const glm::vec4* in, SoftwareVertex& out) {
+		glm::vec4 worldPos = model * glm::vec4(in[0].x, in[0].y, in[0].z, 1.0f);
+		out.position = projection * view * worldPos;
+		out.varyings[0] = worldPos.x;
+		out.varyings[1] = worldPos.y;
+		out.varyings[2] = worldPos.z;
+		out.varyings[3] = in[1].x;
+		out.varyings[4] = in[1].y;
+		out.varyings[5] = in[1].z;
+	};
+	lightingProgram.fragment = [&](const float* in, glm::vec4& color) {
+		glm::vec3 fragPos(in[0], in[1], in[2]);
+		// ambient light
+		float ambientStrength = 0.1f;
+		glm::vec3 ambient = ambientStrength * lightColor;
+		// diffuse light
+		glm::vec3 norm = glm::normalize(glm::vec3(in[3], in[4], in[5]));
+		glm::vec3 lightDir = glm::normalize(lightPos - fragPos);
+		float diff = std::max(glm::dot(norm, lightDir), 0.0f);
+		glm::vec3 diffuse = diff * lightColor;
+		// specular light
+		float specularStrength = 0.5f;
+		glm::vec3 viewDir = glm::normalize(camera.position - fragPos);
+		glm::vec3 reflectDir = -lightDir - 2.0f * glm::dot(norm, -lightDir) * norm;
+		float spec = std::pow(std::max(glm::dot(viewDir, reflectDir), 0.0f), 32.0f);
+		glm::vec3 specular = specularStrength * spec * lightColor;
+
+		glm::vec3 result = (ambient + diffuse + specular) * objectColor;
+		color = glm::vec4(result, 1.0f);
+		return true;
+	};
+
+	// lamp.vert and lamp.frag
+	SoftwareProgram lampProgram;
+	lampProgram.vertex = [&](const glm::vec4* in, SoftwareVertex& out) {
+		out.position = projection * view * model * glm::vec4(in[0].x, in[0].y, in[0].z, 1.0f);
+	};
+	lampProgram.fragment = [](const float*, glm::vec4& color) {
+		color = glm::vec4(1.0f);
+		return true;
+	};
+
+	renderer.enable(GL_DEPTH_TEST);
+	// the camera starts inside the cube, move it back so the frames show the whole scene
+	camera.SetPosition(glm::vec3(0.0f, 0.0f, 3.0f));
+	camera.SetPerspective((GLfloat)WIDTH / (GLfloat)HEIGHT);
+
+	// fixed time step so every run produces the same frames
+	deltaTime = 1.0f / 60.0f;
+	double renderTime = 0.0;
+	for (int frame = 0; frame < frames; frame++) {
+		currentFrame = frame * deltaTime;
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		renderer.clearColor(0.2f, 0.3f, 0.3f, 1.0f);
+		renderer.clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		view = camera.GetViewMatrix();
+		projection = camera.GetProjectionMatrix();
+
+		renderer.useProgram(&lightingProgram);
+		model = glm::mat4();
+		renderer.bindVertexArray(VAO);
+		renderer.drawArrays(GL_TRIANGLES, 0, 36);
+
+		renderer.useProgram(&lampProgram);
+		lightPos = glm::vec3(sin(currentFrame*glm::radians(45.0f)), 1.0f, cos(currentFrame*glm::radians(45.0f)));
+		model = glm::mat4();
+		model = glm::translate(model, lightPos);
+		model = glm::scale(model, glm::vec3(0.2f));
+		renderer.bindVertexArray(lightingVAO);
+		renderer.drawArrays(GL_TRIANGLES, 0, 36);
+		renderer.bindVertexArray(0);
+
+		renderTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (dumpFrames) {
+			char path[64];
+			snprintf(path, sizeof(path), "frame_%04d.ppm", frame);
+			renderer.savePPM(path);
+		}
+	}
+	if (frames > 0)
+		std::cout << frames << " frames in " << renderTime * 1000.0 << " ms (" << frames / renderTime << " fps)" << std::endl;
+	return 0;
+}
+
+// Writes the shader sources and the cube to assets.pack
+bool writeAssetPack()
+{
+	AssetPackWriter writer;
+	bool added = writer.addFile("lighting.vert", ASSET_SHADER) && writer.addFile("lighting.frag", ASSET_SHADER)
+		&& writer.addFile("lamp.vert", ASSET_SHADER) && writer.addFile("lamp.frag", ASSET_SHADER)
+		&& writer.addFile("transform.glsl", ASSET_SHADER) && writer.addFile("frame.glsl", ASSET_SHADER)
+		&& writer.add("cube.vertices", ASSET_MESH, vertices, sizeof(vertices));
+	if (!added || !writer.write(ASSET_PACK_FILE)) {
+		std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_WRITTEN " << ASSET_PACK_FILE << std::endl;
+		return false;
+	}
+	std::cout << "Wrote " << ASSET_PACK_FILE << std::endl;
+	return true;
+}
+
+// Time until the shaders and the cube are in memory, read from the loose files against mapped from assets.pack.
+// Cold runs drop the files from the page cache first, which needs Linux.
+void benchPack()
+{
+	const char* files[] = { "lighting.vert", "lighting.frag", "lamp.vert", "lamp.frag", "transform.glsl", "frame.glsl", ASSET_PACK_FILE };
+	const char* entries[] = { "lighting.vert", "lighting.frag", "lamp.vert", "lamp.frag", "transform.glsl", "frame.glsl", "cube.vertices" };
+	const int warmRuns = 50;
+	AssetPack pack;
+	if (!pack.open(ASSET_PACK_FILE)) {
+		std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_READ " << ASSET_PACK_FILE << ", run --pack first" << std::endl;
+		return;
+	}
+	std::cout << ASSET_PACK_FILE << ": " << pack.count() << " assets, " << pack.size() / 1024.0 << " KB" << std::endl;
+	pack.close();
+	bool canEvict = AssetPack::evictFromCache(ASSET_PACK_FILE);
+	if (!canEvict)
+		std::cout << "  cold: dropping files from the page cache is only supported on Linux" << std::endl;
+	unsigned checksum = 0;
+	for (int cold = canEvict ? 1 : 0; cold >= 0; cold--) {
+		double times[2] = { 0.0, 0.0 };
+		int runs = cold ? 1 : warmRuns;
+		for (int source = 0; source < 2; source++) {
+			for (int run = 0; run < runs; run++) {
+				if (cold) {
+					for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++)
+						AssetPack::evictFromCache(files[f]);
+				}
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				if (source == 0) {
+					std::string vertexCode, fragmentCode;
+					Shader::readSources("lighting.vert", "lighting.frag", vertexCode, fragmentCode);
+					checksum += (unsigned)(vertexCode.size() + fragmentCode.size());
+					Shader::readSources("lamp.vert", "lamp.frag", vertexCode, fragmentCode);
+					checksum += (unsigned)(vertexCode.size() + fragmentCode.size());
+					Shader::readSources("transform.glsl", "frame.glsl", vertexCode, fragmentCode);
+					checksum += (unsigned)(vertexCode.size() + fragmentCode.size());
+				}
+				else {
+					pack.open(ASSET_PACK_FILE);
+					for (size_t e = 0; e < sizeof(entries) / sizeof(entries[0]); e++) {
+						const AssetEntry* entry = pack.find(entries[e]);
+						if (entry != nullptr)
+							checksum += pack.touch(entry);
+					}
+					pack.close();
+				}
+				times[source] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+		}
+		std::cout << (cold ? "  cold" : "  warm") << "  loose files: " << times[0] / runs << " ms, " << ASSET_PACK_FILE << ": " << times[1] / runs << " ms" << std::endl;
+	}
+	// keeps the reads from being optimised away
+	volatile unsigned sink = checksum;
+	(void)sink;
+}
+
+// The shader loading before single reads, copying each file through a stringstream into a std::string
+void readSourcesWithStreams(const GLchar* vertexPath, const GLchar* fragmentPath, std::string& vertexCode, std::string& fragmentCode)
+{
+	std::ifstream vShaderFile(vertexPath);
+	std::ifstream fShaderFile(fragmentPath);
+	std::stringstream vShaderStream, fShaderStream;
+	vShaderStream << vShaderFile.rdbuf();
+	fShaderStream << fShaderFile.rdbuf();
+	vertexCode = vShaderStream.str();
+	fragmentCode = fShaderStream.str();
+}
+
+// Reads the sources of each program as many times as a startup with that many variants of it would, per program:
+// copied through streams as the Shader constructor used to, with a single read per file into reused buffers,
+// and the same with both files read at once. Cold runs drop the files from the page cache first, which needs Linux.
+void benchShaderRead(int variants)
+{
+	const char* programs[][2] = { { "lighting.vert", "lighting.frag" }, { "lamp.vert", "lamp.frag" } };
+	const char* methods[] = { "streams", "single read", "single read, parallel" };
+	const int coldRuns = 5;
+	bool canEvict = AssetPack::evictFromCache(programs[0][0]);
+	if (!canEvict)
+		std::cout << "cold: dropping files from the page cache is only supported on Linux" << std::endl;
+	std::string vertexCode, fragmentCode;
+	size_t checksum = 0;
+	for (size_t p = 0; p < sizeof(programs) / sizeof(programs[0]); p++) {
+		std::cout << programs[p][0] << " + " << programs[p][1] << std::endl;
+		for (int m = 0; m < 3; m++) {
+			double times[2] = { 0.0, 0.0 };
+			for (int cold = canEvict ? 1 : 0; cold >= 0; cold--) {
+				int runs = cold ? coldRuns : variants;
+				for (int run = 0; run < runs; run++) {
+					if (cold) {
+						AssetPack::evictFromCache(programs[p][0]);
+						AssetPack::evictFromCache(programs[p][1]);
+					}
+					std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+					if (m == 0)
+						readSourcesWithStreams(programs[p][0], programs[p][1], vertexCode, fragmentCode);
+					else
+						Shader::readSources(programs[p][0], programs[p][1], vertexCode, fragmentCode, m == 2);
+					times[cold] += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+					checksum += vertexCode.size() + fragmentCode.size();
+				}
+			}
+			std::cout << "  " << methods[m] << ": warm " << times[0] / variants << " us per program, " << times[0] / 1000.0 << " ms for " << variants;
+			if (canEvict)
+				std::cout << ", cold " << times[1] / coldRuns << " us per program";
+			std::cout << std::endl;
+		}
+	}
+	// keeps the reads from being optimised away
+	volatile size_t sink = checksum;
+	(void)sink;
+}
+
+// Constants of each variant of lighting.frag. The first has the values the file uses without defines.
+ShaderDefines lightingDefines(int variant)
+{
+	ShaderDefines defines;
+	defines.set("AMBIENT_STRENGTH", 0.1).set("SPECULAR_STRENGTH", 0.5).set("SHININESS", 32.0);
+	if (variant == 1)
+		defines.set("SHININESS", 8.0);
+	else if (variant == 2)
+		defines.set("SHININESS", 128.0);
+	else if (variant == 3)
+		defines.set("SPECULAR", 0); // diffuse only, the specular term is not compiled
+	return defines;
+}
+
+// Builds the lit shader as that many programs, each made different by a comment so the driver cannot reuse one compile:
+// one after another as the constructor did before, then submitted as one batch and finished once the driver reports them ready.
+// The binary cache is off so every program is compiled.
+void benchCompile(int programs)
+{
+	const GLchar* vertexSource;
+	const GLchar* fragmentSource;
+	GLint vertexLength, fragmentLength;
+	Shader::loadSources(nullptr, "lighting.vert", "lighting.frag", vertexSource, vertexLength, fragmentSource, fragmentLength);
+	std::string vertexCode(vertexSource, vertexLength), fragmentCode(fragmentSource, fragmentLength);
+	bool parallel = Shader::enableParallelCompile();
+	Shader::binaryCacheEnabled() = false;
+	std::cout << programs << " programs, " << (parallel ? "compiled on the driver's threads" : "no parallel shader compile extension") << std::endl;
+	// new sources on every launch, so the driver's own disk cache does not hold them from the last one
+	unsigned long long run = (unsigned long long)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+	for (int deferred = 0; deferred < 2; deferred++) {
+		std::vector<std::string> vertexSources(programs), fragmentSources(programs);
+		for (int i = 0; i < programs; i++) {
+			std::string variant = "\n// variant " + std::to_string(run) + " " + std::to_string(deferred) + " " + std::to_string(i) + "\n";
+			vertexSources[i] = vertexCode + variant;
+			fragmentSources[i] = fragmentCode + variant;
+		}
+		std::vector<Shader> shaders;
+		shaders.reserve(programs);
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < programs; i++)
+			shaders.emplace_back(vertexSources[i].c_str(), (GLint)vertexSources[i].size(), fragmentSources[i].c_str(), (GLint)fragmentSources[i].size(), deferred == 1);
+		double submitted = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		// a frame loop would draw while it waits, here it only polls
+		for (int i = 0; i < programs; i++) {
+			while (!shaders[i].isReady())
+				std::this_thread::yield();
+			shaders[i].finish();
+		}
+		double total = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (deferred)
+			std::cout << "  batch: submitted in " << submitted << " ms, all ready in " << total << " ms, " << total / programs << " ms per program" << std::endl;
+		else
+			std::cout << "  one at a time: " << total << " ms, " << total / programs << " ms per program" << std::endl;
+		for (int i = 0; i < programs; i++)
+			glDeleteProgram(shaders[i].program);
+	}
+	Shader::binaryCacheEnabled() = true;
+}
+
+// Streams each size of streamBenchSizes every frame in each StreamBuffer mode the context supports. Every frame is drawn
+// as points with rasterization off, so the GPU reads all of it and the ring has to wait for it like a real frame would.
+// The time includes the copies, the maps, the draws and waiting for the GPU at the end.
+void benchStream()
+{
+	Shader pointShader("lamp.vert", "lamp.frag");
+	GLState& state = GLState::current();
+	GLuint benchVAO;
+	glGenVertexArrays(1, &benchVAO);
+	state.enable(GL_RASTERIZER_DISCARD);
+	StreamBufferMode modes[] = { STREAM_BUFFER_PERSISTENT, STREAM_BUFFER_UNSYNCHRONIZED, STREAM_BUFFER_ORPHAN };
+	for (size_t size : streamBenchSizes) {
+		// what the frame would have produced on the CPU, copied into the mapping as real data would be
+		std::vector<glm::vec3> source(size / sizeof(glm::vec3));
+		for (size_t i = 0; i < source.size(); i++)
+			source[i] = glm::vec3((GLfloat)(i % 101), (GLfloat)(i % 37), (GLfloat)i);
+		size_t bytes = source.size() * sizeof(glm::vec3);
+		for (StreamBufferMode mode : modes) {
+			if (!StreamBuffer::supported(mode)) {
+				std::cout << StreamBuffer::modeName(mode) << ": not supported" << std::endl;
+				continue;
+			}
+			StreamBuffer stream(GL_ARRAY_BUFFER, bytes, mode);
+			state.bindVertexArray(benchVAO);
+			state.bindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+			glEnableVertexAttribArray(0);
+			pointShader.use();
+			glFinish();
+			unsigned stalls = 0;
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (int frame = 0; frame < STREAM_BENCH_FRAMES; frame++) {
+				stream.beginFrame();
+				stalls += stream.lastFrame.stalls;
+				GLintptr offset = 0;
+				void* data = stream.allocate(bytes, sizeof(glm::vec3), offset);
+				if (data != nullptr)
+					std::memcpy(data, &source[0], bytes);
+				stream.submit();
+				glDrawArrays(GL_POINTS, (GLint)(offset / sizeof(glm::vec3)), (GLsizei)source.size());
+			}
+			glFinish();
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+			double megabytes = (double)bytes * STREAM_BENCH_FRAMES / (1024.0 * 1024.0);
+			std::cout << bytes / 1024 << " KB per frame, " << StreamBuffer::modeName(stream.mode) << ": " << megabytes / seconds << " MB/s, "
+				<< seconds * 1000.0 / STREAM_BENCH_FRAMES << " ms per frame, " << stalls << " stalls" << std::endl;
+		}
+	}
+	state.disable(GL_RASTERIZER_DISCARD);
+	state.bindVertexArray(0);
+	state.deleteVertexArrays(1, &benchVAO);
+	glDeleteProgram(pointShader.program);
+}
+
 bool upP = false, downP = false, leftP = false, rightP = false, shiftP = false, ctrlP = false;
 // Is called whenever a key is pressed/released via GLFW
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
@@ -358,6 +886,22 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 			lockCursor = false;
 		}
 	}
+	if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+		// next variant of lighting.frag, each is compiled the first time it is shown
+		lightingVariant = (lightingVariant + 1) % LIGHTING_VARIANTS;
+		lightingVariantChanged = true;
+		std::cout << "lighting.frag variant: " << lightingDefines(lightingVariant).key() << std::endl;
+	}
+	if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+		// print the uniform calls saved by the Shader setters in the last frame
+		std::cout << "Uniform calls issued: " << lastFrameStats.callsIssued << ", saved: " << lastFrameStats.callsSaved << std::endl;
+		std::cout << "State calls issued: " << lastStateStats.callsIssued << ", filtered: " << lastStateStats.callsFiltered << std::endl;
+		std::cout << "Render queue: " << lastQueueStats.packets << " packets, " << lastQueueStats.shaderChanges << " shader changes, " << lastQueueStats.vertexArrayChanges << " VAO changes";
+		if (lastQueueStats.droppedUniforms > 0)
+			std::cout << ", " << lastQueueStats.droppedUniforms << " uniforms dropped, set before a draw";
+		std::cout << std::endl;
+		std::cout << "Streamed: " << lastStreamStats.bytes << " bytes, " << lastStreamStats.stalls << " stalls, " << lastStreamStats.overflows << " overflows, " << lastStreamStats.fenceFailures << " failed fence waits" << std::endl;
+	}
 	
 
 }
@@ -0,0 +1,6 @@
+// Model space to clip space for the vertex shaders
+#include "frame.glsl"
+
+vec4 transform(mat4 model, vec3 position) {
+	return projection * view * model * vec4(position, 1.0f);
+}
@@ -0,0 +1,578 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+// GL Includes
+#include <GLEW/glew.h>
+
+#include "TextureImport.h"
+#include "MipChain.h"
+
+// to compress RGBA8 textures into GPU block formats offline:
+// 1. build the RGBA mip chain as usual
+//		generateMips(pixels, width, height, 4, flags, levels, threads);
+// 2. encode every level, 4x4 pixel blocks in parallel on threads
+//		std::vector<unsigned char> blocks;
+//		std::vector<MipLevel> blockLevels;
+//		compressMipChain(pixels, levels, BLOCK_BC3, blocks, blockLevels, threads);
+// 3. write them with TextureFile.h and load them with TextureLoader, which uploads with glCompressedTexImage2D
+//		writeTextureFile("buildings.bc.tex", width, height, blockTextureFormat(BLOCK_BC3, false), blocks, blockLevels);
+// BC1 stores RGB in 4 bits per pixel, BC3 adds a separate alpha block (8 bits per pixel) and BC7 mode 6
+// stores RGBA with 16 levels between two 8 bit endpoints (8 bits per pixel, needs GL 4.2 or ARB_texture_compression_bptc).
+// The encoders fit the endpoints along the principal axis of the block and refit them once by least squares.
+
+enum BlockFormat
+{
+	BLOCK_BC1,
+	BLOCK_BC3,
+	BLOCK_BC7
+};
+
+inline int blockBytes(BlockFormat format)
+{
+	return format == BLOCK_BC1 ? 8 : 16;
+}
+
+inline const char* blockFormatName(BlockFormat format)
+{
+	return format == BLOCK_BC1 ? "BC1" : (format == BLOCK_BC3 ? "BC3" : "BC7");
+}
+
+// Bytes of one level of width x height pixels, partial blocks at the edges are padded to 4x4
+inline size_t blockLevelSize(int width, int height, BlockFormat format)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+// GL formats of the blocks, BC1 has no alpha
+inline TextureFormat blockTextureFormat(BlockFormat format, bool srgb)
+{
+	TextureFormat result;
+	if (format == BLOCK_BC1)
+		result.internalFormat = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	else if (format == BLOCK_BC3)
+		result.internalFormat = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	else
+		result.internalFormat = srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+	result.format = 0;
+	result.channels = 4;
+	result.blockBytes = blockBytes(format);
+	result.swizzle = false;
+	result.swizzleMask[0] = GL_RED;
+	result.swizzleMask[1] = GL_GREEN;
+	result.swizzleMask[2] = GL_BLUE;
+	result.swizzleMask[3] = GL_ALPHA;
+	return result;
+}
+
+// Whether the GPU can sample format, plain pixel formats always can. Needs a GL context.
+inline bool blockTextureSupported(const TextureFormat& format)
+{
+	if (format.blockBytes == 0)
+		return true;
+	if (format.internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM || format.internalFormat == GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM)
+		return GLEW_ARB_texture_compression_bptc != 0 || GLEW_VERSION_4_2 != 0;
+	return GLEW_EXT_texture_compression_s3tc != 0;
+}
+
+// Mean and direction of greatest variance of the 16 pixels of a block in the first channels channels,
+// by power iteration on the covariance matrix. The axis is 0 for a flat block.
+inline void blockPrincipalAxis(const unsigned char* rgba, int channels, float mean[4], float axis[4])
+{
+	float minimum[4] = { 255, 255, 255, 255 }, maximum[4] = { 0, 0, 0, 0 };
+	for (int c = 0; c < 4; c++)
+		mean[c] = axis[c] = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < channels; c++) {
+			float v = rgba[i * 4 + c];
+			mean[c] += v;
+			minimum[c] = std::min(minimum[c], v);
+			maximum[c] = std::max(maximum[c], v);
+		}
+	}
+	for (int c = 0; c < channels; c++)
+		mean[c] /= 16.0f;
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; i++) {
+		for (int a = 0; a < channels; a++)
+			for (int b = a; b < channels; b++)
+				covariance[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+	}
+	for (int a = 0; a < channels; a++)
+		for (int b = 0; b < a; b++)
+			covariance[a][b] = covariance[b][a];
+	for (int c = 0; c < channels; c++)
+		axis[c] = maximum[c] - minimum[c];
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float length = 0.0f;
+		for (int a = 0; a < channels; a++) {
+			for (int b = 0; b < channels; b++)
+				next[a] += covariance[a][b] * axis[b];
+			length += next[a] * next[a];
+		}
+		if (length <= 0.0f) {
+			for (int c = 0; c < 4; c++)
+				axis[c] = 0.0f;
+			return;
+		}
+		length = 1.0f / std::sqrt(length);
+		for (int c = 0; c < channels; c++)
+			axis[c] = next[c] * length;
+	}
+}
+
+// Ends of the block along its principal axis, pulled in by 1/16 of the range like most BC1 encoders
+// since the outermost pixels are rarely worth an exact endpoint
+inline void blockEndpoints(const unsigned char* rgba, int channels, float inset, float low[4], float high[4])
+{
+	float mean[4], axis[4];
+	blockPrincipalAxis(rgba, channels, mean, axis);
+	float minimum = 0.0f, maximum = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float t = 0.0f;
+		for (int c = 0; c < channels; c++)
+			t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+		minimum = std::min(minimum, t);
+		maximum = std::max(maximum, t);
+	}
+	float pull = (maximum - minimum) * inset;
+	minimum += pull;
+	maximum -= pull;
+	for (int c = 0; c < 4; c++) {
+		low[c] = c < channels ? std::min(std::max(mean[c] + minimum * axis[c], 0.0f), 255.0f) : 255.0f;
+		high[c] = c < channels ? std::min(std::max(mean[c] + maximum * axis[c], 0.0f), 255.0f) : 255.0f;
+	}
+}
+
+// Least squares endpoints for fixed indices, weights[i] is how far pixel i is from low (0) to high (1).
+// Returns false if every pixel has the same weight and the system has no single solution.
+inline bool refitEndpoints(const unsigned char* rgba, int channels, const float weights[16], float low[4], float high[4])
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {}, bx[4] = {};
+	for (int i = 0; i < 16; i++) {
+		float b = weights[i], a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < channels; c++) {
+			ax[c] += a * rgba[i * 4 + c];
+			bx[c] += b * rgba[i * 4 + c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+		return false;
+	for (int c = 0; c < channels; c++) {
+		low[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / determinant, 0.0f), 255.0f);
+		high[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+inline uint16_t packRGB565(const float colour[4])
+{
+	int r = (int)(colour[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(colour[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(colour[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRGB565(uint16_t colour, int rgb[3])
+{
+	int r = (colour >> 11) & 31, g = (colour >> 5) & 63, b = colour & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// The 4 colours of a BC1 block in 4 colour mode (c0 > c1, always used by BC3)
+inline void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+	unpackRGB565(c0, palette[0]);
+	unpackRGB565(c1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+	}
+}
+
+// Nearest palette entry of every pixel, returns the squared error
+inline int bc1Indices(const unsigned char* rgba, uint16_t c0, uint16_t c1, uint32_t& indices)
+{
+	int palette[4][3];
+	bc1Palette(c0, c1, palette);
+	indices = 0;
+	int total = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestError = 1 << 30;
+		for (int p = 0; p < 4; p++) {
+			int dr = rgba[i * 4] - palette[p][0], dg = rgba[i * 4 + 1] - palette[p][1], db = rgba[i * 4 + 2] - palette[p][2];
+			int error = dr * dr + dg * dg + db * db;
+			if (error < bestError) {
+				bestError = error;
+				best = p;
+			}
+		}
+		indices |= (uint32_t)best << (i * 2);
+		total += bestError;
+	}
+	return total;
+}
+
+// 16 RGBA pixels, row by row, to 8 bytes. Alpha is ignored, the block is always in 4 colour mode.
+inline void compressBlockBC1(const unsigned char* rgba, unsigned char* out)
+{
+	float low[4], high[4];
+	blockEndpoints(rgba, 3, 1.0f / 16.0f, low, high);
+	uint16_t c0 = packRGB565(high), c1 = packRGB565(low);
+	uint32_t indices;
+	int error = bc1Indices(rgba, c0, c1, indices);
+	// one least squares pass with the weights of the chosen indices
+	const float palettePosition[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	float weights[16];
+	for (int i = 0; i < 16; i++)
+		weights[i] = palettePosition[(indices >> (i * 2)) & 3];
+	float refitLow[4], refitHigh[4];
+	if (refitEndpoints(rgba, 3, weights, refitHigh, refitLow)) {
+		uint16_t r0 = packRGB565(refitHigh), r1 = packRGB565(refitLow);
+		uint32_t refitIndices;
+		int refitError = bc1Indices(rgba, r0, r1, refitIndices);
+		if (refitError < error) {
+			c0 = r0;
+			c1 = r1;
+			indices = refitIndices;
+		}
+	}
+	if (c0 < c1) {
+		// 4 colour mode needs c0 > c1, swapping the ends swaps index 0 with 1 and 2 with 3
+		std::swap(c0, c1);
+		indices ^= 0x55555555;
+	}
+	else if (c0 == c1) {
+		indices = 0;
+	}
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// 8 alpha levels between the smallest and largest alpha of the block, as in BC3 and BC4
+inline void compressAlphaBlock(const unsigned char* rgba, unsigned char* out)
+{
+	int minimum = 255, maximum = 0;
+	for (int i = 0; i < 16; i++) {
+		minimum = std::min(minimum, (int)rgba[i * 4 + 3]);
+		maximum = std::max(maximum, (int)rgba[i * 4 + 3]);
+	}
+	out[0] = (unsigned char)maximum;
+	out[1] = (unsigned char)minimum;
+	uint64_t indices = 0;
+	if (maximum > minimum) {
+		int palette[8];
+		palette[0] = maximum;
+		palette[1] = minimum;
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * maximum + (i - 1) * minimum + 3) / 7;
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 8; p++) {
+				int error = std::abs(rgba[i * 4 + 3] - palette[p]);
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// 16 RGBA pixels to 16 bytes, alpha block then colour block
+inline void compressBlockBC3(const unsigned char* rgba, unsigned char* out)
+{
+	compressAlphaBlock(rgba, out);
+	compressBlockBC1(rgba, out + 8);
+}
+
+// BC7 mode 6 interpolation weights, in 64ths
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// 7 bits per channel plus one shared p bit per endpoint, the p bit that loses the least is chosen
+inline void quantizeBC7Endpoint(const float colour[4], int quantized[4], int& pBit)
+{
+	int bestError = 1 << 30;
+	for (int p = 0; p < 2; p++) {
+		int candidate[4], error = 0;
+		for (int c = 0; c < 4; c++) {
+			candidate[c] = std::min(std::max((int)std::floor((colour[c] - p) / 2.0f + 0.5f), 0), 127);
+			int d = ((candidate[c] << 1) | p) - (int)(colour[c] + 0.5f);
+			error += d * d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			pBit = p;
+			for (int c = 0; c < 4; c++)
+				quantized[c] = candidate[c];
+		}
+	}
+}
+
+// Nearest of the 16 interpolated colours for every pixel, returns the squared error
+inline int bc7Indices(const unsigned char* rgba, const int e0[4], const int e1[4], int indices[16])
+{
+	int palette[16][4];
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 4; c++)
+			palette[i][c] = ((64 - BC7_WEIGHTS[i]) * e0[c] + BC7_WEIGHTS[i] * e1[c] + 32) >> 6;
+	int total = 0;
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestError = 1 << 30;
+		for (int p = 0; p < 16; p++) {
+			int error = 0;
+			for (int c = 0; c < 4; c++) {
+				int d = rgba[i * 4 + c] - palette[p][c];
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				best = p;
+			}
+		}
+		indices[i] = best;
+		total += bestError;
+	}
+	return total;
+}
+
+// Writes count bits of value at bit position, least significant bit first
+inline void writeBits(unsigned char* out, int& position, uint32_t value, int count)
+{
+	for (int i = 0; i < count; i++, position++) {
+		if ((value >> i) & 1)
+			out[position >> 3] |= (unsigned char)(1 << (position & 7));
+	}
+}
+
+inline uint32_t readBits(const unsigned char* in, int& position, int count)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < count; i++, position++)
+		value |= (uint32_t)((in[position >> 3] >> (position & 7)) & 1) << i;
+	return value;
+}
+
+// 16 RGBA pixels to a BC7 mode 6 block: one subset, RGBA endpoints, 4 bit indices
+inline void compressBlockBC7(const unsigned char* rgba, unsigned char* out)
+{
+	float low[4], high[4];
+	blockEndpoints(rgba, 4, 0.0f, low, high);
+	int q0[4], q1[4], p0, p1, e0[4], e1[4], indices[16];
+	quantizeBC7Endpoint(low, q0, p0);
+	quantizeBC7Endpoint(high, q1, p1);
+	for (int c = 0; c < 4; c++) {
+		e0[c] = (q0[c] << 1) | p0;
+		e1[c] = (q1[c] << 1) | p1;
+	}
+	int error = bc7Indices(rgba, e0, e1, indices);
+	float weights[16];
+	for (int i = 0; i < 16; i++)
+		weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+	if (refitEndpoints(rgba, 4, weights, low, high)) {
+		int r0[4], r1[4], rp0, rp1, re0[4], re1[4], refitIndices[16];
+		quantizeBC7Endpoint(low, r0, rp0);
+		quantizeBC7Endpoint(high, r1, rp1);
+		for (int c = 0; c < 4; c++) {
+			re0[c] = (r0[c] << 1) | rp0;
+			re1[c] = (r1[c] << 1) | rp1;
+		}
+		int refitError = bc7Indices(rgba, re0, re1, refitIndices);
+		if (refitError < error) {
+			std::memcpy(q0, r0, sizeof(q0));
+			std::memcpy(q1, r1, sizeof(q1));
+			std::memcpy(indices, refitIndices, sizeof(indices));
+			p0 = rp0;
+			p1 = rp1;
+		}
+	}
+	// the first index is stored in 3 bits, so its top bit has to be 0
+	if (indices[0] & 8) {
+		for (int c = 0; c < 4; c++)
+			std::swap(q0[c], q1[c]);
+		std::swap(p0, p1);
+		for (int i = 0; i < 16; i++)
+			indices[i] = 15 - indices[i];
+	}
+	std::memset(out, 0, 16);
+	int position = 0;
+	writeBits(out, position, 1 << 6, 7); // mode 6
+	for (int c = 0; c < 4; c++) {
+		writeBits(out, position, q0[c], 7);
+		writeBits(out, position, q1[c], 7);
+	}
+	writeBits(out, position, p0, 1);
+	writeBits(out, position, p1, 1);
+	writeBits(out, position, indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		writeBits(out, position, indices[i], 4);
+}
+
+// Decoders, used to measure the error of the encoders without a GPU
+inline void decompressBlockBC1(const unsigned char* in, unsigned char* rgba, bool alwaysFourColours)
+{
+	uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8)), c1 = (uint16_t)(in[2] | (in[3] << 8));
+	int palette[4][4];
+	int colours[4][3];
+	bc1Palette(c0, c1, colours);
+	for (int p = 0; p < 4; p++) {
+		for (int c = 0; c < 3; c++)
+			palette[p][c] = colours[p][c];
+		palette[p][3] = 255;
+	}
+	if (c0 <= c1 && !alwaysFourColours) {
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (colours[0][c] + colours[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+		palette[3][3] = 0;
+	}
+	uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 4; c++)
+			rgba[i * 4 + c] = (unsigned char)palette[(indices >> (i * 2)) & 3][c];
+}
+
+inline void decompressBlockBC3(const unsigned char* in, unsigned char* rgba)
+{
+	decompressBlockBC1(in + 8, rgba, true);
+	int a0 = in[0], a1 = in[1], palette[8];
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1) {
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * a0 + (i - 1) * a1 + 3) / 7;
+	}
+	else {
+		for (int i = 2; i < 6; i++)
+			palette[i] = ((6 - i) * a0 + (i - 1) * a1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= (uint64_t)in[2 + i] << (i * 8);
+	for (int i = 0; i < 16; i++)
+		rgba[i * 4 + 3] = (unsigned char)palette[(indices >> (i * 3)) & 7];
+}
+
+// Only mode 6, the one compressBlockBC7 writes. Other modes decode to magenta.
+inline void decompressBlockBC7(const unsigned char* in, unsigned char* rgba)
+{
+	int position = 0;
+	if (readBits(in, position, 7) != (1 << 6)) {
+		for (int i = 0; i < 16; i++) {
+			rgba[i * 4] = rgba[i * 4 + 2] = rgba[i * 4 + 3] = 255;
+			rgba[i * 4 + 1] = 0;
+		}
+		return;
+	}
+	int q0[4], q1[4];
+	for (int c = 0; c < 4; c++) {
+		q0[c] = readBits(in, position, 7);
+		q1[c] = readBits(in, position, 7);
+	}
+	int p0 = readBits(in, position, 1), p1 = readBits(in, position, 1);
+	for (int i = 0; i < 16; i++) {
+		int index = readBits(in, position, i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++) {
+			int e0 = (q0[c] << 1) | p0, e1 = (q1[c] << 1) | p1;
+			rgba[i * 4 + c] = (unsigned char)(((64 - BC7_WEIGHTS[index]) * e0 + BC7_WEIGHTS[index] * e1 + 32) >> 6);
+		}
+	}
+}
+
+// Encodes rows of blocks [blockRowBegin, blockRowEnd) of an RGBA8 image, edge blocks repeat the last row and column
+inline void compressBlockRows(const unsigned char* rgba, int width, int height, BlockFormat format, unsigned char* out, int blockRowBegin, int blockRowEnd)
+{
+	int blocksX = (width + 3) / 4;
+	int bytes = blockBytes(format);
+	unsigned char block[64];
+	for (int by = blockRowBegin; by < blockRowEnd; by++) {
+		for (int bx = 0; bx < blocksX; bx++) {
+			for (int y = 0; y < 4; y++) {
+				int row = std::min(by * 4 + y, height - 1);
+				for (int x = 0; x < 4; x++) {
+					int column = std::min(bx * 4 + x, width - 1);
+					std::memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)row * width + column) * 4, 4);
+				}
+			}
+			unsigned char* target = out + ((size_t)by * blocksX + bx) * bytes;
+			if (format == BLOCK_BC1)
+				compressBlockBC1(block, target);
+			else if (format == BLOCK_BC3)
+				compressBlockBC3(block, target);
+			else
+				compressBlockBC7(block, target);
+		}
+	}
+}
+
+// Decodes a whole level back to RGBA8, for measuring the error
+inline void decompressImage(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* rgba)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	unsigned char block[64];
+	for (int by = 0; by < blocksY; by++) {
+		for (int bx = 0; bx < blocksX; bx++) {
+			const unsigned char* in = blocks + ((size_t)by * blocksX + bx) * blockBytes(format);
+			if (format == BLOCK_BC1)
+				decompressBlockBC1(in, block, false);
+			else if (format == BLOCK_BC3)
+				decompressBlockBC3(in, block);
+			else
+				decompressBlockBC7(in, block);
+			for (int y = 0; y < 4 && by * 4 + y < height; y++)
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+					std::memcpy(rgba + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, block + (y * 4 + x) * 4, 4);
+		}
+	}
+}
+
+// Compresses every level of an RGBA8 chain made by generateMips, each level's block rows are split between threads
+inline void compressMipChain(const std::vector<unsigned char>& pixels, const std::vector<MipLevel>& levels, BlockFormat format, std::vector<unsigned char>& blocks, std::vector<MipLevel>& blockLevels, int threadCount = 1)
+{
+	blockLevels.resize(levels.size());
+	size_t offset = 0;
+	for (size_t i = 0; i < levels.size(); i++) {
+		blockLevels[i].width = levels[i].width;
+		blockLevels[i].height = levels[i].height;
+		blockLevels[i].offset = offset;
+		blockLevels[i].size = blockLevelSize(levels[i].width, levels[i].height, format);
+		offset += blockLevels[i].size;
+	}
+	blocks.resize(offset);
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < levels.size(); i++) {
+		const unsigned char* src = &pixels[levels[i].offset];
+		unsigned char* dst = &blocks[blockLevels[i].offset];
+		int blockRows = (levels[i].height + 3) / 4;
+		int bands = std::max(1, std::min(threadCount, blockRows));
+		for (int band = 1; band < bands; band++)
+			workers.push_back(std::thread(compressBlockRows, src, levels[i].width, levels[i].height, format, dst, blockRows * band / bands, blockRows * (band + 1) / bands));
+		compressBlockRows(src, levels[i].width, levels[i].height, format, dst, 0, blockRows / bands);
+		for (size_t w = 0; w < workers.size(); w++)
+			workers[w].join();
+		workers.clear();
+	}
+}
@@ -0,0 +1,449 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+
+// SIMD downsample kernels are only built for x86, other platforms use the scalar kernel
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MIP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MIP_TARGET_AVX2
+#else
+// lets gcc/clang build the kernels without -mavx2, the kernel is only called after checking the cpu
+#define MIP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#include "TextureImport.h"
+
+// to build the mipmaps on the CPU instead of glGenerateMipmap:
+// 1. put the base level in a vector, reserve room for the whole chain to avoid copying it again
+//		std::vector<unsigned char> pixels;
+//		pixels.reserve(mipChainSize(width, height, channels));
+//		importPixels(image, width * height, stbi_n, format, pixels);
+// 2. append every smaller level, 2x2 box filter or with TEXTURE_KAISER_MIPS a Kaiser windowed sinc, on as many threads as asked
+//		std::vector<MipLevel> levels;
+//		generateMips(pixels, width, height, format.channels, TEXTURE_SRGB | TEXTURE_ALPHA_WEIGHTED_MIPS, levels, threads);
+// 3. upload each level, or write them to a file with TextureFile.h
+//		for (i : levels) glTexImage2D(GL_TEXTURE_2D, i, ..., levels[i].width, levels[i].height, ..., &pixels[levels[i].offset]);
+// sRGB levels are averaged in linear space and TEXTURE_ALPHA_WEIGHTED_MIPS weighs colours by their alpha,
+// so transparent texels do not darken the edges of what is visible. The levels still hold straight alpha, the colour
+// of a texel is not multiplied by its alpha. The Kaiser filter keeps more detail in the smaller levels at several
+// times the cost of the box, it has no AVX2 kernel. Nothing here needs a GL context.
+
+// Levels smaller than this are not split between threads, starting the threads would take longer
+const int MIP_THREAD_MIN_PIXELS = 65536;
+// Source texels on each side of an output texel that the Kaiser filter reads, 8 taps per axis
+const int MIP_KAISER_RADIUS = 4;
+// Shape of the Kaiser window, larger rings less but blurs more
+const double MIP_KAISER_ALPHA = 4.0;
+
+// One level inside the pixel buffer of a chain, level 0 is the full image
+struct MipLevel
+{
+	int width;
+	int height;
+	size_t offset;
+	size_t size;
+};
+
+enum MipKernel
+{
+	MIP_KERNEL_SCALAR,
+	MIP_KERNEL_AVX2
+};
+
+// Levels down to 1x1
+inline int mipLevelCount(int width, int height)
+{
+	int levels = 1;
+	while (width > 1 || height > 1) {
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		levels++;
+	}
+	return levels;
+}
+
+// Bytes of every level together
+inline size_t mipChainSize(int width, int height, int channels)
+{
+	size_t size = (size_t)width * height * channels;
+	while (width > 1 || height > 1) {
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		size += (size_t)width * height * channels;
+	}
+	return size;
+}
+
+// sRGB to linear for every byte, and linear to sRGB in 4096 steps
+struct MipTables
+{
+	float toLinear[256];
+	int toSRGB[4096]; // int so the AVX2 kernel can gather from it
+
+	MipTables()
+	{
+		for (int i = 0; i < 256; i++) {
+			float c = i / 255.0f;
+			this->toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 4096; i++) {
+			float l = i / 4095.0f;
+			float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			this->toSRGB[i] = (int)(c * 255.0f + 0.5f);
+		}
+	}
+};
+
+inline const MipTables& mipTables()
+{
+	static const MipTables tables;
+	return tables;
+}
+
+// The float path: sRGB decode and/or alpha weighting, then encode. Texels are summed rows first,
+// then columns, in the same order as the AVX2 kernel so both give the same bytes.
+inline void downsamplePixelFloat(const unsigned char* t00, const unsigned char* t10, const unsigned char* t01, const unsigned char* t11, unsigned char* out, int channels, bool srgb, bool alphaWeighted)
+{
+	const MipTables& tables = mipTables();
+	const float scale = 1.0f / 255.0f;
+	int alpha = (channels == 2 || channels == 4) ? channels - 1 : -1;
+	const unsigned char* texels[4] = { t00, t10, t01, t11 };
+	float value[4][4], weighted[4][4];
+	for (int t = 0; t < 4; t++) {
+		float a = alpha >= 0 ? texels[t][alpha] * scale : 1.0f;
+		for (int c = 0; c < channels; c++) {
+			value[t][c] = (c == alpha || !srgb) ? texels[t][c] * scale : tables.toLinear[texels[t][c]];
+			weighted[t][c] = c == alpha ? value[t][c] : value[t][c] * a;
+		}
+	}
+	float alphaSum = alpha >= 0 ? (value[0][alpha] + value[1][alpha]) + (value[2][alpha] + value[3][alpha]) : 4.0f;
+	for (int c = 0; c < channels; c++) {
+		float v = ((value[0][c] + value[1][c]) + (value[2][c] + value[3][c])) * 0.25f;
+		if (alphaWeighted && c != alpha && alphaSum > 0.0f)
+			v = ((weighted[0][c] + weighted[1][c]) + (weighted[2][c] + weighted[3][c])) / alphaSum;
+		v = std::min(std::max(v, 0.0f), 1.0f);
+		out[c] = (unsigned char)((c == alpha || !srgb) ? (int)std::lrint(v * 255.0f) : tables.toSRGB[(int)std::lrint(v * 4095.0f)]);
+	}
+}
+
+// Output pixels [xBegin, dstWidth) of one row from the two source rows below it,
+// an odd last column of the source is left out like glGenerateMipmap
+inline void downsampleRowScalar(const unsigned char* row0, const unsigned char* row1, int srcWidth, unsigned char* out, int xBegin, int dstWidth, int channels, int flags)
+{
+	bool srgb = (flags & TEXTURE_SRGB) != 0;
+	bool alphaWeighted = (flags & TEXTURE_ALPHA_WEIGHTED_MIPS) != 0 && (channels == 2 || channels == 4);
+	out += xBegin * channels;
+	for (int x = xBegin; x < dstWidth; x++, out += channels) {
+		int x0 = std::min(2 * x, srcWidth - 1) * channels;
+		int x1 = std::min(2 * x + 1, srcWidth - 1) * channels;
+		if (srgb || alphaWeighted) {
+			downsamplePixelFloat(row0 + x0, row1 + x0, row0 + x1, row1 + x1, out, channels, srgb, alphaWeighted);
+			continue;
+		}
+		for (int c = 0; c < channels; c++)
+			out[c] = (unsigned char)((row0[x0 + c] + row1[x0 + c] + row0[x1 + c] + row1[x1 + c] + 2) >> 2);
+	}
+}
+
+#ifdef MIP_X86
+// Linear RGBA: 8 source pixels of two rows to 4 output pixels, the sums are exact in 16 bits
+MIP_TARGET_AVX2 inline int downsampleRowRGBAAVX2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int dstWidth)
+{
+	const __m256i two = _mm256_set1_epi16(2);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+	int x = 0;
+	for (; x + 4 <= dstWidth; x += 4) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(row0 + x * 8));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(row1 + x * 8));
+		__m256i low = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)));
+		__m256i high = _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)));
+		// one pixel is 64 bits here, even and odd pixels of each pair are added together
+		__m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(low, high), _mm256_unpackhi_epi64(low, high));
+		sum = _mm256_srli_epi16(_mm256_add_epi16(sum, two), 2);
+		__m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(sum, sum), order);
+		_mm_storeu_si128((__m128i*)(out + x * 4), _mm256_castsi256_si128(packed));
+	}
+	return x;
+}
+
+// Linear single channel: 32 source bytes of two rows to 16 output bytes
+MIP_TARGET_AVX2 inline int downsampleRowGreyAVX2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int dstWidth)
+{
+	const __m256i ones = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi16(2);
+	int x = 0;
+	for (; x + 16 <= dstWidth; x += 16) {
+		__m256i a = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(row0 + x * 2)), ones);
+		__m256i b = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i*)(row1 + x * 2)), ones);
+		__m256i sum = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(a, b), two), 2);
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0x08);
+		_mm_storeu_si128((__m128i*)(out + x), _mm256_castsi256_si128(packed));
+	}
+	return x;
+}
+
+// sRGB and/or alpha weighted RGBA: 4 source pixels of two rows to 2 output pixels, one pixel per 128 bit lane
+MIP_TARGET_AVX2 inline int downsampleRowRGBAFloatAVX2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, int dstWidth, bool srgb, bool alphaWeighted)
+{
+	const MipTables& tables = mipTables();
+	const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+	const __m256 quarter = _mm256_set1_ps(0.25f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 byteMax = _mm256_set1_ps(255.0f);
+	const __m256 tableMax = _mm256_set1_ps(4095.0f);
+	int x = 0;
+	for (; x + 2 <= dstWidth; x += 2) {
+		__m256 sums[2], weightedSums[2];
+		for (int half = 0; half < 2; half++) {
+			// pixels 2 and 3 of the group are the second 8 bytes of the load
+			__m256 texel[2], weighted[2];
+			const unsigned char* rows[2] = { row0, row1 };
+			for (int r = 0; r < 2; r++) {
+				__m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(rows[r] + x * 8 + half * 8)));
+				__m256 linear = _mm256_mul_ps(_mm256_cvtepi32_ps(bytes), scale);
+				if (srgb)
+					linear = _mm256_blend_ps(_mm256_i32gather_ps(tables.toLinear, bytes, 4), linear, 0x88);
+				texel[r] = linear;
+				if (alphaWeighted)
+					weighted[r] = _mm256_blend_ps(_mm256_mul_ps(linear, _mm256_permute_ps(linear, 0xFF)), linear, 0x88);
+			}
+			sums[half] = _mm256_add_ps(texel[0], texel[1]);
+			if (alphaWeighted)
+				weightedSums[half] = _mm256_add_ps(weighted[0], weighted[1]);
+		}
+		// [p0 | p1] + [p2 | p3] rows summed, now add the columns
+		__m256 sum = _mm256_add_ps(_mm256_permute2f128_ps(sums[0], sums[1], 0x20), _mm256_permute2f128_ps(sums[0], sums[1], 0x31));
+		__m256 value = _mm256_mul_ps(sum, quarter);
+		if (alphaWeighted) {
+			__m256 weightedSum = _mm256_add_ps(_mm256_permute2f128_ps(weightedSums[0], weightedSums[1], 0x20), _mm256_permute2f128_ps(weightedSums[0], weightedSums[1], 0x31));
+			__m256 alphaSum = _mm256_permute_ps(sum, 0xFF);
+			__m256 visible = _mm256_cmp_ps(alphaSum, zero, _CMP_GT_OQ);
+			__m256 colour = _mm256_blendv_ps(value, _mm256_div_ps(weightedSum, alphaSum), visible);
+			value = _mm256_blend_ps(colour, value, 0x88);
+		}
+		value = _mm256_min_ps(_mm256_max_ps(value, zero), one);
+		__m256i bytes = _mm256_cvtps_epi32(_mm256_mul_ps(value, byteMax));
+		if (srgb) {
+			__m256i encoded = _mm256_i32gather_epi32(tables.toSRGB, _mm256_cvtps_epi32(_mm256_mul_ps(value, tableMax)), 4);
+			bytes = _mm256_blend_epi32(encoded, bytes, 0x88);
+		}
+		__m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(bytes, bytes), _mm256_setzero_si256());
+		int first = _mm_cvtsi128_si32(_mm256_castsi256_si128(packed));
+		int second = _mm_cvtsi128_si32(_mm256_extracti128_si256(packed, 1));
+		std::memcpy(out + x * 4, &first, 4);
+		std::memcpy(out + x * 4 + 4, &second, 4);
+	}
+	return x;
+}
+#endif
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+inline double besselI0(double x)
+{
+	double sum = 1.0, term = 1.0, quarter = x * x / 4.0;
+	for (int k = 1; k < 64 && term > sum * 1e-12; k++) {
+		term *= quarter / ((double)k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+// Weights of the taps on one axis, a sinc cut off at half the source resolution in a Kaiser window, summing to 1.
+// Tap t is source texel 2x - MIP_KAISER_RADIUS + 1 + t of output texel x, whose centre is at 2x + 1.
+struct MipKaiserWeights
+{
+	float weights[2 * MIP_KAISER_RADIUS];
+
+	MipKaiserWeights()
+	{
+		const double pi = 3.14159265358979323846;
+		double raw[2 * MIP_KAISER_RADIUS], sum = 0.0;
+		for (int t = 0; t < 2 * MIP_KAISER_RADIUS; t++) {
+			double distance = t - MIP_KAISER_RADIUS + 0.5;
+			double sinc = std::sin(pi * distance / 2.0) / (pi * distance / 2.0);
+			double r = distance / MIP_KAISER_RADIUS;
+			double window = besselI0(MIP_KAISER_ALPHA * std::sqrt(std::max(0.0, 1.0 - r * r))) / besselI0(MIP_KAISER_ALPHA);
+			raw[t] = sinc * window;
+			sum += raw[t];
+		}
+		for (int t = 0; t < 2 * MIP_KAISER_RADIUS; t++)
+			this->weights[t] = (float)(raw[t] / sum);
+	}
+};
+
+inline const MipKaiserWeights& mipKaiserWeights()
+{
+	static const MipKaiserWeights weights;
+	return weights;
+}
+
+// Rows [rowBegin, rowEnd) of the next level with the Kaiser filter, columns first into a float row, then across it.
+// Texels past the edges repeat the edge. With alpha weighting the unweighted sums are kept as well, for texels
+// whose alpha filters to nothing, as the box filter does.
+inline void downsampleRowsKaiser(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int rowBegin, int rowEnd, int channels, int flags)
+{
+	const MipTables& tables = mipTables();
+	const float* weights = mipKaiserWeights().weights;
+	const float scale = 1.0f / 255.0f;
+	const int taps = 2 * MIP_KAISER_RADIUS;
+	bool srgb = (flags & TEXTURE_SRGB) != 0;
+	int alpha = (channels == 2 || channels == 4) ? channels - 1 : -1;
+	bool alphaWeighted = (flags & TEXTURE_ALPHA_WEIGHTED_MIPS) != 0 && alpha >= 0;
+	// per source column: channels sums, then with alpha weighting channels unweighted sums
+	int stride = alphaWeighted ? channels * 2 : channels;
+	std::vector<float> column((size_t)srcWidth * stride);
+	for (int y = rowBegin; y < rowEnd; y++) {
+		std::fill(column.begin(), column.end(), 0.0f);
+		for (int t = 0; t < taps; t++) {
+			int sy = std::min(std::max(2 * y - MIP_KAISER_RADIUS + 1 + t, 0), srcHeight - 1);
+			const unsigned char* row = src + (size_t)sy * srcWidth * channels;
+			float weight = weights[t];
+			for (int x = 0; x < srcWidth; x++) {
+				const unsigned char* texel = row + x * channels;
+				float* sums = &column[(size_t)x * stride];
+				float a = alpha >= 0 ? texel[alpha] * scale : 1.0f;
+				for (int c = 0; c < channels; c++) {
+					float value = (c == alpha || !srgb) ? texel[c] * scale : tables.toLinear[texel[c]];
+					if (alphaWeighted) {
+						sums[channels + c] += weight * value;
+						if (c != alpha)
+							value *= a;
+					}
+					sums[c] += weight * value;
+				}
+			}
+		}
+		unsigned char* out = dst + (size_t)y * dstWidth * channels;
+		for (int x = 0; x < dstWidth; x++, out += channels) {
+			float sums[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+			for (int t = 0; t < taps; t++) {
+				int sx = std::min(std::max(2 * x - MIP_KAISER_RADIUS + 1 + t, 0), srcWidth - 1);
+				const float* texel = &column[(size_t)sx * stride];
+				for (int c = 0; c < stride; c++)
+					sums[c] += weights[t] * texel[c];
+			}
+			// the negative lobes can bring the alpha sum near 0, below one step of a byte the unweighted colour is used
+			bool visible = alphaWeighted && sums[alpha] > scale;
+			for (int c = 0; c < channels; c++) {
+				float v = sums[c];
+				if (alphaWeighted && c != alpha)
+					v = visible ? sums[c] / sums[alpha] : sums[channels + c];
+				v = std::min(std::max(v, 0.0f), 1.0f);
+				out[c] = (unsigned char)((c == alpha || !srgb) ? (int)std::lrint(v * 255.0f) : tables.toSRGB[(int)std::lrint(v * 4095.0f)]);
+			}
+		}
+	}
+}
+
+// Rows [rowBegin, rowEnd) of the next level with the chosen kernel, the AVX2 kernels cover RGBA and single channel
+// images and leave the last few pixels of each row and the other layouts to the scalar code
+inline void downsampleRows(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth, int rowBegin, int rowEnd, int channels, int flags, MipKernel kernel)
+{
+	if ((flags & TEXTURE_KAISER_MIPS) != 0) {
+		downsampleRowsKaiser(src, srcWidth, srcHeight, dst, dstWidth, rowBegin, rowEnd, channels, flags);
+		return;
+	}
+#ifdef MIP_X86
+	if (kernel == MIP_KERNEL_AVX2 && srcWidth >= 2 && (channels == 4 || channels == 1)) {
+		bool srgb = (flags & TEXTURE_SRGB) != 0;
+		bool alphaWeighted = (flags & TEXTURE_ALPHA_WEIGHTED_MIPS) != 0 && channels == 4;
+		for (int y = rowBegin; y < rowEnd; y++) {
+			const unsigned char* row0 = src + (size_t)std::min(2 * y, srcHeight - 1) * srcWidth * channels;
+			const unsigned char* row1 = src + (size_t)std::min(2 * y + 1, srcHeight - 1) * srcWidth * channels;
+			unsigned char* out = dst + (size_t)y * dstWidth * channels;
+			int done = 0;
+			if (channels == 1 && !srgb)
+				done = downsampleRowGreyAVX2(row0, row1, out, dstWidth);
+			else if (channels == 4 && (srgb || alphaWeighted))
+				done = downsampleRowRGBAFloatAVX2(row0, row1, out, dstWidth, srgb, alphaWeighted);
+			else if (channels == 4)
+				done = downsampleRowRGBAAVX2(row0, row1, out, dstWidth);
+			downsampleRowScalar(row0, row1, srcWidth, out, done, dstWidth, channels, flags);
+		}
+		return;
+	}
+#endif
+	for (int y = rowBegin; y < rowEnd; y++) {
+		const unsigned char* row0 = src + (size_t)std::min(2 * y, srcHeight - 1) * srcWidth * channels;
+		const unsigned char* row1 = src + (size_t)std::min(2 * y + 1, srcHeight - 1) * srcWidth * channels;
+		downsampleRowScalar(row0, row1, srcWidth, dst + (size_t)y * dstWidth * channels, 0, dstWidth, channels, flags);
+	}
+}
+
+inline MipKernel detectMipKernel()
+{
+#ifdef MIP_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	// AVX2 also needs the OS to save the ymm registers
+	bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	bool avx2 = avx && (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	if (avx2)
+		return MIP_KERNEL_AVX2;
+#endif
+	return MIP_KERNEL_SCALAR;
+}
+
+// Fastest kernel supported by this cpu
+inline MipKernel bestMipKernel()
+{
+	static const MipKernel best = detectMipKernel();
+	return best;
+}
+
+inline const char* mipKernelName(MipKernel kernel)
+{
+	return kernel == MIP_KERNEL_AVX2 ? "AVX2" : "scalar";
+}
+
+// pixels holds level 0 on entry, every smaller level is appended to it and levels lists all of them.
+// Large levels are split into bands of rows on threadCount threads, each level waits for the one before it.
+inline void generateMips(std::vector<unsigned char>& pixels, int width, int height, int channels, int flags, std::vector<MipLevel>& levels, int threadCount = 1, MipKernel kernel = bestMipKernel())
+{
+	levels.clear();
+	pixels.resize(mipChainSize(width, height, channels));
+	MipLevel level;
+	level.width = width;
+	level.height = height;
+	level.offset = 0;
+	level.size = (size_t)width * height * channels;
+	levels.push_back(level);
+	std::vector<std::thread> workers;
+	while (level.width > 1 || level.height > 1) {
+		MipLevel next;
+		next.width = std::max(1, level.width / 2);
+		next.height = std::max(1, level.height / 2);
+		next.offset = level.offset + level.size;
+		next.size = (size_t)next.width * next.height * channels;
+		const unsigned char* src = &pixels[level.offset];
+		unsigned char* dst = &pixels[next.offset];
+		int bands = next.width * next.height >= MIP_THREAD_MIN_PIXELS ? std::min(threadCount, next.height) : 1;
+		for (int band = 1; band < bands; band++) {
+			int rowBegin = next.height * band / bands, rowEnd = next.height * (band + 1) / bands;
+			workers.push_back(std::thread(downsampleRows, src, level.width, level.height, dst, next.width, rowBegin, rowEnd, channels, flags, kernel));
+		}
+		downsampleRows(src, level.width, level.height, dst, next.width, 0, next.height / std::max(bands, 1), channels, flags, kernel);
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+		levels.push_back(next);
+		level = next;
+	}
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+// Std. Includes
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h> // inotify_init1, inotify_add_watch
+#include <poll.h> // poll
+#include <unistd.h> // read, close
+#endif
+#include <sys/stat.h> // stat, for polling where there is no inotify
+
+// GL Includes
+#include <GLEW/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "Shader.h"
+#include "ShaderIncludes.h"
+
+// to rebuild shaders while the demo runs whenever one of their files is saved:
+// 1. create a hidden window that shares its objects with the main one, after the shaders are built
+//		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+//		GLFWwindow* reloadContext = glfwCreateWindow(1, 1, "", nullptr, window);
+// 2. register the shaders with the files they were built from and start the watcher thread
+//		ShaderReloader reloader;
+//		reloader.watch(exampleShader, "exampleShader.vert", "exampleShader.frag");
+//		reloader.start(reloadContext);
+// 3. call apply() at the top of every frame, it swaps in the programs the thread has finished and never waits
+// 4. stop() before glfwTerminate
+// The thread compiles and links on the hidden context, so a slow compile never holds up a frame. A program with errors
+// is thrown away after its log is printed and the shader keeps drawing with the last program that worked.
+// Changes to an #include file rebuild every watched shader that uses it (see ShaderIncludes.h).
+// Files are always read from disk, a shader first loaded from an AssetPack is rebuilt from the loose files.
+// Linux is told about changes by inotify, other systems compare modification times every SHADER_RELOAD_POLL_MS.
+
+// Longest wait for a change before the watched files are refreshed, and the interval of the polling fallback
+const int SHADER_RELOAD_POLL_MS = 250;
+// Editors often save in several writes or through a temporary file, changes within this time are rebuilt once
+const int SHADER_RELOAD_SETTLE_MS = 50;
+
+class ShaderReloader
+{
+public:
+	// Programs swapped in by apply() and rebuilds that failed to compile or link, or whose fence could not be waited on
+	unsigned reloads;
+	std::atomic<unsigned> failures;
+
+	ShaderReloader() : reloads(0), failures(0), context(nullptr), running(false), notify(-1) {}
+	~ShaderReloader() { this->stop(); }
+
+	// Rebuilds shader from these files when any of them or their includes change. Call before start(),
+	// shader must stay alive until stop().
+	void watch(Shader& shader, const std::string& vertexPath, const std::string& fragmentPath)
+	{
+		Target target;
+		target.shader = &shader;
+		target.vertexPath = vertexPath;
+		target.fragmentPath = fragmentPath;
+		this->targets.push_back(target);
+	}
+
+	// Starts the watcher thread, which makes sharedContext current for its compiles.
+	// sharedContext must share objects with the render context and must not be current on any other thread.
+	void start(GLFWwindow* sharedContext)
+	{
+		if (this->thread.joinable())
+			return;
+		this->context = sharedContext;
+		this->running = true;
+		this->thread = std::thread(&ShaderReloader::watchLoop, this);
+	}
+
+	// Ends the watcher thread, programs it has built but apply() has not swapped in yet are deleted
+	void stop()
+	{
+		if (!this->thread.joinable())
+			return;
+		this->running = false;
+		this->thread.join();
+		std::lock_guard<std::mutex> lock(this->readyMutex);
+		for (size_t i = 0; i < this->ready.size(); i++) {
+			glDeleteSync(this->ready[i].fence);
+			glDeleteProgram(this->ready[i].shader.program);
+		}
+		this->ready.clear();
+	}
+
+	// Replaces the programs of the watched shaders with the rebuilt ones the GPU has finished linking,
+	// on the render thread between frames. Returns the number of shaders that changed.
+	int apply()
+	{
+		std::lock_guard<std::mutex> lock(this->readyMutex);
+		if (this->ready.empty())
+			return 0;
+		int swapped = 0;
+		std::vector<Rebuilt> waiting;
+		for (size_t i = 0; i < this->ready.size(); i++) {
+			const Rebuilt& rebuilt = this->ready[i];
+			// a zero timeout only asks, the program stays queued until the next frame if the link is still running
+			GLenum status = glClientWaitSync(rebuilt.fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				waiting.push_back(rebuilt);
+				continue;
+			}
+			glDeleteSync(rebuilt.fence);
+			Target& target = this->targets[rebuilt.target];
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+				// GL_WAIT_FAILED, the render context may not see the new program, keep the one that works
+				std::cout << "ERROR::SHADER::HOT_RELOAD::KEEPING_PREVIOUS_PROGRAM fence wait failed " << target.vertexPath << " " << target.fragmentPath << std::endl;
+				glDeleteProgram(rebuilt.shader.program);
+				this->failures++;
+				continue;
+			}
+			glDeleteProgram(target.shader->program);
+			// the copy brings the uniform locations of the new program with it
+			*target.shader = rebuilt.shader;
+			this->reloads++;
+			swapped++;
+			std::cout << "Reloaded " << target.vertexPath << " and " << target.fragmentPath << " in " << rebuilt.shader.buildTime << " ms" << std::endl;
+		}
+		this->ready.swap(waiting);
+		return swapped;
+	}
+
+private:
+	struct Target
+	{
+		Shader* shader;
+		std::string vertexPath;
+		std::string fragmentPath;
+	};
+
+	// A linked program waiting for apply(), fence is signalled once the GPU has finished with it
+	struct Rebuilt
+	{
+		size_t target;
+		Shader shader;
+		GLsync fence;
+
+		Rebuilt(size_t target, const Shader& shader, GLsync fence) : target(target), shader(shader), fence(fence) {}
+	};
+
+	std::vector<Target> targets;
+	GLFWwindow* context;
+	std::thread thread;
+	std::atomic<bool> running;
+	std::mutex readyMutex;
+	std::vector<Rebuilt> ready;
+
+	// inotify descriptor, -1 when files are polled instead
+	int notify;
+	// directories with an inotify watch, by watch descriptor, as prefixes of the file names in events
+	std::map<int, std::string> directories;
+	std::set<std::string> watchedDirectories;
+	// modification times for polling
+	std::map<std::string, time_t> times;
+
+	void watchLoop()
+	{
+		glfwMakeContextCurrent(this->context);
+#ifdef __linux__
+		this->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (this->notify < 0)
+			std::cout << "ERROR::SHADER::HOT_RELOAD::INOTIFY_NOT_AVAILABLE, polling instead" << std::endl;
+#endif
+		// the times the files have now, only later changes count
+		std::set<std::string> changed;
+		this->waitForChanges(this->watchedFiles(), changed, 0);
+		while (this->running) {
+			// include files can be added by a rebuild, the list is refreshed every round
+			std::set<std::string> files = this->watchedFiles();
+			changed.clear();
+			this->waitForChanges(files, changed, SHADER_RELOAD_POLL_MS);
+			if (changed.empty())
+				continue;
+			std::this_thread::sleep_for(std::chrono::milliseconds(SHADER_RELOAD_SETTLE_MS));
+			this->waitForChanges(files, changed, 0);
+			this->rebuild(changed);
+		}
+#ifdef __linux__
+		if (this->notify >= 0)
+			::close(this->notify);
+		this->notify = -1;
+		this->directories.clear();
+		this->watchedDirectories.clear();
+#endif
+		glfwMakeContextCurrent(nullptr);
+	}
+
+	// The files of every target and every file they include, watched directories are added for new ones
+	std::set<std::string> watchedFiles()
+	{
+		std::set<std::string> files;
+		for (size_t i = 0; i < this->targets.size(); i++) {
+			files.insert(this->targets[i].vertexPath);
+			files.insert(this->targets[i].fragmentPath);
+		}
+		std::vector<std::string> included = ShaderIncludes::shared().includedFiles();
+		files.insert(included.begin(), included.end());
+#ifdef __linux__
+		// inotify watches directories rather than files, editors that save by renaming a new file replace the file itself
+		for (std::set<std::string>::const_iterator it = files.begin(); this->notify >= 0 && it != files.end(); ++it) {
+			size_t slash = it->find_last_of('/');
+			std::string directory = slash == std::string::npos ? std::string() : it->substr(0, slash + 1);
+			if (this->watchedDirectories.count(directory) != 0)
+				continue;
+			this->watchedDirectories.insert(directory);
+			int watch = inotify_add_watch(this->notify, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (watch >= 0)
+				this->directories[watch] = directory;
+		}
+#endif
+		return files;
+	}
+
+	// Adds the files that have changed to changed, waiting up to timeout ms for the first one
+	void waitForChanges(const std::set<std::string>& files, std::set<std::string>& changed, int timeout)
+	{
+#ifdef __linux__
+		if (this->notify >= 0) {
+			pollfd request = { this->notify, POLLIN, 0 };
+			if (::poll(&request, 1, timeout) <= 0)
+				return;
+			// each event is followed by its name
+			alignas(inotify_event) char events[4096];
+			for (;;) {
+				ssize_t length = ::read(this->notify, events, sizeof(events));
+				if (length <= 0)
+					break;
+				for (const char* event = events; event < events + length; ) {
+					const inotify_event* header = (const inotify_event*)event;
+					std::map<int, std::string>::const_iterator directory = this->directories.find(header->wd);
+					if (header->len > 0 && directory != this->directories.end()) {
+						std::string path = directory->second + header->name;
+						if (files.count(path) != 0)
+							changed.insert(path);
+					}
+					event += sizeof(inotify_event) + header->len;
+				}
+			}
+			return;
+		}
+#endif
+		if (timeout > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+		for (std::set<std::string>::const_iterator it = files.begin(); it != files.end(); ++it) {
+			struct stat info;
+			time_t modified = stat(it->c_str(), &info) == 0 ? info.st_mtime : 0;
+			std::map<std::string, time_t>::iterator known = this->times.find(*it);
+			if (known == this->times.end())
+				this->times[*it] = modified;
+			else if (known->second != modified) {
+				known->second = modified;
+				changed.insert(*it);
+			}
+		}
+	}
+
+	// Builds a new program for every target that uses one of the changed files and queues the ones that link
+	void rebuild(const std::set<std::string>& changed)
+	{
+		std::set<std::string> affected;
+		for (std::set<std::string>::const_iterator it = changed.begin(); it != changed.end(); ++it) {
+			// drops the file from the include cache so the rebuild reads it again
+			std::vector<std::string> shaders = ShaderIncludes::shared().changed(*it);
+			affected.insert(shaders.begin(), shaders.end());
+			affected.insert(*it);
+		}
+		for (size_t i = 0; i < this->targets.size(); i++) {
+			const Target& target = this->targets[i];
+			if (affected.count(target.vertexPath) == 0 && affected.count(target.fragmentPath) == 0)
+				continue;
+			// the constructor prints the compile and link log
+			Shader shader(target.vertexPath.c_str(), target.fragmentPath.c_str());
+			if (!shader.linked) {
+				std::cout << "ERROR::SHADER::HOT_RELOAD::KEEPING_PREVIOUS_PROGRAM " << target.vertexPath << " " << target.fragmentPath << std::endl;
+				glDeleteProgram(shader.program);
+				this->failures++;
+				continue;
+			}
+			GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			// the render context only sees the fence once this context has sent it
+			glFlush();
+			std::lock_guard<std::mutex> lock(this->readyMutex);
+			this->ready.push_back(Rebuilt(i, shader, fence));
+		}
+	}
+
+	// not copyable, the thread holds a pointer to this object
+	ShaderReloader(const ShaderReloader&);
+	ShaderReloader& operator=(const ShaderReloader&);
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// GL Includes
+#include <GLEW/glew.h>
+
+#include "GLState.h"
+
+#include "TextureImport.h"
+#include "MipChain.h"
+
+// to bake a texture with all its mipmaps so loading needs no decoding or filtering:
+// 1. offline, decode and build the chain then write it
+//		generateMips(pixels, width, height, format.channels, flags, levels, threads);
+//		writeTextureFile("buildings.tex", width, height, format, pixels, levels);
+// 2. at load time read it back, the levels are ready for glTexImage2D
+//		readTextureFile("buildings.tex", width, height, format, pixels, levels, error);
+//    or parse one that is already in memory, such as an AssetPack entry, the levels then point into that memory
+//		parseTextureFile(data, size, width, height, format, levels, error);
+//		GLuint texture = createTexture(format, data, levels);
+// TextureLoader reads .tex files by itself, request("buildings.tex") works the same as request("buildings.png").
+// Levels compressed by BlockCompress.h are stored the same way with format 0, they go to glCompressedTexImage2D.
+
+// File layout, little endian:
+//   TextureFileHeader
+//   TextureFileLevel for every level, largest first
+//   the pixels of every level, each starting on a TEXTURE_FILE_ALIGNMENT byte boundary
+const char TEXTURE_FILE_MAGIC[8] = { 'G', 'L', 'T', 'E', 'X', 'T', 'R', '2' };
+const size_t TEXTURE_FILE_ALIGNMENT = 16;
+
+struct TextureFileHeader
+{
+	char magic[8];
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t channels;			// bytes per pixel of the stored levels
+	uint32_t internalFormat;	// GL enums of the upload
+	uint32_t format;			// 0 for block compressed levels
+	uint32_t blockBytes;		// bytes per 4x4 block of compressed levels, 0 for pixels
+	int32_t swizzle[4];			// all 0 when no swizzle is needed
+	uint64_t dataOffset;		// start of the pixels, from the start of the file
+	uint64_t dataSize;
+};
+
+struct TextureFileLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;			// from dataOffset
+	uint64_t size;
+};
+
+// Writes the levels to a stream, pixels is laid out as generateMips left it. Returns false if the stream failed.
+inline bool writeTextureFile(std::ostream& file, int width, int height, const TextureFormat& format, const std::vector<unsigned char>& pixels, const std::vector<MipLevel>& levels)
+{
+	TextureFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, TEXTURE_FILE_MAGIC, sizeof(header.magic));
+	header.width = width;
+	header.height = height;
+	header.levelCount = (uint32_t)levels.size();
+	header.channels = format.channels;
+	header.internalFormat = format.internalFormat;
+	header.format = format.format;
+	header.blockBytes = format.blockBytes;
+	if (format.swizzle) {
+		for (int i = 0; i < 4; i++)
+			header.swizzle[i] = format.swizzleMask[i];
+	}
+	std::vector<TextureFileLevel> table(levels.size());
+	uint64_t offset = 0;
+	for (size_t i = 0; i < levels.size(); i++) {
+		table[i].width = levels[i].width;
+		table[i].height = levels[i].height;
+		table[i].offset = offset;
+		table[i].size = levels[i].size;
+		offset = (offset + levels[i].size + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+	}
+	size_t headerSize = sizeof(TextureFileHeader) + table.size() * sizeof(TextureFileLevel);
+	header.dataOffset = (headerSize + TEXTURE_FILE_ALIGNMENT - 1) / TEXTURE_FILE_ALIGNMENT * TEXTURE_FILE_ALIGNMENT;
+	header.dataSize = offset;
+
+	const char padding[TEXTURE_FILE_ALIGNMENT] = {};
+	file.write((const char*)&header, sizeof(header));
+	if (!table.empty())
+		file.write((const char*)&table[0], table.size() * sizeof(TextureFileLevel));
+	file.write(padding, header.dataOffset - headerSize);
+	for (size_t i = 0; i < levels.size(); i++) {
+		file.write((const char*)&pixels[levels[i].offset], levels[i].size);
+		uint64_t end = table[i].offset + table[i].size;
+		uint64_t next = i + 1 < levels.size() ? table[i + 1].offset : header.dataSize;
+		file.write(padding, next - end);
+	}
+	return (bool)file;
+}
+
+// Writes the levels to a file. Returns false if the file cannot be written.
+inline bool writeTextureFile(const std::string& path, int width, int height, const TextureFormat& format, const std::vector<unsigned char>& pixels, const std::vector<MipLevel>& levels)
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file)
+		return false;
+	return writeTextureFile(file, width, height, format, pixels, levels);
+}
+
+// The header only comes from a file, so levelCount is checked against the size before a table is allocated for it
+inline bool validTextureHeader(const TextureFileHeader& header)
+{
+	uint32_t maxLevels = 1;
+	for (uint32_t size = std::max(header.width, header.height); size > 1; size /= 2)
+		maxLevels++;
+	return std::memcmp(header.magic, TEXTURE_FILE_MAGIC, sizeof(header.magic)) == 0 && header.width != 0 && header.height != 0
+		&& header.levelCount != 0 && header.levelCount <= maxLevels && header.channels != 0 && header.channels <= 4
+		&& (header.format == 0) == (header.blockBytes != 0);
+}
+
+// Whether a level lies inside the pixels, written so a corrupt offset cannot overflow the sum
+inline bool validTextureLevel(const TextureFileLevel& level, uint64_t dataSize)
+{
+	return level.offset <= dataSize && level.size <= dataSize - level.offset;
+}
+
+inline void readTextureHeader(const TextureFileHeader& header, int& width, int& height, TextureFormat& format)
+{
+	width = header.width;
+	height = header.height;
+	format.internalFormat = header.internalFormat;
+	format.format = header.format;
+	format.channels = header.channels;
+	format.blockBytes = header.blockBytes;
+	format.swizzle = header.swizzle[0] != 0;
+	format.swizzleMask[0] = format.swizzle ? header.swizzle[0] : GL_RED;
+	format.swizzleMask[1] = format.swizzle ? header.swizzle[1] : GL_GREEN;
+	format.swizzleMask[2] = format.swizzle ? header.swizzle[2] : GL_BLUE;
+	format.swizzleMask[3] = format.swizzle ? header.swizzle[3] : GL_ALPHA;
+}
+
+// Reads a file written by writeTextureFile, the pixels come in with one read and keep the padding of the file
+inline bool readTextureFile(const std::string& path, int& width, int& height, TextureFormat& format, std::vector<unsigned char>& pixels, std::vector<MipLevel>& levels, std::string& error)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	TextureFileHeader header;
+	if (!file || !file.read((char*)&header, sizeof(header))) {
+		error = "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ " + path;
+		return false;
+	}
+	if (!validTextureHeader(header)) {
+		error = "ERROR::TEXTURE::NOT_A_TEXTURE_FILE " + path;
+		return false;
+	}
+	// the table and the pixels have to fit in the file before anything is allocated for them
+	file.seekg(0, std::ios::end);
+	uint64_t fileSize = (uint64_t)file.tellg();
+	file.seekg(sizeof(header));
+	uint64_t tableEnd = sizeof(header) + (uint64_t)header.levelCount * sizeof(TextureFileLevel);
+	if (!file || tableEnd > fileSize || header.dataOffset > fileSize || header.dataSize > fileSize - header.dataOffset) {
+		error = "ERROR::TEXTURE::FILE_TRUNCATED " + path;
+		return false;
+	}
+	std::vector<TextureFileLevel> table(header.levelCount);
+	file.read((char*)&table[0], table.size() * sizeof(TextureFileLevel));
+	pixels.resize((size_t)header.dataSize);
+	file.seekg(header.dataOffset);
+	if (!pixels.empty())
+		file.read((char*)&pixels[0], pixels.size());
+	if (!file) {
+		error = "ERROR::TEXTURE::FILE_TRUNCATED " + path;
+		return false;
+	}
+	levels.resize(table.size());
+	for (size_t i = 0; i < table.size(); i++) {
+		if (!validTextureLevel(table[i], header.dataSize)) {
+			error = "ERROR::TEXTURE::FILE_TRUNCATED " + path;
+			return false;
+		}
+		levels[i].width = table[i].width;
+		levels[i].height = table[i].height;
+		levels[i].offset = (size_t)table[i].offset;
+		levels[i].size = (size_t)table[i].size;
+	}
+	readTextureHeader(header, width, height, format);
+	return true;
+}
+
+// Reads the header and level table of a whole .tex file in memory without copying the pixels,
+// the level offsets are from data so the pixels of level i start at data + levels[i].offset
+inline bool parseTextureFile(const unsigned char* data, size_t size, int& width, int& height, TextureFormat& format, std::vector<MipLevel>& levels, std::string& error)
+{
+	TextureFileHeader header;
+	if (size < sizeof(header)) {
+		error = "ERROR::TEXTURE::FILE_TRUNCATED";
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (!validTextureHeader(header)) {
+		error = "ERROR::TEXTURE::NOT_A_TEXTURE_FILE";
+		return false;
+	}
+	if ((size - sizeof(header)) / sizeof(TextureFileLevel) < header.levelCount || header.dataOffset > size || header.dataSize > size - header.dataOffset) {
+		error = "ERROR::TEXTURE::FILE_TRUNCATED";
+		return false;
+	}
+	levels.resize(header.levelCount);
+	for (size_t i = 0; i < levels.size(); i++) {
+		TextureFileLevel level;
+		std::memcpy(&level, data + sizeof(header) + i * sizeof(TextureFileLevel), sizeof(level));
+		if (!validTextureLevel(level, header.dataSize)) {
+			error = "ERROR::TEXTURE::FILE_TRUNCATED";
+			return false;
+		}
+		levels[i].width = level.width;
+		levels[i].height = level.height;
+		levels[i].offset = (size_t)(header.dataOffset + level.offset);
+		levels[i].size = (size_t)level.size;
+	}
+	readTextureHeader(header, width, height, format);
+	return true;
+}
+
+// Creates a mipmapped texture from levels at their offsets from pixels. With a pixel unpack buffer bound
+// pixels is nullptr and the offsets point into the buffer.
+inline GLuint createTexture(const TextureFormat& format, const unsigned char* pixels, const std::vector<MipLevel>& levels)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	GLState::current().bindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+	format.apply(GL_TEXTURE_2D);
+	for (size_t level = 0; level < levels.size(); level++) {
+		const MipLevel& mip = levels[level];
+		const GLvoid* data = (const GLvoid*)((uintptr_t)pixels + mip.offset);
+		if (format.blockBytes != 0)
+			glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, format.internalFormat, mip.width, mip.height, 0, (GLsizei)mip.size, data);
+		else
+			glTexImage2D(GL_TEXTURE_2D, (GLint)level, format.internalFormat, mip.width, mip.height, 0, format.format, GL_UNSIGNED_BYTE, data);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	GLState::current().bindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
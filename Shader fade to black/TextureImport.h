@@ -0,0 +1,228 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <cstddef>
+#include <cstring>
+
+// SIMD conversion kernels are only built for x86, other platforms use the scalar kernel
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEXTURE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TEXTURE_TARGET_SSSE3
+#else
+// lets gcc/clang build the kernels without -mssse3, the kernel is only called after checking the cpu
+#define TEXTURE_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+// GL Includes
+#include <GLEW/glew.h>
+
+// to upload an image in the smallest format that still samples like RGBA:
+// 1. pick the format from the channels stb_image found in the file
+//		TextureFormat format = chooseTextureFormat(stbi_n, flags, GLEW_ARB_texture_swizzle != 0);
+// 2. convert the pixels, this only copies when the format needs a different layout
+//		std::vector<unsigned char> pixels;
+//		importPixels(image, stbi_x * stbi_y, stbi_n, format, pixels);
+// 3. upload with the chosen formats
+//		format.apply(GL_TEXTURE_2D);
+//		glTexImage2D(GL_TEXTURE_2D, 0, format.internalFormat, w, h, 0, format.format, GL_UNSIGNED_BYTE, &pixels[0]);
+// Grey and grey alpha images are kept as R8 and RG8 and read back as RGBA through the texture swizzle,
+// without swizzle support (before GL 3.3) they are expanded to RGBA8 on the CPU.
+
+// Options of an import
+enum TextureImportFlags
+{
+	TEXTURE_LINEAR = 0,
+	TEXTURE_SRGB = 1,			// colours are sRGB encoded, sampling converts them to linear
+	TEXTURE_EXPAND_RGBA = 2,	// always upload 4 channels, for drivers that repack RGB8 on every upload
+	TEXTURE_ALPHA_WEIGHTED_MIPS = 4,	// mipmaps average colours weighted by alpha so transparent texels do not bleed into visible ones, texels stay straight alpha
+	TEXTURE_KAISER_MIPS = 8		// mipmaps use a Kaiser windowed sinc over 8x8 texels instead of the 2x2 box, sharper, scalar only
+};
+
+enum TextureKernel
+{
+	TEXTURE_KERNEL_SCALAR,
+	TEXTURE_KERNEL_SSSE3
+};
+
+struct TextureFormat
+{
+	GLenum internalFormat;
+	GLenum format;		// layout of the uploaded pixels
+	int channels;		// bytes per uploaded pixel
+	int blockBytes;		// bytes per 4x4 block of a compressed format (format is 0), 0 for plain pixels
+	bool swizzle;		// apply() has to set swizzleMask
+	GLint swizzleMask[4];
+
+	// Sets the swizzle of the bound texture, and the unpack alignment since rows of 1 to 3 byte pixels are not 4 byte aligned
+	void apply(GLenum target) const
+	{
+		if (this->swizzle)
+			glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, this->swizzleMask);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, this->channels == 4 ? 4 : 1);
+	}
+};
+
+// Tightest format for an image with fileChannels channels (1 = grey, 2 = grey alpha, 3 = rgb, 4 = rgba)
+inline TextureFormat chooseTextureFormat(int fileChannels, int flags, bool canSwizzle)
+{
+	bool srgb = (flags & TEXTURE_SRGB) != 0;
+	TextureFormat format;
+	format.blockBytes = 0;
+	format.swizzle = false;
+	format.swizzleMask[0] = GL_RED;
+	format.swizzleMask[1] = GL_GREEN;
+	format.swizzleMask[2] = GL_BLUE;
+	format.swizzleMask[3] = GL_ALPHA;
+	// there is no sRGB one or two channel format in GL 3.3, those are expanded like without swizzle
+	bool expand = (flags & TEXTURE_EXPAND_RGBA) != 0 || (fileChannels < 3 && (!canSwizzle || srgb));
+	if (expand || fileChannels == 4) {
+		format.internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+		format.format = GL_RGBA;
+		format.channels = 4;
+	}
+	else if (fileChannels == 3) {
+		format.internalFormat = srgb ? GL_SRGB8 : GL_RGB8;
+		format.format = GL_RGB;
+		format.channels = 3;
+	}
+	else if (fileChannels == 2) {
+		format.internalFormat = GL_RG8;
+		format.format = GL_RG;
+		format.channels = 2;
+		format.swizzle = true;
+		format.swizzleMask[0] = format.swizzleMask[1] = format.swizzleMask[2] = GL_RED;
+		format.swizzleMask[3] = GL_GREEN;
+	}
+	else {
+		format.internalFormat = GL_R8;
+		format.format = GL_RED;
+		format.channels = 1;
+		format.swizzle = true;
+		format.swizzleMask[0] = format.swizzleMask[1] = format.swizzleMask[2] = GL_RED;
+		format.swizzleMask[3] = GL_ONE;
+	}
+	return format;
+}
+
+// Expands grey, grey alpha or rgb pixels to rgba, grey is copied to rgb and missing alpha is 255
+inline void expandToRGBAScalar(const unsigned char* src, int channels, unsigned char* dst, size_t pixels)
+{
+	for (size_t i = 0; i < pixels; i++, src += channels, dst += 4) {
+		if (channels < 3) {
+			dst[0] = dst[1] = dst[2] = src[0];
+			dst[3] = (channels == 2) ? src[1] : 255;
+		}
+		else {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst[3] = (channels == 4) ? src[3] : 255;
+		}
+	}
+}
+
+#ifdef TEXTURE_X86
+// 16 output bytes (4 pixels) per shuffle, the source loads are 16 bytes wide so the last
+// few pixels that could read past the end are left to the scalar loop
+TEXTURE_TARGET_SSSE3 inline void expandToRGBASSSE3(const unsigned char* src, int channels, unsigned char* dst, size_t pixels)
+{
+	size_t i = 0;
+	if (channels == 1) {
+		const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+		const __m128i grey0 = _mm_setr_epi8(0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1);
+		const __m128i grey1 = _mm_setr_epi8(4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1);
+		const __m128i grey2 = _mm_setr_epi8(8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11, -1);
+		const __m128i grey3 = _mm_setr_epi8(12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15, 15, -1);
+		for (; i + 16 <= pixels; i += 16) {
+			__m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+			_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(in, grey0), alpha));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_or_si128(_mm_shuffle_epi8(in, grey1), alpha));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 32), _mm_or_si128(_mm_shuffle_epi8(in, grey2), alpha));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 48), _mm_or_si128(_mm_shuffle_epi8(in, grey3), alpha));
+		}
+	}
+	else if (channels == 2) {
+		const __m128i greyAlpha0 = _mm_setr_epi8(0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7);
+		const __m128i greyAlpha1 = _mm_setr_epi8(8, 8, 8, 9, 10, 10, 10, 11, 12, 12, 12, 13, 14, 14, 14, 15);
+		for (; i + 8 <= pixels; i += 8) {
+			__m128i in = _mm_loadu_si128((const __m128i*)(src + i * 2));
+			_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_shuffle_epi8(in, greyAlpha0));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_shuffle_epi8(in, greyAlpha1));
+		}
+	}
+	else if (channels == 3) {
+		const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+		const __m128i rgb = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		// each load uses 12 of its 16 bytes, the loop stops while 4 spare bytes are still inside the image
+		for (; i + 6 <= pixels; i += 4) {
+			__m128i in = _mm_loadu_si128((const __m128i*)(src + i * 3));
+			_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(in, rgb), alpha));
+		}
+	}
+	else {
+		std::memcpy(dst, src, pixels * 4);
+		return;
+	}
+	expandToRGBAScalar(src + i * channels, channels, dst + i * 4, pixels - i);
+}
+#endif
+
+inline TextureKernel detectTextureKernel()
+{
+#ifdef TEXTURE_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	bool ssse3 = (info[2] & (1 << 9)) != 0;
+#else
+	__builtin_cpu_init();
+	bool ssse3 = __builtin_cpu_supports("ssse3") != 0;
+#endif
+	if (ssse3)
+		return TEXTURE_KERNEL_SSSE3;
+#endif
+	return TEXTURE_KERNEL_SCALAR;
+}
+
+// Fastest kernel supported by this cpu
+inline TextureKernel bestTextureKernel()
+{
+	static const TextureKernel best = detectTextureKernel();
+	return best;
+}
+
+inline const char* textureKernelName(TextureKernel kernel)
+{
+	return kernel == TEXTURE_KERNEL_SSSE3 ? "SSSE3" : "scalar";
+}
+
+inline void expandToRGBA(const unsigned char* src, int channels, unsigned char* dst, size_t pixels, TextureKernel kernel = bestTextureKernel())
+{
+#ifdef TEXTURE_X86
+	if (kernel == TEXTURE_KERNEL_SSSE3) {
+		expandToRGBASSSE3(src, channels, dst, pixels);
+		return;
+	}
+#endif
+	expandToRGBAScalar(src, channels, dst, pixels);
+}
+
+// Writes the pixels in the layout of format into out, a straight copy unless the image has to be expanded.
+// Returns true if a conversion kernel ran.
+inline bool importPixels(const unsigned char* src, size_t pixels, int fileChannels, const TextureFormat& format, std::vector<unsigned char>& out, TextureKernel kernel = bestTextureKernel())
+{
+	out.resize(pixels * format.channels);
+	if (pixels == 0)
+		return false;
+	if (format.channels == fileChannels) {
+		std::memcpy(&out[0], src, out.size());
+		return false;
+	}
+	expandToRGBA(src, fileChannels, &out[0], pixels, kernel);
+	return true;
+}
@@ -0,0 +1,435 @@
+#pragma once
+
+// Std. Includes
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// GL Includes
+#include <GLEW/glew.h>
+
+#include "TextureImport.h"
+#include "MipChain.h"
+#include "TextureFile.h"
+
+// this stb_image version repeats its implementation when included twice, main.cpp includes it first with STB_IMAGE_IMPLEMENTATION
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h"
+#endif
+
+// to load textures without blocking the render loop:
+// 1. create the loader after the GL context exists, it starts one decode thread per core
+//		stbi_set_flip_vertically_on_load(1); // stb_image settings must be set before any request
+//		TextureLoader loader;
+// 2. request the images, this only queues the file name and returns at once
+//		unsigned picture = loader.request("buildings.png"); // or request(path, TEXTURE_SRGB) for colour textures that should be sampled linear
+// 3. call update once per frame, it uploads the images the workers have finished through a ring of pixel buffers
+//    and never waits for the GPU, a texture is 0 until it has been uploaded
+// while (...) {
+//     loader.update();
+//     if (loader.texture(picture) != 0) glBindTexture(GL_TEXTURE_2D, loader.texture(picture));
+// }
+// Images keep the channels of the file (see TextureImport.h) and the workers build their mipmaps (see MipChain.h),
+// .tex files baked with TextureFile.h are uploaded as they are, block compressed ones with glCompressedTexImage2D.
+// Without a GL context receive(...) hands the decoded pixels to a function instead of uploading them.
+
+// Pixel buffers in the upload ring, an image is only copied into a buffer the GPU has finished reading
+const int TEXTURE_PBO_COUNT = 3;
+// Bytes uploaded per update at most, the first waiting image is always uploaded so large images still get through
+const size_t TEXTURE_UPLOAD_BUDGET = 16 * 1024 * 1024;
+
+// Timings of one texture, in milliseconds
+struct TextureLoadStats
+{
+	std::string path;
+	int width;
+	int height;
+	int channels;		// channels in the file
+	GLenum internalFormat;
+	bool converted;		// a kernel changed the layout, false if the pixels were uploaded as decoded
+	double waitTime;	// request until a worker started decoding
+	double decodeTime;	// reading and decoding the file, including mipTime
+	double mipTime;		// building the mipmaps
+	double uploadWait;	// decoded until the render thread started the upload
+	double uploadTime;	// copy into the pixel buffer and glTexImage2D or glCompressedTexImage2D
+	double totalTime;	// request until the texture could be drawn
+	bool failed;
+};
+
+// Decoded image handed from a worker to the render thread
+struct LoadedImage
+{
+	unsigned id;
+	int width;
+	int height;
+	int channels;		// channels in the file
+	int flags;			// TextureImportFlags of the request
+	TextureFormat format;
+	bool converted;
+	double mipTime;
+	std::vector<unsigned char> pixels; // every mip level in the layout of format, empty if the image failed to load
+	std::vector<MipLevel> levels;
+	std::string error;
+	std::chrono::high_resolution_clock::time_point requested;
+	std::chrono::high_resolution_clock::time_point started;
+	std::chrono::high_resolution_clock::time_point decoded;
+	// link in the finished queue
+	std::atomic<LoadedImage*> next;
+};
+
+// Queue of finished images, any number of workers push without locking and only the render thread pops.
+// Intrusive linked list with a stub node (Vyukov), push is a single atomic exchange.
+class FinishedQueue
+{
+public:
+	FinishedQueue() : head(&stub), tail(&stub)
+	{
+		this->stub.next.store(NULL, std::memory_order_relaxed);
+	}
+
+	// Any thread
+	void push(LoadedImage* image)
+	{
+		image->next.store(NULL, std::memory_order_relaxed);
+		LoadedImage* previous = this->head.exchange(image, std::memory_order_acq_rel);
+		previous->next.store(image, std::memory_order_release);
+	}
+
+	// Render thread only, NULL if the queue is empty or a push is halfway done
+	LoadedImage* pop()
+	{
+		LoadedImage* tail = this->tail;
+		LoadedImage* next = tail->next.load(std::memory_order_acquire);
+		if (tail == &this->stub) {
+			if (next == NULL)
+				return NULL;
+			this->tail = next;
+			tail = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (next != NULL) {
+			this->tail = next;
+			return tail;
+		}
+		if (tail != this->head.load(std::memory_order_acquire))
+			return NULL;
+		// tail is the last image, put the stub back behind it so it can be taken
+		this->push(&this->stub);
+		next = tail->next.load(std::memory_order_acquire);
+		if (next != NULL) {
+			this->tail = next;
+			return tail;
+		}
+		return NULL;
+	}
+
+private:
+	std::atomic<LoadedImage*> head;
+	LoadedImage* tail;
+	LoadedImage stub;
+};
+
+class TextureLoader
+{
+public:
+	// Pixel buffers replaced because the wait on their fence failed
+	unsigned fenceFailures;
+
+	TextureLoader(int threadCount = 0) : fenceFailures(0), stopWorkers(false), finishedTotal(0), nextPBO(0)
+	{
+		// swizzle is core in 3.3, without a context this is false and grey images are expanded
+		this->canSwizzle = GLEW_ARB_texture_swizzle != 0 || GLEW_VERSION_3_3 != 0;
+		for (int i = 0; i < TEXTURE_PBO_COUNT; i++) {
+			this->pbo[i] = 0;
+			this->fence[i] = 0;
+		}
+		if (threadCount <= 0)
+			threadCount = (int)std::thread::hardware_concurrency();
+		if (threadCount <= 0)
+			threadCount = 1;
+		for (int i = 0; i < threadCount; i++)
+			this->workers.push_back(std::thread(&TextureLoader::workerLoop, this));
+	}
+
+	~TextureLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->jobMutex);
+			this->stopWorkers = true;
+		}
+		this->jobReady.notify_all();
+		for (size_t i = 0; i < this->workers.size(); i++)
+			this->workers[i].join();
+		while (LoadedImage* image = this->finished.pop())
+			delete image;
+		for (size_t i = 0; i < this->waiting.size(); i++)
+			delete this->waiting[i];
+		for (int i = 0; i < TEXTURE_PBO_COUNT; i++) {
+			if (this->fence[i] != 0)
+				glDeleteSync(this->fence[i]);
+		}
+		if (this->pbo[0] != 0)
+			GLState::current().deleteBuffers(TEXTURE_PBO_COUNT, this->pbo);
+		for (size_t i = 0; i < this->textures.size(); i++) {
+			if (this->textures[i] != 0)
+				GLState::current().deleteTextures(1, &this->textures[i]);
+		}
+	}
+
+	int threadCount() const { return (int)this->workers.size(); }
+
+	// Render thread: queues an image for decoding, returns the id used by texture() and stats()
+	unsigned request(const std::string& path, int flags = TEXTURE_LINEAR)
+	{
+		unsigned id = (unsigned)this->paths.size();
+		this->paths.push_back(path);
+		this->textures.push_back(0);
+		TextureLoadStats stats = TextureLoadStats();
+		stats.path = path;
+		this->loadStats.push_back(stats);
+		Job job;
+		job.id = id;
+		job.path = path;
+		job.flags = flags;
+		job.requested = std::chrono::high_resolution_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(this->jobMutex);
+			this->jobs.push_back(job);
+		}
+		this->jobReady.notify_one();
+		return id;
+	}
+
+	// GL texture of a request, 0 until it has been uploaded or if it failed
+	GLuint texture(unsigned id) const { return this->textures[id]; }
+	const TextureLoadStats& stats(unsigned id) const { return this->loadStats[id]; }
+	unsigned requested() const { return (unsigned)this->paths.size(); }
+	// Requests that have been uploaded or failed
+	unsigned finishedCount() const { return this->finishedTotal; }
+	bool done() const { return this->finishedTotal == this->paths.size(); }
+
+	// Render thread, once per frame: uploads finished images until the byte budget is used
+	// or the next pixel buffer is still being read by the GPU
+	void update()
+	{
+		this->takeFinished();
+		if (this->waiting.empty())
+			return;
+		if (this->pbo[0] == 0)
+			glGenBuffers(TEXTURE_PBO_COUNT, this->pbo);
+		bool sync = GLEW_ARB_sync != 0;
+		bool mapRange = GLEW_ARB_map_buffer_range != 0;
+		size_t uploaded = 0;
+		while (!this->waiting.empty()) {
+			LoadedImage* image = this->waiting.front();
+			size_t size = image->pixels.size();
+			if (uploaded > 0 && uploaded + size > TEXTURE_UPLOAD_BUDGET)
+				break;
+			if (image->pixels.empty()) {
+				this->finish(image, 0, std::chrono::high_resolution_clock::now());
+				continue;
+			}
+			int slot = this->nextPBO;
+			if (sync && this->fence[slot] != 0) {
+				// timeout 0 only asks, the frame never stalls on a buffer that is still in use
+				GLenum state = glClientWaitSync(this->fence[slot], 0, 0);
+				if (state == GL_TIMEOUT_EXPIRED)
+					break;
+				glDeleteSync(this->fence[slot]);
+				this->fence[slot] = 0;
+				if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) {
+					// GL_WAIT_FAILED, the GPU may still read the buffer, so it is left to GL to free once it is done
+					// and this slot starts over with a new one
+					std::cout << "ERROR::TEXTURE_LOADER::FENCE_WAIT_FAILED, replacing pixel buffer " << slot << std::endl;
+					GLState::current().deleteBuffers(1, &this->pbo[slot]);
+					glGenBuffers(1, &this->pbo[slot]);
+					this->fenceFailures++;
+				}
+			}
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+			GLState::current().bindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbo[slot]);
+			if (mapRange) {
+				// orphan the old storage, the driver can keep it alive for a draw that still reads it
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+				void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+				if (mapped != NULL) {
+					std::memcpy(mapped, &image->pixels[0], size);
+					glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				}
+				else {
+					glBufferData(GL_PIXEL_UNPACK_BUFFER, size, &image->pixels[0], GL_STREAM_DRAW);
+				}
+			}
+			else {
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, size, &image->pixels[0], GL_STREAM_DRAW);
+			}
+
+			// with a pixel buffer bound the level offsets point into it and the copy happens on the GPU side
+			GLuint texture = createTexture(image->format, nullptr, image->levels);
+			// unbound again, glTexImage2D calls elsewhere pass pointers rather than offsets
+			GLState::current().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			if (sync)
+				this->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			this->nextPBO = (slot + 1) % TEXTURE_PBO_COUNT;
+
+			uploaded += size;
+			this->finish(image, texture, start);
+		}
+	}
+
+	// Without GL: calls receive(id, image) for every image finished since the last call and marks it done,
+	// image.pixels can be moved out of. Returns how many images were received.
+	template<typename Receive>
+	unsigned receive(Receive receive)
+	{
+		this->takeFinished();
+		unsigned received = 0;
+		while (!this->waiting.empty()) {
+			LoadedImage* image = this->waiting.front();
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			receive(image->id, *image);
+			this->finish(image, 0, start);
+			received++;
+		}
+		return received;
+	}
+
+private:
+	struct Job
+	{
+		unsigned id;
+		std::string path;
+		int flags;
+		std::chrono::high_resolution_clock::time_point requested;
+	};
+
+	// decode threads
+	std::vector<std::thread> workers;
+	std::mutex jobMutex;
+	std::condition_variable jobReady;
+	std::deque<Job> jobs;
+	bool stopWorkers;
+	// workers to render thread
+	FinishedQueue finished;
+	// render thread only
+	std::deque<LoadedImage*> waiting;
+	std::vector<std::string> paths;
+	std::vector<GLuint> textures;
+	std::vector<TextureLoadStats> loadStats;
+	unsigned finishedTotal;
+	// upload ring
+	GLuint pbo[TEXTURE_PBO_COUNT];
+	GLsync fence[TEXTURE_PBO_COUNT];
+	int nextPBO;
+	bool canSwizzle;
+
+	void workerLoop()
+	{
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(this->jobMutex);
+				this->jobReady.wait(lock, [&] { return this->stopWorkers || !this->jobs.empty(); });
+				if (this->stopWorkers)
+					return;
+				job = this->jobs.front();
+				this->jobs.pop_front();
+			}
+			LoadedImage* image = new LoadedImage();
+			image->id = job.id;
+			image->width = image->height = image->channels = 0;
+			image->flags = job.flags;
+			image->converted = false;
+			image->mipTime = 0.0;
+			image->requested = job.requested;
+			image->started = std::chrono::high_resolution_clock::now();
+			this->decode(job.path, *image);
+			image->decoded = std::chrono::high_resolution_clock::now();
+			this->finished.push(image);
+		}
+	}
+
+	// Reads the whole file, decodes it, converts it to the upload format and builds the mipmaps, runs on a worker
+	void decode(const std::string& path, LoadedImage& image) const
+	{
+		if (path.size() > 4 && path.compare(path.size() - 4, 4, ".tex") == 0) {
+			if (readTextureFile(path, image.width, image.height, image.format, image.pixels, image.levels, image.error))
+				image.channels = image.format.channels;
+			else
+				image.pixels.clear();
+			return;
+		}
+		std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+		if (!file) {
+			image.error = "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ " + path;
+			return;
+		}
+		std::vector<unsigned char> data((size_t)file.tellg());
+		file.seekg(0);
+		if (!data.empty())
+			file.read((char*)&data[0], data.size());
+		if (data.empty() || !file) {
+			image.error = "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_READ " + path;
+			return;
+		}
+		unsigned char* pixels = stbi_load_from_memory(&data[0], (int)data.size(), &image.width, &image.height, &image.channels, 0);
+		if (pixels == NULL) {
+			// the failure reason is a global in this stb_image version, another worker may have changed it
+			image.error = "ERROR::IMAGE_LOAD::FAILED " + path + "\n" + stbi_failure_reason();
+			return;
+		}
+		image.format = chooseTextureFormat(image.channels, image.flags, this->canSwizzle);
+		image.pixels.reserve(mipChainSize(image.width, image.height, image.format.channels));
+		image.converted = importPixels(pixels, (size_t)image.width * image.height, image.channels, image.format, image.pixels);
+		stbi_image_free(pixels);
+		// this is already one of many workers, each image is filtered on a single thread
+		std::chrono::high_resolution_clock::time_point mipStart = std::chrono::high_resolution_clock::now();
+		generateMips(image.pixels, image.width, image.height, image.format.channels, image.flags, image.levels);
+		image.mipTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mipStart).count();
+	}
+
+	// moves everything the workers have finished into the upload list, in the order they finished
+	void takeFinished()
+	{
+		while (LoadedImage* image = this->finished.pop())
+			this->waiting.push_back(image);
+	}
+
+	// records the timings of the front image and frees it
+	void finish(LoadedImage* image, GLuint texture, std::chrono::high_resolution_clock::time_point uploadStart)
+	{
+		std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+		TextureLoadStats& stats = this->loadStats[image->id];
+		stats.width = image->width;
+		stats.height = image->height;
+		stats.channels = image->channels;
+		stats.internalFormat = image->format.internalFormat;
+		stats.converted = image->converted;
+		stats.waitTime = std::chrono::duration<double, std::milli>(image->started - image->requested).count();
+		stats.decodeTime = std::chrono::duration<double, std::milli>(image->decoded - image->started).count();
+		stats.mipTime = image->mipTime;
+		stats.uploadWait = std::chrono::duration<double, std::milli>(uploadStart - image->decoded).count();
+		stats.uploadTime = std::chrono::duration<double, std::milli>(now - uploadStart).count();
+		stats.totalTime = std::chrono::duration<double, std::milli>(now - image->requested).count();
+		stats.failed = !image->error.empty();
+		if (stats.failed)
+			std::cout << image->error << std::endl;
+		this->textures[image->id] = texture;
+		this->finishedTotal++;
+		this->waiting.pop_front();
+		delete image;
+	}
+
+	// owns GL objects and threads
+	TextureLoader(const TextureLoader&);
+	TextureLoader& operator=(const TextureLoader&);
+};
@@ -16,13 +16,40 @@
 
 // C++ includes
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
 
 // Shader class
 #include "Shader.h"
 
+// Shadowed GL state, skips binds and switches that change nothing
+#include "GLState.h"
+
 // Camera class
 #include "Camera.h"
 
+// CPU renderer for machines without a GPU
+#include "SoftwareRenderer.h"
+
+// Textures decoded on worker threads in the format that fits their channels
+#include "TextureLoader.h"
+
+// BC1/BC3/BC7 encoder for baking textures
+#include "BlockCompress.h"
+
+// Shaders, mesh and texture mapped from one file
+#include "AssetPack.h"
+
+// Shader hot reload
+#include "ShaderReload.h"
+
 // temporary globals
 bool lockCursor = true; // (un)lock cursor in window by pressing C
 float count = 0;
@@ -32,6 +59,15 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void movement();
+int runHeadless(int frames, bool dumpFrames, int loadTestCount);
+void requestLoadTest(TextureLoader& loader, int count);
+void printLoadReport(const TextureLoader& loader, unsigned first, double longestFrame);
+void benchUpload(bool withGL);
+void bakeTextures();
+void benchMips();
+void benchLoad(bool withGL);
+bool writeAssetPack();
+void benchPack();
 
 // Window dimensions
 const GLuint WIDTH = 800, HEIGHT = 600;
@@ -41,6 +77,10 @@ GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
 GLfloat currentFrame = 0.0f;
 
+// uniform calls and state calls of the previous frame, printed by pressing I
+UniformStats lastFrameStats = { 0, 0 };
+GLStateStats lastStateStats = { 0, 0 };
+
 //camera 
 Camera camera;
 GLfloat lastX = WIDTH / 2.0;
@@ -52,9 +92,81 @@ bool keys[1024];
 // light
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
+// images in the repo, cycled through by --load-test
+const char* loadTestImages[] = { "buildings.png", "container.jpg", "red with alpha.png" };
+
+// full screen quad
+GLfloat vertices[] = {
+	// Position(x,y,z),  TexCoord(x,y)
+	-1.0f,	-1.0f,	0.0f,		0.0f, 0.0f,
+	-1.0f,	1.0f,	0.0f,		0.0f, 1.0f,
+	1.0f,	1.0f,	0.0f,		1.0f, 1.0f,
+	-1.0f,	-1.0f,	0.0f,		0.0f, 0.0f,
+	1.0f,	-1.0f,	0.0f,		1.0f, 0.0f,
+	1.0f,	1.0f,	0.0f,		1.0f, 1.0f,
+				
+	
+}; // can use an EBO to use only 24 vertices instead of 36
+
 // The MAIN function, from here we start the application and run the game loop
-int main()
+int main(int argc, char* argv[])
 {
+	// command line options for running without a GPU:
+	//   --headless      render on the CPU instead of opening a window
+	//   --frames N      number of frames to render in headless mode
+	//   --dump          write every headless frame to frame_NNNN.ppm
+	//   --load-test N   load N extra textures at startup and print the decode and upload latency
+	//   --bench-upload  conversion and upload bandwidth of each image in its tight and RGBA formats, then exit
+	//   --bake          write every image with its mipmaps to .tex, .bc.tex (BC1 or BC3) and .bc7.tex files next to it, then exit
+	//   --bench-load    load time and memory of each image decoded by stb_image against its baked files, then exit
+	//   --bench-mips    mipmap generation speed of each kernel in megapixels per second, then exit
+	// asset pack:
+	//   --pack          write the shaders, the quad and the decoded picture to assets.pack, which is used instead of them from then on, and exit
+	//   --loose         read the loose files even if there is an assets.pack
+	//   --bench-pack    cold and warm time to get the assets into memory from the loose files and from assets.pack, then exit
+	// shaders:
+	//   --hot-reload    rebuild exampleShader from the loose files whenever they are saved, a shader that fails to compile leaves the old one running
+	bool headless = false, dumpFrames = false, benchUploads = false, benchLoads = false, looseFiles = false, hotReload = false;
+	int headlessFrames = 300, loadTestCount = 0;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--headless") headless = true;
+		else if (arg == "--dump") dumpFrames = true;
+		else if (arg == "--frames" && i + 1 < argc) headlessFrames = atoi(argv[++i]);
+		else if (arg == "--load-test" && i + 1 < argc) loadTestCount = atoi(argv[++i]);
+		else if (arg == "--bench-upload") benchUploads = true;
+		else if (arg == "--bench-load") benchLoads = true;
+		else if (arg == "--loose") looseFiles = true;
+		else if (arg == "--hot-reload") hotReload = true;
+		else if (arg == "--pack") return writeAssetPack() ? 0 : 1;
+		else if (arg == "--bench-pack") {
+			benchPack();
+			return 0;
+		}
+		else if (arg == "--bake") {
+			bakeTextures();
+			return 0;
+		}
+		else if (arg == "--bench-mips") {
+			benchMips();
+			return 0;
+		}
+	}
+	if (headless && benchUploads) {
+		benchUpload(false);
+		return 0;
+	}
+	if (headless && benchLoads) {
+		benchLoad(false);
+		return 0;
+	}
+	if (headless)
+		return runHeadless(headlessFrames, dumpFrames, loadTestCount);
+
+	// startup benchmark, time from here until the first frame is on screen
+	std::chrono::high_resolution_clock::time_point startupStart = std::chrono::high_resolution_clock::now();
+	bool firstFrame = true;
+
 	std::cout << "Starting GLFW context, OpenGL 3.3" << std::endl;
 	// Init GLFW
 	glfwInit();
@@ -94,8 +206,17 @@ int main()
 			if (window == nullptr)
 			{
 				std::cout << "Failed to create GLFW window 2.1" << std::endl;
+				std::cout << "Falling back to the software renderer" << std::endl;
 				glfwTerminate();
-				return -1;
+				if (benchUploads) {
+					benchUpload(false);
+					return 0;
+				}
+				if (benchLoads) {
+					benchLoad(false);
+					return 0;
+				}
+				return runHeadless(headlessFrames, dumpFrames, loadTestCount);
 			}
 		}
 	}
@@ -121,19 +242,40 @@ int main()
 	glfwGetFramebufferSize(window, &width, &height); // gets size of screen
 	glViewport(0, 0, width, height); 
 
-	Shader exampleShader("exampleShader.vert", "exampleShader.frag");
-
-	GLfloat vertices[] = {
-		// Position(x,y,z),  TexCoord(x,y)
-		-1.0f,	-1.0f,	0.0f,		0.0f, 0.0f,
-		-1.0f,	1.0f,	0.0f,		0.0f, 1.0f,
-		1.0f,	1.0f,	0.0f,		1.0f, 1.0f,
-		-1.0f,	-1.0f,	0.0f,		0.0f, 0.0f,
-		1.0f,	-1.0f,	0.0f,		1.0f, 0.0f,
-		1.0f,	1.0f,	0.0f,		1.0f, 1.0f,
-					
-		
-	}; // can use an EBO to use only 24 vertices instead of 36
+	if (benchUploads) {
+		benchUpload(true);
+		glfwTerminate();
+		return 0;
+	}
+	if (benchLoads) {
+		benchLoad(true);
+		glfwTerminate();
+		return 0;
+	}
+
+	// shaders, quad and picture straight from the mapping of assets.pack if it has been written with --pack
+	AssetPack pack;
+	bool packed = !looseFiles && pack.open(ASSET_PACK_FILE);
+	if (packed)
+		std::cout << "Loading from " << ASSET_PACK_FILE << std::endl;
+	Shader exampleShader(pack, "exampleShader.vert", "exampleShader.frag");
+	std::cout << "exampleShader: " << exampleShader.buildTime << " ms, read in " << exampleShader.readTime << " ms" << (exampleShader.fromCache ? " (binary cache)" : "") << std::endl;
+
+	// rebuilt shaders are compiled on a hidden window sharing the objects of this one, the game loop only swaps them in
+	ShaderReloader reloader;
+	if (hotReload) {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		GLFWwindow* reloadContext = glfwCreateWindow(1, 1, "", nullptr, window);
+		if (reloadContext != nullptr) {
+			reloader.watch(exampleShader, "exampleShader.vert", "exampleShader.frag");
+			reloader.start(reloadContext);
+			std::cout << "Watching exampleShader.vert and exampleShader.frag" << std::endl;
+		}
+		else {
+			std::cout << "ERROR::GLFW::HOT_RELOAD_CONTEXT_NOT_CREATED" << std::endl;
+		}
+	}
+
 
 
 	// indices useful for EBOs, especially when reusing vertices
@@ -155,12 +297,17 @@ int main()
 	//glGenVertexArrays(1, &VAO2);
 
 
-	// initialisation code
+	// initialisation code, binds and switches go through the state tracker so it can skip the ones that change nothing
+	GLState& state = GLState::current();
 	// 1: bind vertex array object
-	glBindVertexArray(VAO);
+	state.bindVertexArray(VAO);
 	// 2: copy vertices array in buffer for opengl
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	state.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	const AssetEntry* packedVertices = pack.isOpen() ? pack.find("quad.vertices") : nullptr;
+	if (packedVertices != nullptr)
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)packedVertices->size, pack.data(packedVertices), GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 		// GL_STATIC_DRAW = data that is unlikely to change
 		// GL_DYNAMIC_DRAW = data that is likely to change a lot
 		// GL_STREAM_DRAW = data will change every time it is drawn
@@ -174,38 +321,45 @@ int main()
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
 	glEnableVertexAttribArray(1);
 	// 4: unbind VAO (NOT the EBO)
-	glBindVertexArray(0);
+	state.bindVertexArray(0);
+	// the picture is sampled from unit 0, the default of the sampler uniform
+	state.activeTexture(GL_TEXTURE0);
 
 
-	// create texture buffer
+	// load the picture on the decode threads, the window starts drawing while it loads
 	stbi_set_flip_vertically_on_load(1); // flips images so that 0.0 is at the bottom left for openGL
-	GLuint texture;
-	glGenTextures(1, &texture); // generate texture ID
-	glBindTexture(GL_TEXTURE_2D, texture); // bind texture so that all GL_TEXTURE_2D operations act on this texture
-	// set texture wrapping/filtering
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);	// Set texture wrapping to GL_REPEAT (usually basic wrapping method)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	// Set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// load image
-	int stbi_x, stbi_y, stbi_n;
-	// stores the size of image and number of components. stbi_n: 1 = grey, 2 = grey alpha, 3 = rgb, 4 = rgba
-	unsigned char *image = stbi_load("buildings.png", &stbi_x, &stbi_y, &stbi_n, 0);
-	// check if image loads properly
-	if (image == NULL) {
-		std::cout << "ERROR::IMAGE_LOAD::FAILED\n" << stbi_failure_reason() << std::endl;
-	}
-	else {
-		std::cout << "x = " << stbi_x << "\ny = " << stbi_y << "\nn = " << stbi_n << std::endl;
+	TextureLoader loader;
+	// the BC3 file from --bake takes a quarter of the video memory and needs no decoding,
+	// BC3 rather than BC7 since its separate alpha block keeps the transparent sky exactly 0
+	std::string picturePath = "buildings.png";
+	if (GLEW_EXT_texture_compression_s3tc && std::ifstream("buildings.bc.tex"))
+		picturePath = "buildings.bc.tex";
+	// the picture in the pack is decoded and filtered already, it is uploaded from the mapping at once
+	GLuint packedPicture = 0;
+	const AssetEntry* packedTexture = pack.isOpen() ? pack.find("buildings.tex") : nullptr;
+	if (packedTexture != nullptr) {
+		int x, y;
+		TextureFormat format;
+		std::vector<MipLevel> levels;
+		std::string error;
+		if (parseTextureFile(pack.data(packedTexture), (size_t)packedTexture->size, x, y, format, levels, error)) {
+			packedPicture = createTexture(format, pack.data(packedTexture), levels);
+			std::cout << "x = " << x << "\ny = " << y << "\nn = " << format.channels << " (" << ASSET_PACK_FILE << ")" << std::endl;
+		}
+		else {
+			std::cout << error << " " << ASSET_PACK_FILE << std::endl;
+		}
 	}
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, stbi_x, stbi_y, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D); // create mipmap for currently binded texture
-	stbi_image_free(image); 
+	// GL has its own copies now
+	pack.close();
+	unsigned picture = packedPicture == 0 ? loader.request(picturePath, TEXTURE_ALPHA_WEIGHTED_MIPS) : 0;
+	unsigned firstLoadTest = loader.requested();
+	requestLoadTest(loader, loadTestCount);
+	bool pictureReported = packedPicture != 0, loadTestReported = loadTestCount == 0;
+	double longestFrame = 0.0;
 
-	glEnable(GL_BLEND); // process alpha channels
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.enable(GL_BLEND); // process alpha channels
+	state.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Game loop
 	while (!glfwWindowShouldClose(window))
@@ -216,13 +370,35 @@ int main()
 		currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		// profiling counters for this frame
+		lastFrameStats = Shader::frameStats();
+		Shader::resetFrameStats();
+		lastStateStats = state.stats;
+		state.resetFrameStats();
+		// programs rebuilt since the last frame
+		reloader.apply();
 		// movement update
 		//movement();
+		// upload whatever the decode threads have finished
+		loader.update();
+		if (!pictureReported && loader.texture(picture) != 0) {
+			const TextureLoadStats& stats = loader.stats(picture);
+			std::cout << "x = " << stats.width << "\ny = " << stats.height << "\nn = " << stats.channels << (stats.converted ? " (expanded to RGBA)" : "") << std::endl;
+			pictureReported = true;
+		}
+		if (!loadTestReported) {
+			if (deltaTime > longestFrame)
+				longestFrame = deltaTime;
+			if (loader.done()) {
+				printLoadReport(loader, firstLoadTest, longestFrame * 1000.0);
+				loadTestReported = true;
+			}
+		}
 
 		// Render
 		// Clear the colorbuffer
 		//glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-		glClearColor(135.0 / 255.0, 206.0 / 255.0, 235.0 / 255.0, 1.0f);
+		state.clearColor(135.0 / 255.0, 206.0 / 255.0, 235.0 / 255.0, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 		
 		// Activate shader (cannot send uniform data before using the shader)
@@ -230,26 +406,555 @@ int main()
 
 		// send data to shader
 		count += deltaTime*200;
-		glUniform1f(glGetUniformLocation(exampleShader.program, "count"), count);
-
-		// draw triangles
-		glBindVertexArray(VAO);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		// unbind VAO after use
-		glBindVertexArray(0);
+		exampleShader.setFloat("count", count);
+
+		// draw triangles, only the sky until the picture is uploaded
+		GLuint pictureTexture = packedPicture != 0 ? packedPicture : loader.texture(picture);
+		if (pictureTexture != 0) {
+			// both stay bound for the next frame
+			state.bindTexture(GL_TEXTURE_2D, pictureTexture);
+			state.bindVertexArray(VAO);
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+		}
 
 		// Swap the screen buffers
 		glfwSwapBuffers(window);
+		if (firstFrame) {
+			glFinish();
+			std::cout << "Startup time: " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupStart).count() << " ms"
+				<< (packed ? " (" ASSET_PACK_FILE ")" : " (loose files)") << std::endl;
+			firstFrame = false;
+		}
 	}
 	// Terminate GLFW, clearing any resources allocated by GLFW.
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
+	state.deleteVertexArrays(1, &VAO);
+	state.deleteBuffers(1, &VBO);
 	//glDeleteBuffers(1, &EBO);
+	reloader.stop();
 	glfwTerminate();
 	return 0;
 }
 
+// Renders the fading picture on the CPU, used when there is no GPU or display available
+int runHeadless(int frames, bool dumpFrames, int loadTestCount)
+{
+	SoftwareRenderer renderer(WIDTH, HEIGHT);
+	std::cout << "Software renderer: " << WIDTH << "x" << HEIGHT << ", " << renderer.threadCount() << " threads" << std::endl;
+
+	// same buffer setup as the GL version
+	GLuint VBO = renderer.genBuffer();
+	GLuint VAO = renderer.genVertexArray();
+	renderer.bindVertexArray(VAO);
+	renderer.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	renderer.bufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices);
+	renderer.vertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), 0);
+	renderer.enableVertexAttribArray(0);
+	renderer.vertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), 3 * sizeof(GLfloat));
+	renderer.enableVertexAttribArray(1);
+	renderer.bindVertexArray(0);
+
+	// load image, the same loader as the GL version but the pixels go to a SoftwareTexture
+	stbi_set_flip_vertically_on_load(1);
+	SoftwareTexture picture;
+	if (loadTestCount > 0) {
+		// the same images one after another on this thread, to compare with the loader
+		std::chrono::high_resolution_clock::time_point serialStart = std::chrono::high_resolution_clock::now();
+		for (int i = 0; i < loadTestCount; i++) {
+			int x, y, n;
+			unsigned char *image = stbi_load(loadTestImages[i % 3], &x, &y, &n, 0);
+			if (image != NULL)
+				stbi_image_free(image);
+		}
+		std::cout << "Serial decode: " << loadTestCount << " textures in " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - serialStart).count() << " ms" << std::endl;
+	}
+	{
+		TextureLoader loader;
+		unsigned pictureId = loader.request("buildings.png", TEXTURE_ALPHA_WEIGHTED_MIPS);
+		requestLoadTest(loader, loadTestCount);
+		while (!loader.done()) {
+			loader.receive([&](unsigned id, LoadedImage& image) {
+				if (id == pictureId && !image.pixels.empty())
+					picture.load(&image.pixels[0], image.width, image.height, image.format.channels);
+			});
+			std::this_thread::yield();
+		}
+		if (loadTestCount > 0)
+			printLoadReport(loader, 1, 0.0);
+	}
+
+	// exampleShader.vert and exampleShader.frag, varyings are outTexCoord then outPosition
+	SoftwareProgram exampleProgram;
+	exampleProgram.varyingCount = 5;
+	exampleProgram.vertex = [](const glm::vec4* in, SoftwareVertex& out) {
+		out.position = glm::vec4(in[0].x, in[0].y, in[0].z, 1.0f);
+		out.varyings[0] = in[1].x;
+		out.varyings[1] = in[1].y;
+		out.varyings[2] = in[0].x;
+		out.varyings[3] = in[0].y;
+		out.varyings[4] = in[0].z;
+	};
+	exampleProgram.fragment = [&](const float* in, glm::vec4& color) {
+		float multiplier = ((in[2] + 1) * 250 + 500 - count) / 200;
+		if (multiplier > 1) multiplier = 1;
+		if (multiplier < 0) multiplier = 0;
+		color = picture.sample(in[0], in[1]);
+		color = glm::vec4(color.x * multiplier, color.y * multiplier, color.z * multiplier, color.w);
+		// fade transparent section to red, then to black
+		if (color.w == 0) {
+			if (count < 750) color = glm::vec4(1, 0, 0, count / 750); // fade to red
+			else color = glm::vec4((1250 - count) / 500, 0, 0, 1); // fade to black
+		}
+		return true;
+	};
+
+	renderer.enable(GL_BLEND);
+
+	// fixed time step so every run produces the same frames
+	deltaTime = 1.0f / 60.0f;
+	double renderTime = 0.0;
+	for (int frame = 0; frame < frames; frame++) {
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		renderer.clearColor(135.0 / 255.0, 206.0 / 255.0, 235.0 / 255.0, 1.0f);
+		renderer.clear(GL_COLOR_BUFFER_BIT);
+
+		renderer.useProgram(&exampleProgram);
+		count += deltaTime*200;
+
+		renderer.bindVertexArray(VAO);
+		renderer.drawArrays(GL_TRIANGLES, 0, 6);
+		renderer.bindVertexArray(0);
+
+		renderTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+		if (dumpFrames) {
+			char path[64];
+			snprintf(path, sizeof(path), "frame_%04d.ppm", frame);
+			renderer.savePPM(path);
+		}
+	}
+	if (frames > 0)
+		std::cout << frames << " frames in " << renderTime * 1000.0 << " ms (" << frames / renderTime << " fps)" << std::endl;
+	return 0;
+}
+
+// Requests count textures from the images in the repo, for --load-test
+void requestLoadTest(TextureLoader& loader, int count)
+{
+	for (int i = 0; i < count; i++)
+		loader.request(loadTestImages[i % 3]);
+}
+
+// Prints the latency of the textures requested from first on, longestFrame is the slowest frame while they loaded (0 if unknown)
+void printLoadReport(const TextureLoader& loader, unsigned first, double longestFrame)
+{
+	std::vector<double> decode, mips, upload, total;
+	double end = 0.0;
+	unsigned failed = 0;
+	for (unsigned i = first; i < loader.requested(); i++) {
+		const TextureLoadStats& stats = loader.stats(i);
+		if (stats.failed) {
+			failed++;
+			continue;
+		}
+		decode.push_back(stats.decodeTime);
+		mips.push_back(stats.mipTime);
+		upload.push_back(stats.uploadWait + stats.uploadTime);
+		total.push_back(stats.totalTime);
+		end = std::max(end, stats.totalTime);
+	}
+	std::cout << "Loaded " << total.size() << " textures on " << loader.threadCount() << " threads in " << end << " ms";
+	if (failed > 0)
+		std::cout << ", " << failed << " failed";
+	std::cout << std::endl;
+	if (total.empty())
+		return;
+	std::sort(decode.begin(), decode.end());
+	std::sort(mips.begin(), mips.end());
+	std::sort(upload.begin(), upload.end());
+	std::sort(total.begin(), total.end());
+	// median, 95th percentile and worst
+	std::cout << "  decode:           " << decode[decode.size() / 2] << " / " << decode[decode.size() * 95 / 100] << " / " << decode.back() << " ms" << std::endl;
+	std::cout << "  of which mipmaps: " << mips[mips.size() / 2] << " / " << mips[mips.size() * 95 / 100] << " / " << mips.back() << " ms" << std::endl;
+	std::cout << "  decoded to drawn: " << upload[upload.size() / 2] << " / " << upload[upload.size() * 95 / 100] << " / " << upload.back() << " ms" << std::endl;
+	std::cout << "  request to drawn: " << total[total.size() / 2] << " / " << total[total.size() * 95 / 100] << " / " << total.back() << " ms" << std::endl;
+	if (longestFrame > 0.0)
+		std::cout << "  longest frame while loading: " << longestFrame << " ms" << std::endl;
+}
+
+// Times the import of every image in the repo, plus buildings.png decoded as grey and grey alpha:
+// the tight format against RGBA expanded by each kernel, and with a GL context the glTexImage2D of both
+void benchUpload(bool withGL)
+{
+	const int repeats = 50;
+	struct Case { const char* path; int channels; };
+	Case cases[] = { { "buildings.png", 0 }, { "container.jpg", 0 }, { "red with alpha.png", 0 }, { "buildings.png", 1 }, { "buildings.png", 2 } };
+	const char* channelNames[] = { "", "R8", "RG8", "RGB8", "RGBA8" };
+	bool canSwizzle = withGL && (GLEW_ARB_texture_swizzle != 0 || GLEW_VERSION_3_3 != 0);
+	GLuint texture = 0;
+	if (withGL)
+		glGenTextures(1, &texture);
+	std::vector<unsigned char> pixels;
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		int x, y, n;
+		unsigned char *image = stbi_load(cases[c].path, &x, &y, &n, cases[c].channels);
+		if (image == NULL) {
+			std::cout << "ERROR::IMAGE_LOAD::FAILED\n" << stbi_failure_reason() << std::endl;
+			continue;
+		}
+		if (cases[c].channels != 0)
+			n = cases[c].channels;
+		size_t count = (size_t)x * y;
+		std::cout << cases[c].path << " " << x << "x" << y << ", " << n << " channels" << std::endl;
+
+		TextureFormat tight = chooseTextureFormat(n, TEXTURE_LINEAR, canSwizzle);
+		TextureFormat expanded = chooseTextureFormat(n, TEXTURE_EXPAND_RGBA, canSwizzle);
+		TextureKernel kernels[] = { TEXTURE_KERNEL_SCALAR, bestTextureKernel() };
+		// RGBA images are only copied, there is nothing to convert
+		for (int k = 0; n < 4 && k < (kernels[1] == TEXTURE_KERNEL_SCALAR ? 1 : 2); k++) {
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (int r = 0; r < repeats; r++)
+				importPixels(image, count, n, expanded, pixels, kernels[k]);
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+			std::cout << "  convert to RGBA8 (" << textureKernelName(kernels[k]) << "): " << seconds * 1000.0 << " ms, " << count * 4 / seconds / 1e6 << " MB/s" << std::endl;
+		}
+		if (withGL) {
+			GLState::current().bindTexture(GL_TEXTURE_2D, texture);
+			const TextureFormat* formats[] = { &tight, &expanded };
+			for (int f = 0; f < 2; f++) {
+				importPixels(image, count, n, *formats[f], pixels);
+				formats[f]->apply(GL_TEXTURE_2D);
+				glTexImage2D(GL_TEXTURE_2D, 0, formats[f]->internalFormat, x, y, 0, formats[f]->format, GL_UNSIGNED_BYTE, &pixels[0]);
+				glFinish();
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				for (int r = 0; r < repeats; r++)
+					glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, formats[f]->format, GL_UNSIGNED_BYTE, &pixels[0]);
+				glFinish();
+				double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+				std::cout << "  upload " << channelNames[formats[f]->channels] << ": " << pixels.size() / 1024 << " KB, " << seconds * 1000.0 << " ms, " << pixels.size() / seconds / 1e6 << " MB/s" << std::endl;
+			}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}
+		stbi_image_free(image);
+	}
+	if (withGL)
+		GLState::current().deleteTextures(1, &texture);
+}
+
+// Peak signal to noise ratio of the first level of a compressed chain against the RGBA8 pixels it was made from,
+// over RGB only when the format has no alpha
+double blockPSNR(const std::vector<unsigned char>& pixels, const std::vector<unsigned char>& blocks, int width, int height, BlockFormat format)
+{
+	std::vector<unsigned char> decoded((size_t)width * height * 4);
+	decompressImage(&blocks[0], width, height, format, &decoded[0]);
+	int channels = format == BLOCK_BC1 ? 3 : 4;
+	double error = 0.0;
+	for (size_t i = 0; i < (size_t)width * height; i++) {
+		for (int c = 0; c < channels; c++) {
+			double d = (double)pixels[i * 4 + c] - decoded[i * 4 + c];
+			error += d * d;
+		}
+	}
+	error /= (double)width * height * channels;
+	return error == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / error);
+}
+
+// Decodes every image in the project, builds its mipmaps on all cores and writes them three times:
+// name.tex with the levels as the loader would upload them, name.bc.tex in BC1 (opaque images) or BC3,
+// and name.bc7.tex in BC7. request("buildings.bc.tex") then loads without decoding, filtering or compressing.
+void bakeTextures()
+{
+	stbi_set_flip_vertically_on_load(1); // same orientation as the loader
+	int threads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (size_t i = 0; i < sizeof(loadTestImages) / sizeof(loadTestImages[0]); i++) {
+		std::string path = loadTestImages[i];
+		std::string stem = path.substr(0, path.find_last_of('.'));
+		int x, y, n;
+		unsigned char *image = stbi_load(path.c_str(), &x, &y, &n, 0);
+		if (image == NULL) {
+			std::cout << "ERROR::IMAGE_LOAD::FAILED\n" << stbi_failure_reason() << std::endl;
+			continue;
+		}
+		// baked for GL 3.3, where grey images can stay one channel
+		TextureFormat format = chooseTextureFormat(n, TEXTURE_ALPHA_WEIGHTED_MIPS, true);
+		std::vector<unsigned char> pixels;
+		std::vector<MipLevel> levels;
+		pixels.reserve(mipChainSize(x, y, format.channels));
+		importPixels(image, (size_t)x * y, n, format, pixels);
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		generateMips(pixels, x, y, format.channels, TEXTURE_ALPHA_WEIGHTED_MIPS, levels, threads);
+		double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (!writeTextureFile(stem + ".tex", x, y, format, pixels, levels)) {
+			std::cout << "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << stem << ".tex" << std::endl;
+			stbi_image_free(image);
+			continue;
+		}
+		std::cout << stem << ".tex: " << levels.size() << " levels, " << pixels.size() / 1024 << " KB, mipmaps in " << time << " ms" << std::endl;
+
+		// the block encoders take RGBA8
+		TextureFormat rgba = chooseTextureFormat(n, TEXTURE_EXPAND_RGBA, true);
+		pixels.reserve(mipChainSize(x, y, 4));
+		importPixels(image, (size_t)x * y, n, rgba, pixels);
+		stbi_image_free(image);
+		generateMips(pixels, x, y, 4, TEXTURE_ALPHA_WEIGHTED_MIPS, levels, threads);
+		bool opaque = true;
+		for (size_t p = 3; p < levels[0].size && opaque; p += 4)
+			opaque = pixels[p] == 255;
+
+		BlockFormat formats[] = { opaque ? BLOCK_BC1 : BLOCK_BC3, BLOCK_BC7 };
+		const char* suffixes[] = { ".bc.tex", ".bc7.tex" };
+		std::vector<unsigned char> blocks;
+		std::vector<MipLevel> blockLevels;
+		for (int f = 0; f < 2; f++) {
+			start = std::chrono::high_resolution_clock::now();
+			compressMipChain(pixels, levels, formats[f], blocks, blockLevels, threads);
+			time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			std::string bakedPath = stem + suffixes[f];
+			if (!writeTextureFile(bakedPath, x, y, blockTextureFormat(formats[f], false), blocks, blockLevels)) {
+				std::cout << "ERROR::TEXTURE::FILE_NOT_SUCCESFULLY_WRITTEN " << bakedPath << std::endl;
+				continue;
+			}
+			std::cout << bakedPath << ": " << blockFormatName(formats[f]) << ", " << blocks.size() / 1024 << " KB, encoded on " << threads << (threads == 1 ? " thread" : " threads") << " in " << time << " ms, "
+				<< blockPSNR(pixels, blocks, x, y, formats[f]) << " dB" << std::endl;
+		}
+	}
+}
+
+// Load time and texture memory of every image in the project, decoded by stb_image and filtered as the loader does
+// against its files from --bake read back. With a GL context the upload of all levels is timed as well.
+void benchLoad(bool withGL)
+{
+	const int repeats = 10;
+	stbi_set_flip_vertically_on_load(1);
+	bool canSwizzle = withGL && (GLEW_ARB_texture_swizzle != 0 || GLEW_VERSION_3_3 != 0);
+	GLuint texture = 0;
+	if (withGL)
+		glGenTextures(1, &texture);
+	for (size_t i = 0; i < sizeof(loadTestImages) / sizeof(loadTestImages[0]); i++) {
+		std::string path = loadTestImages[i];
+		std::string stem = path.substr(0, path.find_last_of('.'));
+		std::cout << path << std::endl;
+		const std::string sources[] = { path, stem + ".tex", stem + ".bc.tex", stem + ".bc7.tex" };
+		for (int s = 0; s < 4; s++) {
+			int x = 0, y = 0;
+			TextureFormat format;
+			std::vector<unsigned char> pixels;
+			std::vector<MipLevel> levels;
+			std::string error;
+			bool loaded = true;
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (int r = 0; r < repeats && loaded; r++) {
+				if (s == 0) {
+					int n;
+					unsigned char *image = stbi_load(path.c_str(), &x, &y, &n, 0);
+					if (image == NULL) {
+						error = std::string("ERROR::IMAGE_LOAD::FAILED\n") + stbi_failure_reason();
+						loaded = false;
+						break;
+					}
+					format = chooseTextureFormat(n, TEXTURE_ALPHA_WEIGHTED_MIPS, canSwizzle);
+					pixels.reserve(mipChainSize(x, y, format.channels));
+					importPixels(image, (size_t)x * y, n, format, pixels);
+					stbi_image_free(image);
+					generateMips(pixels, x, y, format.channels, TEXTURE_ALPHA_WEIGHTED_MIPS, levels);
+				}
+				else {
+					loaded = readTextureFile(sources[s], x, y, format, pixels, levels, error);
+				}
+			}
+			if (!loaded) {
+				// a missing baked file only means --bake has not been run
+				if (s == 0)
+					std::cout << error << std::endl;
+				else
+					std::cout << "  " << sources[s] << ": not baked" << std::endl;
+				continue;
+			}
+			double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+			size_t bytes = 0;
+			for (size_t l = 0; l < levels.size(); l++)
+				bytes += levels[l].size;
+			std::cout << "  " << sources[s] << ": " << (s == 0 ? "decoded and filtered" : "read") << " in " << time << " ms, " << bytes / 1024 << " KB of texture";
+
+			if (withGL && blockTextureSupported(format)) {
+				GLState::current().bindTexture(GL_TEXTURE_2D, texture);
+				format.apply(GL_TEXTURE_2D);
+				glFinish();
+				start = std::chrono::high_resolution_clock::now();
+				for (int r = 0; r < repeats; r++) {
+					for (size_t l = 0; l < levels.size(); l++) {
+						if (format.blockBytes != 0)
+							glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, format.internalFormat, levels[l].width, levels[l].height, 0, (GLsizei)levels[l].size, &pixels[levels[l].offset]);
+						else
+							glTexImage2D(GL_TEXTURE_2D, (GLint)l, format.internalFormat, levels[l].width, levels[l].height, 0, format.format, GL_UNSIGNED_BYTE, &pixels[levels[l].offset]);
+					}
+					glFinish();
+				}
+				std::cout << ", uploaded in " << std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / repeats << " ms";
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			}
+			else if (withGL) {
+				std::cout << ", not supported by this GPU";
+			}
+			std::cout << std::endl;
+		}
+	}
+	if (withGL)
+		GLState::current().deleteTextures(1, &texture);
+}
+
+// Writes the shader sources, the quad and buildings.png decoded with its mipmaps to assets.pack
+bool writeAssetPack()
+{
+	stbi_set_flip_vertically_on_load(1); // same orientation as the loader
+	int x, y, n;
+	unsigned char *image = stbi_load("buildings.png", &x, &y, &n, 0);
+	if (image == NULL) {
+		std::cout << "ERROR::IMAGE_LOAD::FAILED\n" << stbi_failure_reason() << std::endl;
+		return false;
+	}
+	// packed for GL 3.3 like --bake, premultiplied as the window requests it
+	TextureFormat format = chooseTextureFormat(n, TEXTURE_ALPHA_WEIGHTED_MIPS, true);
+	std::vector<unsigned char> pixels;
+	std::vector<MipLevel> levels;
+	pixels.reserve(mipChainSize(x, y, format.channels));
+	importPixels(image, (size_t)x * y, n, format, pixels);
+	stbi_image_free(image);
+	generateMips(pixels, x, y, format.channels, TEXTURE_ALPHA_WEIGHTED_MIPS, levels, std::max(1, (int)std::thread::hardware_concurrency()));
+	std::ostringstream texture;
+	writeTextureFile(texture, x, y, format, pixels, levels);
+	std::string textureFile = texture.str();
+
+	AssetPackWriter writer;
+	bool added = writer.addFile("exampleShader.vert", ASSET_SHADER) && writer.addFile("exampleShader.frag", ASSET_SHADER)
+		&& writer.add("quad.vertices", ASSET_MESH, vertices, sizeof(vertices))
+		&& writer.add("buildings.tex", ASSET_TEXTURE, textureFile.data(), textureFile.size());
+	if (!added || !writer.write(ASSET_PACK_FILE)) {
+		std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_WRITTEN " << ASSET_PACK_FILE << std::endl;
+		return false;
+	}
+	std::cout << "Wrote " << ASSET_PACK_FILE << std::endl;
+	return true;
+}
+
+// Time until the shaders and the picture are in memory: read from the loose files and decoded and filtered on one
+// thread like a loader worker, against mapped from assets.pack. Cold runs drop the files from the page cache first, which needs Linux.
+void benchPack()
+{
+	const char* files[] = { "exampleShader.vert", "exampleShader.frag", "buildings.png", ASSET_PACK_FILE };
+	const char* entries[] = { "exampleShader.vert", "exampleShader.frag", "quad.vertices", "buildings.tex" };
+	const int warmRuns = 20;
+	stbi_set_flip_vertically_on_load(1);
+	AssetPack pack;
+	if (!pack.open(ASSET_PACK_FILE)) {
+		std::cout << "ERROR::ASSET_PACK::FILE_NOT_SUCCESFULLY_READ " << ASSET_PACK_FILE << ", run --pack first" << std::endl;
+		return;
+	}
+	std::cout << ASSET_PACK_FILE << ": " << pack.count() << " assets, " << pack.size() / 1024.0 << " KB" << std::endl;
+	pack.close();
+	bool canEvict = AssetPack::evictFromCache(ASSET_PACK_FILE);
+	if (!canEvict)
+		std::cout << "  cold: dropping files from the page cache is only supported on Linux" << std::endl;
+	unsigned checksum = 0;
+	std::vector<unsigned char> pixels;
+	std::vector<MipLevel> levels;
+	for (int cold = canEvict ? 1 : 0; cold >= 0; cold--) {
+		double times[2] = { 0.0, 0.0 };
+		int runs = cold ? 1 : warmRuns;
+		for (int source = 0; source < 2; source++) {
+			for (int run = 0; run < runs; run++) {
+				if (cold) {
+					for (size_t f = 0; f < sizeof(files) / sizeof(files[0]); f++)
+						AssetPack::evictFromCache(files[f]);
+				}
+				std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+				if (source == 0) {
+					std::string vertexCode, fragmentCode;
+					Shader::readSources("exampleShader.vert", "exampleShader.frag", vertexCode, fragmentCode);
+					int x, y, n;
+					unsigned char *image = stbi_load("buildings.png", &x, &y, &n, 0);
+					if (image != NULL) {
+						TextureFormat format = chooseTextureFormat(n, TEXTURE_ALPHA_WEIGHTED_MIPS, true);
+						pixels.reserve(mipChainSize(x, y, format.channels));
+						importPixels(image, (size_t)x * y, n, format, pixels);
+						stbi_image_free(image);
+						generateMips(pixels, x, y, format.channels, TEXTURE_ALPHA_WEIGHTED_MIPS, levels);
+					}
+					checksum += (unsigned)(vertexCode.size() + fragmentCode.size() + pixels.size());
+				}
+				else {
+					pack.open(ASSET_PACK_FILE);
+					for (size_t e = 0; e < sizeof(entries) / sizeof(entries[0]); e++) {
+						const AssetEntry* entry = pack.find(entries[e]);
+						if (entry != nullptr)
+							checksum += pack.touch(entry);
+					}
+					pack.close();
+				}
+				times[source] += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+		}
+		std::cout << (cold ? "  cold" : "  warm") << "  loose files: " << times[0] / runs << " ms, " << ASSET_PACK_FILE << ": " << times[1] / runs << " ms" << std::endl;
+	}
+	// keeps the reads from being optimised away
+	volatile unsigned sink = checksum;
+	(void)sink;
+}
+
+// Megapixels of source image filtered per second, for every image in the project and a 4096x4096 tiling of
+// container.jpg large enough to be split between threads, in each filtering mode with each kernel
+void benchMips()
+{
+	int threads = std::max(1, (int)std::thread::hardware_concurrency());
+	struct Mode { const char* name; int flags; };
+	Mode modes[] = { { "linear", TEXTURE_LINEAR }, { "sRGB", TEXTURE_SRGB }, { "alpha weighted", TEXTURE_ALPHA_WEIGHTED_MIPS }, { "sRGB alpha weighted", TEXTURE_SRGB | TEXTURE_ALPHA_WEIGHTED_MIPS },
+		{ "Kaiser", TEXTURE_KAISER_MIPS }, { "sRGB alpha weighted Kaiser", TEXTURE_SRGB | TEXTURE_ALPHA_WEIGHTED_MIPS | TEXTURE_KAISER_MIPS } };
+	std::vector<unsigned char> pixels, base;
+	std::vector<MipLevel> levels;
+	for (int i = 0; i < 4; i++) {
+		int x, y, n;
+		unsigned char *image = stbi_load(loadTestImages[i % 3], &x, &y, &n, 4);
+		if (image == NULL) {
+			std::cout << "ERROR::IMAGE_LOAD::FAILED\n" << stbi_failure_reason() << std::endl;
+			continue;
+		}
+		if (i < 3) {
+			base.assign(image, image + (size_t)x * y * 4);
+		}
+		else {
+			const int size = 4096;
+			base.resize((size_t)size * size * 4);
+			for (int row = 0; row < size; row++)
+				for (int column = 0; column < size; column++)
+					std::memcpy(&base[((size_t)row * size + column) * 4], image + ((size_t)(row % y) * x + column % x) * 4, 4);
+			x = y = size;
+		}
+		stbi_image_free(image);
+		std::cout << (i < 3 ? loadTestImages[i] : "container.jpg tiled") << " " << x << "x" << y << " RGBA8" << std::endl;
+		for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+			std::cout << "  " << modes[m].name << ":";
+			struct Run { MipKernel kernel; int threads; };
+			// the Kaiser filter has only the scalar kernel
+			MipKernel best = (modes[m].flags & TEXTURE_KAISER_MIPS) != 0 ? MIP_KERNEL_SCALAR : bestMipKernel();
+			Run runs[] = { { MIP_KERNEL_SCALAR, 1 }, { best, 1 }, { best, threads } };
+			for (int r = 0; r < 3; r++) {
+				if ((r == 1 && runs[1].kernel == MIP_KERNEL_SCALAR) || (r == 2 && threads == 1))
+					continue;
+				int repeats = std::max(1, (int)(20000000 / base.size()));
+				double seconds = 0.0;
+				for (int repeat = 0; repeat < repeats; repeat++) {
+					pixels = base;
+					std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+					generateMips(pixels, x, y, 4, modes[m].flags, levels, runs[r].threads, runs[r].kernel);
+					seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+				}
+				std::cout << "  " << mipKernelName(runs[r].kernel) << " " << runs[r].threads << (runs[r].threads == 1 ? " thread " : " threads ") << (double)x * y * repeats / seconds / 1e6 << " MP/s";
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
 // Is called whenever a key is pressed/released via GLFW
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
@@ -271,6 +976,11 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	if (key == GLFW_KEY_R && action == GLFW_PRESS) {
 		count = 0;
 	}
+	if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+		// print the uniform calls saved by the Shader setters in the last frame
+		std::cout << "Uniform calls issued: " << lastFrameStats.callsIssued << ", saved: " << lastFrameStats.callsSaved << std::endl;
+		std::cout << "State calls issued: " << lastStateStats.callsIssued << ", filtered: " << lastStateStats.callsFiltered << std::endl;
+	}
 
 }
 